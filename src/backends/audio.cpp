@@ -24,11 +24,45 @@
 #include <iostream>
 #include "logger.h"
 #include <sys/time.h>
+#include <cstring>
+#include <tuple>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 
 using namespace lightspark;
 using namespace std;
 
+namespace
+{
+// adds the interleaved stereo samples of src multiplied by the gains of their channel to dst
+void mixSamplesF32(const float* src, float* dst, uint32_t count, float leftgain, float rightgain)
+{
+	uint32_t i = 0;
+#ifdef __SSE2__
+	const __m128 gains = _mm_set_ps(rightgain, leftgain, rightgain, leftgain);
+	for (; i+4 <= count; i+=4)
+		_mm_storeu_ps(dst+i, _mm_add_ps(_mm_loadu_ps(dst+i), _mm_mul_ps(_mm_loadu_ps(src+i), gains)));
+#endif
+	for (; i < count; i++)
+		dst[i] += src[i]*(i&1 ? rightgain : leftgain);
+}
+// limits the samples to the range -1.0 to 1.0
+void clipSamplesF32(float* samples, uint32_t count)
+{
+	uint32_t i = 0;
+#ifdef __SSE2__
+	const __m128 maxval = _mm_set1_ps(1.0f);
+	const __m128 minval = _mm_set1_ps(-1.0f);
+	for (; i+4 <= count; i+=4)
+		_mm_storeu_ps(samples+i, _mm_max_ps(minval, _mm_min_ps(maxval, _mm_loadu_ps(samples+i))));
+#endif
+	for (; i < count; i++)
+		samples[i] = max(-1.0f, min(1.0f, samples[i]));
+}
+}
+
 uint32_t AudioStream::getPlayedTime()
 {
 	uint32_t ret;
@@ -46,6 +80,8 @@ bool AudioStream::init(double volume)
 	mixer_channel = manager->engineData->audio_StreamInit(this);
 	if (mixer_channel >= 0)
 	{
+		// allocated here, as the mixer must not allocate memory
+		audiobuffer = new uint8_t[AUDIO_MIXER_CHUNKSIZE];
 		isPaused = false;
 		return true;
 	}
@@ -126,11 +162,168 @@ AudioStream::~AudioStream()
 {
 }
 
-AudioManager::AudioManager(EngineData *engine):muteAllStreams(false),audio_available(false),mixeropened(0),engineData(engine),device(0)
+AudioManager::AudioManager(EngineData *engine, const tiny_string& wavOutput):muteAllStreams(false),audio_available(false),mixeropened(0),engineData(engine)
+  ,mixerStreams(new MixerStreams()),mixerGeneration(0),underruns(0),wavOutputFile(wavOutput),wavDataSize(0),wavThread(nullptr),wavThreadStop(false)
+  ,decodedSoundsSize(0),decodedSoundHits(0),decodedSoundMisses(0),prefetchSignal(0),decodeThread(nullptr),decodeThreadStop(false),device(0)
 {
 	audio_available = engine->audio_ManagerInit();
 	mixeropened = 0;
 }
+
+void AudioManager::publishMixerStreams()
+{
+	MixerStreams* newstreams = new MixerStreams();
+	newstreams->streams.reserve(streams.size());
+	newstreams->streams.insert(newstreams->streams.end(),streams.begin(),streams.end());
+	MixerStreams* oldstreams = mixerStreams.exchange(newstreams);
+	// the old list (and removed streams) may still be used if the mixer is running, so wait until it is done
+	int32_t generation = mixerGeneration;
+	if (generation & 1)
+	{
+		while (mixerGeneration == generation)
+			compat_msleep(1);
+	}
+	delete oldstreams;
+}
+
+void AudioManager::mix(uint8_t* buf, uint32_t len)
+{
+	mixerGeneration++;
+	memset(buf, 0, len);
+	float* dst = (float*)buf;
+	MixerStreams* current = mixerStreams;
+	for (auto it = current->streams.begin(); it != current->streams.end(); it++)
+	{
+		AudioStream* s = (*it);
+		if (s->ispaused())
+			continue;
+		s->startMixing();
+		const float volume = s->getVolume();
+		const float leftgain = volume*s->getPanning()[0];
+		const float rightgain = volume*s->getPanning()[1];
+		uint32_t mixedcount = 0;
+		while (mixedcount < len)
+		{
+			uint32_t chunksize = min(len-mixedcount,uint32_t(AUDIO_MIXER_CHUNKSIZE));
+			uint32_t readcount = 0;
+			uint32_t ret = 0;
+			while (readcount < chunksize)
+			{
+				ret = s->getDecoder()->copyFrameF32((float *)(s->audiobuffer+readcount), chunksize-readcount);
+				if (!ret)
+					break;
+				// every part returned by the decoder starts with the left channel
+				mixSamplesF32((float*)(s->audiobuffer+readcount), dst+(mixedcount+readcount)/4, ret/4, leftgain, rightgain);
+				readcount += ret;
+			}
+			mixedcount += readcount;
+			if (readcount)
+				s->hasMixedSamples = true;
+			if (!ret)
+			{
+				if (s->hasMixedSamples && !s->getIsDone())
+					underruns++;
+				break;
+			}
+		}
+	}
+	clipSamplesF32(dst, len/4);
+	mixerGeneration++;
+}
+
+bool AudioManager::openMixer()
+{
+	if (wavOutputFile.empty())
+		return engineData->audio_ManagerOpenMixer(this);
+	return openWAVOutput();
+}
+
+void AudioManager::closeMixer()
+{
+	if (wavOutputFile.empty())
+		engineData->audio_ManagerCloseMixer(this);
+	else
+		closeWAVOutput();
+	if (underruns)
+		LOG(LOG_INFO,"audio mixer underruns:"<<underruns);
+}
+
+static void writeLE(std::ofstream& f, uint32_t value, uint32_t bytes)
+{
+	for (uint32_t i = 0; i < bytes; i++)
+		f.put(char((value>>(i*8))&0xff));
+}
+
+bool AudioManager::openWAVOutput()
+{
+	wavFile.open(wavOutputFile.raw_buf(), ios_base::out | ios_base::binary | ios_base::trunc);
+	if (!wavFile.is_open())
+	{
+		LOG(LOG_ERROR,"couldn't open WAV output file:"<<wavOutputFile);
+		return false;
+	}
+	uint32_t samplerate = engineData->audio_getSampleRate();
+	// RIFF header for 32 bit float stereo samples, the sizes are set when the file is closed
+	wavFile.write("RIFF",4);
+	writeLE(wavFile,0,4);
+	wavFile.write("WAVEfmt ",8);
+	writeLE(wavFile,16,4);
+	writeLE(wavFile,3,2); // WAVE_FORMAT_IEEE_FLOAT
+	writeLE(wavFile,2,2);
+	writeLE(wavFile,samplerate,4);
+	writeLE(wavFile,samplerate*2*sizeof(float),4);
+	writeLE(wavFile,2*sizeof(float),2);
+	writeLE(wavFile,32,2);
+	wavFile.write("data",4);
+	writeLE(wavFile,0,4);
+	wavDataSize = 0;
+	wavThreadStop = false;
+	wavThread = SDL_CreateThread(wavWriterThread,"AudioWAVWriter",this);
+	return true;
+}
+
+void AudioManager::closeWAVOutput()
+{
+	if (wavThread)
+	{
+		wavThreadStop = true;
+		SDL_WaitThread(wavThread,nullptr);
+		wavThread = nullptr;
+	}
+	if (!wavFile.is_open())
+		return;
+	wavFile.seekp(4);
+	writeLE(wavFile,36+wavDataSize,4);
+	wavFile.seekp(40);
+	writeLE(wavFile,wavDataSize,4);
+	wavFile.close();
+	LOG(LOG_INFO,"audio written to "<<wavOutputFile<<", "<<wavDataSize<<" bytes");
+}
+
+int AudioManager::wavWriterThread(void* data)
+{
+	AudioManager* th = (AudioManager*)data;
+	// same amount of samples as requested from the audio device
+	const uint32_t len = AUDIO_MIXER_CHUNKSIZE/2;
+	const uint32_t samplerate = th->engineData->audio_getSampleRate();
+	uint8_t* buf = new uint8_t[len];
+	uint64_t starttime = compat_msectiming();
+	uint64_t mixedframes = 0;
+	while (!th->wavThreadStop)
+	{
+		th->mix(buf, len);
+		th->wavFile.write((const char*)buf, len);
+		th->wavDataSize += len;
+		mixedframes += len/(2*sizeof(float));
+		// mix in real time, so the sounds are produced at the same speed as for an audio device
+		uint64_t due = starttime + mixedframes*1000/samplerate;
+		uint64_t now = compat_msectiming();
+		if (due > now)
+			compat_msleep(due-now);
+	}
+	delete[] buf;
+	return 0;
+}
 void AudioManager::muteAll()
 {
 	Locker l(streamMutex);
@@ -154,6 +347,7 @@ void AudioManager::removeStream(AudioStream *s)
 {
 	streamMutex.lock();
 	streams.remove(s);
+	publishMixerStreams();
 	s->deinit();
 	delete s;
 	if (streams.empty())
@@ -161,7 +355,7 @@ void AudioManager::removeStream(AudioStream *s)
 		streamMutex.unlock();
 		managerMutex.lock();
 		if (mixeropened)
-			engineData->audio_ManagerCloseMixer(this);
+			closeMixer();
 		mixeropened = false;
 		managerMutex.unlock();
 	}
@@ -190,12 +384,12 @@ void AudioManager::stopAllSounds()
 
 AudioStream* AudioManager::createStream(AudioDecoder* decoder, bool startpaused, IThreadJob* producer, int grouptag, uint32_t playedTime, double volume)
 {
-	if (!audio_available)
+	if (!audio_available && wavOutputFile.empty())
 		return nullptr;
 	managerMutex.lock();
 	if (!mixeropened)
 	{
-		if (!engineData->audio_ManagerOpenMixer(this))
+		if (!openMixer())
 		{
 			LOG(LOG_ERROR,"Couldn't open mixer");
 			audio_available = 0;
@@ -217,21 +411,198 @@ AudioStream* AudioManager::createStream(AudioDecoder* decoder, bool startpaused,
 	else
 		stream->hasStarted=true;
 	streams.push_back(stream);
+	publishMixerStreams();
 
 	return stream;
 }
 
+bool AudioManager::DecodedSoundKey::operator<(const DecodedSoundKey& r) const
+{
+	return std::tie(data,sampleRate,floatSamples) < std::tie(r.data,r.sampleRate,r.floatSamples);
+}
+
+_NR<DecodedSound> AudioManager::getDecodedSound(_R<StreamCache> data, const AudioFormat& format)
+{
+	DecodedSoundKey key;
+	key.data = data.getPtr();
+	key.sampleRate = engineData->audio_getSampleRate();
+	key.floatSamples = engineData->audio_useFloatSampleFormat();
+	Locker l(soundCacheMutex);
+	auto it = decodedSounds.find(key);
+	if (it != decodedSounds.end())
+	{
+		if (it->second.sound.isNull())
+		{
+			// the data of a failed sound isn't kept, so its address may belong to a different sound now
+			if (it->second.dataLength == data->getReceivedLength())
+			{
+				decodedSoundMisses++;
+				return NullRef;
+			}
+			decodedSounds.erase(it);
+		}
+		else
+		{
+			decodedSoundHits++;
+			decodedSoundsLRU.splice(decodedSoundsLRU.begin(),decodedSoundsLRU,it->second.lruPosition);
+			return it->second.sound;
+		}
+	}
+	decodedSoundMisses++;
+	if (decodeThreadStop)
+		return NullRef;
+	for (auto itqueue = prefetchQueue.begin(); itqueue != prefetchQueue.end(); itqueue++)
+	{
+		if (!(itqueue->key < key) && !(key < itqueue->key))
+			return NullRef;
+	}
+	if (!decodeThread)
+		decodeThread = SDL_CreateThread(decodeThreadFunction,"AudioDecoder",this);
+	PrefetchRequest req = {key,data,format};
+	prefetchQueue.push_back(req);
+	prefetchSignal.signal();
+	return NullRef;
+}
+
+int AudioManager::decodeThreadFunction(void* data)
+{
+	AudioManager* th = (AudioManager*)data;
+	while (true)
+	{
+		th->prefetchSignal.wait();
+		th->soundCacheMutex.lock();
+		if (th->decodeThreadStop)
+		{
+			th->soundCacheMutex.unlock();
+			break;
+		}
+		assert(!th->prefetchQueue.empty());
+		PrefetchRequest req = th->prefetchQueue.front();
+		th->soundCacheMutex.unlock();
+		// the request stays in the queue while it is decoded, so it isn't queued again
+		_NR<DecodedSound> sound = th->decodeSound(req);
+		th->addDecodedSound(req,sound);
+	}
+	return 0;
+}
+
+_NR<DecodedSound> AudioManager::decodeSound(const PrefetchRequest& req)
+{
+#ifdef ENABLE_LIBAVCODEC
+	// the stream decoder produces samples in the format of the audio engine
+	assert(req.key.sampleRate == uint32_t(engineData->audio_getSampleRate()) && req.key.floatSamples == engineData->audio_useFloatSampleFormat());
+	bool usefloat = req.key.floatSamples;
+	_R<DecodedSound> sound = _MR(new DecodedSound(usefloat ? 2*sizeof(float) : 2*sizeof(int16_t),req.key.sampleRate));
+	uint64_t maxsize = uint64_t(AUDIO_SOUNDCACHE_MAX_DURATION)*sound->sampleRate/1000*sound->frameSize;
+	AudioFormat format = req.format;
+	std::streambuf *sbuf = req.data->createReader();
+	istream s(sbuf);
+	s.exceptions ( istream::failbit | istream::badbit );
+	FFMpegStreamDecoder* streamDecoder=nullptr;
+	bool ok=false;
+	try
+	{
+		// the decoder buffer is emptied after every packet, so it only has to hold the frames decoded from one packet
+		streamDecoder=new FFMpegStreamDecoder(nullptr,engineData,s,8,&format,req.data->getReceivedLength());
+		ok=streamDecoder->isValid();
+		uint8_t buf[AUDIO_MIXER_CHUNKSIZE];
+		while (ok && streamDecoder->decodeNextFrame())
+		{
+			if (!streamDecoder->audioDecoder)
+				continue;
+			while (true)
+			{
+				uint32_t len = usefloat ? streamDecoder->audioDecoder->copyFrameF32((float*)buf,AUDIO_MIXER_CHUNKSIZE)
+										: streamDecoder->audioDecoder->copyFrameS16((int16_t*)buf,AUDIO_MIXER_CHUNKSIZE);
+				if (!len)
+					break;
+				sound->samples.insert(sound->samples.end(),buf,buf+len);
+			}
+			if (sound->samples.size() > maxsize)
+				ok=false;
+		}
+	}
+	catch(LightsparkException& e)
+	{
+		LOG(LOG_ERROR,"Exception while decoding sound for cache: "<<e.cause);
+		ok=false;
+	}
+	catch(exception& e)
+	{
+		LOG(LOG_ERROR,"Exception while decoding sound for cache: "<<e.what());
+		ok=false;
+	}
+	if (streamDecoder)
+		delete streamDecoder;
+	delete sbuf;
+	if (ok && !sound->samples.empty())
+	{
+		sound->samples.shrink_to_fit();
+		return sound;
+	}
+#endif
+	return NullRef;
+}
+
+void AudioManager::addDecodedSound(const PrefetchRequest& req, _NR<DecodedSound> sound)
+{
+	Locker l(soundCacheMutex);
+	prefetchQueue.pop_front();
+	// entries for sounds that are not cached only store the key, so the data can be released
+	DecodedSoundEntry entry = {NullRef,sound,req.data->getReceivedLength(),decodedSoundsLRU.end()};
+	if (sound)
+	{
+		entry.data = req.data;
+		uint64_t size = sound->samples.size();
+		// evict the least recently used sounds, channels still playing them keep their reference
+		while (!decodedSoundsLRU.empty() && decodedSoundsSize + size > AUDIO_SOUNDCACHE_MAX_SIZE)
+		{
+			auto it = decodedSounds.find(decodedSoundsLRU.back());
+			assert(it != decodedSounds.end());
+			decodedSoundsSize -= it->second.sound->samples.size();
+			decodedSounds.erase(it);
+			decodedSoundsLRU.pop_back();
+		}
+		decodedSoundsLRU.push_front(req.key);
+		entry.lruPosition = decodedSoundsLRU.begin();
+		decodedSoundsSize += size;
+	}
+	decodedSounds.insert(make_pair(req.key,entry));
+}
+
+void AudioManager::stopDecodeThread()
+{
+	soundCacheMutex.lock();
+	decodeThreadStop=true;
+	SDL_Thread* t = decodeThread;
+	decodeThread=nullptr;
+	soundCacheMutex.unlock();
+	if (t)
+	{
+		prefetchSignal.signal();
+		SDL_WaitThread(t,nullptr);
+	}
+	Locker l(soundCacheMutex);
+	if (decodedSoundHits || decodedSoundMisses)
+		LOG(LOG_INFO,"decoded sound cache hits:"<<decodedSoundHits<<" misses:"<<decodedSoundMisses<<" bytes:"<<decodedSoundsSize);
+	prefetchQueue.clear();
+	decodedSounds.clear();
+	decodedSoundsLRU.clear();
+	decodedSoundsSize=0;
+}
 
 AudioManager::~AudioManager()
 {
+	stopDecodeThread();
 	managerMutex.lock();
 	if (mixeropened)
 	{
-		engineData->audio_ManagerCloseMixer(this);
+		closeMixer();
 	}
 	if (audio_available)
 	{
 		engineData->audio_ManagerDeinit();
 	}
 	managerMutex.unlock();
+	delete mixerStreams.exchange(nullptr);
 }
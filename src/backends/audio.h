@@ -22,11 +22,24 @@
 
 
 #include "compat.h"
+#include "smartrefs.h"
 #include "backends/decoder.h"
+#include "backends/streamcache.h"
 #include <iostream>
+#include <fstream>
+#include <deque>
+#include <list>
+#include <map>
 #include <unordered_set>
 #include <SDL.h>
 
+// size (in bytes) of the buffer each stream is mixed through, streams are mixed in parts of this size
+#define AUDIO_MIXER_CHUNKSIZE (LIGHTSPARK_AUDIO_BUFFERSIZE*2*sizeof(float))
+// sounds up to this duration (in milliseconds) are decoded completely and kept in the decoded sound cache
+#define AUDIO_SOUNDCACHE_MAX_DURATION 10000
+// memory limit of the decoded sound cache
+#define AUDIO_SOUNDCACHE_MAX_SIZE (64*1024*1024)
+
 namespace lightspark
 {
 class AudioStream;
@@ -36,18 +49,111 @@ class AudioManager
 {
 	friend class AudioStream;
 private:
+	struct DecodedSoundKey
+	{
+		// the sound data of the tag (or Sound object)
+		StreamCache* data;
+		// output format of the decoded samples
+		uint32_t sampleRate;
+		bool floatSamples;
+		bool operator<(const DecodedSoundKey& r) const;
+	};
+	struct DecodedSoundEntry
+	{
+		// keep the sound data alive, so its address can't be reused while the decoded sound is cached.
+		// Not set if sound is null, the data may be released then
+		_NR<StreamCache> data;
+		// null if the sound couldn't be decoded or is too long for the cache
+		_NR<DecodedSound> sound;
+		// length of the sound data, detects reused addresses for entries without data
+		size_t dataLength;
+		std::list<DecodedSoundKey>::iterator lruPosition;
+	};
+	struct PrefetchRequest
+	{
+		DecodedSoundKey key;
+		_R<StreamCache> data;
+		AudioFormat format;
+	};
+	/*
+	 * The streams seen by the mixer. The list is never changed after it is published,
+	 * adding or removing a stream publishes a new list
+	 */
+	struct MixerStreams
+	{
+		std::vector<AudioStream*> streams;
+	};
 	bool muteAllStreams;
 	bool audio_available;
 	int mixeropened;
 	EngineData* engineData;
+	std::atomic<MixerStreams*> mixerStreams;
+	// incremented at the start and at the end of mix(), so it is odd while mixing
+	ATOMIC_INT32(mixerGeneration);
+	// number of times a playing stream could not deliver enough samples
+	ATOMIC_INT32(underruns);
+	// offline mixing into a WAV file instead of an audio device
+	tiny_string wavOutputFile;
+	std::ofstream wavFile;
+	uint32_t wavDataSize;
+	SDL_Thread* wavThread;
+	ACQUIRE_RELEASE_FLAG(wavThreadStop);
+	static int wavWriterThread(void* data);
+	bool openWAVOutput();
+	void closeWAVOutput();
+	bool openMixer();
+	void closeMixer();
+	// publishes the current content of streams to the mixer, has to be called with streamMutex locked
+	void publishMixerStreams();
+	/*
+	 * Short sounds are decoded completely by the decode thread, so playing them again
+	 * only needs a read position in the shared samples instead of a new decoder.
+	 * soundCacheMutex protects all members below
+	 */
+	Mutex soundCacheMutex;
+	std::map<DecodedSoundKey, DecodedSoundEntry> decodedSounds;
+	// most recently used sound first
+	std::list<DecodedSoundKey> decodedSoundsLRU;
+	uint64_t decodedSoundsSize;
+	uint64_t decodedSoundHits;
+	uint64_t decodedSoundMisses;
+	std::deque<PrefetchRequest> prefetchQueue;
+	// signalled for every request added to prefetchQueue and on shutdown
+	Semaphore prefetchSignal;
+	SDL_Thread* decodeThread;
+	bool decodeThreadStop;
+	static int decodeThreadFunction(void* data);
+	_NR<DecodedSound> decodeSound(const PrefetchRequest& req);
+	void addDecodedSound(const PrefetchRequest& req, _NR<DecodedSound> sound);
+	void stopDecodeThread();
 public:
 	Mutex streamMutex;
 	Mutex managerMutex;
 	std::list<AudioStream *> streams;
 	SDL_AudioDeviceID device;
-	AudioManager(EngineData* engine);
+	/*
+	 * If wavOutput is set, the mixed sound is written to that file in real time
+	 * instead of being played on the audio device
+	 */
+	AudioManager(EngineData* engine, const tiny_string& wavOutput="");
+	/*
+	 * Mixes all playing streams into buf (interleaved stereo float samples).
+	 * Called from the audio thread, it does not lock and does not allocate memory
+	 */
+	void mix(uint8_t* buf, uint32_t len);
+	uint32_t getUnderrunCount() const { return underruns; }
 
 	AudioStream *createStream(AudioDecoder *decoder, bool startpaused, IThreadJob *producer, int grouptag, uint32_t playedTime, double volume);
+	/*
+	 * Returns the decoded samples of a completely loaded sound, if they are in the cache.
+	 * Otherwise the sound is queued for decoding by the decode thread and NullRef is returned,
+	 * so the sound has to be played from the compressed data this time
+	 */
+	_NR<DecodedSound> getDecodedSound(_R<StreamCache> data, const AudioFormat& format);
+	// statistics of the decoded sound cache
+	uint64_t getDecodedSoundHits() const { return decodedSoundHits; }
+	uint64_t getDecodedSoundMisses() const { return decodedSoundMisses; }
+	uint64_t getDecodedSoundsSize() const { return decodedSoundsSize; }
 
 	void toggleMuteAll() { muteAllStreams ? unmuteAll() : muteAll(); }
 	bool allMuted() { return muteAllStreams; }
@@ -70,6 +176,8 @@ private:
 	bool hasStarted;
 	bool isPaused;
 	bool mixingStarted;
+	// set after the mixer got samples from the decoder for the first time
+	bool hasMixedSamples;
 	ACQUIRE_RELEASE_FLAG(isdone);
 	double curvolume;
 	double unmutevolume;
@@ -78,12 +186,13 @@ private:
 	struct timeval starttime;
 	int mixer_channel;
 public:
+	// scratch buffer of AUDIO_MIXER_CHUNKSIZE bytes used by the mixer
 	uint8_t* audiobuffer;
 	bool init(double volume);
 	void deinit();
 	void startMixing();
 	AudioStream(AudioManager* _manager,IThreadJob* _producer, int _grouptag,uint64_t _playedtime):manager(_manager),decoder(nullptr),producer(_producer),grouptag(_grouptag)
-	  ,hasStarted(false),isPaused(true),mixingStarted(false),isdone(false),curvolume(1.0),unmutevolume(1.0),panning{1.0,1.0},playedtime(_playedtime),mixer_channel(-1),audiobuffer(nullptr)
+	  ,hasStarted(false),isPaused(true),mixingStarted(false),hasMixedSamples(false),isdone(false),curvolume(1.0),unmutevolume(1.0),panning{1.0,1.0},playedtime(_playedtime),mixer_channel(-1),audiobuffer(nullptr)
 	{
 	}
 
@@ -244,6 +244,7 @@ void CachedSurface::Render(SystemState* sys,RenderContext& ctxt, const MATRIX* s
 					nvgStroke(nvgctxt);
 					nvgClosePath(nvgctxt);
 					nvgEndFrame(nvgctxt);
+					sys->getRenderThread()->restoreScissor();
 					engineData->exec_glActiveTexture_GL_TEXTURE0(SAMPLEPOSITION::SAMPLEPOS_STANDARD);
 					engineData->exec_glBlendFunc(BLEND_ONE,BLEND_ONE_MINUS_SRC_ALPHA);
 					engineData->exec_glUseProgram(((RenderThread&)ctxt).gpu_program);
@@ -288,7 +289,7 @@ void CachedSurface::renderImpl(SystemState* sys,RenderContext& ctxt)
 	if (state->scrollRect.Xmin || state->scrollRect.Xmax || state->scrollRect.Ymin || state->scrollRect.Ymax)
 	{
 		MATRIX m = ctxt.transformStack().transform().matrix;
-		sys->getEngineData()->exec_glScissor(m.getTranslateX()+state->scrollRect.Xmin*m.getScaleX()
+		sys->getRenderThread()->setScissorRect(m.getTranslateX()+state->scrollRect.Xmin*m.getScaleX()
 											 ,sys->getRenderThread()->windowHeight-m.getTranslateY()-state->scrollRect.Ymax*m.getScaleY()
 											 ,(state->scrollRect.Xmax-state->scrollRect.Xmin)*m.getScaleX()
 											 ,(state->scrollRect.Ymax-state->scrollRect.Ymin)*m.getScaleY());
@@ -817,7 +818,10 @@ void CachedSurface::renderImpl(SystemState* sys,RenderContext& ctxt)
 			}
 			nvgClosePath(nvgctxt);
 			if (!ctxt.isDrawingMask())
+			{
 				nvgEndFrame(nvgctxt);
+				sys->getRenderThread()->restoreScissor();
+			}
 			sys->getEngineData()->exec_glStencilFunc_GL_ALWAYS();
 			sys->getEngineData()->exec_glActiveTexture_GL_TEXTURE0(SAMPLEPOSITION::SAMPLEPOS_STANDARD);
 			sys->getEngineData()->exec_glBlendFunc(BLEND_ONE,BLEND_ONE_MINUS_SRC_ALPHA);
@@ -831,6 +835,8 @@ void CachedSurface::renderImpl(SystemState* sys,RenderContext& ctxt)
 	
 	int clipDepth = 0;
 	vector<pair<int, CachedSurface*>> clipDepthStack;
+	// the children may reset the scissor rectangle, so they can't be batched while it is active
+	bool allowBatching = sys->batchRendering && !ctxt.isDrawingMask() && !sys->getRenderThread()->isScissorRectActive();
 	//Now draw also the display list
 	auto it= state->childrenlist.begin();
 	for(;it!=state->childrenlist.end();++it)
@@ -840,6 +846,11 @@ void CachedSurface::renderImpl(SystemState* sys,RenderContext& ctxt)
 		if (!childstate)
 			continue;
 		int depth = childstate->depth;
+		// consecutive simple children are collected into as few draw calls as possible
+		if (allowBatching && child->canBeBatched() && (clipDepthStack.empty() || clipDepth <= 0 || depth <= clipDepth))
+			ctxt.beginBatch();
+		else
+			ctxt.endBatch();
 		// Pop off masks (if any).
 		while (!clipDepthStack.empty() && clipDepth > 0 && depth > clipDepth)
 		{
@@ -864,13 +875,16 @@ void CachedSurface::renderImpl(SystemState* sys,RenderContext& ctxt)
 			child->Render(sys,ctxt);
 	}
 	
+	// a batch collects the children of one surface, so it is not ended by the leaves it contains
+	if (!state->childrenlist.empty())
+		ctxt.endBatch();
 	// Pop remaining masks (if any).
 	for_each(clipDepthStack.rbegin(), clipDepthStack.rend(), [&](pair<int, CachedSurface*>& it)
 	{
 		ctxt.deactivateMask();
 		ctxt.popMask();
 	});
-	sys->getEngineData()->exec_glDisable_GL_SCISSOR_TEST();
+	sys->getRenderThread()->resetScissorRect();
 }
 void CachedSurface::renderFilters(SystemState* sys,RenderContext& ctxt, uint32_t w, uint32_t h, const MATRIX& m)
 {
@@ -915,6 +929,9 @@ void CachedSurface::renderFilters(SystemState* sys,RenderContext& ctxt, uint32_t
 	engineData->exec_glTexParameteri_GL_TEXTURE_2D_GL_TEXTURE_MAG_FILTER_GL_NEAREST();
 	engineData->exec_glFramebufferTexture2D_GL_FRAMEBUFFER(filterTextureIDoriginal);
 	engineData->exec_glTexImage2D_GL_TEXTURE_2D_GL_UNSIGNED_BYTE(0, w, h, 0, nullptr,true);
+	// the scissor for the damaged region of the stage doesn't apply to the filter texture
+	if (sys->getRenderThread()->isDamageScissorActive())
+		engineData->exec_glDisable_GL_SCISSOR_TEST();
 	uint32_t parentframebufferWidth = sys->getRenderThread()->currentframebufferWidth;
 	uint32_t parentframebufferHeight = sys->getRenderThread()->currentframebufferHeight;
 	
@@ -990,6 +1007,7 @@ void CachedSurface::renderFilters(SystemState* sys,RenderContext& ctxt, uint32_t
 	if (sys->getRenderThread()->filterframebufferstack.empty())
 	{
 		sys->getRenderThread()->resetCurrentFrameBuffer();
+		sys->getRenderThread()->restoreScissor();
 		if (!sys->getRenderThread()->getFlipVertical())
 			sys->getRenderThread()->setViewPort(parentframebufferWidth,parentframebufferHeight,false);
 		else
@@ -1016,6 +1034,18 @@ void CachedSurface::renderFilters(SystemState* sys,RenderContext& ctxt, uint32_t
 	ctxt.removeTransformStack();
 	state->needsFilterRefresh=false;
 }
+bool CachedSurface::canBeBatched() const
+{
+	if (!state || !state->childrenlist.empty() || !state->mask.isNull() || !state->filters.empty())
+		return false;
+	if (state->isMask || state->clipdepth || !state->visible || state->cacheAsBitmap || state->needsLayer || state->renderWithNanoVG)
+		return false;
+	if (state->blendmode == BLENDMODE_LAYER || DisplayObject::isShaderBlendMode(state->blendmode))
+		return false;
+	if (state->scrollRect.Xmin || state->scrollRect.Xmax || state->scrollRect.Ymin || state->scrollRect.Ymax)
+		return false;
+	return cachedFilterTextureID == UINT32_MAX;
+}
 void CachedSurface::defaultRender(RenderContext& ctxt)
 {
 	const Transform2D& t = ctxt.transformStack().transform();
@@ -93,8 +93,10 @@ private:
 	SurfaceState* state;
 	void renderImpl(SystemState* sys,RenderContext& ctxt);
 	void defaultRender(RenderContext& ctxt);
+	// true if rendering this surface only draws its own texture with the default rendering path
+	bool canBeBatched() const;
 public:
-	CachedSurface():state(nullptr),tex(nullptr),isChunkOwner(true),isValid(false),isInitialized(false),wasUpdated(false),cachedFilterTextureID(UINT32_MAX)
+	CachedSurface():state(nullptr),tex(nullptr),isChunkOwner(true),isValid(false),isInitialized(false),wasUpdated(false),isDamaged(true),hasDamageBounds(false),cachedFilterTextureID(UINT32_MAX)
 	{
 	}
 	~CachedSurface();
@@ -103,6 +105,7 @@ public:
 		if (state && state != newstate)
 			delete state;
 		state = newstate;
+		isDamaged = true;
 	}
 	SurfaceState* getState() const
 	{
@@ -116,6 +119,12 @@ public:
 	bool isValid;
 	bool isInitialized;
 	bool wasUpdated;
+	// set when the state or the texture changed since the surface was last checked for damage by the render thread
+	bool isDamaged;
+	// area covered by this surface and its children in the last rendered frame, in stage rendering coordinates
+	bool hasDamageBounds;
+	RectF damageBounds;
+	MATRIX damageMatrix;
 	uint32_t cachedFilterTextureID;
 };
 
@@ -84,7 +84,7 @@ Config::Config():
 	systemConfigDirectories(g_get_system_config_dirs()),userConfigDirectory(g_get_user_config_dir()),
 	//DEFAULT SETTINGS
 	defaultCacheDirectory((string) g_get_user_cache_dir() + G_DIR_SEPARATOR_S + "lightspark"),
-	cacheDirectory(defaultCacheDirectory),cachePrefix("cache"),userDataDirectory((string)g_get_user_data_dir() + G_DIR_SEPARATOR_S + "lightspark"),
+	cacheDirectory(defaultCacheDirectory),cachePrefix("cache"),persistentCacheEnabled(false),persistentCacheMaxSize(512),downloadConnections(1),appendBytesHighWatermark(32),appendBytesLowWatermark(8),userDataDirectory((string)g_get_user_data_dir() + G_DIR_SEPARATOR_S + "lightspark"),
 	renderingEnabled(true)
 {
 #ifdef _WIN32
@@ -211,6 +211,20 @@ void Config::handleEntry()
 	//Cache prefix
 	else if(group == "cache" && key == "prefix")
 		cachePrefix = value;
+	//Persistent download cache
+	else if(group == "cache" && key == "persistent")
+		persistentCacheEnabled = atoi(value.c_str());
+	//Persistent download cache size limit
+	else if(group == "cache" && key == "maxsize")
+		persistentCacheMaxSize = atoi(value.c_str());
+	//Parallel range requests for large downloads
+	else if(group == "network" && key == "connections")
+		downloadConnections = imax(1, atoi(value.c_str()));
+	//Amount of data appended by NetStream.appendBytes that may wait for the decoder
+	else if(group == "netstream" && key == "appendbytes_highwatermark")
+		appendBytesHighWatermark = imax(1, atoi(value.c_str()));
+	else if(group == "netstream" && key == "appendbytes_lowwatermark")
+		appendBytesLowWatermark = imax(0, atoi(value.c_str()));
 	else
 		LOG(LOG_ERROR,"Invalid entry encountered in configuration file" << ": '" << group << "/" << key << "'='" << value << "'");
 }
@@ -44,6 +44,17 @@ namespace lightspark
 		std::string cacheDirectory;
 		//Specifies what prefix the cache files should have, default="cache"
 		std::string cachePrefix;
+		//Specifies if downloaded files are kept in a persistent cache, default=false
+		bool persistentCacheEnabled;
+		//Specifies the maximum size of the persistent cache in megabytes, default=512
+		uint32_t persistentCacheMaxSize;
+		//Specifies how many connections may be used to download a large file in parallel, default=1
+		uint32_t downloadConnections;
+		//Specifies in megabytes how much data appended by NetStream.appendBytes may wait for the decoder
+		//before the application is asked to stop appending, default=32
+		uint32_t appendBytesHighWatermark;
+		//Specifies in megabytes below which amount of waiting data the application is notified again, default=8
+		uint32_t appendBytesLowWatermark;
 		//Specifies the filename including full path of the gnash executable
 		std::string gnashPath;
 		//Specifies the directory where the app can store files
@@ -60,6 +71,12 @@ namespace lightspark
 
 		const std::string& getCacheDirectory() const { return cacheDirectory; }
 		const std::string& getCachePrefix() const { return cachePrefix; }
+		bool isPersistentCacheEnabled() const { return persistentCacheEnabled; }
+		uint64_t getPersistentCacheMaxSize() const { return uint64_t(persistentCacheMaxSize)*1024*1024; }
+		std::string getPersistentCacheDirectory() const { return cacheDirectory + G_DIR_SEPARATOR_S + "downloads"; }
+		uint32_t getDownloadConnections() const { return downloadConnections; }
+		uint64_t getAppendBytesHighWatermark() const { return uint64_t(appendBytesHighWatermark)*1024*1024; }
+		uint64_t getAppendBytesLowWatermark() const { return uint64_t(imin(appendBytesLowWatermark,appendBytesHighWatermark))*1024*1024; }
 		const std::string& getDataDirectory() const { return dataDirectory; }
 		const std::string& getUserDataDirectory() const { return userDataDirectory; }
 		
@@ -21,7 +21,7 @@
 #include <cassert>
 
 #include "backends/decoder.h"
-#include "platforms/fastpaths.h"
+#include "backends/yuvconversion.h"
 #include "platforms/engineutils.h"
 #include "swf.h"
 #include "backends/rendering.h"
@@ -50,21 +50,24 @@ bool VideoDecoder::setSize(uint32_t w, uint32_t h)
 {
 	if(w!=frameWidth || h!=frameHeight)
 	{
+		Locker l(framebufferMutex);
 		frameWidth=w;
 		frameHeight=h;
 		LOG(LOG_INFO,"VIDEO DEC: Video frame size " << frameWidth << 'x' << frameHeight);
 		resizeGLBuffers=true;
+		//The rows are padded to the width returned by sizeNeeded
+		uint32_t buffersize=getFrameStride()*frameHeight;
 #ifdef _WIN32
 		if (decodedframebuffer)
 			_aligned_free(decodedframebuffer);
-		decodedframebuffer = (uint8_t*)_aligned_malloc(frameWidth*frameHeight*4, 16);
+		decodedframebuffer = (uint8_t*)_aligned_malloc(buffersize, 16);
 		if (!decodedframebuffer) {
 			LOG(LOG_ERROR, "posix_memalign could not allocate memory");
 		}
 #else
 		if (decodedframebuffer)
 			free(decodedframebuffer);
-		if(posix_memalign((void **)&decodedframebuffer, 16, frameWidth*frameHeight*4)) {
+		if(posix_memalign((void **)&decodedframebuffer, 16, buffersize)) {
 			LOG(LOG_ERROR, "posix_memalign could not allocate memory");
 		}
 #endif
@@ -115,10 +118,26 @@ void VideoDecoder::markForDestruction()
 	markedForDeletion=true;
 }
 
+bool VideoDecoder::getFramePixels(std::vector<uint8_t>& pixels, uint32_t& w, uint32_t& h)
+{
+	Locker l(framebufferMutex);
+	if (!decodedframebuffer || frameWidth==0 || frameHeight==0)
+		return false;
+	w=frameWidth;
+	h=frameHeight;
+	pixels.resize(w*h*4);
+	YUVImage img(YUV_FORMAT_PACKED_YUVA,w,h);
+	img.planes[0]=decodedframebuffer;
+	img.strides[0]=getFrameStride();
+	yuvToPremultipliedARGB(img,pixels.data(),w*4);
+	return true;
+}
+
 void VideoDecoder::clearFrameBuffer()
 {
+	Locker l(framebufferMutex);
 	if (decodedframebuffer)
-		memset(decodedframebuffer,0,frameWidth*frameHeight*4);
+		memset(decodedframebuffer,0,getFrameStride()*frameHeight);
 }
 VideoDecoder::VideoDecoder():decodedframebuffer(nullptr),frameRate(0),framesdecoded(0),framesdropped(0),frameWidth(0),frameHeight(0),lastframe(UINT32_MAX),currentframe(UINT32_MAX),fenceCount(0),resizeGLBuffers(false),markedForDeletion(false)
 {
@@ -168,7 +187,7 @@ bool FFMpegVideoDecoder::fillDataAndCheckValidity()
 }
 
 FFMpegVideoDecoder::FFMpegVideoDecoder(LS_VIDEO_CODEC codecId, uint8_t* initdata, uint32_t datalen, double frameRateHint, DefineVideoStreamTag *tag):
-	ownedContext(true),curBuffer(0),codecContext(nullptr),streamingbuffers(FFMPEGVIDEODECODERBUFFERSIZE),embeddedbuffers(2),curBufferOffset(0),embeddedvideotag(tag)
+	ownedContext(true),curBuffer(0),codecContext(nullptr),streamingbuffers(FFMPEGVIDEODECODERBUFFERSIZE),embeddedbuffers(2),uploadFrame(av_frame_alloc()),curBufferOffset(0),embeddedvideotag(tag)
 {
 	//The tag is the header, initialize decoding
 	switchCodec(codecId, initdata, datalen, frameRateHint);
@@ -182,10 +201,24 @@ FFMpegVideoDecoder::FFMpegVideoDecoder(LS_VIDEO_CODEC codecId, uint8_t* initdata
 	}
 }
 
+void FFMpegVideoDecoder::setupThreading()
+{
+	codecContext->thread_count=imax(1,imin(SDL_GetCPUCount(),FFMPEGVIDEODECODERMAXTHREADS));
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(57,106,102)
+	// frame threading delays the output by one frame per thread, so it is only used for streams,
+	// embedded video is decoded on demand and needs the frame immediately
+	codecContext->thread_type=embeddedvideotag ? FF_THREAD_SLICE : FF_THREAD_FRAME|FF_THREAD_SLICE;
+#else
+	// the held back frames can't be drained with the old decoding api
+	codecContext->thread_type=FF_THREAD_SLICE;
+#endif
+}
+
 void FFMpegVideoDecoder::switchCodec(LS_VIDEO_CODEC codecId, uint8_t *initdata, uint32_t datalen, double frameRateHint)
 {
 	if (codecContext)
 	{
+		drain();
 #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(55,63,100)
 		avcodec_free_context(&codecContext);
 #else
@@ -253,6 +286,7 @@ void FFMpegVideoDecoder::switchCodec(LS_VIDEO_CODEC codecId, uint8_t *initdata,
 		codecContext->extradata=initdata;
 		codecContext->extradata_size=datalen;
 	}
+	setupThreading();
 #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(53,8,0)
 	if(avcodec_open2(codecContext, codec, nullptr)<0)
 #else
@@ -267,7 +301,7 @@ void FFMpegVideoDecoder::switchCodec(LS_VIDEO_CODEC codecId, uint8_t *initdata,
 }
 #if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(57, 40, 101)
 FFMpegVideoDecoder::FFMpegVideoDecoder(AVCodecParameters* codecPar, double frameRateHint):
-	ownedContext(true),curBuffer(0),codecContext(nullptr),streamingbuffers(FFMPEGVIDEODECODERBUFFERSIZE),embeddedbuffers(2),curBufferOffset(0),embeddedvideotag(nullptr)
+	ownedContext(true),curBuffer(0),codecContext(nullptr),streamingbuffers(FFMPEGVIDEODECODERBUFFERSIZE),embeddedbuffers(2),uploadFrame(av_frame_alloc()),curBufferOffset(0),embeddedvideotag(nullptr)
 {
 	status=INIT;
 #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(53,8,0)
@@ -296,6 +330,7 @@ FFMpegVideoDecoder::FFMpegVideoDecoder(AVCodecParameters* codecPar, double frame
 	}
 	avcodec_parameters_to_context(codecContext,codecPar);
 	const AVCodec* codec=avcodec_find_decoder(codecPar->codec_id);
+	setupThreading();
 #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(53,8,0)
 	if(avcodec_open2(codecContext, codec, nullptr)<0)
 #else
@@ -311,7 +346,7 @@ FFMpegVideoDecoder::FFMpegVideoDecoder(AVCodecParameters* codecPar, double frame
 }
 #else
 FFMpegVideoDecoder::FFMpegVideoDecoder(AVCodecContext* _c, double frameRateHint):
-	ownedContext(false),curBuffer(0),codecContext(_c),curBufferOffset(0),embeddedvideotag(nullptr)
+	ownedContext(false),curBuffer(0),codecContext(_c),uploadFrame(av_frame_alloc()),curBufferOffset(0),embeddedvideotag(nullptr)
 {
 	frameIn=av_frame_alloc();
 	status=INIT;
@@ -331,6 +366,7 @@ FFMpegVideoDecoder::FFMpegVideoDecoder(AVCodecContext* _c, double frameRateHint)
 			return;
 	}
 	const AVCodec* codec=avcodec_find_decoder(codecContext->codec_id);
+	setupThreading();
 #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(53,8,0)
 	if(avcodec_open2(codecContext, codec, nullptr)<0)
 #else
@@ -356,6 +392,7 @@ FFMpegVideoDecoder::~FFMpegVideoDecoder()
 	if(ownedContext)
 		av_free(codecContext);
 #endif
+	av_frame_free(&uploadFrame);
 #if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 0, 0)
 	av_frame_free(&frameIn);
 #else
@@ -371,12 +408,9 @@ void FFMpegVideoDecoder::setSize(uint32_t w, uint32_t h)
 		//Discard all the frames
 		while(discardFrame());
 	
-		//As the size changed, reset the buffer
-		uint32_t bufferSize=frameWidth*frameHeight/**4*/;
-		if (embeddedvideotag)
-			embeddedbuffers.regen(YUVBufferGenerator(bufferSize,this->codecContext->pix_fmt==AV_PIX_FMT_YUVA420P, this->codecContext->pix_fmt!=AV_PIX_FMT_BGRA));
-		else
-			streamingbuffers.regen(YUVBufferGenerator(bufferSize,this->codecContext->pix_fmt==AV_PIX_FMT_YUVA420P, this->codecContext->pix_fmt!=AV_PIX_FMT_BGRA));
+		//The buffers only reference the decoded frames, so only the amount of frames decoded ahead has to be adapted
+		if (!embeddedvideotag && frameRate>0)
+			streamingbuffers.setCapacity(imax(4,imin(frameRate*FFMPEGVIDEODECODERBUFFERTIME/1000,FFMPEGVIDEODECODERBUFFERSIZE)));
 	}
 }
 
@@ -422,7 +456,13 @@ bool FFMpegVideoDecoder::discardFrame()
 	//We don't want ot block if no frame is available
 	if (embeddedvideotag)
 	{
-		bool ret=embeddedbuffers.nonBlockingPopFront();
+		bool ret;
+		{
+			Locker l(buffersMutex);
+			if(!embeddedbuffers.isEmpty())
+				embeddedbuffers.front().release();
+			ret=embeddedbuffers.nonBlockingPopFront();
+		}
 		if(flushing && embeddedbuffers.isEmpty()) //End of our work
 		{
 			status=FLUSHED;
@@ -434,7 +474,14 @@ bool FFMpegVideoDecoder::discardFrame()
 	}
 	else
 	{
-		bool ret=streamingbuffers.nonBlockingPopFront();
+		bool ret;
+		{
+			// upload() may be referencing the front frame in the render thread
+			Locker l(buffersMutex);
+			if(!streamingbuffers.isEmpty())
+				streamingbuffers.front().release();
+			ret=streamingbuffers.nonBlockingPopFront();
+		}
 		if(flushing && streamingbuffers.isEmpty()) //End of our work
 		{
 			status=FLUSHED;
@@ -456,6 +503,8 @@ bool FFMpegVideoDecoder::decodeData(uint8_t* data, uint32_t datalen, uint32_t ti
 		return 0;
 	pkt->data=data;
 	pkt->size=datalen;
+	// the time is passed through the codec, frames are held back when frame threading is used
+	pkt->pts=time;
 	int ret = avcodec_send_packet(codecContext, pkt);
 	while (ret == 0)
 	{
@@ -478,9 +527,9 @@ bool FFMpegVideoDecoder::decodeData(uint8_t* data, uint32_t datalen, uint32_t ti
 			if(status==INIT && fillDataAndCheckValidity())
 				status=VALID;
 	
-			assert(frameIn->pts==(int64_t)AV_NOPTS_VALUE || frameIn->pts==0);
-			if (time != UINT32_MAX)
-				copyFrameToBuffers(frameIn, time);
+			uint32_t frametime=frameIn->pts==(int64_t)AV_NOPTS_VALUE ? time : frameIn->pts;
+			if (frametime != UINT32_MAX)
+				copyFrameToBuffers(frameIn, frametime);
 		}
 	}
 #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(57,12,100)
@@ -524,6 +573,8 @@ bool FFMpegVideoDecoder::decodeData(uint8_t* data, uint32_t datalen, uint32_t ti
 bool FFMpegVideoDecoder::decodePacket(AVPacket* pkt, uint32_t time)
 {
 #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(57,106,102)
+	// the time is passed through the codec, frames are held back when frame threading is used
+	pkt->pts=time;
 	int ret = avcodec_send_packet(codecContext, pkt);
 	while (ret == 0)
 	{
@@ -553,7 +604,7 @@ bool FFMpegVideoDecoder::decodePacket(AVPacket* pkt, uint32_t time)
 					LOG(LOG_NOT_IMPLEMENTED,"sending metadata from stream:"<<entry->key<<" "<<entry->value);
 				}
 			}
-			copyFrameToBuffers(frameIn, time);
+			copyFrameToBuffers(frameIn, frameIn->pts==(int64_t)AV_NOPTS_VALUE ? time : frameIn->pts);
 		}
 	}
 #else
@@ -586,48 +637,32 @@ bool FFMpegVideoDecoder::decodePacket(AVPacket* pkt, uint32_t time)
 	return true;
 }
 
-void FFMpegVideoDecoder::copyFrameToBuffers(const AVFrame* frameIn, uint32_t time)
+void FFMpegVideoDecoder::drain()
+{
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(57,106,102)
+	if (embeddedvideotag || status<INIT)
+		return;
+	if (avcodec_send_packet(codecContext, nullptr) != 0)
+		return;
+	while (avcodec_receive_frame(codecContext,frameIn) == 0)
+	{
+		if(frameIn->pts!=(int64_t)AV_NOPTS_VALUE)
+			copyFrameToBuffers(frameIn, frameIn->pts);
+	}
+	// allow further decoding after the end of stream was signaled
+	avcodec_flush_buffers(codecContext);
+#endif
+}
+
+void FFMpegVideoDecoder::copyFrameToBuffers(AVFrame* frameIn, uint32_t time)
 {
 	YUVBuffer* curTail=nullptr;
 	curTail=embeddedvideotag ?  &embeddedbuffers.acquireLast() : &streamingbuffers.acquireLast();
 	//Only one thread may access the tail
-	int offset[3]={0,0,0};
-	// ffmpeg seems to decode GIFs in AV_PIX_FMT_BGRA format and puts all data in first channel
-	if (codecContext->pix_fmt==AV_PIX_FMT_BGRA)
-	{
-		uint32_t fw = frameWidth*4;
-		for(uint32_t y=0;y<frameHeight;y++)
-		{
-			for(uint32_t x=0;x<frameWidth;x++)
-			{
-				// convert BGRA to RGBA
-				curTail->ch[0][fw*y+x*4+2] = frameIn->data[0][y*frameIn->linesize[0]+x*4  ];
-				curTail->ch[0][fw*y+x*4+1] = frameIn->data[0][y*frameIn->linesize[0]+x*4+1];
-				curTail->ch[0][fw*y+x*4  ] = frameIn->data[0][y*frameIn->linesize[0]+x*4+2];
-				curTail->ch[0][fw*y+x*4+3] = frameIn->data[0][y*frameIn->linesize[0]+x*4+3];
-			}
-		}
-	}
-	else
-	{
-		for(uint32_t y=0;y<frameHeight;y++)
-		{
-			memcpy(curTail->ch[0]+offset[0],frameIn->data[0]+(y*frameIn->linesize[0]),frameWidth);
-			if (codecContext->pix_fmt==AV_PIX_FMT_YUVA420P)
-				memcpy(curTail->ch[3]+offset[0],frameIn->data[3]+(y*frameIn->linesize[0]),frameWidth);
-			offset[0]+=frameWidth;
-		}
-		if (codecContext->pix_fmt!=AV_PIX_FMT_BGRA)
-		{
-			for(uint32_t y=0;y<frameHeight/2;y++)
-			{
-				memcpy(curTail->ch[1]+offset[1],frameIn->data[1]+(y*frameIn->linesize[1]),frameWidth/2);
-				memcpy(curTail->ch[2]+offset[2],frameIn->data[2]+(y*frameIn->linesize[2]),frameWidth/2);
-				offset[1]+=frameWidth/2;
-				offset[2]+=frameWidth/2;
-			}
-		}
-	}
+	//The planes are not copied, the buffer keeps a reference to the frame until it is discarded
+	curTail->release();
+	if (av_frame_ref(curTail->frame,frameIn)<0)
+		LOG(LOG_ERROR,"failed to reference decoded video frame");
 	curTail->time=time;
 	if (embeddedvideotag)
 		embeddedbuffers.commitLast();
@@ -657,64 +692,84 @@ uint8_t* FFMpegVideoDecoder::upload(bool refresh)
 			decodeData(t->getData(), t->getNumBytes(), (i == currentframe) ? 0 : UINT32_MAX);
 			lastframe = i;
 		}
-		if(embeddedbuffers.isEmpty())
-			return decodedframebuffer;
 	}
-	else
 	{
-		if(streamingbuffers.isEmpty())
+		// the VM thread may discard the front frame while it is converted,
+		// so the conversion works on its own reference to the frame data
+		Locker l(buffersMutex);
+		BlockingCircularQueue<YUVBuffer>& buffers=embeddedvideotag ? embeddedbuffers : streamingbuffers;
+		if(buffers.isEmpty())
+			return decodedframebuffer;
+		//At least a frame is available
+		if (!buffers.front().frame->data[0] || av_frame_ref(uploadFrame,buffers.front().frame)<0)
 			return decodedframebuffer;
 	}
-	//At least a frame is available
-	YUVBuffer* cur=embeddedvideotag ? &embeddedbuffers.front() : &streamingbuffers.front();
-	if (codecContext->pix_fmt==AV_PIX_FMT_BGRA)
 	{
-		memcpy(decodedframebuffer,cur->ch[0],frameWidth*frameHeight*4);
-	}
-	else
-	{
-		fastYUV420ChannelsToYUV0Buffer(cur->ch[0],cur->ch[1],cur->ch[2],decodedframebuffer,frameWidth,frameHeight);
-		if (codecContext->pix_fmt==AV_PIX_FMT_YUVA420P)
-		{
-			uint32_t texw= (frameWidth+15)&0xfffffff0;
-			for(uint32_t i=0;i<frameHeight;i++)
-			{
-				for(uint32_t j=0;j<frameWidth;j++)
-				{
-					uint32_t pixelCoordFull=i*texw+j;
-					decodedframebuffer[pixelCoordFull*4+3]=cur->ch[3][i*frameWidth+j];
-				}
-			}
-		}
+		Locker l(framebufferMutex);
+		convertFrame(uploadFrame);
 	}
+	av_frame_unref(uploadFrame);
 	return decodedframebuffer;
 }
 
-void FFMpegVideoDecoder::YUVBufferGenerator::init(YUVBuffer& buf) const
+void FFMpegVideoDecoder::convertFrame(const AVFrame* frame)
 {
-	if(buf.ch[0])
+	if (uint32_t(frame->width)<frameWidth || uint32_t(frame->height)<frameHeight)
+		return;
+	uint32_t stride=getFrameStride();
+	// ffmpeg seems to decode GIFs in AV_PIX_FMT_BGRA format and puts all data in first channel
+	if (frame->format==AV_PIX_FMT_BGRA)
 	{
-		aligned_free(buf.ch[0]);
-		if (hasChannels)
+		for(uint32_t y=0;y<frameHeight;y++)
 		{
-			aligned_free(buf.ch[1]);
-			aligned_free(buf.ch[2]);
-			if (buf.ch[3])
-				aligned_free(buf.ch[3]);
+			const uint8_t* src=frame->data[0]+y*frame->linesize[0];
+			uint8_t* dst=decodedframebuffer+stride*y;
+			for(uint32_t x=0;x<frameWidth;x++)
+			{
+				// convert BGRA to RGBA
+				dst[x*4+2] = src[x*4  ];
+				dst[x*4+1] = src[x*4+1];
+				dst[x*4  ] = src[x*4+2];
+				dst[x*4+3] = src[x*4+3];
+			}
 		}
+		return;
 	}
-	if (hasChannels)
+	YUV_FORMAT format;
+	switch (frame->format)
 	{
-		aligned_malloc((void**)&buf.ch[0], 16, bufferSize);
-		aligned_malloc((void**)&buf.ch[1], 16, bufferSize/4);
-		aligned_malloc((void**)&buf.ch[2], 16, bufferSize/4);
-		if (hasAlpha)
-			aligned_malloc((void**)&buf.ch[3], 16, bufferSize);
+		case AV_PIX_FMT_YUV420P:
+		case AV_PIX_FMT_YUVJ420P:
+		case AV_PIX_FMT_YUVA420P:
+			format=YUV_FORMAT_420P;
+			break;
+		case AV_PIX_FMT_YUV422P:
+		case AV_PIX_FMT_YUVJ422P:
+			format=YUV_FORMAT_422P;
+			break;
+		case AV_PIX_FMT_YUV444P:
+		case AV_PIX_FMT_YUVJ444P:
+			format=YUV_FORMAT_444P;
+			break;
+		case AV_PIX_FMT_NV12:
+			format=YUV_FORMAT_NV12;
+			break;
+		default:
+			LOG(LOG_NOT_IMPLEMENTED,"unsupported video pixel format:"<<frame->format);
+			return;
 	}
-	else
+	YUVImage img(format,frameWidth,frameHeight);
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		img.planes[i]=frame->data[i];
+		img.strides[i]=frame->linesize[i];
+	}
+	if (frame->format==AV_PIX_FMT_YUVA420P)
 	{
-		aligned_malloc((void**)&buf.ch[0], 16, bufferSize*4);
+		img.planes[3]=frame->data[3];
+		img.strides[3]=frame->linesize[3];
 	}
+	yuvToPackedYUVA(img,decodedframebuffer,stride);
 }
 #endif //ENABLE_LIBAVCODEC
 
@@ -845,6 +900,12 @@ uint32_t AudioDecoder::getFrontTime() const
 	return engine->audio_useFloatSampleFormat() ? samplesBufferF32.front().time : samplesBufferS16.front().time;
 }
 
+uint32_t AudioDecoder::getBackTime() const
+{
+	assert(!samplesBufferS16.isEmpty() || !samplesBufferF32.isEmpty());
+	return engine->audio_useFloatSampleFormat() ? samplesBufferF32.back().time : samplesBufferS16.back().time;
+}
+
 void AudioDecoder::skipUntil(uint32_t time, uint32_t usecs)
 {
 	assert(isValid());
@@ -2026,6 +2087,66 @@ int64_t FFMpegStreamDecoder::avioSeek(void* opaque, int64_t offset, int whence)
 }
 #endif //ENABLE_LIBAVCODEC
 
+DecodedSoundAudioDecoder::DecodedSoundAudioDecoder(_R<DecodedSound> _sound, uint32_t startposition, EngineData* engine):AudioDecoder(0,engine),sound(_sound)
+	,position(min(startposition,uint32_t(_sound->samples.size()))/_sound->frameSize*_sound->frameSize)
+{
+	status=VALID;
+	sampleRate=sound->sampleRate;
+	channelCount=2;
+}
+
+uint32_t DecodedSoundAudioDecoder::copySamples(uint8_t* dest, uint32_t len)
+{
+	uint32_t pos = position;
+	uint32_t count = min(len,uint32_t(sound->samples.size())-pos);
+	if (count == 0)
+	{
+		if(flushing) //End of our work
+		{
+			status=FLUSHED;
+			flushed.signal();
+		}
+		return 0;
+	}
+	memcpy(dest,sound->samples.data()+pos,count);
+	// skipAll() may have been called concurrently, the samples must not be played then
+	if (!position.compare_exchange_strong(pos,pos+count))
+		return 0;
+	return count;
+}
+
+uint32_t DecodedSoundAudioDecoder::copyFrameS16(int16_t* dest, uint32_t len)
+{
+	assert(dest && !engine->audio_useFloatSampleFormat());
+	return copySamples((uint8_t*)dest,len);
+}
+
+uint32_t DecodedSoundAudioDecoder::copyFrameF32(float* dest, uint32_t len)
+{
+	assert(dest && engine->audio_useFloatSampleFormat());
+	return copySamples((uint8_t*)dest,len);
+}
+
+void DecodedSoundAudioDecoder::skipAll()
+{
+	position = sound->samples.size();
+	if (flushing)
+	{
+		status=FLUSHED;
+		flushed.signal();
+	}
+}
+
+void DecodedSoundAudioDecoder::setFlushing()
+{
+	flushing=true;
+	if (isFinished())
+	{
+		status=FLUSHED;
+		flushed.signal();
+	}
+}
+
 void SampleDataAudioDecoder::samplesconsumed(uint32_t samples)
 {
 	bufferedsamples -= samples;
@@ -105,6 +105,9 @@ class VideoDecoder: public Decoder, public ITextureUploadable
 {
 protected:
 	uint8_t* decodedframebuffer;
+	// getFramePixels() reads the frame buffer in the drawing threads of the cpu renderer,
+	// so this must be held while the buffer is written or reallocated
+	Mutex framebufferMutex;
 public:
 	VideoDecoder();
 	virtual ~VideoDecoder();
@@ -113,6 +116,11 @@ public:
 	virtual bool discardFrame()=0;
 	virtual uint32_t skipUntil(uint32_t time)=0;
 	virtual void skipAll()=0;
+	/*
+		Outputs the frames still held back by the codec at the end of the stream,
+		must be called from the thread feeding the decoder
+	*/
+	virtual void drain() {}
 	uint32_t getWidth()
 	{
 		return frameWidth;
@@ -121,6 +129,11 @@ public:
 	{
 		return frameHeight;
 	}
+	// distance between two rows of the decoded frame buffer in bytes
+	uint32_t getFrameStride() const
+	{
+		return ((frameWidth+15)&0xfffffff0)*4;
+	}
 	double frameRate;
 	uint32_t framesdecoded;
 	uint32_t framesdropped;
@@ -136,6 +149,11 @@ public:
 	bool isUploading() { return fenceCount; }
 	void setVideoFrameToDecode(uint32_t frame) { currentframe=frame; }
 	void clearFrameBuffer();
+	/*
+		Converts the last uploaded frame to premultiplied ARGB, used to draw videos on the cpu
+		@return false if no frame is available
+	*/
+	bool getFramePixels(std::vector<uint8_t>& pixels, uint32_t& w, uint32_t& h);
 protected:
 	TextureChunk videoTexture;
 	uint32_t frameWidth;
@@ -176,6 +194,9 @@ public:
 };
 #ifdef ENABLE_LIBAVCODEC
 #define FFMPEGVIDEODECODERBUFFERSIZE 80
+// streams are decoded ahead by this many milliseconds (limited by FFMPEGVIDEODECODERBUFFERSIZE frames)
+#define FFMPEGVIDEODECODERBUFFERTIME 2000
+#define FFMPEGVIDEODECODERMAXTHREADS 8
 class FFMpegVideoDecoder: public VideoDecoder
 {
 private:
@@ -184,57 +205,45 @@ private:
 	YUVBuffer(const YUVBuffer&); /* no impl */
 	YUVBuffer& operator=(const YUVBuffer&); /* no impl */
 	public:
-		uint8_t* ch[4];
+		// reference to the decoded frame, its planes are used directly as the source of the upload
+		AVFrame* frame;
 		uint32_t time;
-		YUVBuffer():time(0){ch[0]=nullptr;ch[1]=nullptr;ch[2]=nullptr;ch[3]=nullptr;}
+		YUVBuffer():frame(nullptr),time(0){}
 		~YUVBuffer()
 		{
-			setDecodedData(nullptr);
+			cleanup();
 		}
-		void setDecodedData(uint8_t* data)
+		void release()
 		{
-			if(ch[0])
-				aligned_free(ch[0]);
-			if(ch[1])
-				aligned_free(ch[1]);
-			if(ch[2])
-				aligned_free(ch[2]);
-			if(ch[3])
-				aligned_free(ch[3]);
-			ch[0]=data;
-			ch[1]=nullptr;
-			ch[2]=nullptr;
-			ch[3]=nullptr;
+			if(frame)
+				av_frame_unref(frame);
 		}
 		void init()
 		{
-			ch[0]=nullptr;
-			ch[1]=nullptr;
-			ch[2]=nullptr;
-			ch[3]=nullptr;
+			frame=av_frame_alloc();
+			time=0;
 		}
 		void cleanup()
 		{
-			setDecodedData(nullptr);
+			if(frame)
+				av_frame_free(&frame);
 		}
 	};
-	class YUVBufferGenerator
-	{
-	private:
-		uint32_t bufferSize;
-		bool hasAlpha;
-		bool hasChannels;
-	public:
-		YUVBufferGenerator(uint32_t b, bool _hasalpha, bool _haschannels):bufferSize(b),hasAlpha(_hasalpha),hasChannels(_haschannels){}
-		void init(YUVBuffer& buf) const;
-	};
 	bool ownedContext;
 	uint32_t curBuffer;
 	AVCodecContext* codecContext;
 	BlockingCircularQueue<YUVBuffer> streamingbuffers;
 	BlockingCircularQueue<YUVBuffer> embeddedbuffers;
+	// the front frame is referenced in uploadFrame while it is converted by upload(),
+	// so discardFrame() can drop it at any time. Must be held while the front of the
+	// buffers is released or referenced
+	Mutex buffersMutex;
+	AVFrame* uploadFrame;
 	AVFrame* frameIn;
-	void copyFrameToBuffers(const AVFrame* frameIn, uint32_t time);
+	void copyFrameToBuffers(AVFrame* frameIn, uint32_t time);
+	// converts a decoded frame into decodedframebuffer
+	void convertFrame(const AVFrame* frame);
+	void setupThreading();
 	void setSize(uint32_t w, uint32_t h);
 	bool fillDataAndCheckValidity();
 	uint32_t curBufferOffset;
@@ -259,6 +268,7 @@ public:
 	bool discardFrame() override;
 	uint32_t skipUntil(uint32_t time) override;
 	void skipAll() override;
+	void drain() override;
 	void setFlushing() override
 	{
 		flushing=true;
@@ -352,12 +362,14 @@ public:
 		return !samplesBufferS16.isEmpty() || !samplesBufferF32.isEmpty();
 	}
 	uint32_t getFrontTime() const;
+	// time of the last decoded frame, must only be called by the thread feeding the decoder
+	uint32_t getBackTime() const;
 	uint32_t getBytesPerMSec() const
 	{
 		return sampleRate*channelCount*2/1000;
 	}
-	uint32_t copyFrameS16(int16_t* dest, uint32_t len) DLL_PUBLIC;
-	uint32_t copyFrameF32(float* dest, uint32_t len) DLL_PUBLIC;
+	virtual uint32_t copyFrameS16(int16_t* dest, uint32_t len) DLL_PUBLIC;
+	virtual uint32_t copyFrameF32(float* dest, uint32_t len) DLL_PUBLIC;
 	/**
 	  	Skip samples until the given time
 
@@ -368,7 +380,7 @@ public:
 	/**
 	  	Skip all the samples
 	*/
-	void skipAll() DLL_PUBLIC;
+	virtual void skipAll() DLL_PUBLIC;
 	bool discardFrame();
 	void setFlushing() override
 	{
@@ -421,6 +433,45 @@ public:
 	inline int32_t getBufferedSamples() const { return  bufferedsamples; }
 };
 
+/*
+ * The complete samples of a sound, as interleaved stereo samples
+ * in the sample format and rate of the audio engine.
+ * The samples are never changed after the sound is added to the cache,
+ * so they can be played by several SoundChannels at once
+ */
+class DecodedSound: public RefCountable
+{
+public:
+	std::vector<uint8_t> samples;
+	// size of one sample for both channels
+	uint32_t frameSize;
+	uint32_t sampleRate;
+	DecodedSound(uint32_t _frameSize, uint32_t _sampleRate):frameSize(_frameSize),sampleRate(_sampleRate) {}
+	uint32_t getDurationInMS() const { return uint64_t(samples.size()/frameSize)*1000/sampleRate; }
+};
+
+/*
+ * Plays a DecodedSound. The samples are read directly from the shared buffer of the
+ * sound, so every channel playing the sound only has its own read position
+ */
+class DecodedSoundAudioDecoder: public AudioDecoder
+{
+private:
+	_R<DecodedSound> sound;
+	// read position in bytes, advanced by the mixer and set to the end by skipAll()
+	std::atomic<uint32_t> position;
+	uint32_t copySamples(uint8_t* dest, uint32_t len);
+public:
+	DecodedSoundAudioDecoder(_R<DecodedSound> _sound, uint32_t startposition, EngineData* engine);
+	void switchCodec(LS_AUDIO_CODEC codecId, uint8_t* initdata, uint32_t datalen) override {}
+	uint32_t decodeData(uint8_t* data, int32_t datalen, uint32_t time) override { return 0; }
+	uint32_t copyFrameS16(int16_t* dest, uint32_t len) override;
+	uint32_t copyFrameF32(float* dest, uint32_t len) override;
+	void skipAll() override;
+	void setFlushing() override;
+	bool isFinished() const { return position == sound->samples.size(); }
+	uint32_t getPosition() const { return position; }
+};
 
 #ifdef ENABLE_LIBAVCODEC
 class FFMpegAudioDecoder: public AudioDecoder
@@ -0,0 +1,310 @@
+/**************************************************************************
+    Lightspark, a free flash player implementation
+
+    Copyright (C) 2024  Ludger Krämer <dbluelle@onlinehome.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include <glib/gstdio.h>
+#include <sstream>
+#include <vector>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "backends/diskcache.h"
+#include "logger.h"
+
+using namespace std;
+using namespace lightspark;
+
+#define DISKCACHE_INDEX_MAGIC "LSDISKCACHE 1"
+
+DiskCache::Writer::Writer(const tiny_string& _url, const std::string& _tempFilename):
+	url(_url),tempFilename(_tempFilename),checksum(g_checksum_new(G_CHECKSUM_SHA256)),size(0),failed(false)
+{
+	file.open(tempFilename.c_str(), std::ios::out|std::ios::binary|std::ios::trunc);
+	if (!file.is_open())
+		failed = true;
+}
+
+DiskCache::Writer::~Writer()
+{
+	if (file.is_open())
+		file.close();
+	g_checksum_free(checksum);
+}
+
+void DiskCache::Writer::append(const unsigned char* buffer, size_t length)
+{
+	if (failed)
+		return;
+	file.write((const char*)buffer, length);
+	if (file.fail())
+	{
+		failed = true;
+		return;
+	}
+	g_checksum_update(checksum, buffer, length);
+	size += length;
+}
+
+DiskCache::DiskCache(const std::string& _directory, uint64_t _maxSize):
+	directory(_directory),indexFilename(_directory + G_DIR_SEPARATOR_S + "index"),maxSize(_maxSize),totalSize(0)
+{
+	if (g_mkdir_with_parents(directory.c_str(), S_IRUSR | S_IWUSR | S_IXUSR))
+	{
+		LOG(LOG_ERROR, "NET: could not create disk cache directory " << directory);
+		return;
+	}
+	Locker l(mutex);
+	loadIndex();
+	// The limit may have been lowered since the last run
+	evict(0);
+}
+
+DiskCache::~DiskCache()
+{
+	Locker l(mutex);
+	saveIndex();
+}
+
+/**
+ * \brief Reads the index written by a previous run
+ *
+ * Each line of the index holds the hash, size, last access time, ETag,
+ * Last-Modified value and URL of one entry, separated by tabs.
+ * Entries whose content file has disappeared are dropped.
+ */
+void DiskCache::loadIndex()
+{
+	std::ifstream f(indexFilename.c_str(), std::ios::in);
+	if (!f.is_open())
+		return;
+
+	std::string line;
+	if (!getline(f, line) || line != DISKCACHE_INDEX_MAGIC)
+	{
+		LOG(LOG_INFO, "NET: ignoring disk cache index with unknown format");
+		return;
+	}
+	while (getline(f, line))
+	{
+		std::vector<std::string> fields;
+		std::istringstream ls(line);
+		std::string field;
+		while (getline(ls, field, '\t'))
+			fields.push_back(field);
+		if (fields.size() != 6)
+			continue;
+
+		Entry e;
+		e.hash = fields[0];
+		e.size = g_ascii_strtoull(fields[1].c_str(), nullptr, 10);
+		e.lastAccess = g_ascii_strtoll(fields[2].c_str(), nullptr, 10);
+		e.etag = fields[3];
+		e.lastModified = fields[4];
+
+		GStatBuf st;
+		if (g_stat(getContentFilename(e).c_str(), &st) != 0 || (uint64_t)st.st_size != e.size)
+			continue;
+
+		tiny_string url(fields[5]);
+		if (entries.find(url) != entries.end())
+			continue;
+		if (hashRefCount[e.hash]++ == 0)
+			totalSize += e.size;
+		entries[url] = e;
+	}
+	LOG(LOG_INFO, "NET: disk cache contains " << entries.size() << " entries, " << totalSize << " bytes");
+}
+
+void DiskCache::saveIndex()
+{
+	std::string tempFilename = indexFilename + ".tmp";
+	{
+		std::ofstream f(tempFilename.c_str(), std::ios::out|std::ios::trunc);
+		if (!f.is_open())
+		{
+			LOG(LOG_ERROR, "NET: could not write disk cache index " << tempFilename);
+			return;
+		}
+		f << DISKCACHE_INDEX_MAGIC << "\n";
+		for (auto it = entries.begin(); it != entries.end(); ++it)
+		{
+			const Entry& e = it->second;
+			f << e.hash << "\t" << e.size << "\t" << e.lastAccess << "\t"
+			  << e.etag << "\t" << e.lastModified << "\t" << it->first.raw_buf() << "\n";
+		}
+		if (f.fail())
+		{
+			f.close();
+			g_unlink(tempFilename.c_str());
+			return;
+		}
+	}
+	// Replace the index atomically, so a crash never leaves a truncated one behind
+	g_rename(tempFilename.c_str(), indexFilename.c_str());
+}
+
+void DiskCache::removeEntry(std::map<tiny_string, Entry>::iterator it)
+{
+	const Entry& e = it->second;
+	auto rc = hashRefCount.find(e.hash);
+	if (rc != hashRefCount.end() && --rc->second == 0)
+	{
+		// This was the last url with this content
+		hashRefCount.erase(rc);
+		totalSize -= e.size;
+		g_unlink(getContentFilename(e).c_str());
+	}
+	entries.erase(it);
+}
+
+/**
+ * \brief Removes the least recently used entries
+ *
+ * Removes entries until neededSize more bytes can be stored without
+ * exceeding the size limit.
+ */
+void DiskCache::evict(uint64_t neededSize)
+{
+	bool changed = false;
+	while (!entries.empty() && totalSize + neededSize > maxSize)
+	{
+		auto oldest = entries.begin();
+		for (auto it = entries.begin(); it != entries.end(); ++it)
+		{
+			if (it->second.lastAccess < oldest->second.lastAccess)
+				oldest = it;
+		}
+		LOG(LOG_INFO, "NET: evicting from disk cache: " << oldest->first);
+		removeEntry(oldest);
+		changed = true;
+	}
+	if (changed)
+		saveIndex();
+}
+
+bool DiskCache::lookup(const tiny_string& url, Entry& entry)
+{
+	Locker l(mutex);
+	auto it = entries.find(url);
+	if (it == entries.end())
+		return false;
+	entry = it->second;
+	return true;
+}
+
+std::string DiskCache::getContentFilename(const Entry& entry) const
+{
+	return directory + G_DIR_SEPARATOR_S + entry.hash;
+}
+
+void DiskCache::touch(const tiny_string& url)
+{
+	Locker l(mutex);
+	auto it = entries.find(url);
+	if (it == entries.end())
+		return;
+	it->second.lastAccess = g_get_real_time();
+	saveIndex();
+}
+
+void DiskCache::remove(const tiny_string& url)
+{
+	Locker l(mutex);
+	auto it = entries.find(url);
+	if (it == entries.end())
+		return;
+	removeEntry(it);
+	saveIndex();
+}
+
+DiskCache::Writer* DiskCache::createWriter(const tiny_string& url)
+{
+	std::string tempFilename = directory + G_DIR_SEPARATOR_S + "incomingXXXXXX";
+	int fd = g_mkstemp(&tempFilename[0]);
+	if (fd == -1)
+	{
+		LOG(LOG_ERROR, "NET: could not create temporary disk cache file");
+		return nullptr;
+	}
+	// The writer uses its own stream
+	close(fd);
+
+	Writer* writer = new Writer(url, tempFilename);
+	if (writer->hasFailed())
+	{
+		discard(writer);
+		return nullptr;
+	}
+	return writer;
+}
+
+void DiskCache::commit(Writer* writer, const std::string& etag, const std::string& lastModified)
+{
+	writer->file.close();
+	if (writer->failed || writer->file.fail() || writer->size > maxSize ||
+			etag.find_first_of("\t\n") != std::string::npos ||
+			lastModified.find_first_of("\t\n") != std::string::npos ||
+			writer->url.find("\t") != tiny_string::npos || writer->url.find("\n") != tiny_string::npos)
+	{
+		discard(writer);
+		return;
+	}
+
+	Entry e;
+	e.hash = g_checksum_get_string(writer->checksum);
+	e.size = writer->size;
+	e.lastAccess = g_get_real_time();
+	e.etag = etag;
+	e.lastModified = lastModified;
+
+	Locker l(mutex);
+	auto it = entries.find(writer->url);
+	if (it != entries.end())
+		removeEntry(it);
+
+	if (hashRefCount.find(e.hash) == hashRefCount.end())
+	{
+		evict(e.size);
+		if (g_rename(writer->tempFilename.c_str(), getContentFilename(e).c_str()) != 0)
+		{
+			LOG(LOG_ERROR, "NET: could not store " << writer->url << " in disk cache");
+			g_unlink(writer->tempFilename.c_str());
+			delete writer;
+			saveIndex();
+			return;
+		}
+		totalSize += e.size;
+	}
+	else
+	{
+		// Same content is already stored for another url
+		g_unlink(writer->tempFilename.c_str());
+	}
+	hashRefCount[e.hash]++;
+	entries[writer->url] = e;
+	saveIndex();
+	LOG(LOG_INFO, "NET: stored in disk cache: " << writer->url << " " << e.size << " bytes");
+	delete writer;
+}
+
+void DiskCache::discard(Writer* writer)
+{
+	if (writer->file.is_open())
+		writer->file.close();
+	g_unlink(writer->tempFilename.c_str());
+	delete writer;
+}
@@ -0,0 +1,126 @@
+/**************************************************************************
+    Lightspark, a free flash player implementation
+
+    Copyright (C) 2024  Ludger Krämer <dbluelle@onlinehome.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef BACKENDS_DISKCACHE_H
+#define BACKENDS_DISKCACHE_H 1
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <string>
+#include <glib.h>
+#include "threading.h"
+#include "tiny_string.h"
+#include "compat.h"
+
+namespace lightspark
+{
+
+/*
+ * A persistent, content addressed cache for downloaded resources.
+ *
+ * Every cached URL is recorded in an index together with the HTTP
+ * validators (ETag/Last-Modified) of the response and the SHA-256 hash
+ * of its content. The content itself is stored in a file named after
+ * the hash, so identical resources served from different URLs are
+ * stored only once. The index survives restarts, and the least recently
+ * used entries are evicted when the size of the stored content exceeds
+ * the configured limit.
+ *
+ * All methods are thread safe.
+ */
+class DLL_PUBLIC DiskCache
+{
+public:
+	struct Entry
+	{
+		std::string hash;
+		uint64_t size;
+		// Time of the last use in microseconds since the epoch
+		int64_t lastAccess;
+		std::string etag;
+		std::string lastModified;
+		Entry():size(0),lastAccess(0) {}
+	};
+	/*
+	 * Receives the content of a response while it is downloaded.
+	 * The data is written to a temporary file and becomes visible
+	 * in the cache only after DiskCache::commit().
+	 */
+	class DLL_PUBLIC Writer
+	{
+	friend class DiskCache;
+	private:
+		tiny_string url;
+		std::string tempFilename;
+		std::ofstream file;
+		GChecksum* checksum;
+		uint64_t size;
+		bool failed;
+		Writer(const tiny_string& _url, const std::string& _tempFilename);
+	public:
+		~Writer();
+		void append(const unsigned char* buffer, size_t length);
+		bool hasFailed() const { return failed; }
+	};
+private:
+	Mutex mutex;
+	std::string directory;
+	std::string indexFilename;
+	uint64_t maxSize;
+	// Total size of the content files referenced by the index
+	uint64_t totalSize;
+	std::map<tiny_string, Entry> entries;
+	// Number of index entries referencing each content file
+	std::map<std::string, uint32_t> hashRefCount;
+
+	void loadIndex() DLL_LOCAL;
+	void saveIndex() DLL_LOCAL;
+	// mutex must be held by the callers of the following methods
+	void removeEntry(std::map<tiny_string, Entry>::iterator it) DLL_LOCAL;
+	void evict(uint64_t neededSize) DLL_LOCAL;
+public:
+	DiskCache(const std::string& _directory, uint64_t _maxSize);
+	~DiskCache();
+
+	// Fills entry with the cached response for url, returns false
+	// if url is not in the cache
+	bool lookup(const tiny_string& url, Entry& entry);
+	// Returns the name of the file holding the content of entry
+	std::string getContentFilename(const Entry& entry) const;
+	// Marks the entry of url as recently used
+	void touch(const tiny_string& url);
+	// Drops url from the cache, e.g. when its content file is broken
+	void remove(const tiny_string& url);
+
+	// Starts storing a new response for url. Returns nullptr if the
+	// temporary file can't be created.
+	Writer* createWriter(const tiny_string& url);
+	// Makes the data received by writer the cached content of its
+	// url and deletes writer
+	void commit(Writer* writer, const std::string& etag, const std::string& lastModified);
+	// Throws away the data received by writer and deletes writer
+	void discard(Writer* writer);
+
+	uint64_t getTotalSize() const { return totalSize; }
+	uint64_t getMaxSize() const { return maxSize; }
+};
+
+};
+#endif /* BACKENDS_DISKCACHE_H */
@@ -650,6 +650,16 @@ void tokensVector::destruct()
 	stroketokens.reset();
 }
 
+void tokensVector::setReadOnly()
+{
+	if (next)
+		next->setReadOnly();
+	if (filltokens)
+		filltokens->isReadOnly=true;
+	if (stroketokens)
+		stroketokens->isReadOnly=true;
+}
+
 tokenListRef::~tokenListRef()
 {
 	if (fillStyles)
@@ -143,7 +143,9 @@ class tokenListRef : public RefCountable
 	linestylecache* lineStyles;
 public:
 	TokenList tokens;
-	tokenListRef():fillStyles(nullptr),lineStyles(nullptr)
+	// true if the tokens are generated from a dictionary tag and will never be modified
+	bool isReadOnly;
+	tokenListRef():fillStyles(nullptr),lineStyles(nullptr),isReadOnly(false)
 	{
 	}
 	~tokenListRef();
@@ -167,6 +169,8 @@ struct tokensVector
 	}
 	void clear();
 	void destruct();
+	// marks all token lists as read-only, so rasterized results can be shared between instances
+	void setReadOnly();
 	bool empty() const
 	{
 		return (!filltokens || filltokens->tokens.empty()) && (!stroketokens || stroketokens->tokens.empty()) && (!next || next->empty());
@@ -27,6 +27,9 @@
 #include "backends/cachedsurface.h"
 #include "backends/rendering.h"
 #include "backends/config.h"
+#include "backends/shapecache.h"
+#include "backends/textcache.h"
+#include "raster_scheduler.h"
 #include "compat.h"
 #include "scripting/flash/geom/flashgeom.h"
 #include "scripting/flash/text/flashtext.h"
@@ -81,6 +84,11 @@ TextureChunk& TextureChunk::operator=(const TextureChunk& r)
 	uint32_t blocksW=(width+CHUNKSIZE_REAL-1)/CHUNKSIZE_REAL;
 	uint32_t blocksH=(height+CHUNKSIZE_REAL-1)/CHUNKSIZE_REAL;
 	texId=r.texId;
+	isAtlasItem=r.isAtlasItem;
+	atlasX=r.atlasX;
+	atlasY=r.atlasY;
+	atlasWidth=r.atlasWidth;
+	atlasHeight=r.atlasHeight;
 	if(r.chunks)
 	{
 		chunks=new uint32_t[blocksW*blocksH];
@@ -107,6 +115,7 @@ void TextureChunk::makeEmpty()
 	width=0;
 	height=0;
 	texId=0;
+	isAtlasItem=false;
 	if (chunks)
 		delete[] chunks;
 	chunks=nullptr;
@@ -126,10 +135,22 @@ bool TextureChunk::resizeIfLargeEnough(uint32_t w, uint32_t h)
 		getSys()->getRenderThread()->releaseTexture(*this);
 		delete[] chunks;
 		chunks=nullptr;
+		isAtlasItem=false;
 		width=w;
 		height=h;
 		return true;
 	}
+	if(isAtlasItem)
+	{
+		// the area in the atlas includes a border of 1 pixel
+		if(w+2<=atlasWidth && h+2<=atlasHeight)
+		{
+			width=w;
+			height=h;
+			return true;
+		}
+		return false;
+	}
 	const uint32_t blocksW=(width+CHUNKSIZE_REAL-1)/CHUNKSIZE_REAL;
 	const uint32_t blocksH=(height+CHUNKSIZE_REAL-1)/CHUNKSIZE_REAL;
 	if(w<=blocksW*CHUNKSIZE_REAL && h<=blocksH*CHUNKSIZE_REAL)
@@ -248,21 +269,20 @@ cairo_pattern_t* CairoTokenRenderer::FILLSTYLEToCairo(const FILLSTYLE& style, do
 				return nullptr;
 			if (!style.Matrix.isInvertible())
 				return nullptr;
-			if (bm->cachedCairoPattern == nullptr)
-			{
-				cairo_surface_t* surface = nullptr;
-				uint8_t* buf = nullptr;
-				//Do an explicit cast, the data will not be modified
-				buf = (uint8_t*)bm->getData();
-				surface = cairo_image_surface_create_for_data (buf,
-									CAIRO_FORMAT_ARGB32,
-									bm->getWidth(),
-									bm->getHeight(),
-									cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, bm->getWidth()));
-				bm->cachedCairoPattern = cairo_pattern_create_for_surface(surface);
-				cairo_surface_destroy(surface);
-			}
-			pattern = cairo_pattern_reference(bm->cachedCairoPattern);
+			// the pattern is created for every call, as the same bitmap may be drawn by several
+			// threads at once (e.g. in bands of one shape) and each one sets its own matrix.
+			// Wrapping the bitmap data doesn't copy it, so this is cheap
+			cairo_surface_t* surface = nullptr;
+			uint8_t* buf = nullptr;
+			//Do an explicit cast, the data will not be modified
+			buf = (uint8_t*)bm->getData();
+			surface = cairo_image_surface_create_for_data (buf,
+								CAIRO_FORMAT_ARGB32,
+								bm->getWidth(),
+								bm->getHeight(),
+								cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, bm->getWidth()));
+			pattern = cairo_pattern_create_for_surface(surface);
+			cairo_surface_destroy(surface);
 			//Make a copy to invert it
 			cairo_matrix_t mat=style.Matrix;
 			mat.x0 -= number_t(style.ShapeBounds.Xmin)/20.0;
@@ -667,6 +687,35 @@ uint8_t* CairoRenderer::getPixelBuffer(bool *isBufferOwner, uint32_t* bufsize)
 		return nullptr;
 
 	uint8_t* ret=nullptr;
+	RasterScheduler* scheduler = getSys() ? getSys()->getRasterScheduler() : nullptr;
+	if (scheduler && canRenderInBands() && width*height >= RASTER_BAND_MIN_AREA)
+	{
+		// large surface, rasterize horizontal bands of it in parallel
+		uint32_t bandcount = std::min(uint32_t(height/RASTER_BAND_MIN_HEIGHT),scheduler->getThreadCount());
+		if (bandcount > 1)
+		{
+			int32_t stride=width*4;
+			ret=new uint8_t[stride*height];
+			int32_t bandheight = (height+bandcount-1)/bandcount;
+			scheduler->parallelFor(bandcount,[this,ret,stride,bandheight](uint32_t band)
+			{
+				int32_t y = band*bandheight;
+				int32_t h = std::min(bandheight,height-y);
+				if (h <= 0)
+					return;
+				cairo_surface_t* bandSurface=cairo_image_surface_create_for_data(ret+y*stride, CAIRO_FORMAT_ARGB32, width, h, stride);
+				cairo_t* bandcr=cairo_create(bandSurface);
+				cairo_surface_destroy(bandSurface); /* cr has an reference to it */
+				cairo_translate(bandcr, 0, -y);
+				cairo_scale(bandcr, getState()->xscale, getState()->yscale);
+				cairoClean(bandcr);
+				cairo_set_antialias(bandcr,getState()->smoothing ? CAIRO_ANTIALIAS_DEFAULT : CAIRO_ANTIALIAS_NONE);
+				executeDraw(bandcr);
+				cairo_destroy(bandcr);
+			});
+			return ret;
+		}
+	}
 	cairo_surface_t* cairoSurface=allocateSurface(ret);
 	cairo_t* cr=cairo_create(cairoSurface);
 
@@ -683,6 +732,41 @@ uint8_t* CairoRenderer::getPixelBuffer(bool *isBufferOwner, uint32_t* bufsize)
 	return ret;
 }
 
+uint8_t* CairoTokenRenderer::getPixelBuffer(bool* isBufferOwner, uint32_t* bufsize)
+{
+	ShapeRasterCache* cache = getSys() ? getSys()->getShapeRasterCache() : nullptr;
+	if (!cache || width<=0 || height<=0 || !Config::getConfig()->isRenderingEnabled()
+		|| (filltokens && !filltokens->isReadOnly)
+		|| (stroketokens && !stroketokens->isReadOnly)
+		|| (!filltokens && !stroketokens))
+		return CairoRenderer::getPixelBuffer(isBufferOwner,bufsize);
+
+	if (isBufferOwner)
+		*isBufferOwner=true;
+	if (bufsize)
+		*bufsize=width*height*4;
+	// the color transformation is applied when the texture is rendered, so it's not part of the key
+	ShapeRasterCache::Key key;
+	key.filltokens = filltokens.getPtr();
+	key.stroketokens = stroketokens.getPtr();
+	key.width = width;
+	key.height = height;
+	key.xscale = ShapeRasterCache::quantizeScale(getState()->xscale);
+	key.yscale = ShapeRasterCache::quantizeScale(getState()->yscale);
+	key.scaling = state->scaling;
+	key.xstart = xstart;
+	key.ystart = ystart;
+	key.isMask = getState()->isMask;
+	key.smoothing = getState()->smoothing != SMOOTH_NONE;
+	uint8_t* ret = cache->lookup(key,width*height*4);
+	if (ret)
+		return ret;
+	ret = CairoRenderer::getPixelBuffer();
+	if (ret)
+		cache->insert(key,filltokens,stroketokens,ret,width*height*4);
+	return ret;
+}
+
 bool CairoRenderer::isCachedSurfaceUsable(const DisplayObject* o) const
 {
 	const TextureChunk* tex = o->cachedSurface->tex;
@@ -884,17 +968,11 @@ void CairoPangoRenderer::executeDraw(cairo_t* cr)
 		
 		cairo_translate(cr, it->autosizeposition, linepos);
 		tiny_string text = it->text;
-		pangoLayoutFromData(layout, textData,text);
-		if (textData.isPassword)
+		if (!drawCachedLine(cr, layout, text))
 		{
-			tiny_string pwtxt;
-			for (uint32_t i = 0; i < text.numChars(); i++)
-				pwtxt+="*";
-			pango_layout_set_text(layout, pwtxt.raw_buf(), -1);
+			pangoLayoutFromData(layout, textData,text);
+			pango_cairo_show_layout(cr, layout);
 		}
-		else
-			pango_layout_set_text(layout, text.raw_buf(), -1);
-		pango_cairo_show_layout(cr, layout);
 		cairo_translate(cr, -it->autosizeposition, -linepos);
 		linepos += textData.fontSize+textData.leading;
 	}
@@ -935,6 +1013,93 @@ void CairoPangoRenderer::executeDraw(cairo_t* cr)
 	g_object_unref(layout);
 }
 
+bool CairoPangoRenderer::drawCachedLine(cairo_t* cr, PangoLayout* layout, const tiny_string& text)
+{
+	TextRasterCache* cache = getSys() ? getSys()->getTextRasterCache() : nullptr;
+	cairo_matrix_t m;
+	cairo_get_matrix(cr,&m);
+	// the lines are composited in device space, so this only works without rotation and skewing
+	if (!cache || m.xy != 0 || m.yx != 0 || m.xx <= 0 || m.yy <= 0)
+		return false;
+	double originx=0;
+	double originy=0;
+	cairo_user_to_device(cr,&originx,&originy);
+	double basex = floor(originx);
+	double basey = floor(originy);
+	TextRasterCache::Key key;
+	key.text = text;
+	key.font = textData.font;
+	key.fontSize = textData.fontSize;
+	key.bold = textData.isBold;
+	key.italic = textData.isItalic;
+	key.xscale = TextRasterCache::quantizeScale(m.xx);
+	key.yscale = TextRasterCache::quantizeScale(m.yy);
+	key.subpixelX = lround((originx-basex)*TEXTCACHE_SUBPIXEL_STEPS);
+	key.subpixelY = lround((originy-basey)*TEXTCACHE_SUBPIXEL_STEPS);
+	if (key.subpixelX == TEXTCACHE_SUBPIXEL_STEPS)
+	{
+		basex += 1;
+		key.subpixelX = 0;
+	}
+	if (key.subpixelY == TEXTCACHE_SUBPIXEL_STEPS)
+	{
+		basey += 1;
+		key.subpixelY = 0;
+	}
+	key.smoothing = cairo_get_antialias(cr) != CAIRO_ANTIALIAS_NONE;
+	if (textData.isPassword)
+	{
+		// the key must contain the text that is displayed
+		key.text = "";
+		for (uint32_t i = 0; i < text.numChars(); i++)
+			key.text += "*";
+	}
+
+	TextRasterCache::Line line;
+	if (!cache->lookup(key,line))
+	{
+		pangoLayoutFromData(layout, textData,text);
+		PangoRectangle ink;
+		pango_layout_get_extents(layout,&ink,nullptr);
+		double subx = double(key.subpixelX)/TEXTCACHE_SUBPIXEL_STEPS;
+		double suby = double(key.subpixelY)/TEXTCACHE_SUBPIXEL_STEPS;
+		line.width = 0;
+		line.height = 0;
+		line.stride = 0;
+		// add a border of one pixel for antialiasing
+		line.x = int32_t(floor(subx+double(ink.x)*m.xx/PANGO_SCALE))-1;
+		line.y = int32_t(floor(suby+double(ink.y)*m.yy/PANGO_SCALE))-1;
+		if (ink.width > 0 && ink.height > 0)
+		{
+			line.width = int32_t(ceil(subx+double(ink.x+ink.width)*m.xx/PANGO_SCALE))+1-line.x;
+			line.height = int32_t(ceil(suby+double(ink.y+ink.height)*m.yy/PANGO_SCALE))+1-line.y;
+			line.stride = cairo_format_stride_for_width(CAIRO_FORMAT_A8,line.width);
+			line.mask.resize(line.stride*line.height,0);
+			cairo_surface_t* maskSurface=cairo_image_surface_create_for_data(line.mask.data(), CAIRO_FORMAT_A8, line.width, line.height, line.stride);
+			cairo_t* maskcr=cairo_create(maskSurface);
+			cairo_surface_destroy(maskSurface); /* maskcr has an reference to it */
+			cairo_set_antialias(maskcr,cairo_get_antialias(cr));
+			cairo_translate(maskcr,subx-line.x,suby-line.y);
+			cairo_scale(maskcr,m.xx,m.yy);
+			pango_cairo_update_layout(maskcr,layout);
+			pango_cairo_show_layout(maskcr,layout);
+			cairo_destroy(maskcr);
+			pango_cairo_update_layout(cr,layout);
+		}
+		cache->insert(key,line);
+	}
+	if (line.mask.empty())
+		return true;
+	cairo_surface_t* maskSurface=cairo_image_surface_create_for_data(line.mask.data(), CAIRO_FORMAT_A8, line.width, line.height, line.stride);
+	// the source color is already set, the mask only contains the coverage of the glyphs
+	cairo_save(cr);
+	cairo_identity_matrix(cr);
+	cairo_mask_surface(cr,maskSurface,basex+line.x,basey+line.y);
+	cairo_restore(cr);
+	cairo_surface_destroy(maskSurface);
+	return true;
+}
+
 bool CairoPangoRenderer::getBounds(const TextData& tData, const tiny_string& text, number_t& tw, number_t& th)
 {
 	cairo_surface_t* cairoSurface=cairo_image_surface_create_for_data(nullptr, CAIRO_FORMAT_ARGB32, 0, 0, 0);
@@ -979,38 +1144,39 @@ PangoRectangle CairoPangoRenderer::lineExtents(PangoLayout *layout, int lineNumb
 	return rect;
 }
 
-std::vector<LineData> CairoPangoRenderer::getLineData(const TextData& _textData)
+LineData CairoPangoRenderer::getLineData(const TextData& _textData, uint32_t lineIndex)
 {
 	cairo_surface_t* cairoSurface=cairo_image_surface_create_for_data(NULL, CAIRO_FORMAT_ARGB32, 0, 0, 0);
 	cairo_t *cr=cairo_create(cairoSurface);
 
 	PangoLayout* layout;
 	layout = pango_cairo_create_layout(cr);
-	tiny_string text = _textData.getText();
+	const tiny_string& text = _textData.textlines[lineIndex].text;
 	pangoLayoutFromData(layout, _textData,text);
 
+	// the vertical position is taken from the measured heights of the lines above
 	int XOffset = _textData.scrollH;
-	int YOffset = PANGO_PIXELS(lineExtents(layout, _textData.scrollV-1).y);
-	std::vector<LineData> data;
-	data.reserve(pango_layout_get_line_count(layout));
+	int firstvisibleline = imin(imax(_textData.scrollV-1,0),_textData.getLineCount());
+	int ypos = 0;
+	for (int i = firstvisibleline; i < int(lineIndex); i++)
+		ypos += int(_textData.textlines[i].height)+_textData.leading;
+	for (int i = lineIndex; i < firstvisibleline; i++)
+		ypos -= int(_textData.textlines[i].height)+_textData.leading;
+
+	PangoRectangle rect;
 	PangoLayoutIter* lineIter = pango_layout_get_iter(layout);
-	do
-	{
-		PangoRectangle rect;
-		pango_layout_iter_get_line_extents(lineIter, NULL, &rect);
-		PangoLayoutLine* line = pango_layout_iter_get_line(lineIter);
-		data.emplace_back(PANGO_PIXELS(rect.x) - XOffset,
-				  PANGO_PIXELS(rect.y) - YOffset,
-				  PANGO_PIXELS(rect.width),
-				  PANGO_PIXELS(rect.height),
-				  text.bytePosToIndex(line->start_index),
-				  text.substr_bytes(line->start_index, line->length).numChars(),
-				  PANGO_PIXELS(PANGO_ASCENT(rect)),
-				  PANGO_PIXELS(PANGO_DESCENT(rect)),
-				  PANGO_PIXELS(PANGO_LBEARING(rect)),
-				  0); // FIXME
-	} while (pango_layout_iter_next_line(lineIter));
+	pango_layout_iter_get_line_extents(lineIter, NULL, &rect);
 	pango_layout_iter_free(lineIter);
+	LineData data(PANGO_PIXELS(rect.x) - XOffset,
+		      ypos,
+		      PANGO_PIXELS(rect.width),
+		      PANGO_PIXELS(rect.height),
+		      _textData.getLineOffset(lineIndex),
+		      text.numChars(),
+		      PANGO_PIXELS(PANGO_ASCENT(rect)),
+		      PANGO_PIXELS(PANGO_DESCENT(rect)),
+		      PANGO_PIXELS(PANGO_LBEARING(rect)),
+		      0); // FIXME
 
 	g_object_unref(layout);
 	cairo_destroy(cr);
@@ -1085,6 +1251,8 @@ TextureChunk& AsyncDrawJob::getTexture()
 	}
 	if(!surface->tex->resizeIfLargeEnough(width, height))
 		*surface->tex=owner->getSystemState()->getRenderThread()->allocateTexture(width, height,false);
+	// the texture content is replaced even if the state is kept
+	surface->isDamaged=true;
 	if (!surface->wasUpdated) // surface may have already been changed by DisplayObject::updateCachedSurface() before it was uploaded
 	{
 		surface->SetState(drawable->getState());
@@ -1193,22 +1361,9 @@ void TextData::setText(const char* text, bool firstlineonly)
 	textlines.clear();
 	appendText(text,firstlineonly);
 }
-void TextData::appendText(const char *text,bool firstlineonly,const FormatText* format)
+void TextData::splitText(const tiny_string& t, std::vector<textline>& lines, bool firstlineonly, const FormatText* format) const
 {
-	if (*text == 0x00)
-		return;
-	tiny_string t = text;
-	if (getLineCount() && !textlines.back().text.empty())
-	{
-		t = textlines.back().text + t;
-		textlines.pop_back();
-	}
-	number_t w,h;
-	if (embeddedFont)
-		embeddedFont->getTextBounds("",fontSize,w,h);
-	else
-		CairoPangoRenderer::getBounds(*this,"", w, h);
-	
+	tiny_string s = t;
 	uint32_t index=0;
 	do
 	{
@@ -1217,8 +1372,8 @@ void TextData::appendText(const char *text,bool firstlineonly,const FormatText*
 			line.format = *format;
 		line.autosizeposition=0;
 		line.textwidth=UINT32_MAX;
-		bool haslineterminator = t.getLine(index,line.text);
-		textlines.push_back(line);
+		bool haslineterminator = s.getLine(index,line.text);
+		lines.push_back(line);
 		if (haslineterminator && index==tiny_string::npos)
 		{
 			// add an empty line if text ends with line terminator
@@ -1227,12 +1382,85 @@ void TextData::appendText(const char *text,bool firstlineonly,const FormatText*
 				line.format = *format;
 			line.autosizeposition=0;
 			line.textwidth=UINT32_MAX;
-			textlines.push_back(line);
+			lines.push_back(line);
 		}
 	}
 	while (index != tiny_string::npos && !firstlineonly);
 }
 
+void TextData::appendText(const char *text,bool firstlineonly,const FormatText* format)
+{
+	if (*text == 0x00)
+		return;
+	tiny_string t = text;
+	if (getLineCount() && !textlines.back().text.empty())
+	{
+		t = textlines.back().text + t;
+		textlines.pop_back();
+	}
+	splitText(t,textlines,firstlineonly,format);
+}
+
+void TextData::replaceTextRange(uint32_t begin, uint32_t end, const tiny_string& text)
+{
+	if (textlines.empty())
+	{
+		splitText(text,textlines,false,nullptr);
+		return;
+	}
+	// find the first and last line touched by the range
+	uint32_t firstline=UINT32_MAX;
+	uint32_t firstoffset=0;
+	uint32_t lastline=UINT32_MAX;
+	uint32_t lastoffset=0;
+	uint32_t offset=0;
+	for (uint32_t i = 0; i < textlines.size(); i++)
+	{
+		uint32_t len = textlines[i].text.numChars();
+		if (firstline == UINT32_MAX && begin <= offset+len)
+		{
+			firstline=i;
+			firstoffset=offset;
+		}
+		if (firstline != UINT32_MAX && end <= offset+len)
+		{
+			lastline=i;
+			lastoffset=offset;
+			break;
+		}
+		offset += len+1; // add one for the \n
+	}
+	if (firstline == UINT32_MAX)
+	{
+		// range starts behind the text, append to last line
+		firstline=textlines.size()-1;
+		firstoffset=offset-textlines[firstline].text.numChars()-1;
+		begin=firstoffset+textlines[firstline].text.numChars();
+	}
+	if (lastline == UINT32_MAX)
+	{
+		lastline=textlines.size()-1;
+		lastoffset=offset-textlines[lastline].text.numChars()-1;
+		end=lastoffset+textlines[lastline].text.numChars();
+	}
+	if (end < begin)
+		end = begin;
+	tiny_string t = textlines[firstline].text.substr(0,begin-firstoffset) + text + textlines[lastline].text.substr(end-lastoffset,UINT32_MAX);
+	FormatText format = textlines[firstline].format;
+	std::vector<textline> newlines;
+	splitText(t,newlines,false,&format);
+	textlines.erase(textlines.begin()+firstline,textlines.begin()+lastline+1);
+	textlines.insert(textlines.begin()+firstline,newlines.begin(),newlines.end());
+}
+
+uint32_t TextData::getLineOffset(uint32_t line) const
+{
+	uint32_t offset=0;
+	for (uint32_t i=0; i < line && i < textlines.size(); ++i)
+		offset+=textlines[i].text.numChars()+1; // add one for the \n
+	return offset;
+}
+
 void TextData::appendFormatText(const char *text, const FormatText& format, bool firstlineonly)
 {
 	appendText(text, firstlineonly, &format);
@@ -1259,6 +1487,47 @@ bool TextData::TextIsEqual(const std::vector<tiny_string>& lines) const
 	return true;
 }
 
+void TextData::measureLines(uint32_t maxwidth)
+{
+	measuredAttributesChanged();
+	for (auto it = textlines.begin(); it != textlines.end(); it++)
+	{
+		if ((*it).textwidth != UINT32_MAX)
+			continue;
+		number_t w,h;
+		getTextSizes((*it).text,w,h);
+		// lines that need word wrapping are left to the owner of the TextData
+		if (wordWrap && uint32_t(w) > maxwidth)
+			continue;
+		(*it).textwidth=w;
+		(*it).height=h;
+	}
+}
+
+void TextData::takeLines(TextData& other)
+{
+	textlines.swap(other.textlines);
+	measuredAttributes = other.measuredAttributes;
+}
+
+bool TextData::measuredAttributesChanged()
+{
+	MeasuredAttributes& m = measuredAttributes;
+	if (m.font == font && m.embeddedFont == embeddedFont && m.fontSize == fontSize
+		&& m.isBold == isBold && m.isItalic == isItalic && m.isPassword == isPassword
+		&& m.wordWrap == wordWrap && (!wordWrap || m.width == width))
+		return false;
+	m.font = font;
+	m.embeddedFont = embeddedFont;
+	m.fontSize = fontSize;
+	m.isBold = isBold;
+	m.isItalic = isItalic;
+	m.isPassword = isPassword;
+	m.wordWrap = wordWrap;
+	m.width = width;
+	return true;
+}
+
 FontTag* TextData::checkEmbeddedFont(DisplayObject* d)
 {
 	ApplicationDomain* currentDomain=d->loadedFrom;
@@ -100,6 +100,15 @@ private:
 	 */
 	uint32_t* chunks = nullptr;
 	uint32_t texId = 0;
+	/*
+	 * Small textures are packed into an atlas page instead of using whole chunks.
+	 * The allocated area (including the border) starts at atlasX/atlasY
+	 */
+	bool isAtlasItem = false;
+	uint32_t atlasX = 0;
+	uint32_t atlasY = 0;
+	uint32_t atlasWidth = 0;
+	uint32_t atlasHeight = 0;
 	TextureChunk(uint32_t w, uint32_t h);
 public:
 	TextureChunk() {}
@@ -302,6 +311,7 @@ public:
 	void sizeNeeded(uint32_t& w, uint32_t& h) const override;
 	TextureChunk& getTexture() override;
 	void uploadFence() override;
+	bool isSurfaceLocal() const override { return true; }
 	void contentScale(number_t& x, number_t& y) const override;
 	void contentOffset(number_t& x, number_t& y) const override;
 	DisplayObject* getOwner() { return owner.getPtr(); }
@@ -317,6 +327,8 @@ protected:
 	static void cairoClean(cairo_t* cr);
 	cairo_surface_t* allocateSurface(uint8_t*& buf);
 	virtual void executeDraw(cairo_t* cr)=0;
+	// true if executeDraw() can be called concurrently for several parts of the surface
+	virtual bool canRenderInBands() const { return false; }
 	static void copyRGB15To24(uint32_t& dest, uint8_t* src);
 	static void copyRGB24To24(uint32_t& dest, uint8_t* src);
 public:
@@ -360,6 +372,7 @@ private:
 	 * This is run by CairoRenderer::execute()
 	 */
 	void executeDraw(cairo_t* cr) override;
+	bool canRenderInBands() const override { return true; }
 	number_t xstart;
 	number_t ystart;
 public:
@@ -382,6 +395,8 @@ CairoTokenRenderer(_NR<tokenListRef> _filltokens,_NR<tokenListRef> _stroketokens
 			const ColorTransformBase& _colortransform,
 			SMOOTH_MODE _smoothing, AS_BLENDMODE _blendmode,
 			number_t _xstart, number_t _ystart);
+	// looks up shapes generated from dictionary tags in the ShapeRasterCache before rasterizing them
+	uint8_t* getPixelBuffer(bool* isBufferOwner=nullptr, uint32_t* bufsize=nullptr) override;
 	/*
 	   Hit testing helper. Uses cairo to find if a point in inside the shape
 
@@ -412,6 +427,7 @@ struct textline
 {
 	tiny_string text;
 	number_t autosizeposition;
+	// UINT32_MAX if the line has not been measured yet
 	uint32_t textwidth;
 	uint32_t height;
 	FormatText format;
@@ -421,8 +437,31 @@ class FontTag;
 class DLL_PUBLIC TextData
 {
 friend class CairoPangoRenderer;
+private:
+	/*
+	 * the attributes the measured sizes of the lines depend on,
+	 * as they were when the lines were measured
+	 */
+	struct MeasuredAttributes
+	{
+		tiny_string font;
+		FontTag* embeddedFont {nullptr};
+		uint32_t fontSize {0};
+		uint32_t width {0};
+		bool isBold {false};
+		bool isItalic {false};
+		bool isPassword {false};
+		bool wordWrap {false};
+	};
+	MeasuredAttributes measuredAttributes;
+	void splitText(const tiny_string& t, std::vector<textline>& lines, bool firstlineonly, const FormatText* format) const;
 protected:
 	std::vector<textline> textlines;
+	/*
+	 * checks if any attribute the line sizes depend on has changed since the last call,
+	 * in that case all lines have to be measured again
+	 */
+	bool measuredAttributesChanged();
 public:
 	/* the default values are from the spec for flash.text.TextField and flash.text.TextFormat */
 	TextData() : width(100), height(100),leading(0), textWidth(0), textHeight(0), font("Times New Roman"),fontID(UINT32_MAX), scrollH(0), scrollV(1), backgroundColor(0xFFFFFF),borderColor(0x000000),
@@ -459,6 +498,20 @@ public:
 	void setText(const char* text, bool firstlineonly=false);
 	void appendText(const char* text, bool firstlineonly=false, const FormatText* format = nullptr);
 	void appendFormatText(const char* text, const FormatText& format, bool firstlineonly=false);
+	/*
+	 * replaces the characters from begin to end (as in getText()) with text.
+	 * Only the lines touched by the range are split again, all other lines keep their measured sizes
+	 */
+	void replaceTextRange(uint32_t begin, uint32_t end, const tiny_string& text);
+	// offset of the first character of the line in getText()
+	uint32_t getLineOffset(uint32_t line) const;
+	/*
+	 * measures all lines that were not measured yet and that don't need word wrapping at maxwidth.
+	 * Can be used from a background thread on a TextData that is not displayed
+	 */
+	void measureLines(uint32_t maxwidth);
+	// replaces the lines with the lines of other, including their measured sizes
+	void takeLines(TextData& other);
 	void getTextSizes(const tiny_string& text, number_t& tw, number_t& th);
 	bool TextIsEqual(const std::vector<tiny_string>& lines) const;
 	uint32_t getLineCount() const { return textlines.size(); }
@@ -497,6 +550,11 @@ class CairoPangoRenderer : public CairoRenderer
 	uint32_t caretIndex;
 	static void pangoLayoutFromData(PangoLayout* layout, const TextData& tData, const tiny_string& text);
 	static PangoRectangle lineExtents(PangoLayout *layout, int lineNumber);
+	/*
+	 * Draws a line of text at the origin of cr using the TextRasterCache,
+	 * returns false if the line can't be drawn from the cache
+	 */
+	bool drawCachedLine(cairo_t* cr, PangoLayout* layout, const tiny_string& text);
 public:
 	CairoPangoRenderer(const TextData& _textData, const MATRIX& _m,
 			int32_t _x, int32_t _y, int32_t _w, int32_t _h,
@@ -516,7 +574,12 @@ public:
 		@param w,h,tw,th are the (text)width and (text)height of the textData.
 	*/
 	static bool getBounds(const TextData& tData, const tiny_string& text, number_t& tw, number_t& th);
-	static std::vector<LineData> getLineData(const TextData& _textData);
+	/**
+		Helper. Uses Pango to get the metrics of a single line of the textData,
+		only the requested line is laid out
+		@param lineIndex has to be smaller than _textData.getLineCount()
+	*/
+	static LineData getLineData(const TextData& _textData, uint32_t lineIndex);
 };
 
 class RefreshableDrawable: public IDrawable
@@ -606,6 +606,10 @@ bool InputThread::handleKeyboardShortcuts(const SDL_KeyboardEvent *keyevent)
 			handled = true;
 			m_sys->showProfilingData=!m_sys->showProfilingData;
 			break;
+		case SDLK_r:
+			handled = true;
+			m_sys->showRedrawRegions=!m_sys->showRedrawRegions;
+			break;
 		case SDLK_m:
 			handled = true;
 			m_sys->audioManager->toggleMuteAll();
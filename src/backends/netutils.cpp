@@ -151,14 +151,19 @@ bool DownloadManager::removeDownloader(Downloader* downloader)
  * The standalone download manager produces \c ThreadedDownloader-type \c Downloaders.
  * It should only be used in the standalone version of LS.
  */
-StandaloneDownloadManager::StandaloneDownloadManager()
+StandaloneDownloadManager::StandaloneDownloadManager():diskCache(nullptr)
 {
 	type = STANDALONE;
+	Config* config = Config::getConfig();
+	maxConnections = config->getDownloadConnections();
+	if (config->isPersistentCacheEnabled())
+		diskCache = new DiskCache(config->getPersistentCacheDirectory(), config->getPersistentCacheMaxSize());
 }
 
 StandaloneDownloadManager::~StandaloneDownloadManager()
 {
 	cleanUp();
+	delete diskCache;
 }
 
 /**
@@ -195,7 +200,7 @@ Downloader* StandaloneDownloadManager::download(const URLInfo& url, _R<StreamCac
 	else
 	{
 		LOG(LOG_INFO, "NET: STANDALONE: DownloadManager: remote file");
-		downloader=new CurlDownloader(url.getParsedURL(), cache, owner);
+		downloader=new CurlDownloader(url.getParsedURL(), cache, owner, diskCache, maxConnections);
 	}
 	downloader->enableFencingWaiting();
 	addDownloader(downloader);
@@ -540,9 +545,12 @@ ThreadedDownloader::~ThreadedDownloader()
  *
  * \param[in] _url The URL for the Downloader.
  * \param[in] _cached Whether or not to cache this download.
+ * \param[in] _diskCache Persistent cache used to revalidate and store the response, may be nullptr.
+ * \param[in] _maxConnections Number of connections that may be used to fetch byte ranges of a large file in parallel.
  */
-CurlDownloader::CurlDownloader(const tiny_string& _url, _R<StreamCache> _cache, ILoadable* o):
-	ThreadedDownloader(_url, _cache, o)
+CurlDownloader::CurlDownloader(const tiny_string& _url, _R<StreamCache> _cache, ILoadable* o, DiskCache* _diskCache, uint32_t _maxConnections):
+	ThreadedDownloader(_url, _cache, o),diskCache(_diskCache),diskCacheWriter(nullptr),
+	maxConnections(_maxConnections),flushedSegments(0),rangesFailed(false),initialHandle(nullptr)
 {
 }
 
@@ -555,10 +563,16 @@ CurlDownloader::CurlDownloader(const tiny_string& _url, _R<StreamCache> _cache,
 CurlDownloader::CurlDownloader(const tiny_string& _url, _R<StreamCache> _cache,
 			       const std::vector<uint8_t>& _data,
 			       const std::list<tiny_string>& _headers, ILoadable* o):
-	ThreadedDownloader(_url, _cache, _data, _headers, o)
+	ThreadedDownloader(_url, _cache, _data, _headers, o),diskCache(nullptr),diskCacheWriter(nullptr),
+	maxConnections(1),flushedSegments(0),rangesFailed(false),initialHandle(nullptr)
 {
 }
 
+CurlDownloader::~CurlDownloader()
+{
+	cleanupRanges();
+}
+
 /**
  * \brief Called by \c IThreadJob::stop to abort this thread.
  * Calls \c Downloader::stop.
@@ -581,6 +595,9 @@ void CurlDownloader::execute()
 	}
 	LOG(LOG_INFO, "NET: CurlDownloader::execute: reading remote file: " << url.raw_buf());
 #ifdef ENABLE_CURL
+	// Only plain GET requests are cached
+	DiskCache::Entry cachedEntry;
+	bool hasCachedEntry = diskCache && data.empty() && diskCache->lookup(originalURL, cachedEntry);
 	CURL *curl;
 	CURLcode res;
 	curl = curl_easy_init();
@@ -632,6 +649,15 @@ void CurlDownloader::execute()
 			}
 		}
 
+		if(hasCachedEntry)
+		{
+			// Ask the server to send the file only if it has changed
+			if(!cachedEntry.etag.empty())
+				headerList=curl_slist_append(headerList, ("If-None-Match: "+cachedEntry.etag).c_str());
+			if(!cachedEntry.lastModified.empty())
+				headerList=curl_slist_append(headerList, ("If-Modified-Since: "+cachedEntry.lastModified).c_str());
+		}
+
 		if(!data.empty())
 		{
 			curl_easy_setopt(curl, CURLOPT_POST, 1);
@@ -644,16 +670,42 @@ void CurlDownloader::execute()
 			curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headerList);
 
 		//curl_easy_setopt(curl, CURLOPT_VERBOSE, 1);
-		res = curl_easy_perform(curl);
+		if(maxConnections > 1 && data.empty())
+			res = (CURLcode)performWithRanges(curl);
+		else
+			res = curl_easy_perform(curl);
+		cleanupRanges();
 
 		curl_slist_free_all(headerList);
 
 		curl_easy_cleanup(curl);
 		if(res!=0)
 		{
+			if(diskCacheWriter)
+				diskCache->discard(diskCacheWriter);
+			diskCacheWriter=nullptr;
 			setFailed();
 			return;
 		}
+		if(hasCachedEntry && getRequestStatus() == 304)
+		{
+			LOG(LOG_INFO, "NET: CurlDownloader: not modified, using disk cache: " << originalURL);
+			if(!appendFromDiskCache(cachedEntry))
+			{
+				diskCache->remove(originalURL);
+				setFailed();
+				return;
+			}
+			diskCache->touch(originalURL);
+		}
+		else if(diskCacheWriter)
+		{
+			if(cache->hasFailed())
+				diskCache->discard(diskCacheWriter);
+			else
+				diskCache->commit(diskCacheWriter, getHeader("etag").raw_buf(), getHeader("last-modified").raw_buf());
+			diskCacheWriter=nullptr;
+		}
 	}
 	else
 	{
@@ -692,10 +744,366 @@ size_t CurlDownloader::write_data(void *buffer, size_t size, size_t nmemb, void
 	CurlDownloader* th=static_cast<CurlDownloader*>(userp);
 	size_t added=size*nmemb;
 	if(th->getRequestStatus()/100 == 2 || th->getRequestStatus()/100 == 3)
-		th->append((uint8_t*)buffer,added);
+	{
+		if(!th->diskCacheWriter && th->getReceivedLength() == 0 && th->canStoreInDiskCache())
+			th->diskCacheWriter=th->diskCache->createWriter(th->originalURL);
+		if(th->rangeSegments.empty() && th->getReceivedLength() == 0 && th->canUseRanges())
+			th->startRanges();
+		// The initial request only delivers the first segment when
+		// the rest of the file is fetched in ranges
+		if(!th->rangeSegments.empty())
+			return th->writeSegment(th->rangeSegments[0],(const uint8_t*)buffer,added);
+		th->appendInOrder((uint8_t*)buffer,added);
+	}
 	return added;
 }
 
+void CurlDownloader::appendInOrder(uint8_t* buffer, uint32_t length)
+{
+	append(buffer,length);
+	if(diskCacheWriter)
+		diskCacheWriter->append(buffer,length);
+}
+
+/**
+ * \brief Checks if the response can be stored in the disk cache
+ *
+ * Only complete responses to GET requests that carry a validator are
+ * stored, as they are the only ones that can be revalidated later.
+ */
+bool CurlDownloader::canStoreInDiskCache()
+{
+	if(!diskCache || !data.empty() || getRequestStatus() != 200)
+		return false;
+	if(getHeader("etag").empty() && getHeader("last-modified").empty())
+		return false;
+	tiny_string cacheControl=getHeader("cache-control").lowercase();
+	return cacheControl.find("no-store") == tiny_string::npos;
+}
+
+/**
+ * \brief Feeds the content of a disk cache entry to the StreamCache
+ *
+ * Used when the server reports that the cached copy is still valid.
+ * \return false if the cached file could not be read completely
+ */
+bool CurlDownloader::appendFromDiskCache(const DiskCache::Entry& entry)
+{
+	std::ifstream file(diskCache->getContentFilename(entry).c_str(), std::ios::in|std::ios::binary);
+	if(!file.is_open())
+		return false;
+
+	setLength(entry.size);
+	uint8_t buffer[8192];
+	uint64_t read=0;
+	while(!file.eof() && !cache->hasFailed())
+	{
+		file.read((char*)buffer, sizeof(buffer));
+		if(file.bad())
+			return false;
+		append(buffer, file.gcount());
+		read+=file.gcount();
+	}
+	return read == entry.size;
+}
+
+// Files smaller than this are always downloaded through a single connection
+#define RANGE_MIN_FILE_SIZE (4*1024*1024)
+// Size of the byte ranges a large file is split into
+#define RANGE_MIN_SEGMENT_SIZE (1024*1024)
+#define RANGE_MAX_SEGMENT_SIZE (16*1024*1024)
+
+/**
+ * \brief Checks if the rest of the response can be fetched in parallel byte ranges
+ *
+ * Called when the first data of the initial request arrives, so all of its headers are known.
+ */
+bool CurlDownloader::canUseRanges()
+{
+	if(maxConnections <= 1 || !data.empty() || getRequestStatus() != 200)
+		return false;
+	if(length < RANGE_MIN_FILE_SIZE)
+		return false;
+	if(getHeader("accept-ranges").lowercase() != "bytes")
+		return false;
+	// Ranges of a compressed response refer to the compressed data
+	tiny_string encoding=getHeader("content-encoding").lowercase();
+	if(!encoding.empty() && encoding != "identity")
+		return false;
+#ifdef ENABLE_CURL
+	// Requesting the ranges from the original URL would only get the
+	// redirect again, so without the final URL a single connection is used
+	char* effectiveURL=nullptr;
+	if(!initialHandle || curl_easy_getinfo((CURL*)initialHandle, CURLINFO_EFFECTIVE_URL, &effectiveURL) != CURLE_OK || !effectiveURL)
+		return false;
+	rangeURL=effectiveURL;
+	return true;
+#else
+	return false;
+#endif
+}
+
+/**
+ * \brief Splits the file into segments
+ *
+ * The initial request keeps receiving the first segment, the others are
+ * requested by performWithRanges() as connections become available.
+ */
+void CurlDownloader::startRanges()
+{
+	uint64_t segmentSize = length/(maxConnections*4);
+	segmentSize = std::max<uint64_t>(RANGE_MIN_SEGMENT_SIZE, std::min<uint64_t>(RANGE_MAX_SEGMENT_SIZE, segmentSize));
+	for(uint64_t start=0; start<length; start+=segmentSize)
+	{
+		RangeSegment* segment=new RangeSegment();
+		segment->downloader=this;
+		segment->handle=nullptr;
+		segment->headerList=nullptr;
+		segment->start=start;
+		segment->size=std::min<uint64_t>(segmentSize, length-start);
+		segment->received=0;
+		segment->done=false;
+		rangeSegments.push_back(segment);
+	}
+	flushedSegments=0;
+	LOG(LOG_INFO, "NET: CurlDownloader: downloading " << url << " in " << rangeSegments.size() << " ranges");
+}
+
+/**
+ * \brief Stores data received for a segment
+ *
+ * Data of the segment that is next in file order goes directly to the
+ * StreamCache, data of later segments is kept until the segments before
+ * it are complete.
+ * \return the number of bytes consumed, less than length when the
+ * connection delivers more than the segment, which makes CURL stop it
+ */
+size_t CurlDownloader::writeSegment(RangeSegment* segment, const uint8_t* buffer, size_t length)
+{
+	if(threadAborting || cache->hasFailed())
+		return 0;
+	size_t used=std::min<uint64_t>(length, segment->size-segment->received);
+	bool inOrder=segment->pending.empty() &&
+		segment->start+segment->received == (uint64_t)getReceivedLength();
+	if(inOrder)
+		appendInOrder((uint8_t*)buffer,used);
+	else
+		segment->pending.insert(segment->pending.end(), buffer, buffer+used);
+	segment->received+=used;
+	if(segment->received == segment->size)
+		segment->done=true;
+	flushSegments();
+	return used;
+}
+
+/**
+ * \brief Moves data of segments that are now next in file order to the StreamCache
+ */
+void CurlDownloader::flushSegments()
+{
+	while(flushedSegments < rangeSegments.size())
+	{
+		RangeSegment* segment=rangeSegments[flushedSegments];
+		if(!segment->pending.empty() &&
+				segment->start+segment->received-segment->pending.size() == (uint64_t)getReceivedLength())
+		{
+			appendInOrder(segment->pending.data(), segment->pending.size());
+			segment->pending.clear();
+			segment->pending.shrink_to_fit();
+		}
+		if(!segment->done || !segment->pending.empty())
+			break;
+		flushedSegments++;
+	}
+}
+
+#ifdef ENABLE_CURL
+size_t CurlDownloader::write_range_data(void *buffer, size_t size, size_t nmemb, void *userp)
+{
+	RangeSegment* segment=static_cast<RangeSegment*>(userp);
+	CurlDownloader* th=segment->downloader;
+	long code=0;
+	curl_easy_getinfo((CURL*)segment->handle, CURLINFO_RESPONSE_CODE, &code);
+	if(code != 206)
+	{
+		// The server ignored the range or the file has changed
+		LOG(LOG_ERROR, "NET: CurlDownloader: range request failed with status " << code);
+		th->rangesFailed=true;
+		return 0;
+	}
+	return th->writeSegment(segment,(const uint8_t*)buffer,size*nmemb);
+}
+
+/**
+ * \brief Starts the request for the next segment that has no connection yet
+ *
+ * Segments are requested in file order. To bound the memory used for
+ * out of order data, no segment is requested that is too far ahead of the
+ * data already in the StreamCache.
+ * \return false if no request was started
+ */
+bool CurlDownloader::startNextRange(void* multi)
+{
+	uint32_t window=flushedSegments+maxConnections*2;
+	for(uint32_t i=1; i<rangeSegments.size() && i<window; i++)
+	{
+		RangeSegment* segment=rangeSegments[i];
+		if(segment->handle || segment->done)
+			continue;
+		CURL* curl=curl_easy_init();
+		if(!curl)
+			return false;
+		segment->handle=curl;
+		curl_easy_setopt(curl, CURLOPT_URL, rangeURL.raw_buf());
+		curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1);
+		curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0);
+		curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0);
+		curl_easy_setopt(curl, CURLOPT_USERAGENT, "Lightspark " VERSION);
+		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_range_data);
+		curl_easy_setopt(curl, CURLOPT_WRITEDATA, segment);
+		if (URLInfo(rangeURL).sameHost(getSys()->mainClip->getOrigin()) &&
+		    !getSys()->getCookies().empty())
+			curl_easy_setopt(curl, CURLOPT_COOKIE, getSys()->getCookies().c_str());
+		std::string range=std::to_string(segment->start)+"-"+std::to_string(segment->start+segment->size-1);
+		curl_easy_setopt(curl, CURLOPT_RANGE, range.c_str());
+		// Ranges are sent with the same headers as the initial request,
+		// the server may require them (e.g. for authentication)
+		curl_slist* headerList=nullptr;
+		for(auto it=requestHeaders.begin(); it!=requestHeaders.end(); ++it)
+			headerList=curl_slist_append(headerList, it->raw_buf());
+		// Make sure all ranges come from the same version of the file
+		tiny_string validator=getHeader("etag");
+		if(validator.empty() || validator.startsWith("W/"))
+			validator=getHeader("last-modified");
+		if(!validator.empty())
+			headerList=curl_slist_append(headerList, (tiny_string("If-Range: ")+validator).raw_buf());
+		if(headerList)
+		{
+			segment->headerList=headerList;
+			curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headerList);
+		}
+		curl_multi_add_handle((CURLM*)multi, curl);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * \brief Runs the initial request and the range requests on a CURL multi handle
+ *
+ * All connections are driven from this thread. The initial request
+ * behaves exactly like curl_easy_perform() until its first data shows that
+ * the file can be fetched in ranges.
+ * \return the CURLcode of the download
+ */
+int CurlDownloader::performWithRanges(void* curl)
+{
+	CURLM* multi=curl_multi_init();
+	if(!multi)
+		return curl_easy_perform((CURL*)curl);
+	curl_multi_add_handle(multi, (CURL*)curl);
+	initialHandle=curl;
+
+	CURLcode res=CURLE_OK;
+	int running=1;
+	while(running)
+	{
+		if(threadAborting || cache->hasFailed() || rangesFailed)
+		{
+			res=CURLE_ABORTED_BY_CALLBACK;
+			break;
+		}
+		curl_multi_perform(multi, &running);
+
+		int queued;
+		CURLMsg* msg;
+		while((msg=curl_multi_info_read(multi, &queued)))
+		{
+			if(msg->msg != CURLMSG_DONE)
+				continue;
+			bool isInitial = msg->easy_handle == curl;
+			// The initial request is stopped by writeSegment()
+			// once the first segment is complete
+			bool segmentDone = isInitial && !rangeSegments.empty() && rangeSegments[0]->done;
+			if(msg->data.result != CURLE_OK && !segmentDone)
+			{
+				res=msg->data.result;
+				running=0;
+				break;
+			}
+			curl_multi_remove_handle(multi, msg->easy_handle);
+			if(!isInitial)
+			{
+				for(auto it=rangeSegments.begin(); it!=rangeSegments.end(); ++it)
+				{
+					if((*it)->handle == msg->easy_handle)
+					{
+						if(!(*it)->done)
+							res=CURLE_PARTIAL_FILE;
+						curl_easy_cleanup((CURL*)(*it)->handle);
+						(*it)->handle=nullptr;
+						curl_slist_free_all((curl_slist*)(*it)->headerList);
+						(*it)->headerList=nullptr;
+					}
+				}
+			}
+		}
+		if(res!=CURLE_OK)
+			break;
+
+		// Keep maxConnections requests running
+		int active=0;
+		for(auto it=rangeSegments.begin(); it!=rangeSegments.end(); ++it)
+			active+=((*it)->handle != nullptr);
+		if(!rangeSegments.empty() && !rangeSegments[0]->done)
+			active++;
+		while(!rangeSegments.empty() && active<(int)maxConnections && startNextRange(multi))
+		{
+			active++;
+			running=1;
+		}
+		if(!running && flushedSegments<rangeSegments.size())
+		{
+			// All connections finished, but some segments are
+			// missing. This happens when the window was full.
+			if(startNextRange(multi))
+				running=1;
+			else
+				res=CURLE_PARTIAL_FILE;
+		}
+		if(running)
+			curl_multi_wait(multi, nullptr, 0, 100, nullptr);
+	}
+
+	for(auto it=rangeSegments.begin(); it!=rangeSegments.end(); ++it)
+	{
+		if((*it)->handle)
+			curl_multi_remove_handle(multi, (CURL*)(*it)->handle);
+	}
+	curl_multi_remove_handle(multi, (CURL*)curl);
+	curl_multi_cleanup(multi);
+	initialHandle=nullptr;
+	if(res==CURLE_OK && rangesFailed)
+		res=CURLE_RANGE_ERROR;
+	return res;
+}
+#endif
+
+void CurlDownloader::cleanupRanges()
+{
+	for(auto it=rangeSegments.begin(); it!=rangeSegments.end(); ++it)
+	{
+#ifdef ENABLE_CURL
+		if((*it)->handle)
+			curl_easy_cleanup((CURL*)(*it)->handle);
+		if((*it)->headerList)
+			curl_slist_free_all((curl_slist*)(*it)->headerList);
+#endif
+		delete *it;
+	}
+	rangeSegments.clear();
+}
+
 /**
  * \brief Header callback for CURL
  *
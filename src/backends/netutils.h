@@ -33,6 +33,7 @@
 #include "swftypes.h"
 #include "backends/urlutils.h"
 #include "backends/streamcache.h"
+#include "backends/diskcache.h"
 #include "smartrefs.h"
 
 namespace lightspark
@@ -63,6 +64,11 @@ public:
 
 class DLL_PUBLIC StandaloneDownloadManager:public DownloadManager
 {
+private:
+	// Persistent cache for remote files, nullptr if disabled
+	DiskCache* diskCache;
+	// Maximum number of connections used to download a single large file
+	uint32_t maxConnections;
 public:
 	StandaloneDownloadManager();
 	~StandaloneDownloadManager();
@@ -184,13 +190,59 @@ protected:
 class CurlDownloader: public ThreadedDownloader
 {
 private:
+	DiskCache* diskCache;
+	// Receives the response body if it can be stored in diskCache
+	DiskCache::Writer* diskCacheWriter;
+	bool canStoreInDiskCache();
+	bool appendFromDiskCache(const DiskCache::Entry& entry);
+
+	//-- PARALLEL RANGE DOWNLOADS
+	// A byte range of the file, fetched by its own connection.
+	// The first segment is received by the initial request.
+	struct RangeSegment
+	{
+		CurlDownloader* downloader;
+		// CURL easy handle, nullptr until the request is started
+		void* handle;
+		// Extra request headers (curl_slist) of handle
+		void* headerList;
+		uint64_t start;
+		uint64_t size;
+		uint64_t received;
+		// Received bytes that are not yet in the StreamCache,
+		// because the preceding segments are incomplete
+		std::vector<uint8_t> pending;
+		bool done;
+	};
+	// Maximum number of concurrent connections, 1 disables range requests
+	uint32_t maxConnections;
+	std::vector<RangeSegment*> rangeSegments;
+	// Index of the first segment that is not completely in the StreamCache
+	uint32_t flushedSegments;
+	bool rangesFailed;
+	// CURL easy handle of the initial request while performWithRanges() runs
+	void* initialHandle;
+	// The ranges are requested from the URL the initial request was redirected to
+	tiny_string rangeURL;
+	bool canUseRanges();
+	void startRanges();
+	bool startNextRange(void* multi);
+	size_t writeSegment(RangeSegment* segment, const uint8_t* buffer, size_t length);
+	void flushSegments();
+	int performWithRanges(void* curl);
+	void cleanupRanges();
+	static size_t write_range_data(void *buffer, size_t size, size_t nmemb, void *userp);
+	// Appends data that is next in file order
+	void appendInOrder(uint8_t* buffer, uint32_t length);
+
 	static size_t write_data(void *buffer, size_t size, size_t nmemb, void *userp);
 	static size_t write_header(void *buffer, size_t size, size_t nmemb, void *userp);
 	static int progress_callback(void *clientp, double dltotal, double dlnow, double ultotal, double ulnow);
 	void execute();
 	void threadAbort();
 public:
-	CurlDownloader(const tiny_string& _url, _R<StreamCache> cache, ILoadable* o);
+	CurlDownloader(const tiny_string& _url, _R<StreamCache> cache, ILoadable* o, DiskCache* _diskCache=nullptr, uint32_t _maxConnections=1);
+	~CurlDownloader();
 	CurlDownloader(const tiny_string& _url, _R<StreamCache> cache, const std::vector<uint8_t>& data,
 		       const std::list<tiny_string>& headers, ILoadable* o);
 };
@@ -0,0 +1,424 @@
+/**************************************************************************
+    Lightspark, a free flash player implementation
+
+    Copyright (C) 2024  Ludger Krämer <dbluelle@onlinehome.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include <algorithm>
+#include <cstring>
+#include "backends/pixelkernels.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+using namespace lightspark;
+
+namespace
+{
+// unpremultiplied channel values, indexed by alpha and premultiplied channel value
+struct UnpremultiplyTable
+{
+	uint8_t values[256][256];
+	UnpremultiplyTable()
+	{
+		for (uint32_t a = 0; a < 256; a++)
+		{
+			for (uint32_t c = 0; c < 256; c++)
+			{
+				if (a == 0 || a == 0xff)
+					values[a][c] = c;
+				else // ceiling(value*255/alpha)
+					values[a][c] = ((c*0xff)/a+((c*0xff)%a ? 1:0))&0xff;
+			}
+		}
+	}
+};
+const UnpremultiplyTable& getUnpremultiplyTable()
+{
+	static const UnpremultiplyTable table;
+	return table;
+}
+
+void premultiplyPixelsScalar(const uint32_t* src, uint32_t* dst, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++)
+		dst[i] = premultiplyPixel(src[i]);
+}
+
+inline int32_t transformChannel(uint32_t value, number_t multiplier, number_t offset)
+{
+	return max(0,min(255,int(number_t(value)*multiplier+offset)));
+}
+void colorTransformPixelsScalar(uint32_t* pixels, uint32_t count, const number_t* multipliers, const number_t* offsets)
+{
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t p = pixels[i];
+		pixels[i] = (transformChannel((p>>24)&0xff,multipliers[3],offsets[3])<<24)
+			| (transformChannel((p>>16)&0xff,multipliers[2],offsets[2])<<16)
+			| (transformChannel((p>> 8)&0xff,multipliers[1],offsets[1])<< 8)
+			| (transformChannel((p    )&0xff,multipliers[0],offsets[0])    );
+	}
+}
+
+void copyChannelPixelsScalar(const uint32_t* src, uint32_t* dst, uint32_t count, uint32_t srcShift, uint32_t dstShift)
+{
+	uint32_t constantChannelsMask = ~(0xffU << dstShift);
+	for (uint32_t i = 0; i < count; i++)
+		dst[i] = (dst[i] & constantChannelsMask) | (((src[i] >> srcShift) & 0xff) << dstShift);
+}
+
+inline bool thresholdTest(uint32_t value, THRESHOLD_OPERATION op, uint32_t threshold)
+{
+	switch (op)
+	{
+		case THRESHOLD_LESS: return value < threshold;
+		case THRESHOLD_LESS_EQUAL: return value <= threshold;
+		case THRESHOLD_GREATER: return value > threshold;
+		case THRESHOLD_GREATER_EQUAL: return value >= threshold;
+		case THRESHOLD_EQUAL: return value == threshold;
+		case THRESHOLD_NOT_EQUAL: return value != threshold;
+	}
+	return false;
+}
+uint32_t thresholdPixelsScalar(const uint32_t* src, uint32_t* dst, uint32_t count, THRESHOLD_OPERATION op, uint32_t threshold, uint32_t color, uint32_t mask, bool copySource)
+{
+	uint32_t res = 0;
+	threshold &= mask;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (thresholdTest(src[i]&mask,op,threshold))
+		{
+			dst[i] = color;
+			res++;
+		}
+		else if (copySource)
+			dst[i] = src[i];
+	}
+	return res;
+}
+
+void blendPixelsScalar(const uint32_t* src, uint32_t* dst, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t s = src[i];
+		uint32_t d = dst[i];
+		uint32_t srcalpha = ((s >> 24)&0xff);
+		uint32_t dstalpha = 0xff-srcalpha;
+		uint32_t b = (((s     ) &0xff) * srcalpha + ((d     ) &0xff) * dstalpha) / 0xff;
+		uint32_t g = (((s >> 8) &0xff) * srcalpha + ((d >> 8) &0xff) * dstalpha) / 0xff;
+		uint32_t r = (((s >>16) &0xff) * srcalpha + ((d >>16) &0xff) * dstalpha) / 0xff;
+		uint32_t a = min (srcalpha + ((d >>24) &0xff) * dstalpha, 0xffU);
+		dst[i] = (b & 0xff) | ((g&0xff)<<8) | ((r&0xff)<<16) | (a<<24);
+	}
+}
+
+bool comparePixelsScalar(const uint32_t* a, const uint32_t* b, uint32_t* result, uint32_t count)
+{
+	bool different = false;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t pixel = a[i];
+		uint32_t otherpixel = b[i];
+		if (pixel == otherpixel)
+			result[i] = 0;
+		else if ((pixel & 0x00FFFFFF) == (otherpixel & 0x00FFFFFF))
+		{
+			different = true;
+			result[i] = ((pixel & 0xFF000000) - (otherpixel & 0xFF000000)) | 0x00FFFFFF;
+		}
+		else
+		{
+			// the color channels are subtracted separately, modulo 256
+			different = true;
+			uint32_t diff = 0xFF000000;
+			for (uint32_t shift = 0; shift < 24; shift += 8)
+				diff |= ((((pixel >> shift) & 0xff) - ((otherpixel >> shift) & 0xff)) & 0xff) << shift;
+			result[i] = diff;
+		}
+	}
+	return different;
+}
+
+void mergePixelsScalar(const uint32_t* src, uint32_t* dst, uint32_t count, const uint32_t* multipliers)
+{
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t res = 0;
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			uint32_t s = (src[i] >> (c*8)) & 0xff;
+			uint32_t d = (dst[i] >> (c*8)) & 0xff;
+			res |= ((s*multipliers[c] + d*(256-multipliers[c])) >> 8) << (c*8);
+		}
+		dst[i] = res;
+	}
+}
+
+#ifdef __SSE2__
+// x/255 for all 16 bit lanes, exact for x <= 65280
+inline __m128i div255_epu16(__m128i x)
+{
+	return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(x,_mm_set1_epi16(1)),_mm_srli_epi16(x,8)),8);
+}
+// copies the alpha lane of both pixels to all lanes of the pixel
+inline __m128i broadcastAlpha_epi16(__m128i x)
+{
+	return _mm_shufflehi_epi16(_mm_shufflelo_epi16(x,_MM_SHUFFLE(3,3,3,3)),_MM_SHUFFLE(3,3,3,3));
+}
+inline __m128i select_si128(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask,a),_mm_andnot_si128(mask,b));
+}
+// unsigned 32 bit comparison a > b
+inline __m128i cmpgt_epu32(__m128i a, __m128i b)
+{
+	__m128i sign = _mm_set1_epi32(0x80000000);
+	return _mm_cmpgt_epi32(_mm_xor_si128(a,sign),_mm_xor_si128(b,sign));
+}
+#endif
+}
+
+uint32_t lightspark::unpremultiplyPixel(uint32_t color)
+{
+	uint32_t alpha = color>>24;
+	const uint8_t* values = getUnpremultiplyTable().values[alpha];
+	return (alpha<<24)
+		| (values[(color>>16)&0xff]<<16)
+		| (values[(color>> 8)&0xff]<< 8)
+		| (values[(color    )&0xff]    );
+}
+
+void lightspark::premultiplyPixels(const uint32_t* src, uint32_t* dst, uint32_t count)
+{
+	uint32_t i = 0;
+#ifdef __SSE2__
+	__m128i zero = _mm_setzero_si128();
+	__m128i alphalanes = _mm_set_epi16(-1,0,0,0,-1,0,0,0);
+	for (; i+4 <= count; i+=4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(src+i));
+		__m128i lo = _mm_unpacklo_epi8(v,zero);
+		__m128i hi = _mm_unpackhi_epi8(v,zero);
+		__m128i plo = div255_epu16(_mm_mullo_epi16(lo,broadcastAlpha_epi16(lo)));
+		__m128i phi = div255_epu16(_mm_mullo_epi16(hi,broadcastAlpha_epi16(hi)));
+		plo = select_si128(alphalanes,lo,plo);
+		phi = select_si128(alphalanes,hi,phi);
+		_mm_storeu_si128((__m128i*)(dst+i),_mm_packus_epi16(plo,phi));
+	}
+#endif
+	premultiplyPixelsScalar(src+i,dst+i,count-i);
+}
+
+void lightspark::unpremultiplyPixels(const uint32_t* src, uint32_t* dst, uint32_t count)
+{
+	// a table lookup is faster than any vectorized division
+	for (uint32_t i = 0; i < count; i++)
+		dst[i] = unpremultiplyPixel(src[i]);
+}
+
+void lightspark::colorTransformPixels(uint32_t* pixels, uint32_t count, const number_t* multipliers, const number_t* offsets)
+{
+	uint32_t i = 0;
+#ifdef __SSE2__
+	// the computation is done in double precision, so the results are the same as in the scalar version
+	__m128d mul_bg = _mm_set_pd(multipliers[1],multipliers[0]);
+	__m128d mul_ra = _mm_set_pd(multipliers[3],multipliers[2]);
+	__m128d off_bg = _mm_set_pd(offsets[1],offsets[0]);
+	__m128d off_ra = _mm_set_pd(offsets[3],offsets[2]);
+	__m128i zero = _mm_setzero_si128();
+	for (; i+4 <= count; i+=4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(pixels+i));
+		__m128i lo = _mm_unpacklo_epi8(v,zero);
+		__m128i hi = _mm_unpackhi_epi8(v,zero);
+		__m128i p[4] = { _mm_unpacklo_epi16(lo,zero), _mm_unpackhi_epi16(lo,zero), _mm_unpacklo_epi16(hi,zero), _mm_unpackhi_epi16(hi,zero) };
+		for (uint32_t j = 0; j < 4; j++)
+		{
+			__m128i bg = _mm_cvttpd_epi32(_mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(p[j]),mul_bg),off_bg));
+			__m128i ra = _mm_cvttpd_epi32(_mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(p[j],8)),mul_ra),off_ra));
+			p[j] = _mm_unpacklo_epi64(bg,ra);
+		}
+		// saturating packs clamp the channels to 0..255
+		__m128i res = _mm_packus_epi16(_mm_packs_epi32(p[0],p[1]),_mm_packs_epi32(p[2],p[3]));
+		_mm_storeu_si128((__m128i*)(pixels+i),res);
+	}
+#endif
+	colorTransformPixelsScalar(pixels+i,count-i,multipliers,offsets);
+}
+
+void lightspark::copyChannelPixels(const uint32_t* src, uint32_t* dst, uint32_t count, uint32_t srcShift, uint32_t dstShift)
+{
+	uint32_t i = 0;
+#ifdef __SSE2__
+	__m128i srcshiftv = _mm_cvtsi32_si128(srcShift);
+	__m128i dstshiftv = _mm_cvtsi32_si128(dstShift);
+	__m128i channelmask = _mm_set1_epi32(0xff);
+	__m128i constantmask = _mm_set1_epi32(~(0xffU << dstShift));
+	for (; i+4 <= count; i+=4)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i*)(src+i));
+		__m128i d = _mm_loadu_si128((const __m128i*)(dst+i));
+		s = _mm_sll_epi32(_mm_and_si128(_mm_srl_epi32(s,srcshiftv),channelmask),dstshiftv);
+		_mm_storeu_si128((__m128i*)(dst+i),_mm_or_si128(_mm_and_si128(d,constantmask),s));
+	}
+#endif
+	copyChannelPixelsScalar(src+i,dst+i,count-i,srcShift,dstShift);
+}
+
+uint32_t lightspark::thresholdPixels(const uint32_t* src, uint32_t* dst, uint32_t count, THRESHOLD_OPERATION op, uint32_t threshold, uint32_t color, uint32_t mask, bool copySource)
+{
+	uint32_t i = 0;
+	uint32_t res = 0;
+#ifdef __SSE2__
+	__m128i maskv = _mm_set1_epi32(mask);
+	__m128i thresholdv = _mm_set1_epi32(threshold&mask);
+	__m128i colorv = _mm_set1_epi32(color);
+	__m128i allset = _mm_set1_epi32(-1);
+	for (; i+4 <= count; i+=4)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i*)(src+i));
+		__m128i v = _mm_and_si128(s,maskv);
+		__m128i match;
+		switch (op)
+		{
+			case THRESHOLD_LESS: match = cmpgt_epu32(thresholdv,v); break;
+			case THRESHOLD_LESS_EQUAL: match = _mm_xor_si128(cmpgt_epu32(v,thresholdv),allset); break;
+			case THRESHOLD_GREATER: match = cmpgt_epu32(v,thresholdv); break;
+			case THRESHOLD_GREATER_EQUAL: match = _mm_xor_si128(cmpgt_epu32(thresholdv,v),allset); break;
+			case THRESHOLD_EQUAL: match = _mm_cmpeq_epi32(v,thresholdv); break;
+			default: match = _mm_xor_si128(_mm_cmpeq_epi32(v,thresholdv),allset); break;
+		}
+		__m128i other = copySource ? s : _mm_loadu_si128((const __m128i*)(dst+i));
+		_mm_storeu_si128((__m128i*)(dst+i),select_si128(match,colorv,other));
+		int bits = _mm_movemask_ps(_mm_castsi128_ps(match));
+		res += (bits&1) + ((bits>>1)&1) + ((bits>>2)&1) + ((bits>>3)&1);
+	}
+#endif
+	return res+thresholdPixelsScalar(src+i,dst+i,count-i,op,threshold,color,mask,copySource);
+}
+
+void lightspark::histogramPixels(const uint32_t* pixels, uint32_t count, uint32_t counts[4][256])
+{
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t p = pixels[i];
+		counts[0][p&0xff]++;
+		counts[1][(p>>8)&0xff]++;
+		counts[2][(p>>16)&0xff]++;
+		counts[3][p>>24]++;
+	}
+}
+
+void lightspark::blendPixels(const uint32_t* src, uint32_t* dst, uint32_t count)
+{
+	uint32_t i = 0;
+#ifdef __SSE2__
+	__m128i zero = _mm_setzero_si128();
+	__m128i c255 = _mm_set1_epi16(0xff);
+	__m128i alphalanes = _mm_set_epi16(-1,0,0,0,-1,0,0,0);
+	for (; i+4 <= count; i+=4)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i*)(src+i));
+		__m128i d = _mm_loadu_si128((const __m128i*)(dst+i));
+		__m128i res[2];
+		for (uint32_t j = 0; j < 2; j++)
+		{
+			__m128i s16 = j ? _mm_unpackhi_epi8(s,zero) : _mm_unpacklo_epi8(s,zero);
+			__m128i d16 = j ? _mm_unpackhi_epi8(d,zero) : _mm_unpacklo_epi8(d,zero);
+			__m128i srcalpha = broadcastAlpha_epi16(s16);
+			__m128i dstpart = _mm_mullo_epi16(d16,_mm_sub_epi16(c255,srcalpha));
+			__m128i color = div255_epu16(_mm_add_epi16(_mm_mullo_epi16(s16,srcalpha),dstpart));
+			// alpha = min(srcalpha + dstalpha*(255-srcalpha), 255)
+			__m128i alpha = _mm_add_epi16(srcalpha,dstpart);
+			alpha = _mm_sub_epi16(alpha,_mm_subs_epu16(alpha,c255));
+			res[j] = select_si128(alphalanes,alpha,color);
+		}
+		_mm_storeu_si128((__m128i*)(dst+i),_mm_packus_epi16(res[0],res[1]));
+	}
+#endif
+	blendPixelsScalar(src+i,dst+i,count-i);
+}
+
+void lightspark::fillPixels(uint32_t* dst, uint32_t count, uint32_t color)
+{
+	uint32_t i = 0;
+#ifdef __SSE2__
+	__m128i colorv = _mm_set1_epi32(color);
+	for (; i+4 <= count; i+=4)
+		_mm_storeu_si128((__m128i*)(dst+i),colorv);
+#endif
+	for (; i < count; i++)
+		dst[i] = color;
+}
+
+bool lightspark::comparePixels(const uint32_t* a, const uint32_t* b, uint32_t* result, uint32_t count)
+{
+	uint32_t i = 0;
+	bool different = false;
+#ifdef __SSE2__
+	__m128i rgbmask = _mm_set1_epi32(0x00FFFFFF);
+	__m128i alphamask = _mm_set1_epi32(0xFF000000);
+	for (; i+4 <= count; i+=4)
+	{
+		__m128i pa = _mm_loadu_si128((const __m128i*)(a+i));
+		__m128i pb = _mm_loadu_si128((const __m128i*)(b+i));
+		__m128i equal = _mm_cmpeq_epi32(pa,pb);
+		__m128i rgba = _mm_and_si128(pa,rgbmask);
+		__m128i rgbb = _mm_and_si128(pb,rgbmask);
+		__m128i rgbequal = _mm_cmpeq_epi32(rgba,rgbb);
+		__m128i alphadiff = _mm_or_si128(_mm_sub_epi32(_mm_and_si128(pa,alphamask),_mm_and_si128(pb,alphamask)),rgbmask);
+		__m128i rgbdiff = _mm_or_si128(_mm_and_si128(_mm_sub_epi8(pa,pb),rgbmask),alphamask);
+		__m128i res = _mm_andnot_si128(equal,select_si128(rgbequal,alphadiff,rgbdiff));
+		_mm_storeu_si128((__m128i*)(result+i),res);
+		if (_mm_movemask_epi8(equal) != 0xffff)
+			different = true;
+	}
+#endif
+	if (comparePixelsScalar(a+i,b+i,result+i,count-i))
+		different = true;
+	return different;
+}
+
+void lightspark::mergePixels(const uint32_t* src, uint32_t* dst, uint32_t count, const uint32_t* multipliers)
+{
+	uint32_t i = 0;
+#ifdef __SSE2__
+	__m128i zero = _mm_setzero_si128();
+	__m128i mul = _mm_set_epi16(multipliers[3],multipliers[2],multipliers[1],multipliers[0],multipliers[3],multipliers[2],multipliers[1],multipliers[0]);
+	__m128i invmul = _mm_sub_epi16(_mm_set1_epi16(256),mul);
+	for (; i+4 <= count; i+=4)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i*)(src+i));
+		__m128i d = _mm_loadu_si128((const __m128i*)(dst+i));
+		__m128i lo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(s,zero),mul),_mm_mullo_epi16(_mm_unpacklo_epi8(d,zero),invmul)),8);
+		__m128i hi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(s,zero),mul),_mm_mullo_epi16(_mm_unpackhi_epi8(d,zero),invmul)),8);
+		_mm_storeu_si128((__m128i*)(dst+i),_mm_packus_epi16(lo,hi));
+	}
+#endif
+	mergePixelsScalar(src+i,dst+i,count-i,multipliers);
+}
+
+void lightspark::paletteMapPixels(const uint32_t* src, uint32_t* dst, uint32_t count, const uint32_t maps[4][256])
+{
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t p = src[i];
+		dst[i] = maps[0][p&0xff] + maps[1][(p>>8)&0xff] + maps[2][(p>>16)&0xff] + maps[3][p>>24];
+	}
+}
@@ -0,0 +1,93 @@
+/**************************************************************************
+    Lightspark, a free flash player implementation
+
+    Copyright (C) 2024  Ludger Krämer <dbluelle@onlinehome.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef BACKENDS_PIXELKERNELS_H
+#define BACKENDS_PIXELKERNELS_H 1
+
+#include <cstdint>
+#include "compat.h"
+#include "swftypes.h"
+
+namespace lightspark
+{
+
+/*
+ * Kernels for processing runs of 32 bit ARGB pixels (0xAARRGGBB in native
+ * byte order, the format used by BitmapContainer).
+ *
+ * On x86 the kernels use SSE2, everywhere else a scalar implementation
+ * with identical results is used.
+ */
+
+enum THRESHOLD_OPERATION { THRESHOLD_LESS, THRESHOLD_LESS_EQUAL, THRESHOLD_GREATER, THRESHOLD_GREATER_EQUAL, THRESHOLD_EQUAL, THRESHOLD_NOT_EQUAL };
+
+// converts a straight alpha pixel to premultiplied alpha
+inline uint32_t premultiplyPixel(uint32_t color)
+{
+	uint32_t alpha = color>>24;
+	if (alpha == 0xff)
+		return color;
+	return (alpha<<24)
+		| ((((color>>16)&0xff)*alpha/0xff)<<16)
+		| ((((color>> 8)&0xff)*alpha/0xff)<< 8)
+		| ((((color    )&0xff)*alpha/0xff)    );
+}
+// converts a premultiplied pixel to straight alpha, the color channels are rounded up
+uint32_t unpremultiplyPixel(uint32_t color);
+
+void premultiplyPixels(const uint32_t* src, uint32_t* dst, uint32_t count);
+void unpremultiplyPixels(const uint32_t* src, uint32_t* dst, uint32_t count);
+/*
+ * Applies a color transformation to straight alpha pixels:
+ * channel = clamp(int(channel*multiplier+offset)).
+ * multipliers and offsets are given in the order blue, green, red, alpha
+ */
+void colorTransformPixels(uint32_t* pixels, uint32_t count, const number_t* multipliers, const number_t* offsets);
+// replaces the channel at dstShift of dst by the channel at srcShift of src
+void copyChannelPixels(const uint32_t* src, uint32_t* dst, uint32_t count, uint32_t srcShift, uint32_t dstShift);
+/*
+ * Sets dst to color for every pixel where (src&mask) op (threshold&mask) is true.
+ * The other pixels are set to src if copySource is true and are left unchanged otherwise.
+ * Returns the number of pixels set to color
+ */
+uint32_t thresholdPixels(const uint32_t* src, uint32_t* dst, uint32_t count, THRESHOLD_OPERATION op, uint32_t threshold, uint32_t color, uint32_t mask, bool copySource);
+// adds the channel values of the pixels to counts (indexed by byte position and value)
+void histogramPixels(const uint32_t* pixels, uint32_t count, uint32_t counts[4][256]);
+// draws src over dst, as done by BitmapContainer::copyRectangle with mergeAlpha
+void blendPixels(const uint32_t* src, uint32_t* dst, uint32_t count);
+void fillPixels(uint32_t* dst, uint32_t count, uint32_t color);
+/*
+ * Computes the difference of the straight alpha pixels as defined by BitmapData.compare():
+ * 0 for equal pixels, 0xFF000000 | the per channel differences of the colors if they
+ * differ, otherwise the alpha difference << 24 | 0x00FFFFFF.
+ * Returns true if any pixel is different
+ */
+bool comparePixels(const uint32_t* a, const uint32_t* b, uint32_t* result, uint32_t count);
+/*
+ * channel = (src*multiplier + dst*(256-multiplier))/256, as defined by BitmapData.merge().
+ * multipliers are given in the order blue, green, red, alpha and must be <= 256
+ */
+void mergePixels(const uint32_t* src, uint32_t* dst, uint32_t count, const uint32_t* multipliers);
+/*
+ * dst = maps[0][blue]+maps[1][green]+maps[2][red]+maps[3][alpha], as defined by BitmapData.paletteMap()
+ */
+void paletteMapPixels(const uint32_t* src, uint32_t* dst, uint32_t count, const uint32_t maps[4][256]);
+
+}
+#endif /* BACKENDS_PIXELKERNELS_H */
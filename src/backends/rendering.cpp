@@ -26,6 +26,7 @@
 #include "parsing/textfile.h"
 #include "backends/cachedsurface.h"
 #include "backends/rendering.h"
+#include "backends/textureatlas.h"
 #include "backends/input.h"
 #include "compat.h"
 #include <sstream>
@@ -39,6 +40,9 @@
 using namespace lightspark;
 using namespace std;
 
+// if more than this fraction of the window is damaged, the whole stage is redrawn
+#define PARTIAL_REDRAW_MAX_AREA 0.5
+
 
 DEFINE_AND_INITIALIZE_TLS(renderThread);
 RenderThread* lightspark::getRenderThread()
@@ -65,8 +69,12 @@ RenderThread::RenderThread(SystemState* s):GLRenderContext(),
 	m_sys(s),status(CREATED),
 	prevUploadJob(nullptr),
 	renderNeeded(false),uploadNeeded(false),resizeNeeded(false),newTextureNeeded(false),event(0),newWidth(0),newHeight(0),scaleX(1),scaleY(1),
-	offsetX(0),offsetY(0),tempBufferAcquired(false),frameCount(0),secsCount(0),initialized(0),refreshNeeded(false),renderToBitmapContainerNeeded(false),
-	screenshotneeded(false),inSettings(false),canrender(false),
+	offsetX(0),offsetY(0),tempBufferAcquired(false),frameCount(0),secsCount(0),initialized(0),refreshNeeded(false),buildingRefreshBuffer(0),readyRefreshBuffer(1),renderingRefreshBuffer(2),vmWaitTime(0),renderWaitTime(0),renderToBitmapContainerNeeded(false),
+	stageFramebuffer(0),stageRenderbuffer(0),stageTextureID(0),stageFramebufferWidth(0),stageFramebufferHeight(0),fullRedrawNeeded(true),lastBackground(0),
+	hasDamage(false),damageScissorActive(false),damageScissorX(0),damageScissorY(0),damageScissorWidth(0),damageScissorHeight(0),
+	scissorRectActive(false),scissorX(0),scissorY(0),scissorWidth(0),scissorHeight(0),
+	redrawnPixels(0),redrawnPixelsPerSecond(0),
+	screenshotToFile(false),screenshotneeded(false),inSettings(false),canrender(false),
 	cairoTextureContextSettings(nullptr),cairoTextureContext(nullptr)
 {
 	LOG(LOG_INFO,"RenderThread this=" << this);
@@ -103,7 +111,7 @@ void RenderThread::handleNewTexture()
 	for(uint32_t i=0;i<largeTextures.size();i++)
 	{
 		if(largeTextures[i].id==(uint32_t)-1)
-			largeTextures[i].id=allocateNewGLTexture();
+			largeTextures[i].id=allocateNewGLTexture(largeTextures[i].size);
 	}
 	newTextureNeeded=false;
 }
@@ -117,6 +125,8 @@ void RenderThread::finalizeUpload()
 	u->contentScale(tex.xContentScale, tex.yContentScale);
 	u->contentOffset(tex.xOffset, tex.yOffset);
 	loadChunkBGRA(tex, w, h, u->upload(false));
+	if (!u->isSurfaceLocal())
+		fullRedrawNeeded=true;
 	u->uploadFence();
 	prevUploadJob=nullptr;
 }
@@ -203,7 +213,9 @@ int RenderThread::worker(void* d)
 }
 bool RenderThread::doRender(ThreadProfile* profile,Chronometer* chronometer)
 {
+	gint64 waitstart=g_get_monotonic_time();
 	event.wait();
+	renderWaitTime+=g_get_monotonic_time()-waitstart;
 	if(m_sys->isShuttingDown())
 		return false;
 	if (chronometer)
@@ -232,7 +244,13 @@ bool RenderThread::doRender(ThreadProfile* profile,Chronometer* chronometer)
 		finalizeUpload();
 	if (refreshNeeded)
 	{
-		Locker l(mutexRefreshSurfaces);
+		{
+			Locker l(mutexRefreshSurfaces);
+			std::swap(readyRefreshBuffer,renderingRefreshBuffer);
+			refreshNeeded=false;
+		}
+		// the rendering buffer is only accessed by the render thread, so no locking is needed while applying it
+		std::list<RefreshableSurface>& surfacesToRefresh = refreshBuffers[renderingRefreshBuffer];
 		auto it = surfacesToRefresh.begin();
 		while (it != surfacesToRefresh.end())
 		{
@@ -246,7 +264,6 @@ bool RenderThread::doRender(ThreadProfile* profile,Chronometer* chronometer)
 			}
 			it = surfacesToRefresh.erase(it);
 		}
-		refreshNeeded=false;
 		renderNeeded=true;
 	}
 
@@ -327,6 +344,7 @@ bool RenderThread::doRender(ThreadProfile* profile,Chronometer* chronometer)
 			setViewPort(w,h,false);
 			
 			// render DisplayObject to texture
+			flushAtlasUploads();
 			it->cachedsurface->Render(m_sys,*this,&it->initialMatrix,&(*it));
 			
 			// read rendered texture back into bitmapcontainer (no need for locking the bitmapcontainer as the worker thread is waiting until rendering is done)
@@ -385,14 +403,23 @@ bool RenderThread::doRender(ThreadProfile* profile,Chronometer* chronometer)
 					renderSettingsPage();
 					engineData->DoSwapBuffers();
 				}
-				if (screenshotneeded)
+				// screenshots written to a file have to wait for the stage to be rendered
+				if (screenshotneeded && !screenshotToFile)
 					generateScreenshot();
 				renderNeeded=false;
 				return true;
 			}
 			if(!m_sys->isOnError())
 			{
-				coreRendering();
+				if (!coreRendering())
+				{
+					// nothing changed since the last frame, so we keep showing it
+					if (profile && chronometer)
+						profile->accountTime(chronometer->checkpoint());
+					canrender=false;
+					renderNeeded=false;
+					return true;
+				}
 				//Call glFlush to offload work on the GPU
 				engineData->exec_glFlush();
 			}
@@ -412,12 +439,14 @@ bool RenderThread::doRender(ThreadProfile* profile,Chronometer* chronometer)
 		if(diff>1000) /* one second elapsed */
 		{
 			time_s=time_d;
-			LOG(LOG_INFO,"FPS: " << dec << frameCount<<" "<<(getVm(m_sys) ? getVm(m_sys)->getEventQueueSize() : 0));
+			LOG(LOG_INFO,"FPS: " << dec << frameCount<<" "<<(getVm(m_sys) ? getVm(m_sys)->getEventQueueSize() : 0)<<" redrawn pixels: "<<redrawnPixelsPerSecond);
 			frameCount=0;
+			redrawnPixelsPerSecond=0;
 			secsCount++;
 		}
 		else
 			frameCount++;
+		redrawnPixelsPerSecond+=redrawnPixels;
 	}
 	
 	if (profile && chronometer)
@@ -620,25 +649,22 @@ void RenderThread::renderTextureToFrameBuffer(uint32_t filterTextureID, uint32_t
 }
 void RenderThread::generateScreenshot()
 {
-	char* buf = new char[windowWidth*windowHeight*3];
+	size_t size = 54 + windowWidth * windowHeight * 3;
+	unsigned char* buf = new unsigned char[size];
 	if (!buf)
 	{
 		LOG(LOG_ERROR,"generating screenshot memory failed");
 		return;
 	}
-	engineData->exec_glReadPixels(windowWidth, windowHeight, buf);
-	
-	char* name_used=nullptr;
-	int fd = g_file_open_tmp("lightsparkXXXXXX.bmp",&name_used,nullptr);
-	if(fd == -1)
-	{
-		LOG(LOG_ERROR,"generating screenshot file failed");
-		return;
-	}
-	
-	unsigned char bmp_file_header[14] = { 'B', 'M', 0, 0, 0, 0, 0, 0, 0, 0, 54, 0, 0, 0, };
-	unsigned char bmp_info_header[40] = { 40, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 24, 0, };
-	size_t size = 54 + windowWidth * windowHeight * 3;
+	unsigned char* bmp_file_header = buf;
+	unsigned char* bmp_info_header = buf+14;
+	memset(buf,0,54);
+	bmp_file_header[0] = 'B';
+	bmp_file_header[1] = 'M';
+	bmp_file_header[10] = 54;
+	bmp_info_header[0] = 40;
+	bmp_info_header[12] = 1;
+	bmp_info_header[14] = 24;
 
 	bmp_file_header[2] = (size)&0xff;
 	bmp_file_header[3] = (size >> 8);
@@ -654,12 +680,36 @@ void RenderThread::generateScreenshot()
 	bmp_info_header[9] = (windowHeight >> 8)&0xff;
 	bmp_info_header[10] = (windowHeight >> 16)&0xff;
 	bmp_info_header[11] = (windowHeight >> 24)&0xff;
-		
-	if (write(fd,bmp_file_header,14)<0)
-		LOG(LOG_INFO,"screenshot header write error");
-	if (write(fd,bmp_info_header,40)<0)
-		LOG(LOG_INFO,"screenshot header write error");
-	if (write(fd,buf,windowWidth * windowHeight * 3)<0)
+
+	engineData->exec_glReadPixels(windowWidth, windowHeight, buf+54);
+
+	if (screenshotToFile)
+	{
+		// requested by --screenshot-frame, the player exits afterwards
+		GError* error=nullptr;
+		if (g_file_set_contents(m_sys->screenshotFile.raw_buf(),(const gchar*)buf,size,&error))
+			LOG(LOG_INFO,"screenshot generated:"<<m_sys->screenshotFile);
+		else
+		{
+			LOG(LOG_ERROR,"writing screenshot "<<m_sys->screenshotFile<<" failed:"<<error->message);
+			g_error_free(error);
+		}
+		delete[] buf;
+		screenshotToFile=false;
+		screenshotneeded=false;
+		m_sys->setShutdownFlag();
+		return;
+	}
+
+	char* name_used=nullptr;
+	int fd = g_file_open_tmp("lightsparkXXXXXX.bmp",&name_used,nullptr);
+	if(fd == -1)
+	{
+		LOG(LOG_ERROR,"generating screenshot file failed");
+		delete[] buf;
+		return;
+	}
+	if (write(fd,buf,size)<0)
 		LOG(LOG_INFO,"screenshot write error");
 	close(fd);
 	delete[] buf;
@@ -668,23 +718,45 @@ void RenderThread::generateScreenshot()
 	screenshotneeded=false;
 }
 
+void RenderThread::requestScreenshotToFile()
+{
+	screenshotToFile=true;
+	screenshotneeded=true;
+	// the whole stage has to be in the screenshot, not only the damaged parts
+	draw(true);
+}
+
 void RenderThread::addRefreshableSurface(IDrawable* d, _NR<DisplayObject> o)
 {
-	Locker l(mutexRefreshSurfaces);
+	// the building buffer is only accessed by the vm thread (protected by the invalidateQueueLock), so no locking is needed
 	RefreshableSurface s;
 	s.displayobject = o;
 	s.drawable = d;
-	surfacesToRefresh.push_back(s);
+	refreshBuffers[buildingRefreshBuffer].push_back(s);
 }
 
 void RenderThread::signalSurfaceRefresh()
 {
-	Locker l(mutexRefreshSurfaces);
-	if (!surfacesToRefresh.empty())
+	std::list<RefreshableSurface>& surfaces = refreshBuffers[buildingRefreshBuffer];
+	if (surfaces.empty())
+		return;
+	gint64 waitstart=g_get_monotonic_time();
 	{
-		refreshNeeded=true;
-		event.signal();
+		Locker l(mutexRefreshSurfaces);
+		vmWaitTime+=g_get_monotonic_time()-waitstart;
+		if (refreshNeeded)
+		{
+			// the render thread has not taken the previous frame yet, so add this frame to it
+			std::list<RefreshableSurface>& ready = refreshBuffers[readyRefreshBuffer];
+			ready.splice(ready.end(),surfaces);
+		}
+		else
+		{
+			std::swap(buildingRefreshBuffer,readyRefreshBuffer);
+			refreshNeeded=true;
+		}
 	}
+	event.signal();
 }
 
 void RenderThread::deinit()
@@ -763,9 +835,11 @@ void RenderThread::commonGLDeinit()
 	{
 		engineData->exec_glDeleteTextures(1,&largeTextures[i].id);
 		delete[] largeTextures[i].bitmap;
+		delete largeTextures[i].atlas;
 	}
 	engineData->exec_glDeleteTextures(1, &cairoTextureID);
 	engineData->exec_glDeleteTextures(1, &cairoTextureIDSettings);
+	deleteStageFramebuffer();
 }
 
 void RenderThread::commonGLInit()
@@ -872,6 +946,7 @@ void RenderThread::commonGLResize()
 
 	engineData->exec_glDisable_GL_DEPTH_TEST();
 	engineData->exec_glDisable_GL_STENCIL_TEST();
+	fullRedrawNeeded=true;
 
 	engineData->exec_glBindFramebuffer_GL_FRAMEBUFFER(0);
 	engineData->exec_glActiveTexture_GL_TEXTURE0(SAMPLEPOSITION::SAMPLEPOS_STANDARD);
@@ -956,7 +1031,9 @@ void RenderThread::renderText(cairo_t *cr, const char *text, int x, int y)
 
 void RenderThread::waitRendering()
 {
+	gint64 waitstart=g_get_monotonic_time();
 	Locker l(mutexRendering);
+	vmWaitTime+=g_get_monotonic_time()-waitstart;
 }
 
 //Send the texture drawn by Cairo to the GPU
@@ -1213,36 +1290,343 @@ void RenderThread::removeDebugRect()
 		debugRects.pop_back();
 }
 
-void RenderThread::coreRendering()
+bool RenderThread::checkStageFramebuffer()
+{
+	if (stageFramebuffer && stageFramebufferWidth == windowWidth && stageFramebufferHeight == windowHeight)
+		return true;
+	deleteStageFramebuffer();
+	if (windowWidth == 0 || windowHeight == 0
+		|| windowWidth > uint32_t(engineData->maxTextureSize) || windowHeight > uint32_t(engineData->maxTextureSize))
+		return false;
+	engineData->exec_glActiveTexture_GL_TEXTURE0(SAMPLEPOSITION::SAMPLEPOS_STANDARD);
+	engineData->exec_glGenTextures(1, &stageTextureID);
+	engineData->exec_glBindTexture_GL_TEXTURE_2D(stageTextureID);
+	stageFramebuffer = engineData->exec_glGenFramebuffer();
+	engineData->exec_glBindFramebuffer_GL_FRAMEBUFFER(stageFramebuffer);
+	stageRenderbuffer = engineData->exec_glGenRenderbuffer();
+	engineData->exec_glBindRenderbuffer_GL_RENDERBUFFER(stageRenderbuffer);
+	if (engineData->supportPackedDepthStencil)
+	{
+		engineData->exec_glRenderbufferStorage_GL_RENDERBUFFER_GL_DEPTH_STENCIL(windowWidth,windowHeight);
+		engineData->exec_glFramebufferRenderbuffer_GL_FRAMEBUFFER_GL_DEPTH_STENCIL_ATTACHMENT(stageRenderbuffer);
+	}
+	else
+	{
+		engineData->exec_glRenderbufferStorage_GL_RENDERBUFFER_GL_STENCIL_INDEX8(windowWidth,windowHeight);
+		engineData->exec_glFramebufferRenderbuffer_GL_FRAMEBUFFER_GL_STENCIL_ATTACHMENT(stageRenderbuffer);
+	}
+	engineData->exec_glTexParameteri_GL_TEXTURE_2D_GL_TEXTURE_MIN_FILTER_GL_NEAREST();
+	engineData->exec_glTexParameteri_GL_TEXTURE_2D_GL_TEXTURE_MAG_FILTER_GL_NEAREST();
+	engineData->exec_glFramebufferTexture2D_GL_FRAMEBUFFER(stageTextureID);
+	engineData->exec_glTexImage2D_GL_TEXTURE_2D_GL_UNSIGNED_BYTE(0, windowWidth, windowHeight, 0, nullptr,true);
+	engineData->exec_glBindFramebuffer_GL_FRAMEBUFFER(0);
+	engineData->exec_glBindTexture_GL_TEXTURE_2D(0);
+	if (handleGLErrors())
+	{
+		LOG(LOG_ERROR,"could not create stage framebuffer, partial redraw disabled");
+		deleteStageFramebuffer();
+		m_sys->partialRedraw=false;
+		return false;
+	}
+	stageFramebufferWidth=windowWidth;
+	stageFramebufferHeight=windowHeight;
+	fullRedrawNeeded=true;
+	return true;
+}
+
+void RenderThread::deleteStageFramebuffer()
+{
+	if (stageFramebuffer)
+		engineData->exec_glDeleteFramebuffers(1,&stageFramebuffer);
+	if (stageRenderbuffer)
+		engineData->exec_glDeleteRenderbuffers(1,&stageRenderbuffer);
+	if (stageTextureID)
+		engineData->exec_glDeleteTextures(1,&stageTextureID);
+	stageFramebuffer=0;
+	stageRenderbuffer=0;
+	stageTextureID=0;
+	stageFramebufferWidth=0;
+	stageFramebufferHeight=0;
+}
+
+void RenderThread::addDamage(const RectF& r)
+{
+	if (hasDamage)
+		damagedRect = damagedRect._union(r);
+	else
+		damagedRect = r;
+	hasDamage=true;
+}
+
+/*
+ * Computes the area covered by surface and its children in the current frame and adds the area of every
+ * surface that changed since the last frame (before and after the change) to the damaged region.
+ * The transformations are computed the same way as in CachedSurface::Render().
+ * returns true if anything in the subtree of surface has changed
+ */
+bool RenderThread::collectDamage(CachedSurface* surface, const MATRIX& parentMatrix, const MATRIX& initialMatrix, bool isRoot)
+{
+	SurfaceState* state = surface->getState();
+	bool changed = surface->isDamaged;
+	surface->isDamaged=false;
+	if (!state || (!state->isMask && !state->clipdepth && (!state->visible || state->alpha==0.0)))
+	{
+		// surface is not rendered
+		if (surface->hasDamageBounds)
+			addDamage(surface->damageBounds);
+		bool hadbounds = surface->hasDamageBounds;
+		surface->hasDamageBounds=false;
+		return hadbounds;
+	}
+	MATRIX m = isRoot ? parentMatrix : state->matrix;
+	m.translate(-state->scrollRect.Xmin,-state->scrollRect.Ymin);
+	if (!isRoot)
+		m = parentMatrix.multiplyMatrix(m);
+	if (!surface->hasDamageBounds || m != surface->damageMatrix)
+		changed=true;
+
+	RectF bounds = state->bounds * m;
+	bool childchanged = false;
+	for (auto child : state->childrenlist)
+	{
+		if (collectDamage(child.getPtr(), m, initialMatrix, false))
+			childchanged=true;
+		if (child->hasDamageBounds)
+			bounds = bounds._union(child->damageBounds);
+	}
+	if (!state->mask.isNull())
+	{
+		// the mask is rendered relative to the masked surface
+		if (collectDamage(state->mask.getPtr(), m, initialMatrix, false))
+			childchanged=true;
+	}
+	if (!state->filters.empty())
+	{
+		number_t filterborder = state->maxfilterborder;
+		bounds.min.x -= filterborder*initialMatrix.getScaleX();
+		bounds.max.x += filterborder*initialMatrix.getScaleX();
+		bounds.min.y -= filterborder*initialMatrix.getScaleY();
+		bounds.max.y += filterborder*initialMatrix.getScaleY();
+		// filters may spread a change of a child over the whole surface
+		if (childchanged)
+			changed=true;
+	}
+	if (changed)
+	{
+		if (surface->hasDamageBounds)
+			addDamage(surface->damageBounds);
+		addDamage(bounds);
+	}
+	surface->damageBounds=bounds;
+	surface->damageMatrix=m;
+	surface->hasDamageBounds=true;
+	return changed || childchanged;
+}
+
+void RenderThread::setScissorRect(int32_t x, int32_t y, int32_t width, int32_t height)
+{
+	scissorRectActive=true;
+	scissorX=x;
+	scissorY=y;
+	scissorWidth=width;
+	scissorHeight=height;
+	restoreScissor();
+}
+
+void RenderThread::resetScissorRect()
+{
+	scissorRectActive=false;
+	restoreScissor();
+}
+
+void RenderThread::restoreScissor()
+{
+	bool damagescissor = damageScissorActive && filterframebufferstack.empty();
+	if (scissorRectActive)
+	{
+		int32_t x = scissorX;
+		int32_t y = scissorY;
+		int32_t width = scissorWidth;
+		int32_t height = scissorHeight;
+		if (damagescissor)
+		{
+			int32_t x2 = min(x+width,damageScissorX+damageScissorWidth);
+			int32_t y2 = min(y+height,damageScissorY+damageScissorHeight);
+			x = max(x,damageScissorX);
+			y = max(y,damageScissorY);
+			width = max(0,x2-x);
+			height = max(0,y2-y);
+		}
+		engineData->exec_glScissor(x,y,width,height);
+	}
+	else if (damagescissor)
+		engineData->exec_glScissor(damageScissorX,damageScissorY,damageScissorWidth,damageScissorHeight);
+	else
+		engineData->exec_glDisable_GL_SCISSOR_TEST();
+}
+
+bool RenderThread::coreRendering()
 {
 	Locker l(mutexRendering);
+	flushAtlasUploads();
 	baseFramebuffer=0;
 	baseRenderbuffer=0;
 	flipvertical=true;
-	engineData->exec_glBindFramebuffer_GL_FRAMEBUFFER(0);
-	engineData->exec_glFrontFace(false);
-	engineData->exec_glDrawBuffer_GL_BACK();
-	if (!m_sys->stage->renderStage3D()) // no need to clear the backbuffer when using Stage3D
-	{
-		//Clear the back buffer
-		RGB bg=m_sys->mainClip->getBackground();
-		engineData->exec_glClearColor(bg.Red/255.0F,bg.Green/255.0F,bg.Blue/255.0F,1);
-		engineData->exec_glClear(CLEARMASK(CLEARMASK::COLOR|CLEARMASK::DEPTH|CLEARMASK::STENCIL));
-	}
-	engineData->exec_glUseProgram(gpu_program);
-	lsglLoadIdentity();
-	setMatrixUniform(LSGL_MODELVIEW);
+	damageScissorActive=false;
+	redrawnPixels=0;
+	bool renderstage3d = m_sys->stage->renderStage3D();
 	Vector2f scale = getScale();
 	MATRIX initialMatrix;
 	initialMatrix.scale(scale.x, scale.y);
-	m_sys->stage->render(*this,&initialMatrix);
+	RGB bg=m_sys->mainClip->getBackground();
+
+	if (!renderstage3d && m_sys->partialRedraw && checkStageFramebuffer())
+	{
+		hasDamage=false;
+		collectDamage(m_sys->stage->getCachedSurface().getPtr(), initialMatrix, initialMatrix, true);
+		if (bg.toUInt() != lastBackground)
+			fullRedrawNeeded=true;
+		bool fullredraw = fullRedrawNeeded;
+		fullRedrawNeeded=false;
+		lastBackground=bg.toUInt();
+		if (hasDamage && !fullredraw)
+		{
+			// convert to window coordinates, the damaged rectangle is extended by one pixel to account for antialiasing
+			int32_t x1 = max(0,int32_t(floor(damagedRect.min.x))-1+offsetX);
+			int32_t x2 = min(int32_t(windowWidth),int32_t(ceil(damagedRect.max.x))+1+offsetX);
+			int32_t y1 = max(0,int32_t(floor(damagedRect.min.y))-1+offsetY);
+			int32_t y2 = min(int32_t(windowHeight),int32_t(ceil(damagedRect.max.y))+1+offsetY);
+			if (x2 <= x1 || y2 <= y1)
+				hasDamage=false;
+			else if (uint64_t(x2-x1)*uint64_t(y2-y1) > PARTIAL_REDRAW_MAX_AREA*windowWidth*windowHeight)
+				fullredraw=true;
+			else
+			{
+				damageScissorX=x1;
+				damageScissorY=windowHeight-y2;
+				damageScissorWidth=x2-x1;
+				damageScissorHeight=y2-y1;
+				damageScissorActive=true;
+			}
+		}
+		bool hasOverlay = !debugRects.empty() || m_sys->showProfilingData || inSettings || screenshotneeded;
+		if (!fullredraw && !damageScissorActive && !hasOverlay)
+		{
+			debugRects.clear();
+			while (!texturesToDelete.empty())
+			{
+				uint32_t id = texturesToDelete.front();
+				engineData->exec_glDeleteTextures(1,&id);
+				texturesToDelete.pop_front();
+			}
+			return false;
+		}
+		if (fullredraw || damageScissorActive)
+		{
+			baseFramebuffer=stageFramebuffer;
+			baseRenderbuffer=stageRenderbuffer;
+			engineData->exec_glBindFramebuffer_GL_FRAMEBUFFER(stageFramebuffer);
+			engineData->exec_glBindRenderbuffer_GL_RENDERBUFFER(stageRenderbuffer);
+			engineData->exec_glFrontFace(false);
+			scissorRectActive=false;
+			restoreScissor();
+			engineData->exec_glClearColor(bg.Red/255.0F,bg.Green/255.0F,bg.Blue/255.0F,1);
+			engineData->exec_glClear(CLEARMASK(CLEARMASK::COLOR|CLEARMASK::DEPTH|CLEARMASK::STENCIL));
+			engineData->exec_glUseProgram(gpu_program);
+			resetViewPort();
+			m_sys->stage->render(*this,&initialMatrix);
+			redrawnPixels = damageScissorActive ? uint64_t(damageScissorWidth)*uint64_t(damageScissorHeight) : uint64_t(windowWidth)*uint64_t(windowHeight);
+			damageScissorActive=false;
+			engineData->exec_glDisable_GL_SCISSOR_TEST();
+			baseFramebuffer=0;
+			baseRenderbuffer=0;
+		}
+		// copy the stage to the back buffer
+		engineData->exec_glBindFramebuffer_GL_FRAMEBUFFER(0);
+		engineData->exec_glFrontFace(false);
+		engineData->exec_glDrawBuffer_GL_BACK();
+		engineData->exec_glClearColor(0,0,0,0);
+		engineData->exec_glClear(CLEARMASK(CLEARMASK::COLOR|CLEARMASK::DEPTH|CLEARMASK::STENCIL));
+		engineData->exec_glUseProgram(gpu_program);
+		setViewPort(windowWidth,windowHeight,false);
+		lsglLoadIdentity();
+		setMatrixUniform(LSGL_MODELVIEW);
+		renderTextureToFrameBuffer(stageTextureID,windowWidth,windowHeight,nullptr,nullptr,false,false);
+		resetViewPort();
+		if (m_sys->showRedrawRegions && redrawnPixels && redrawnPixels < uint64_t(windowWidth)*uint64_t(windowHeight))
+		{
+			MATRIX m;
+			m.scale(1.0/scaleX,1.0/scaleY);
+			drawDebugRect(damageScissorX-offsetX,windowHeight-damageScissorY-damageScissorHeight-offsetY,damageScissorWidth,damageScissorHeight,m);
+		}
+	}
+	else
+	{
+		// the content of the stage framebuffer is no longer up to date
+		fullRedrawNeeded=true;
+		engineData->exec_glBindFramebuffer_GL_FRAMEBUFFER(0);
+		engineData->exec_glFrontFace(false);
+		engineData->exec_glDrawBuffer_GL_BACK();
+		if (!renderstage3d) // no need to clear the backbuffer when using Stage3D
+		{
+			//Clear the back buffer
+			engineData->exec_glClearColor(bg.Red/255.0F,bg.Green/255.0F,bg.Blue/255.0F,1);
+			engineData->exec_glClear(CLEARMASK(CLEARMASK::COLOR|CLEARMASK::DEPTH|CLEARMASK::STENCIL));
+		}
+		engineData->exec_glUseProgram(gpu_program);
+		lsglLoadIdentity();
+		setMatrixUniform(LSGL_MODELVIEW);
+		m_sys->stage->render(*this,&initialMatrix);
+		redrawnPixels = uint64_t(windowWidth)*uint64_t(windowHeight);
+	}
+	if (m_sys->showRedrawRegions)
+	{
+		char buf[64];
+		snprintf(buf,64,"redrawn pixels: %llu",(unsigned long long)redrawnPixels);
+		drawDebugText(buf,Vector2f(10,20));
+	}
 
 	for (auto it : debugRects)
 		drawDebugRect(it.pos.x, it.pos.y, it.size.x, it.size.y, it.matrix, it.onlyTranslate);
 	debugRects.clear();
 
 	if(m_sys->showProfilingData)
+	{
 		plotProfilingData();
+		uint32_t atlasPages=0;
+		uint64_t atlasUsed=0;
+		uint64_t atlasSize=0;
+		{
+			Locker l(mutexLargeTexture);
+			for (auto it=largeTextures.begin(); it!=largeTextures.end(); it++)
+			{
+				if (!it->atlas)
+					continue;
+				atlasPages++;
+				atlasUsed+=it->atlas->getUsedArea();
+				atlasSize+=uint64_t(it->size)*uint64_t(it->size);
+			}
+		}
+		char buf[128];
+		snprintf(buf,128,"texture uploads: %llu bytes, binds: %u, atlas pages: %u (%u%% used)",
+				 (unsigned long long)textureUploadBytes,textureBinds,atlasPages,atlasSize ? uint32_t(atlasUsed*100/atlasSize) : 0);
+		drawDebugText(buf,Vector2f(10,40));
+		snprintf(buf,128,"draw calls: %u, batches: %u, surfaces per batch: %.1f",
+				 drawCalls,batchCount,batchCount ? float(batchedSurfaces)/float(batchCount) : 0.0f);
+		drawDebugText(buf,Vector2f(10,60));
+		snprintf(buf,128,"vm wait: %.2f ms, render wait: %.2f ms",
+				 double(vmWaitTime)/1000.0,double(renderWaitTime)/1000.0);
+		drawDebugText(buf,Vector2f(10,80));
+	}
+	if (screenshotToFile)
+		LOG(LOG_INFO,"screenshot frame: draw calls: "<<drawCalls<<", batches: "<<batchCount<<", batched surfaces: "<<batchedSurfaces);
+	textureUploadBytes=0;
+	textureBinds=0;
+	drawCalls=0;
+	batchCount=0;
+	batchedSurfaces=0;
+	vmWaitTime=0;
+	renderWaitTime=0;
 
 	while (!texturesToDelete.empty())
 	{
@@ -1251,6 +1635,7 @@ void RenderThread::coreRendering()
 		texturesToDelete.pop_front();
 	}
 	handleGLErrors();
+	return true;
 }
 
 //Renders the error message which caused the VM to stop.
@@ -1345,6 +1730,8 @@ ITextureUploadable* RenderThread::getUploadJob()
 
 void RenderThread::draw(bool force)
 {
+	if (force) // the window content may have been lost
+		fullRedrawNeeded=true;
 	if(renderNeeded && !force) //A rendering is already queued
 		return;
 	renderNeeded=true;
@@ -1367,6 +1754,11 @@ void RenderThread::releaseTexture(const TextureChunk& chunk)
 	uint32_t numberOfBlocks=blocksW*blocksH;
 	Locker l(mutexLargeTexture);
 	LargeTexture& tex=largeTextures[chunk.texId];
+	if (chunk.isAtlasItem)
+	{
+		tex.atlas->release(chunk.atlasX, chunk.atlasY, chunk.atlasWidth, chunk.atlasHeight);
+		return;
+	}
 	for(uint32_t i=0;i<numberOfBlocks;i++)
 	{
 		uint32_t bitOffset=chunk.chunks[i];
@@ -1375,7 +1767,7 @@ void RenderThread::releaseTexture(const TextureChunk& chunk)
 	}
 }
 
-uint32_t RenderThread::allocateNewGLTexture() const
+uint32_t RenderThread::allocateNewGLTexture(uint32_t size) const
 {
 	//Set up the huge texture
 	uint32_t tmp;
@@ -1386,7 +1778,7 @@ uint32_t RenderThread::allocateNewGLTexture() const
 	engineData->exec_glTexParameteri_GL_TEXTURE_2D_GL_TEXTURE_MIN_FILTER_GL_LINEAR();
 	engineData->exec_glTexParameteri_GL_TEXTURE_2D_GL_TEXTURE_MAG_FILTER_GL_LINEAR();
 	//Allocate the texture
-	engineData->exec_glTexImage2D_GL_TEXTURE_2D_GL_UNSIGNED_INT_8_8_8_8_HOST(0, largeTextureSize, largeTextureSize, 0, 0);
+	engineData->exec_glTexImage2D_GL_TEXTURE_2D_GL_UNSIGNED_INT_8_8_8_8_HOST(0, size, size, 0, 0);
 	if(handleGLErrors())
 	{
 		LOG(LOG_ERROR,"Can't allocate large texture... Aborting");
@@ -1406,7 +1798,7 @@ RenderThread::LargeTexture& RenderThread::allocateNewTexture(bool direct)
 	uint32_t bitmapSize=(largeTextureSize/CHUNKSIZE)*(largeTextureSize/CHUNKSIZE)/8;
 	uint8_t* bitmap=new uint8_t[bitmapSize];
 	memset(bitmap,0,bitmapSize);
-	largeTextures.emplace_back(bitmap);
+	largeTextures.emplace_back(bitmap,largeTextureSize);
 	if (direct)
 		handleNewTexture();
 	return largeTextures.back();
@@ -1504,12 +1896,19 @@ TextureChunk RenderThread::allocateTexture(uint32_t w, uint32_t h, bool compact,
 	Locker l(mutexLargeTexture);
 	//Find the number of blocks needed for the given w and h
 	TextureChunk ret(w, h);
+	if(!compact && w+2<=ATLAS_MAX_ITEM_SIZE && h+2<=ATLAS_MAX_ITEM_SIZE)
+	{
+		allocateOnAtlas(ret, direct);
+		return ret;
+	}
 	uint32_t blocksW=(ret.width+CHUNKSIZE_REAL-1)/CHUNKSIZE_REAL;
 	uint32_t blocksH=(ret.height+CHUNKSIZE_REAL-1)/CHUNKSIZE_REAL;
 	//Try to find a good place in the available textures
 	uint32_t index=0;
 	for(index=0;index<largeTextures.size();index++)
 	{
+		if(largeTextures[index].atlas)
+			continue;
 		if(compact)
 		{
 			if(allocateChunkOnTextureCompact(largeTextures[index], ret, blocksW, blocksH))
@@ -1545,13 +1944,69 @@ TextureChunk RenderThread::allocateTexture(uint32_t w, uint32_t h, bool compact,
 	return ret;
 }
 
+void RenderThread::allocateOnAtlas(TextureChunk& ret, bool direct)
+{
+	// mutexLargeTexture is held by allocateTexture()
+	uint32_t w=ret.width+2;
+	uint32_t h=ret.height+2;
+	uint32_t x,y;
+	uint32_t index;
+	for(index=0;index<largeTextures.size();index++)
+	{
+		if(largeTextures[index].atlas && largeTextures[index].atlas->allocate(w,h,x,y))
+			break;
+	}
+	if(index==largeTextures.size())
+	{
+		uint32_t size=min(largeTextureSize,uint32_t(ATLAS_PAGE_SIZE));
+		largeTextures.emplace_back(nullptr,size,new TextureAtlas(size));
+		if (direct)
+			handleNewTexture();
+		else
+			newTextureNeeded=true;
+		largeTextures[index].atlas->allocate(w,h,x,y);
+	}
+	ret.texId=index;
+	ret.isAtlasItem=true;
+	ret.atlasX=x;
+	ret.atlasY=y;
+	ret.atlasWidth=w;
+	ret.atlasHeight=h;
+}
+
+void RenderThread::flushAtlasUploads()
+{
+	Locker l(mutexLargeTexture);
+	std::vector<TextureAtlas::Upload> uploads;
+	for(auto it=largeTextures.begin();it!=largeTextures.end();it++)
+	{
+		if(!it->atlas || !it->atlas->hasPendingUploads() || it->id==(uint32_t)-1)
+			continue;
+		// all pending uploads of a page are done with one bind
+		uploads.clear();
+		it->atlas->takeUploads(uploads);
+		engineData->exec_glActiveTexture_GL_TEXTURE0(SAMPLEPOSITION::SAMPLEPOS_STANDARD);
+		engineData->exec_glBindTexture_GL_TEXTURE_2D(it->id);
+		textureBinds++;
+		for(auto itup=uploads.begin();itup!=uploads.end();itup++)
+		{
+			engineData->exec_glTexSubImage2D_GL_TEXTURE_2D(0, itup->x, itup->y, itup->width, itup->height, itup->data.data());
+			textureUploadBytes+=itup->data.size();
+		}
+	}
+}
+
 void RenderThread::loadChunkBGRA(const TextureChunk& chunk, uint32_t w, uint32_t h, uint8_t* data)
 {
 	//Fast bailout if the TextureChunk is not valid
 	if(chunk.chunks==nullptr || data == nullptr)
 		return;
-	engineData->exec_glActiveTexture_GL_TEXTURE0(SAMPLEPOSITION::SAMPLEPOS_STANDARD);
-	engineData->exec_glBindTexture_GL_TEXTURE_2D(largeTextures[chunk.texId].id);
+	if(!chunk.isAtlasItem)
+	{
+		engineData->exec_glActiveTexture_GL_TEXTURE0(SAMPLEPOSITION::SAMPLEPOS_STANDARD);
+		engineData->exec_glBindTexture_GL_TEXTURE_2D(largeTextures[chunk.texId].id);
+		textureBinds++;
+	}
 	//TODO: Detect continuos
 	//The size is ok if doesn't grow over the allocated size
 	//this allows some alignment freedom
@@ -1567,8 +2022,8 @@ void RenderThread::loadChunkBGRA(const TextureChunk& chunk, uint32_t w, uint32_t
 			break;
 		uint32_t sizeX=min(int(w-curX),CHUNKSIZE_REAL)+2;
 		uint32_t sizeY=min(int(h-curY),CHUNKSIZE_REAL)+2;
-		const uint32_t blockX=((chunk.chunks[i]%blocksPerSide)*CHUNKSIZE);
-		const uint32_t blockY=((chunk.chunks[i]/blocksPerSide)*CHUNKSIZE);
+		const uint32_t blockX=chunk.isAtlasItem ? chunk.atlasX : ((chunk.chunks[i]%blocksPerSide)*CHUNKSIZE);
+		const uint32_t blockY=chunk.isAtlasItem ? chunk.atlasY : ((chunk.chunks[i]/blocksPerSide)*CHUNKSIZE);
 
 		// copy chunk data
 		for(uint32_t j=1;j<sizeY-1;j++) {
@@ -1592,7 +2047,15 @@ void RenderThread::loadChunkBGRA(const TextureChunk& chunk, uint32_t w, uint32_t
 		memcpy(data_clamp, data_clamp+4*sizeX, sizeX*4);
 		// clamp bottom border to edge
 		memcpy(data_clamp+(sizeY-1)*sizeX*4, data_clamp+(sizeY-2)*sizeX*4, sizeX*4);
+		if(chunk.isAtlasItem)
+		{
+			// uploaded together with the other pending uploads of the page in flushAtlasUploads()
+			Locker l(mutexLargeTexture);
+			largeTextures[chunk.texId].atlas->addUpload(blockX, blockY, sizeX, sizeY, data_clamp);
+			continue;
+		}
 		engineData->exec_glTexSubImage2D_GL_TEXTURE_2D(0, blockX, blockY, sizeX, sizeY, data_clamp);
+		textureUploadBytes+=sizeX*sizeY*4;
 	}
 }
 void RenderThread::renderDisplayObjectToBimapContainer(_NR<DisplayObject> o, const MATRIX &initialMatrix, bool smoothing, AS_BLENDMODE blendMode, ColorTransformBase *ct, _NR<BitmapContainer> bm)
@@ -50,10 +50,13 @@ private:
 	void commonGLResize();
 	void commonGLDeinit();
 	ITextureUploadable* prevUploadJob;
-	uint32_t allocateNewGLTexture() const;
+	uint32_t allocateNewGLTexture(uint32_t size) const;
 	LargeTexture& allocateNewTexture(bool direct);
 	bool allocateChunkOnTextureCompact(LargeTexture& tex, TextureChunk& ret, uint32_t blocksW, uint32_t blocksH);
 	bool allocateChunkOnTextureSparse(LargeTexture& tex, TextureChunk& ret, uint32_t blocksW, uint32_t blocksH);
+	void allocateOnAtlas(TextureChunk& ret, bool direct);
+	// uploads the queued pixels of all atlas pages, must be called before rendering
+	void flushAtlasUploads();
 	//Possible events to be handled
 	//TODO: pad to avoid false sharing on the cache lines
 	volatile bool renderNeeded;
@@ -88,14 +91,28 @@ private:
 	ITextureUploadable* getUploadJob();
 	/*
 		Common code to handle the core of the rendering
-		returns true if at least one of the displayobjects on the stage couldn't be rendered becaus of an AsyncDrawJob not done yet
+		returns false if nothing changed since the last frame and there is no need to swap buffers
 	*/
-	void coreRendering();
+	bool coreRendering();
 	void plotProfilingData();
 	Semaphore initialized;
+	/*
+		The surface updates of a frame are passed from the vm thread to the render thread through three buffers:
+		the vm thread fills the building buffer, publishes it as ready buffer at the end of the frame,
+		and the render thread takes the ready buffer as rendering buffer and applies it.
+		mutexRefreshSurfaces only protects swapping the buffer indices, so neither thread waits while the other one is working on its buffer.
+		refreshNeeded is set while the ready buffer has not been taken by the render thread
+	*/
 	volatile bool refreshNeeded;
 	Mutex mutexRefreshSurfaces;
-	std::list<RefreshableSurface> surfacesToRefresh;
+	std::list<RefreshableSurface> refreshBuffers[3];
+	uint32_t buildingRefreshBuffer;
+	uint32_t readyRefreshBuffer;
+	uint32_t renderingRefreshBuffer;
+	// time (in microseconds) the vm thread was blocked by the render thread since the last frame
+	ACQUIRE_RELEASE_VARIABLE(uint64_t, vmWaitTime);
+	// time (in microseconds) the render thread waited for work since the last frame
+	uint64_t renderWaitTime;
 
 	volatile bool renderToBitmapContainerNeeded;
 	Mutex mutexRenderToBitmapContainer;
@@ -112,6 +129,42 @@ private:
 		bool onlyTranslate;
 	};
 	std::list<DebugRect> debugRects;
+
+	/*
+		The stage is rendered to this framebuffer and copied to the window afterwards.
+		As its content survives buffer swaps, only the damaged region has to be redrawn in the next frame
+	*/
+	uint32_t stageFramebuffer;
+	uint32_t stageRenderbuffer;
+	uint32_t stageTextureID;
+	uint32_t stageFramebufferWidth;
+	uint32_t stageFramebufferHeight;
+	volatile bool fullRedrawNeeded;
+	uint32_t lastBackground;
+	// union of the areas that changed since the last frame, in stage rendering coordinates
+	RectF damagedRect;
+	bool hasDamage;
+	// true while the stage is drawn with a scissor around the damaged region
+	bool damageScissorActive;
+	// damaged region in window coordinates (origin at the bottom left)
+	int32_t damageScissorX;
+	int32_t damageScissorY;
+	int32_t damageScissorWidth;
+	int32_t damageScissorHeight;
+	// scissor rectangle set by setScissorRect()
+	bool scissorRectActive;
+	int32_t scissorX;
+	int32_t scissorY;
+	int32_t scissorWidth;
+	int32_t scissorHeight;
+	uint64_t redrawnPixels;
+	uint64_t redrawnPixelsPerSecond;
+	// the pending screenshot is written to SystemState::screenshotFile
+	volatile bool screenshotToFile;
+	bool checkStageFramebuffer();
+	void deleteStageFramebuffer();
+	void addDamage(const RectF& r);
+	bool collectDamage(CachedSurface* surface, const MATRIX& parentMatrix, const MATRIX& initialMatrix, bool isRoot);
 public:
 	Mutex mutexRendering;
 	volatile bool screenshotneeded;
@@ -134,6 +187,8 @@ public:
 	void deinit();
 	bool doRender(ThreadProfile *profile=nullptr, Chronometer *chronometer=nullptr);
 	void generateScreenshot();
+	// writes the next rendered frame to SystemState::screenshotFile and shuts down
+	void requestScreenshotToFile();
 	bool isStarted() const { return status == STARTED; }
 	/**
 	 * @brief updates the arguments of a cachedSurface without recreating the texture
@@ -190,6 +245,22 @@ public:
 	void drawDebugText(const tiny_string& str, const Vector2f& pos);
 	void addDebugRect(DisplayObject* obj, const MATRIX& matrix, bool scaleDown = false, const Vector2f& pos = Vector2f(), const Vector2f& size = Vector2f(), bool onlyTranslate = false);
 	void removeDebugRect();
+	/*
+		sets the scissor rectangle (in window coordinates), limited to the damaged region of the stage if only that is redrawn
+	*/
+	void setScissorRect(int32_t x, int32_t y, int32_t width, int32_t height);
+	/*
+		removes the scissor rectangle, only the scissor for the damaged region remains active
+	*/
+	void resetScissorRect();
+	/*
+		applies the current scissor rectangle again, e.g. after nanovg has changed the scissor state
+	*/
+	void restoreScissor();
+	bool isDamageScissorActive() const { return damageScissorActive; }
+	bool isScissorRectActive() const { return scissorRectActive; }
+	// number of pixels of the stage redrawn in the last frame
+	uint64_t getRedrawnPixels() const { return redrawnPixels; }
 	void setViewPort(uint32_t w, uint32_t h, bool flip);
 	void resetViewPort();
 	void setModelView(const MATRIX& matrix);
@@ -225,10 +225,8 @@ void GLRenderContext::setupRenderingState(float alpha, const ColorTransformBase&
 	// set mask drawing indicator
 	engineData->exec_glUniform1f(maskUniform, isDrawingMask() ? 1 : 0);
 }
-void GLRenderContext::renderTextured(const TextureChunk& chunk, float alpha, COLOR_MODE colorMode,
-									 const ColorTransformBase& colortransform,
-									 bool isMask, float directMode, RGB directColor, SMOOTH_MODE smooth, const MATRIX& matrix, const RECT& scalingGrid,
-									 AS_BLENDMODE blendmode)
+void GLRenderContext::setupTexturedState(const TextureChunk& chunk, float alpha, COLOR_MODE colorMode, const ColorTransformBase& colortransform,
+										  float directMode, RGB directColor, SMOOTH_MODE smooth, AS_BLENDMODE blendmode)
 {
 	setupRenderingState(alpha,colortransform,smooth,blendmode);
 	float empty=0;
@@ -245,10 +243,49 @@ void GLRenderContext::renderTextured(const TextureChunk& chunk, float alpha, COL
 	engineData->exec_glUniform4f(directColorUniform,float(directColor.Red)/255.0,float(directColor.Green)/255.0,float(directColor.Blue)/255.0,1.0);
 
 	engineData->exec_glBindTexture_GL_TEXTURE_2D(largeTextures[chunk.texId].id);
+	textureBinds++;
+}
+void GLRenderContext::renderTextured(const TextureChunk& chunk, float alpha, COLOR_MODE colorMode,
+									 const ColorTransformBase& colortransform,
+									 bool isMask, float directMode, RGB directColor, SMOOTH_MODE smooth, const MATRIX& matrix, const RECT& scalingGrid,
+									 AS_BLENDMODE blendmode)
+{
 	assert(chunk.getNumberOfChunks()==((chunk.width+CHUNKSIZE_REAL-1)/CHUNKSIZE_REAL)*((chunk.height+CHUNKSIZE_REAL-1)/CHUNKSIZE_REAL));
+	bool useScalingGrid = (scalingGrid.Xmin!= 0 || scalingGrid.Xmax != 0 || scalingGrid.Ymin !=0 || scalingGrid.Ymax != 0)
+		&& (scalingGrid.Xmax-scalingGrid.Xmin)+abs(scalingGrid.Xmin) < chunk.width/chunk.xContentScale && (scalingGrid.Ymax-scalingGrid.Ymin)+abs(scalingGrid.Ymin) < chunk.height/chunk.yContentScale && matrix.getRotation()==0;
+	if (batchingEnabled && !useScalingGrid && !isDrawingMask())
+	{
+		// all quads of a batch share the uniforms, so any difference in the rendering state starts a new batch
+		if (batchSurfaceCount &&
+				(batchTexId != chunk.texId ||
+				 batchAlpha != alpha ||
+				 batchColorMode != colorMode ||
+				 !(batchColorTransform == colortransform) ||
+				 batchDirectMode != directMode ||
+				 batchDirectColor != directColor.toUInt() ||
+				 batchSmooth != smooth ||
+				 batchBlendMode != blendmode))
+			flushBatch();
+		if (!batchSurfaceCount)
+		{
+			setupTexturedState(chunk,alpha,colorMode,colortransform,directMode,directColor,smooth,blendmode);
+			batchTexId = chunk.texId;
+			batchAlpha = alpha;
+			batchColorMode = colorMode;
+			batchColorTransform = colortransform;
+			batchDirectMode = directMode;
+			batchDirectColor = directColor.toUInt();
+			batchSmooth = smooth;
+			batchBlendMode = blendmode;
+		}
+		renderpart(matrix,chunk,0,0,chunk.width,chunk.height,chunk.xOffset/chunk.xContentScale,chunk.yOffset/chunk.yContentScale,true);
+		batchSurfaceCount++;
+		return;
+	}
+	flushBatch();
+	setupTexturedState(chunk,alpha,colorMode,colortransform,directMode,directColor,smooth,blendmode);
 	
-	if ((scalingGrid.Xmin!= 0 || scalingGrid.Xmax != 0 || scalingGrid.Ymin !=0 || scalingGrid.Ymax != 0)
-		&& (scalingGrid.Xmax-scalingGrid.Xmin)+abs(scalingGrid.Xmin) < chunk.width/chunk.xContentScale && (scalingGrid.Ymax-scalingGrid.Ymin)+abs(scalingGrid.Ymin) < chunk.height/chunk.yContentScale && matrix.getRotation()==0)
+	if (useScalingGrid)
 	{
 		// rendering with scalingGrid
 
@@ -329,13 +366,51 @@ void GLRenderContext::renderTextured(const TextureChunk& chunk, float alpha, COL
 		engineData->exec_glTexParameteri_GL_TEXTURE_2D_GL_TEXTURE_MAG_FILTER_GL_LINEAR();
 	}
 }
-void GLRenderContext::renderpart(const MATRIX& matrix, const TextureChunk& chunk, float cropleft, float croptop, float cropwidth, float cropheight,float tx,float ty)
+void GLRenderContext::beginBatch()
 {
-	//Set matrix
-	float fmatrix[16];
-	matrix.get4DMatrix(fmatrix);
-	lsglLoadMatrixf(fmatrix);
+	batchingEnabled=true;
+}
+void GLRenderContext::endBatch()
+{
+	flushBatch();
+	batchingEnabled=false;
+}
+void GLRenderContext::flushBatch()
+{
+	if (!batchSurfaceCount)
+		return;
+	// the vertices are already transformed
+	lsglLoadIdentity();
 	setMatrixUniform(LSGL_MODELVIEW);
+	engineData->exec_glVertexAttribPointer(VERTEX_ATTRIB, 0, batchVertices.data(),FLOAT_2);
+	engineData->exec_glVertexAttribPointer(TEXCOORD_ATTRIB, 0, batchTexCoords.data(),FLOAT_2);
+	engineData->exec_glEnableVertexAttribArray(VERTEX_ATTRIB);
+	engineData->exec_glEnableVertexAttribArray(TEXCOORD_ATTRIB);
+	engineData->exec_glDrawArrays_GL_TRIANGLES( 0, batchVertices.size()/2);
+	engineData->exec_glDisableVertexAttribArray(VERTEX_ATTRIB);
+	engineData->exec_glDisableVertexAttribArray(TEXCOORD_ATTRIB);
+	drawCalls++;
+	batchCount++;
+	batchedSurfaces+=batchSurfaceCount;
+	if (batchSmooth != SMOOTH_MODE::SMOOTH_NONE)
+	{
+		engineData->exec_glTexParameteri_GL_TEXTURE_2D_GL_TEXTURE_MIN_FILTER_GL_LINEAR();
+		engineData->exec_glTexParameteri_GL_TEXTURE_2D_GL_TEXTURE_MAG_FILTER_GL_LINEAR();
+	}
+	batchVertices.clear();
+	batchTexCoords.clear();
+	batchSurfaceCount=0;
+}
+void GLRenderContext::renderpart(const MATRIX& matrix, const TextureChunk& chunk, float cropleft, float croptop, float cropwidth, float cropheight,float tx,float ty, bool batched)
+{
+	//Set matrix
+	if (!batched)
+	{
+		float fmatrix[16];
+		matrix.get4DMatrix(fmatrix);
+		lsglLoadMatrixf(fmatrix);
+		setMatrixUniform(LSGL_MODELVIEW);
+	}
 	
 	uint32_t firstchunkhorizontal = floor(float(cropleft)/float(CHUNKSIZE_REAL));
 	uint32_t firstchunkvertical = floor(float(croptop)/float(CHUNKSIZE_REAL));
@@ -350,7 +425,8 @@ void GLRenderContext::renderpart(const MATRIX& matrix, const TextureChunk& chunk
 	float *vertex_coords = g_newa(float,realchunkcount*12);
 	float *texture_coords = g_newa(float,realchunkcount*12);
 	
-	const uint32_t blocksPerSide=largeTextureSize/CHUNKSIZE;
+	const uint32_t textureSize=largeTextures[chunk.texId].size;
+	const uint32_t blocksPerSide=textureSize/CHUNKSIZE;
 	float realchunkwidth = cropwidth;
 	float realchunkheight = cropheight;
 	uint32_t curChunk=firstchunkhorizontal+firstchunkvertical*horizontalchunks;
@@ -382,18 +458,18 @@ void GLRenderContext::renderpart(const MATRIX& matrix, const TextureChunk& chunk
 		for(uint32_t j=firstchunkhorizontal;j<lastchunkhorizontal;j++)
 		{
 			const uint32_t curChunkId=chunk.chunks[curChunk];
-			const uint32_t blockX=((curChunkId%blocksPerSide)*CHUNKSIZE);
-			const uint32_t blockY=((curChunkId/blocksPerSide)*CHUNKSIZE);
+			const uint32_t blockX=chunk.isAtlasItem ? chunk.atlasX : ((curChunkId%blocksPerSide)*CHUNKSIZE);
+			const uint32_t blockY=chunk.isAtlasItem ? chunk.atlasY : ((curChunkId/blocksPerSide)*CHUNKSIZE);
 			const uint32_t availX=min(availXForTexture,uint32_t(CHUNKSIZE_REAL));
 			availXForTexture-=availX;
 			float startU=blockX + 1 + startULeft;
-			startU/=float(largeTextureSize);
+			startU/=float(textureSize);
 			float startV=blockY + 1 + startVtop;
-			startV/=float(largeTextureSize);
+			startV/=float(textureSize);
 			float endU=blockX+availX+1;
-			endU/=float(largeTextureSize);
+			endU/=float(textureSize);
 			float endV=blockY+availY+1;
-			endV/=float(largeTextureSize);
+			endV/=float(textureSize);
 
 			float widthconsumed;
 			if (startULeft && (realchunkwidth + leftstart > CHUNKSIZE_REAL))
@@ -446,6 +522,18 @@ void GLRenderContext::renderpart(const MATRIX& matrix, const TextureChunk& chunk
 		startVtop = 0;
 		startY = endY;
 	}
+	if (batched)
+	{
+		for (uint32_t i = 0; i < chunkrendercount*12; i+=2)
+		{
+			number_t x,y;
+			matrix.multiply2D(vertex_coords[i],vertex_coords[i+1],x,y);
+			batchVertices.push_back(x);
+			batchVertices.push_back(y);
+		}
+		batchTexCoords.insert(batchTexCoords.end(),texture_coords,texture_coords+chunkrendercount*12);
+		return;
+	}
 	engineData->exec_glVertexAttribPointer(VERTEX_ATTRIB, 0, vertex_coords,FLOAT_2);
 	engineData->exec_glVertexAttribPointer(TEXCOORD_ATTRIB, 0, texture_coords,FLOAT_2);
 	engineData->exec_glEnableVertexAttribArray(VERTEX_ATTRIB);
@@ -453,6 +541,7 @@ void GLRenderContext::renderpart(const MATRIX& matrix, const TextureChunk& chunk
 	engineData->exec_glDrawArrays_GL_TRIANGLES( 0, chunkrendercount*6);
 	engineData->exec_glDisableVertexAttribArray(VERTEX_ATTRIB);
 	engineData->exec_glDisableVertexAttribArray(TEXCOORD_ATTRIB);
+	drawCalls++;
 }
 
 int GLRenderContext::errorCount = 0;
@@ -34,6 +34,7 @@ enum VertexAttrib { VERTEX_ATTRIB=0, COLOR_ATTRIB, TEXCOORD_ATTRIB};
 
 class Rectangle;
 class EngineData;
+class TextureAtlas;
 
 struct Transform2D
 {
@@ -127,6 +128,13 @@ public:
 		inMaskRendering=false;
 		maskActive=true;
 	}
+	/*
+	 * Between beginBatch() and endBatch() renderTextured() may defer drawing and merge
+	 * consecutive calls with the same rendering state into one draw call.
+	 * The caller has to make sure that nothing else changes the rendering state in between
+	 */
+	virtual void beginBatch() {}
+	virtual void endBatch() {}
 	bool isDrawingMask() const { return inMaskRendering; }
 	bool isMaskActive() const { return maskActive; }
 };
@@ -173,20 +181,54 @@ protected:
 	public:
 		uint32_t id;
 		uint8_t* bitmap;
-		LargeTexture(uint8_t* b):id(-1),bitmap(b){}
+		uint32_t size;
+		// set for atlas pages, which contain small textures instead of blocks
+		TextureAtlas* atlas;
+		LargeTexture(uint8_t* b, uint32_t s, TextureAtlas* a=nullptr):id(-1),bitmap(b),size(s),atlas(a){}
 		~LargeTexture(){/*delete[] bitmap;*/}
 	};
 	std::vector<LargeTexture> largeTextures;
+	// statistics shown in the profiling overlay, reset after every frame
+	uint64_t textureUploadBytes;
+	uint32_t textureBinds;
+	uint32_t drawCalls;
+	uint32_t batchCount;
+	uint32_t batchedSurfaces;
+
+	/* Batching of textured quads */
+	bool batchingEnabled;
+	// rendering state of the quads collected in batchVertices/batchTexCoords
+	uint32_t batchSurfaceCount;
+	uint32_t batchTexId;
+	float batchAlpha;
+	COLOR_MODE batchColorMode;
+	ColorTransformBase batchColorTransform;
+	float batchDirectMode;
+	uint32_t batchDirectColor;
+	SMOOTH_MODE batchSmooth;
+	AS_BLENDMODE batchBlendMode;
+	// vertices are already transformed, the batch is drawn with the identity modelview matrix
+	std::vector<float> batchVertices;
+	std::vector<float> batchTexCoords;
+	void flushBatch();
 
 	~GLRenderContext(){}
-	void renderpart(const MATRIX& matrix, const TextureChunk& chunk, float cropleft, float croptop, float cropwidth, float cropheight, float tx, float ty);
+	void setupTexturedState(const TextureChunk& chunk, float alpha, COLOR_MODE colorMode, const ColorTransformBase& colortransform,
+			float directMode, RGB directColor, SMOOTH_MODE smooth, AS_BLENDMODE blendmode);
+	/*
+	 * Renders a part of the chunk.
+	 * If batched is true, the vertices are transformed by matrix and added to the current batch instead
+	 */
+	void renderpart(const MATRIX& matrix, const TextureChunk& chunk, float cropleft, float croptop, float cropwidth, float cropheight, float tx, float ty, bool batched=false);
 public:
 	enum LSGL_MATRIX {LSGL_PROJECTION=0, LSGL_MODELVIEW};
 	/*
 	 * Uploads the current matrix as the specified type.
 	 */
 	void setMatrixUniform(LSGL_MATRIX m) const;
-	GLRenderContext() : RenderContext(),maskCount(0),engineData(nullptr), largeTextureSize(0)
+	GLRenderContext() : RenderContext(),maskCount(0),engineData(nullptr), largeTextureSize(0), textureUploadBytes(0), textureBinds(0)
+	  ,drawCalls(0),batchCount(0),batchedSurfaces(0),batchingEnabled(false),batchSurfaceCount(0),batchTexId(UINT32_MAX),batchAlpha(1.0)
+	  ,batchColorMode(RGB_MODE),batchDirectMode(0.0),batchDirectColor(0),batchSmooth(SMOOTH_MODE::SMOOTH_ANTIALIAS),batchBlendMode(BLENDMODE_NORMAL)
 	{
 	}
 	void SetEngineData(EngineData* data) { engineData = data;}
@@ -206,6 +248,8 @@ public:
 	void popMask() override;
 	void deactivateMask() override;
 	void activateMask() override;
+	void beginBatch() override;
+	void endBatch() override;
 	
 	bool getFlipVertical() const { return flipvertical; }
 	void resetCurrentFrameBuffer();
@@ -0,0 +1,102 @@
+/**************************************************************************
+    Lightspark, a free flash player implementation
+
+    Copyright (C) 2024  Ludger Krämer <dbluelle@onlinehome.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <tuple>
+#include "backends/shapecache.h"
+#include "logger.h"
+
+using namespace std;
+using namespace lightspark;
+
+bool ShapeRasterCache::Key::operator<(const Key& r) const
+{
+	return std::tie(filltokens,stroketokens,width,height,xscale,yscale,scaling,xstart,ystart,isMask,smoothing)
+		< std::tie(r.filltokens,r.stroketokens,r.width,r.height,r.xscale,r.yscale,r.scaling,r.xstart,r.ystart,r.isMask,r.smoothing);
+}
+
+ShapeRasterCache::ShapeRasterCache(uint64_t _maxSize):maxSize(_maxSize),totalSize(0),hits(0),misses(0)
+{
+}
+
+int64_t ShapeRasterCache::quantizeScale(number_t scale)
+{
+	return llround(scale*SHAPECACHE_SCALE_STEPS);
+}
+
+void ShapeRasterCache::evict(uint64_t neededSize)
+{
+	while (!lru.empty() && totalSize + neededSize > maxSize)
+	{
+		auto it = entries.find(lru.back());
+		assert(it != entries.end());
+		totalSize -= it->second.data.size();
+		entries.erase(it);
+		lru.pop_back();
+	}
+}
+
+uint8_t* ShapeRasterCache::lookup(const Key& key, uint32_t size)
+{
+	Locker l(mutex);
+	auto it = entries.find(key);
+	if (it == entries.end() || it->second.data.size() != size)
+	{
+		misses++;
+		return nullptr;
+	}
+	hits++;
+	// move to the front of the lru list
+	lru.splice(lru.begin(),lru,it->second.lruPosition);
+	uint8_t* ret = new uint8_t[size];
+	memcpy(ret,it->second.data.data(),size);
+	return ret;
+}
+
+void ShapeRasterCache::insert(const Key& key, _NR<tokenListRef> filltokens, _NR<tokenListRef> stroketokens, const uint8_t* data, uint32_t size)
+{
+	// don't let a single huge shape push out everything else
+	if (size > maxSize/4)
+		return;
+	Locker l(mutex);
+	auto it = entries.find(key);
+	if (it != entries.end())
+	{
+		// rasterized concurrently by another thread
+		return;
+	}
+	evict(size);
+	lru.push_front(key);
+	Entry& e = entries[key];
+	e.filltokens = filltokens;
+	e.stroketokens = stroketokens;
+	e.data.assign(data,data+size);
+	e.lruPosition = lru.begin();
+	totalSize += size;
+}
+
+void ShapeRasterCache::clear()
+{
+	Locker l(mutex);
+	entries.clear();
+	lru.clear();
+	totalSize = 0;
+}
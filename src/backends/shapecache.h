@@ -0,0 +1,105 @@
+/**************************************************************************
+    Lightspark, a free flash player implementation
+
+    Copyright (C) 2024  Ludger Krämer <dbluelle@onlinehome.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef BACKENDS_SHAPECACHE_H
+#define BACKENDS_SHAPECACHE_H 1
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <vector>
+#include "backends/geometry.h"
+#include "smartrefs.h"
+#include "threading.h"
+#include "compat.h"
+
+namespace lightspark
+{
+
+// default memory limit of the rasterized shapes
+#define SHAPECACHE_MAX_SIZE (64*1024*1024)
+// scale factors are rounded to multiples of 1/SHAPECACHE_SCALE_STEPS
+#define SHAPECACHE_SCALE_STEPS 4096
+
+/*
+ * Caches the pixels rasterized by CairoTokenRenderer.
+ *
+ * Only read-only token lists (generated from DefineShape and
+ * DefineMorphShape tags) are cached, so all instances of a symbol that
+ * are displayed with the same scale share the rasterized result, and
+ * zoom animations that return to a previous scale don't rasterize the
+ * shape again. The least recently used entries are evicted when the
+ * size of the cached pixels exceeds the limit.
+ *
+ * All methods are thread safe.
+ */
+class ShapeRasterCache
+{
+public:
+	struct Key
+	{
+		const tokenListRef* filltokens;
+		const tokenListRef* stroketokens;
+		int32_t width;
+		int32_t height;
+		int64_t xscale;
+		int64_t yscale;
+		float scaling;
+		number_t xstart;
+		number_t ystart;
+		bool isMask;
+		bool smoothing;
+		bool operator<(const Key& r) const;
+	};
+private:
+	struct Entry
+	{
+		// keep the tokens alive, so their addresses can't be reused while the entry exists
+		_NR<tokenListRef> filltokens;
+		_NR<tokenListRef> stroketokens;
+		std::vector<uint8_t> data;
+		std::list<Key>::iterator lruPosition;
+	};
+	Mutex mutex;
+	std::map<Key, Entry> entries;
+	// most recently used key first
+	std::list<Key> lru;
+	uint64_t maxSize;
+	uint64_t totalSize;
+	uint64_t hits;
+	uint64_t misses;
+	// mutex must be held by the caller
+	void evict(uint64_t neededSize);
+public:
+	ShapeRasterCache(uint64_t _maxSize=SHAPECACHE_MAX_SIZE);
+	static int64_t quantizeScale(number_t scale);
+	/*
+	 * Returns a copy of the cached pixels for key, or nullptr if key is not
+	 * in the cache. The caller owns the returned buffer.
+	 */
+	uint8_t* lookup(const Key& key, uint32_t size);
+	void insert(const Key& key, _NR<tokenListRef> filltokens, _NR<tokenListRef> stroketokens, const uint8_t* data, uint32_t size);
+	void clear();
+	uint64_t getSize() const { return totalSize; }
+	uint64_t getHits() const { return hits; }
+	uint64_t getMisses() const { return misses; }
+};
+
+}
+#endif /* BACKENDS_SHAPECACHE_H */
@@ -0,0 +1,638 @@
+/**************************************************************************
+    Lightspark, a free flash player implementation
+
+    Copyright (C) 2024  Ludger Krämer <dbluelle@onlinehome.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <sys/stat.h>
+#include "backends/softwarerendering.h"
+#include "backends/rendering.h"
+#include "swf.h"
+#include "logger.h"
+#include "scripting/flash/display/DisplayObject.h"
+#include "scripting/flash/display/flashdisplay.h"
+#include "scripting/flash/display/RootMovieClip.h"
+#include "scripting/flash/display/Stage.h"
+#include "scripting/flash/display/BitmapContainer.h"
+#include "scripting/flash/filters/flashfilters.h"
+#include "scripting/flash/media/flashmedia.h"
+#include "scripting/toplevel/Array.h"
+#include "raster_scheduler.h"
+
+using namespace std;
+using namespace lightspark;
+
+static cairo_operator_t getCairoOperator(AS_BLENDMODE blendmode)
+{
+	switch (blendmode)
+	{
+		case BLENDMODE_NORMAL:
+		case BLENDMODE_LAYER:
+			return CAIRO_OPERATOR_OVER;
+		case BLENDMODE_MULTIPLY:
+			return CAIRO_OPERATOR_MULTIPLY;
+		case BLENDMODE_ADD:
+			return CAIRO_OPERATOR_ADD;
+		case BLENDMODE_SCREEN:
+			return CAIRO_OPERATOR_SCREEN;
+		case BLENDMODE_DARKEN:
+			return CAIRO_OPERATOR_DARKEN;
+		case BLENDMODE_LIGHTEN:
+			return CAIRO_OPERATOR_LIGHTEN;
+		case BLENDMODE_DIFFERENCE:
+			return CAIRO_OPERATOR_DIFFERENCE;
+		case BLENDMODE_HARDLIGHT:
+			return CAIRO_OPERATOR_HARD_LIGHT;
+		case BLENDMODE_OVERLAY:
+			return CAIRO_OPERATOR_OVERLAY;
+		case BLENDMODE_ALPHA:
+			return CAIRO_OPERATOR_DEST_IN;
+		case BLENDMODE_ERASE:
+			return CAIRO_OPERATOR_DEST_OUT;
+		default:
+			LOG(LOG_NOT_IMPLEMENTED,"software rendering of blend mode "<<(int)blendmode);
+			return CAIRO_OPERATOR_OVER;
+	}
+}
+
+static inline uint32_t clampColor(number_t v)
+{
+	return v <= 0 ? 0 : (v >= 255 ? 255 : uint32_t(v));
+}
+
+/*
+ * Applies a color transformation to premultiplied ARGB32 pixels
+ */
+static void applyColorTransform(std::vector<uint8_t>& data, const ColorTransformBase& ct)
+{
+	uint32_t* pixels = (uint32_t*)data.data();
+	size_t count = data.size()/4;
+	for (size_t i = 0; i < count; i++)
+	{
+		uint32_t px = pixels[i];
+		uint32_t a = px>>24;
+		uint32_t na = clampColor(a*ct.alphaMultiplier+ct.alphaOffset);
+		if (na == 0)
+		{
+			pixels[i] = 0;
+			continue;
+		}
+		number_t unpremultiply = a ? 255.0/a : 0;
+		uint32_t r = clampColor(((px>>16)&0xff)*unpremultiply*ct.redMultiplier+ct.redOffset);
+		uint32_t g = clampColor(((px>>8)&0xff)*unpremultiply*ct.greenMultiplier+ct.greenOffset);
+		uint32_t b = clampColor((px&0xff)*unpremultiply*ct.blueMultiplier+ct.blueOffset);
+		pixels[i] = (na<<24) | ((r*na/255)<<16) | ((g*na/255)<<8) | (b*na/255);
+	}
+}
+
+SoftwareRenderer::SoftwareRenderer(const std::string& _outputDir, uint32_t _maxFrames, bool _rawOutput):
+	outputDir(_outputDir),maxFrames(_maxFrames),rawOutput(_rawOutput),frameCount(0),framebuffer(nullptr),width(0),height(0),needsSerialComposite(false)
+{
+	if (!outputDir.empty() && g_mkdir_with_parents(outputDir.c_str(), S_IRUSR | S_IWUSR | S_IXUSR))
+	{
+		LOG(LOG_ERROR,"could not create output directory " << outputDir);
+		outputDir.clear();
+	}
+}
+
+SoftwareRenderer::~SoftwareRenderer()
+{
+	if (framebuffer)
+		cairo_surface_destroy(framebuffer);
+}
+
+/*
+ * Creates or refreshes the SurfaceState of obj and its children and
+ * rasterizes the contents that have changed since the last frame
+ */
+void SoftwareRenderer::prepareObject(DisplayObject* obj)
+{
+	CachedSurface* surface = obj->getCachedSurface().getPtr();
+	if (owners.find(surface) != owners.end())
+		return;
+	owners[surface] = obj;
+	if (obj->getMask())
+		prepareObject(obj->getMask());
+
+	IDrawable* d = obj->invalidate(true);
+	if (d)
+	{
+		obj->setupSurfaceState(d);
+		SurfacePixels& p = pixelCache[surface];
+		bool isNew = p.surface.isNull();
+		if (isNew)
+		{
+			surface->incRef();
+			p.surface = _MR(surface);
+		}
+		if (isNew || obj->hasChanged || obj->getNeedsTextureRecalculation()
+				|| p.width != uint32_t(d->getWidth()) || p.height != uint32_t(d->getHeight())
+				|| p.xContentScale != d->getXContentScale() || p.yContentScale != d->getYContentScale())
+			storePixels(p, d, obj);
+		p.used = true;
+		obj->updateCachedSurface(d);
+		delete d;
+	}
+	obj->hasChanged = false;
+	obj->resetNeedsTextureRecalculation();
+
+	if (obj->is<DisplayObjectContainer>())
+	{
+		std::vector<_R<DisplayObject>> children;
+		obj->as<DisplayObjectContainer>()->cloneDisplayList(children);
+		for (auto it = children.begin(); it != children.end(); ++it)
+			prepareObject(it->getPtr());
+	}
+}
+
+void SoftwareRenderer::storePixels(SurfacePixels& p, IDrawable* d, DisplayObject* obj)
+{
+	p.width = d->getWidth();
+	p.height = d->getHeight();
+	p.xContentScale = d->getXContentScale();
+	p.yContentScale = d->getYContentScale();
+	// video frames are in YUV format, the current frame is converted and stretched over the area of the drawable
+	if (d->getState()->isYUV)
+	{
+		uint32_t framewidth, frameheight;
+		if (obj->is<Video>() && p.width && p.height && p.xContentScale && p.yContentScale
+				&& obj->as<Video>()->getFramePixels(p.data, framewidth, frameheight))
+		{
+			p.xContentScale *= number_t(framewidth)/p.width;
+			p.yContentScale *= number_t(frameheight)/p.height;
+			p.width = framewidth;
+			p.height = frameheight;
+		}
+		else
+			p.data.clear();
+		return;
+	}
+	bool isBufferOwner = true;
+	uint8_t* buf = d->getPixelBuffer(&isBufferOwner);
+	if (buf && p.xContentScale && p.yContentScale)
+		p.data.assign(buf, buf+p.width*p.height*4);
+	else
+		p.data.clear();
+	if (buf && isBufferOwner)
+		delete[] buf;
+}
+
+bool SoftwareRenderer::hasFilters(CachedSurface* surface) const
+{
+	if (!surface->getState()->filters.empty())
+		return true;
+	// the filter list of the state is only filled when it has changed
+	auto it = owners.find(surface);
+	return it != owners.end() && it->second->filters && it->second->filters->size();
+}
+
+/*
+ * Builds a CachedSurface tree for obj and its children that is only used
+ * by drawToBitmap(), so the surfaces used by the render thread are not modified
+ */
+CachedSurface* SoftwareRenderer::prepareDrawObject(DisplayObject* obj, bool smoothing, bool isRoot)
+{
+	IDrawable* d = obj->invalidate(smoothing);
+	if (!d)
+		return nullptr;
+	obj->setupSurfaceState(d);
+	SurfaceState* state = d->getState();
+	CachedSurface* surface = new CachedSurface();
+	surface->SetState(state);
+	drawSurfaces.push_back(_MR(surface));
+	// BitmapData.draw() ignores the mask and filters of the drawn object itself
+	if (isRoot)
+		state->filters.clear();
+	else
+		owners[surface] = obj;
+	SurfacePixels& p = pixelCache[surface];
+	storePixels(p, d, obj);
+	p.used = true;
+	delete d;
+
+	state->mask.reset();
+	if (obj->getMask() && !isRoot)
+	{
+		CachedSurface* mask = prepareDrawObject(obj->getMask(), smoothing, false);
+		if (mask)
+		{
+			mask->incRef();
+			state->mask = _MR(mask);
+		}
+	}
+	if (!state->mask.isNull() || state->clipdepth || hasFilters(surface))
+		needsSerialComposite = true;
+
+	// replace the surfaces of the children by surfaces of the draw tree
+	state->childrenlist.clear();
+	if (obj->is<DisplayObjectContainer>())
+	{
+		std::vector<_R<DisplayObject>> children;
+		obj->as<DisplayObjectContainer>()->cloneDisplayList(children);
+		for (auto it = children.begin(); it != children.end(); ++it)
+		{
+			CachedSurface* child = prepareDrawObject(it->getPtr(), smoothing, false);
+			if (child)
+			{
+				child->incRef();
+				state->childrenlist.push_back(_MR(child));
+			}
+		}
+	}
+	return surface;
+}
+
+void SoftwareRenderer::drawToBitmap(DisplayObject* obj, const MATRIX& matrix, bool smoothing, AS_BLENDMODE blendmode,
+		ColorTransformBase* ct, const RECT* clipRect, BitmapContainer* target)
+{
+	if (target->isEmpty())
+		return;
+	SoftwareRenderer r("", 0, false);
+	r.width = target->getWidth();
+	r.height = target->getHeight();
+	CachedSurface* root = r.prepareDrawObject(obj, smoothing, true);
+	if (!root)
+		return;
+	// the transformations of the drawn object itself are ignored, too
+	SurfaceState* state = root->getState();
+	state->matrix = MATRIX();
+	state->scrollRect = RECT();
+	state->colortransform = ColorTransformBase();
+	state->alpha = 1.0;
+	state->visible = true;
+	state->isMask = false;
+	state->clipdepth = 0;
+	state->blendmode = blendmode;
+	// masks of children are positioned relative to obj
+	MATRIX objMatrix = obj->getConcatenatedMatrix();
+	r.initialMatrix = matrix.multiplyMatrix(objMatrix.getInverted());
+	ColorTransformBase colortransform;
+	if (ct)
+		colortransform = *ct;
+
+	int32_t stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, r.width);
+	uint8_t* data = target->getData();
+	auto composite = [&](int32_t y, int32_t h)
+	{
+		cairo_surface_t* surface = cairo_image_surface_create_for_data(data+y*stride, CAIRO_FORMAT_ARGB32, r.width, h, stride);
+		cairo_surface_set_device_offset(surface, 0, -y);
+		cairo_t* cr = cairo_create(surface);
+		cairo_surface_destroy(surface); /* cr has an reference to it */
+		if (clipRect)
+		{
+			cairo_rectangle(cr, clipRect->Xmin, clipRect->Ymin, clipRect->Xmax-clipRect->Xmin, clipRect->Ymax-clipRect->Ymin);
+			cairo_clip(cr);
+		}
+		r.renderSurface(cr, root, matrix, colortransform, 1.0, false);
+		cairo_destroy(cr);
+	};
+
+	RasterScheduler* scheduler = getSys() ? getSys()->getRasterScheduler() : nullptr;
+	uint32_t bandcount = 1;
+	if (scheduler && !r.needsSerialComposite && r.width*r.height >= RASTER_BAND_MIN_AREA)
+		bandcount = min(uint32_t(r.height/RASTER_BAND_MIN_HEIGHT), scheduler->getThreadCount());
+	if (bandcount > 1)
+	{
+		// every band only reads the rasterized pixels, so the bands can be composited in parallel
+		int32_t bandheight = (r.height+bandcount-1)/bandcount;
+		scheduler->parallelFor(bandcount, [&](uint32_t band)
+		{
+			int32_t y = band*bandheight;
+			int32_t h = min(bandheight, int32_t(r.height)-y);
+			if (h > 0)
+				composite(y, h);
+		});
+	}
+	else
+		composite(0, r.height);
+}
+
+void SoftwareRenderer::renderFrame(SystemState* sys)
+{
+	RenderThread* rt = sys->getRenderThread();
+	if (!rt || !rt->windowWidth || !rt->windowHeight || !sys->stage || !sys->mainClip)
+		return;
+	if (!framebuffer || width != rt->windowWidth || height != rt->windowHeight)
+	{
+		if (framebuffer)
+			cairo_surface_destroy(framebuffer);
+		width = rt->windowWidth;
+		height = rt->windowHeight;
+		framebuffer = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+	}
+	int offsetX, offsetY;
+	float scaleX, scaleY;
+	sys->stageCoordinateMapping(width, height, offsetX, offsetY, scaleX, scaleY);
+	initialMatrix = MATRIX(scaleX, scaleY, 0, 0, offsetX, offsetY);
+
+	for (auto it = pixelCache.begin(); it != pixelCache.end(); ++it)
+		it->second.used = false;
+	prepareObject(sys->stage);
+	// drop the pixels of objects that are no longer displayed
+	for (auto it = pixelCache.begin(); it != pixelCache.end();)
+	{
+		if (it->second.used)
+			++it;
+		else
+			it = pixelCache.erase(it);
+	}
+
+	cairo_t* cr = cairo_create(framebuffer);
+	RGB bg = sys->mainClip->getBackground();
+	cairo_set_source_rgb(cr, bg.Red/255.0, bg.Green/255.0, bg.Blue/255.0);
+	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+	cairo_paint(cr);
+	cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+	renderSurface(cr, sys->stage->getCachedSurface().getPtr(), initialMatrix, ColorTransformBase(), 1.0, false);
+	cairo_destroy(cr);
+	cairo_surface_flush(framebuffer);
+	owners.clear();
+
+	writeFrame();
+	frameCount++;
+	if (maxFrames && frameCount >= maxFrames)
+	{
+		LOG(LOG_INFO,"rendered " << frameCount << " frames, shutting down");
+		sys->setShutdownFlag();
+	}
+}
+
+void SoftwareRenderer::renderSurface(cairo_t* cr, CachedSurface* surface, const MATRIX& parentMatrix,
+		const ColorTransformBase& parentColorTransform, float parentAlpha, bool isMask)
+{
+	SurfaceState* state = surface->getState();
+	if (!state)
+		return;
+	if (!isMask)
+	{
+		if (!state->mask.isNull() && !state->mask->getState())
+			return;
+		if ((!state->isMask && !state->clipdepth && !state->visible) || state->alpha==0.0 || (state->isMask && !state->clipdepth))
+			return;
+	}
+	MATRIX localMatrix = state->matrix;
+	localMatrix.translate(-state->scrollRect.Xmin,-state->scrollRect.Ymin);
+	MATRIX matrix = parentMatrix.multiplyMatrix(localMatrix);
+	ColorTransformBase ct;
+	float alpha = 1.0;
+	AS_BLENDMODE blendmode = BLENDMODE_NORMAL;
+	if (!isMask)
+	{
+		ct = parentColorTransform;
+		ct = ct.multiplyTransform(state->colortransform);
+		alpha = parentAlpha*state->alpha;
+		blendmode = state->blendmode;
+	}
+
+	bool hasScrollRect = state->scrollRect.Xmin || state->scrollRect.Xmax || state->scrollRect.Ymin || state->scrollRect.Ymax;
+	if (hasScrollRect)
+	{
+		cairo_save(cr);
+		cairo_set_matrix(cr, &matrix);
+		cairo_rectangle(cr, state->scrollRect.Xmin, state->scrollRect.Ymin,
+						state->scrollRect.Xmax-state->scrollRect.Xmin, state->scrollRect.Ymax-state->scrollRect.Ymin);
+		cairo_identity_matrix(cr);
+		cairo_clip(cr);
+	}
+
+	cairo_surface_t* masksurface = nullptr;
+	if (!isMask && !state->mask.isNull())
+	{
+		auto it = owners.find(state->mask.getPtr());
+		if (it != owners.end())
+		{
+			DisplayObject* maskobj = it->second;
+			MATRIX maskParentMatrix = initialMatrix;
+			if (maskobj->getParent())
+				maskParentMatrix = initialMatrix.multiplyMatrix(maskobj->getParent()->getConcatenatedMatrix());
+			masksurface = renderMask(state->mask.getPtr(), maskParentMatrix);
+			cairo_push_group(cr);
+		}
+	}
+
+	// filters and blend modes of containers are applied to the composited subtree
+	bool needsLayer = !isMask && (hasFilters(surface) || (blendmode != BLENDMODE_NORMAL && !state->childrenlist.empty()));
+	if (needsLayer)
+		renderLayer(cr, surface, matrix, ct, alpha, blendmode);
+	else
+	{
+		renderContent(cr, surface, matrix, ct, alpha, blendmode, isMask);
+		renderChildren(cr, surface, matrix, ct, alpha, isMask);
+	}
+
+	if (masksurface)
+	{
+		cairo_pop_group_to_source(cr);
+		cairo_mask_surface(cr, masksurface, 0, 0);
+		cairo_surface_destroy(masksurface);
+	}
+	if (hasScrollRect)
+		cairo_restore(cr);
+}
+
+void SoftwareRenderer::renderContent(cairo_t* cr, CachedSurface* surface, const MATRIX& matrix,
+		const ColorTransformBase& colortransform, float alpha, AS_BLENDMODE blendmode, bool isMask)
+{
+	SurfaceState* state = surface->getState();
+	if (state->hasOpaqueBackground && !isMask && state->bounds.min.x < state->bounds.max.x && state->bounds.min.y < state->bounds.max.y)
+	{
+		cairo_save(cr);
+		cairo_set_matrix(cr, &matrix);
+		cairo_rectangle(cr, state->bounds.min.x, state->bounds.min.y,
+						state->bounds.max.x-state->bounds.min.x, state->bounds.max.y-state->bounds.min.y);
+		cairo_identity_matrix(cr);
+		cairo_set_source_rgba(cr, state->opaqueBackground.Red/255.0, state->opaqueBackground.Green/255.0,
+							  state->opaqueBackground.Blue/255.0, alpha);
+		cairo_fill(cr);
+		cairo_restore(cr);
+	}
+
+	auto it = pixelCache.find(surface);
+	if (it == pixelCache.end() || it->second.data.empty())
+		return;
+	SurfacePixels& p = it->second;
+	uint8_t* pixels = p.data.data();
+	std::vector<uint8_t> transformed;
+	if (!isMask && !colortransform.isIdentity())
+	{
+		transformed = p.data;
+		applyColorTransform(transformed, colortransform);
+		pixels = transformed.data();
+	}
+	cairo_surface_t* image = cairo_image_surface_create_for_data(pixels, CAIRO_FORMAT_ARGB32, p.width, p.height, p.width*4);
+	cairo_save(cr);
+	cairo_set_matrix(cr, &matrix);
+	// same placement as GLRenderContext::renderTextured
+	cairo_translate(cr, state->xOffset/p.xContentScale, state->yOffset/p.yContentScale);
+	cairo_scale(cr, 1.0/p.xContentScale, 1.0/p.yContentScale);
+	cairo_set_source_surface(cr, image, 0, 0);
+	cairo_pattern_set_filter(cairo_get_source(cr), state->smoothing == SMOOTH_MODE::SMOOTH_NONE ? CAIRO_FILTER_NEAREST : CAIRO_FILTER_GOOD);
+	cairo_set_operator(cr, isMask ? CAIRO_OPERATOR_OVER : getCairoOperator(blendmode));
+	cairo_paint_with_alpha(cr, alpha);
+	cairo_restore(cr);
+	cairo_surface_destroy(image);
+}
+
+void SoftwareRenderer::renderChildren(cairo_t* cr, CachedSurface* surface, const MATRIX& matrix,
+		const ColorTransformBase& colortransform, float alpha, bool isMask)
+{
+	SurfaceState* state = surface->getState();
+	int clipDepth = 0;
+	// previous clip depth and mask of all active clip layers
+	vector<pair<int, cairo_surface_t*>> clipDepthStack;
+	for (auto it = state->childrenlist.begin(); it != state->childrenlist.end(); ++it)
+	{
+		CachedSurface* child = it->getPtr();
+		SurfaceState* childstate = child->getState();
+		if (!childstate)
+			continue;
+		int depth = childstate->depth;
+		// Pop off masks (if any).
+		while (!clipDepthStack.empty() && clipDepth > 0 && depth > clipDepth)
+		{
+			clipDepth = clipDepthStack.back().first;
+			cairo_pop_group_to_source(cr);
+			cairo_mask_surface(cr, clipDepthStack.back().second, 0, 0);
+			cairo_surface_destroy(clipDepthStack.back().second);
+			clipDepthStack.pop_back();
+		}
+
+		if (childstate->clipdepth > 0 && childstate->allowAsMask)
+		{
+			if (isMask)
+			{
+				// clip layers inside a mask are part of the mask
+				renderSurface(cr, child, matrix, colortransform, alpha, true);
+				continue;
+			}
+			// Push, and render this mask.
+			clipDepthStack.push_back(make_pair(clipDepth, renderMask(child, matrix)));
+			clipDepth = childstate->clipdepth;
+			cairo_push_group(cr);
+		}
+		else if ((childstate->visible && !childstate->clipdepth && !childstate->isMask) || isMask)
+			renderSurface(cr, child, matrix, colortransform, alpha, isMask);
+	}
+
+	// Pop remaining masks (if any).
+	while (!clipDepthStack.empty())
+	{
+		cairo_pop_group_to_source(cr);
+		cairo_mask_surface(cr, clipDepthStack.back().second, 0, 0);
+		cairo_surface_destroy(clipDepthStack.back().second);
+		clipDepthStack.pop_back();
+	}
+}
+
+/*
+ * Renders surface and its children into an offscreen surface, applies
+ * the filters of the DisplayObject and composites the result with the
+ * blend mode of the DisplayObject
+ */
+void SoftwareRenderer::renderLayer(cairo_t* cr, CachedSurface* surface, const MATRIX& matrix,
+		const ColorTransformBase& colortransform, float alpha, AS_BLENDMODE blendmode)
+{
+	SurfaceState* state = surface->getState();
+	RectF bounds = surface->boundsRectWithRenderTransform(matrix, initialMatrix);
+	// parts outside of the framebuffer are only needed as far as filters can pull them in
+	number_t border = !hasFilters(surface) ? 0 : state->maxfilterborder*max(initialMatrix.getScaleX(), initialMatrix.getScaleY());
+	int32_t x = floor(max(number_t(bounds.min.x), -border));
+	int32_t y = floor(max(number_t(bounds.min.y), -border));
+	int32_t w = int32_t(ceil(min(number_t(bounds.max.x), width+border)))-x;
+	int32_t h = int32_t(ceil(min(number_t(bounds.max.y), height+border)))-y;
+	if (w <= 0 || h <= 0)
+		return;
+
+	cairo_surface_t* layer = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, w, h);
+	cairo_surface_set_device_offset(layer, -x, -y);
+	cairo_t* lcr = cairo_create(layer);
+	renderContent(lcr, surface, matrix, colortransform, 1.0, BLENDMODE_NORMAL, false);
+	renderChildren(lcr, surface, matrix, colortransform, 1.0, false);
+	cairo_destroy(lcr);
+	cairo_surface_flush(layer);
+
+	auto it = owners.find(surface);
+	if (it != owners.end() && it->second->filters)
+	{
+		DisplayObject* obj = it->second;
+		uint8_t* data = cairo_image_surface_get_data(layer);
+		_R<BitmapContainer> target = _MR(new BitmapContainer(nullptr));
+		target->fromRawData(data, w, h);
+		_R<BitmapContainer> source = _MR(new BitmapContainer(nullptr));
+		RECT sourceRect(0, w, 0, h);
+		for (uint32_t i = 0; i < obj->filters->size(); i++)
+		{
+			asAtom f = asAtomHandler::invalidAtom;
+			obj->filters->at_nocheck(f,i);
+			if (!asAtomHandler::is<BitmapFilter>(f))
+				continue;
+			// every filter is applied to the result of the previous one
+			source->fromRawData(target->getData(), w, h);
+			asAtomHandler::as<BitmapFilter>(f)->applyFilter(target.getPtr(), source.getPtr(), sourceRect, 0, 0,
+															  initialMatrix.getScaleX(), initialMatrix.getScaleY(), obj);
+		}
+		memcpy(data, target->getData(), w*h*4);
+		cairo_surface_mark_dirty(layer);
+	}
+
+	cairo_save(cr);
+	cairo_set_source_surface(cr, layer, 0, 0);
+	cairo_set_operator(cr, getCairoOperator(blendmode));
+	cairo_paint_with_alpha(cr, alpha);
+	cairo_restore(cr);
+	cairo_surface_destroy(layer);
+}
+
+/*
+ * Renders the coverage of a mask into a surface of the size of the framebuffer
+ */
+cairo_surface_t* SoftwareRenderer::renderMask(CachedSurface* mask, const MATRIX& matrix)
+{
+	cairo_surface_t* masksurface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+	cairo_t* mcr = cairo_create(masksurface);
+	renderSurface(mcr, mask, matrix, ColorTransformBase(), 1.0, true);
+	cairo_destroy(mcr);
+	cairo_surface_flush(masksurface);
+	return masksurface;
+}
+
+void SoftwareRenderer::writeFrame()
+{
+	if (outputDir.empty())
+		return;
+	char* name = g_strdup_printf(rawOutput ? "frame%06u.raw" : "frame%06u.png", frameCount);
+	char* path = g_build_filename(outputDir.c_str(), name, nullptr);
+	if (rawOutput)
+	{
+		// premultiplied native-endian ARGB32, without any header
+		std::ofstream f(path, std::ios::out|std::ios::binary|std::ios::trunc);
+		const char* data = (const char*)cairo_image_surface_get_data(framebuffer);
+		int stride = cairo_image_surface_get_stride(framebuffer);
+		for (uint32_t i = 0; i < height && f; i++)
+			f.write(data+i*stride, width*4);
+		if (!f)
+			LOG(LOG_ERROR,"could not write frame " << path);
+	}
+	else if (cairo_surface_write_to_png(framebuffer, path) != CAIRO_STATUS_SUCCESS)
+		LOG(LOG_ERROR,"could not write frame " << path);
+	g_free(path);
+	g_free(name);
+}
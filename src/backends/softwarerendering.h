@@ -0,0 +1,124 @@
+/**************************************************************************
+    Lightspark, a free flash player implementation
+
+    Copyright (C) 2024  Ludger Krämer <dbluelle@onlinehome.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef BACKENDS_SOFTWARERENDERING_H
+#define BACKENDS_SOFTWARERENDERING_H 1
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include <cairo.h>
+#include "backends/cachedsurface.h"
+#include "smartrefs.h"
+#include "swftypes.h"
+#include "compat.h"
+
+namespace lightspark
+{
+class BitmapContainer;
+class DisplayObject;
+class SystemState;
+
+/*
+ * Renders the stage on the CPU without any OpenGL context.
+ *
+ * This is used for headless batch rendering: after every frame the
+ * display list is rasterized with cairo, the CachedSurface tree built from
+ * it is composited into an in-memory framebuffer (including color
+ * transforms, blend modes, masks and filters) and the framebuffer is
+ * written to disk as a PNG or raw image.
+ *
+ * It is also used by BitmapData.draw() to rasterize a DisplayObject
+ * directly into a BitmapContainer, without a round trip through the
+ * render thread.
+ *
+ * All methods must be called from the vm thread.
+ */
+class DLL_PUBLIC SoftwareRenderer
+{
+private:
+	// CPU side replacement for the texture of a CachedSurface
+	struct SurfacePixels
+	{
+		_NR<CachedSurface> surface;
+		// premultiplied native-endian ARGB32, stride is width*4
+		std::vector<uint8_t> data;
+		uint32_t width;
+		uint32_t height;
+		number_t xContentScale;
+		number_t yContentScale;
+		bool used;
+		SurfacePixels():width(0),height(0),xContentScale(1),yContentScale(1),used(false) {}
+	};
+	std::map<CachedSurface*, SurfacePixels> pixelCache;
+	// DisplayObjects of the surfaces of the current frame, needed for filters and masks
+	std::map<CachedSurface*, DisplayObject*> owners;
+	std::string outputDir;
+	uint32_t maxFrames;
+	bool rawOutput;
+	uint32_t frameCount;
+	cairo_surface_t* framebuffer;
+	uint32_t width;
+	uint32_t height;
+	MATRIX initialMatrix;
+	// surfaces created by drawToBitmap(), these are not attached to their DisplayObjects
+	std::vector<_R<CachedSurface>> drawSurfaces;
+	// set if the surfaces to draw use masks or filters, which can't be composited in bands
+	bool needsSerialComposite;
+
+	void prepareObject(DisplayObject* obj);
+	CachedSurface* prepareDrawObject(DisplayObject* obj, bool smoothing, bool isRoot);
+	void storePixels(SurfacePixels& p, IDrawable* d, DisplayObject* obj);
+	bool hasFilters(CachedSurface* surface) const;
+	void renderSurface(cairo_t* cr, CachedSurface* surface, const MATRIX& parentMatrix,
+			const ColorTransformBase& parentColorTransform, float parentAlpha, bool isMask);
+	void renderContent(cairo_t* cr, CachedSurface* surface, const MATRIX& matrix,
+			const ColorTransformBase& colortransform, float alpha, AS_BLENDMODE blendmode, bool isMask);
+	void renderChildren(cairo_t* cr, CachedSurface* surface, const MATRIX& matrix,
+			const ColorTransformBase& colortransform, float alpha, bool isMask);
+	void renderLayer(cairo_t* cr, CachedSurface* surface, const MATRIX& matrix,
+			const ColorTransformBase& colortransform, float alpha, AS_BLENDMODE blendmode);
+	cairo_surface_t* renderMask(CachedSurface* mask, const MATRIX& matrix);
+	void writeFrame();
+public:
+	/*
+	 * @param _outputDir directory the frames are written to, no files are written if empty
+	 * @param _maxFrames number of frames to render before shutting down, 0 renders until the movie ends
+	 * @param _rawOutput write raw premultiplied BGRA data instead of PNG files
+	 */
+	SoftwareRenderer(const std::string& _outputDir, uint32_t _maxFrames, bool _rawOutput);
+	~SoftwareRenderer();
+	// Renders the current state of the stage, called once per frame
+	void renderFrame(SystemState* sys);
+	// The framebuffer of the last rendered frame, may be nullptr
+	cairo_surface_t* getFramebuffer() const { return framebuffer; }
+	uint32_t getFrameCount() const { return frameCount; }
+	/*
+	 * Renders obj and its children into target, as done by BitmapData.draw().
+	 * The transformation, color transformation and blend mode of obj itself
+	 * are replaced by matrix, ct and blendmode.
+	 * @param clipRect area of target to draw into, may be nullptr
+	 */
+	static void drawToBitmap(DisplayObject* obj, const MATRIX& matrix, bool smoothing, AS_BLENDMODE blendmode,
+			ColorTransformBase* ct, const RECT* clipRect, BitmapContainer* target);
+};
+
+}
+#endif /* BACKENDS_SOFTWARERENDERING_H */
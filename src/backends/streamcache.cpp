@@ -17,14 +17,21 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 **************************************************************************/
 
+#include <algorithm>
 #include <string.h>
 #include <unistd.h>
 #include <glib.h>
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
 #include "backends/streamcache.h"
 #include "backends/config.h"
 #include "exceptions.h"
 #include "logger.h"
 #include "netutils.h"
+#include "scripting/abc.h"
 #include "swf.h"
 #include <SDL.h>
 
@@ -44,6 +51,7 @@ size_t StreamCache::markFinished(bool _failed)
 
 	failed = _failed;
 	terminated = true;
+	stateCond.broadcast();
 	sys->sendMainSignal();
 	return receivedLength;
 }
@@ -53,9 +61,16 @@ void StreamCache::waitForData(size_t currentOffset)
 	stateMutex.lock();
 	while (receivedLength <= currentOffset && !terminated)
 	{
-		stateMutex.unlock();
-		sys->waitMainSignal();
-		stateMutex.lock();
+		if (isVmThread())
+		{
+			// The vm thread has to keep handling external calls
+			// while waiting, so it waits for the main signal
+			stateMutex.unlock();
+			sys->waitMainSignal();
+			stateMutex.lock();
+		}
+		else
+			stateCond.wait(stateMutex);
 	}
 	stateMutex.unlock();
 }
@@ -65,9 +80,14 @@ void StreamCache::waitForTermination()
 	stateMutex.lock();
 	while (!terminated)
 	{
-		stateMutex.unlock();
-		sys->waitMainSignal();
-		stateMutex.lock();
+		if (isVmThread())
+		{
+			stateMutex.unlock();
+			sys->waitMainSignal();
+			stateMutex.lock();
+		}
+		else
+			stateCond.wait(stateMutex);
 	}
 	stateMutex.unlock();
 }
@@ -82,6 +102,7 @@ void StreamCache::append(const unsigned char* buffer, size_t length)
 	{
 		stateMutex.lock();
 		receivedLength += length;
+		stateCond.broadcast();
 		stateMutex.unlock();
 		sys->sendMainSignal();
 	}
@@ -349,11 +370,17 @@ streampos MemoryStreamCache::Reader::getOffset() const
 
 FileStreamCache::FileStreamCache(SystemState* _sys):StreamCache(_sys),
   keepCache(false)
+#ifdef LS_FILESTREAMCACHE_MMAP
+  ,mappedFd(-1)
+#endif
 {
 }
 
 FileStreamCache::~FileStreamCache()
 {
+#ifdef LS_FILESTREAMCACHE_MMAP
+	unmapSegments();
+#endif
 	if (cache.is_open())
 		cache.close();
 	if (!keepCache && !cacheFilename.empty())
@@ -481,6 +508,15 @@ std::streambuf *FileStreamCache::createReader()
 		return NULL;
 	}
 
+#ifdef LS_FILESTREAMCACHE_MMAP
+	if (getMappedSegment(0))
+	{
+		incRef();
+		return new FileStreamCache::MappedReader(_MR(this));
+	}
+	LOG(LOG_INFO,"NET: cannot map cache file, falling back to buffered reading");
+#endif
+
 	incRef();
 	FileStreamCache::Reader *fbuf = new FileStreamCache::Reader(_MR(this));
 	fbuf->open(cacheFilename.raw_buf(), std::fstream::binary | std::fstream::in);
@@ -525,6 +561,356 @@ streamsize FileStreamCache::Reader::xsgetn(char* s, streamsize n)
 	return read;
 }
 
+#ifdef LS_FILESTREAMCACHE_MMAP
+unsigned char* FileStreamCache::getMappedSegment(size_t index)
+{
+	Locker locker(mappingMutex);
+	if (index < mappedSegments.size() && mappedSegments[index])
+		return mappedSegments[index];
+
+	if (mappedFd == -1)
+	{
+		mappedFd = open(cacheFilename.raw_buf(), O_RDONLY);
+		if (mappedFd == -1)
+			return nullptr;
+	}
+
+	void* addr = mmap(nullptr, mappingSegmentSize, PROT_READ, MAP_SHARED,
+			  mappedFd, (off_t)(index*mappingSegmentSize));
+	if (addr == MAP_FAILED)
+	{
+		LOG(LOG_ERROR,"NET: mmap of cache file failed: " << strerror(errno));
+		return nullptr;
+	}
+	// Readers move sequentially through the stream most of the time
+	madvise(addr, mappingSegmentSize, MADV_SEQUENTIAL);
+
+	if (index >= mappedSegments.size())
+		mappedSegments.resize(index+1, nullptr);
+	mappedSegments[index] = (unsigned char*)addr;
+	return mappedSegments[index];
+}
+
+void FileStreamCache::unmapSegments()
+{
+	Locker locker(mappingMutex);
+	for (auto it=mappedSegments.begin(); it!=mappedSegments.end(); ++it)
+	{
+		if (*it)
+			munmap(*it, mappingSegmentSize);
+	}
+	mappedSegments.clear();
+	if (mappedFd != -1)
+		close(mappedFd);
+	mappedFd = -1;
+}
+
+FileStreamCache::MappedReader::MappedReader(_R<FileStreamCache> b) :
+	buffer(b), segmentStartOffset(0)
+{
+	setg(nullptr, nullptr, nullptr);
+}
+
+/**
+ * Get the position of the read cursor in the cache file.
+ */
+streampos FileStreamCache::MappedReader::getOffset() const
+{
+	return segmentStartOffset + (size_t)(gptr() - eback());
+}
+
+bool FileStreamCache::MappedReader::setPosition(size_t pos)
+{
+	size_t received = buffer->getReceivedLength();
+	if (pos > received)
+		return false;
+
+	size_t index = pos / mappingSegmentSize;
+	unsigned char* segment = buffer->getMappedSegment(index);
+	if (!segment)
+		return false;
+
+	segmentStartOffset = index * mappingSegmentSize;
+	size_t available = std::min(received - segmentStartOffset, (size_t)mappingSegmentSize);
+	setg((char*)segment,
+	     (char*)segment + (pos - segmentStartOffset),
+	     (char*)segment + available);
+	return true;
+}
+
+/**
+ * \brief Called by the streambuf API
+ *
+ * Called by the streambuf API when the data exposed by the current
+ * segment has been consumed. Either more data has arrived in this
+ * segment, or the reader moves to the next one.
+ */
+int FileStreamCache::MappedReader::underflow()
+{
+	size_t offset = getOffset();
+	if (offset >= buffer->getReceivedLength() && !buffer->hasTerminated())
+		buffer->waitForData(offset);
+
+	if (offset >= buffer->getReceivedLength())
+		return EOF;
+
+	if (!setPosition(offset))
+		return EOF;
+
+	return (int)(unsigned char)*gptr();
+}
+
+streamsize FileStreamCache::MappedReader::showmanyc()
+{
+	size_t offset = getOffset();
+	size_t received = buffer->getReceivedLength();
+	if (offset < received)
+		return received - offset;
+	return buffer->hasTerminated() ? -1 : 0;
+}
+
+/**
+ * \brief Called by the streambuf API
+ *
+ * Called by the streambuf API to seek to a relative position
+ */
+streampos FileStreamCache::MappedReader::seekoff(streamoff off, std::ios_base::seekdir dir,
+						 std::ios_base::openmode mode)
+{
+	if (mode != std::ios_base::in)
+		return -1;
+
+	switch (dir)
+	{
+		case std::ios_base::beg:
+			return seekpos(off, mode);
+		case std::ios_base::cur:
+			if (off == 0)
+				return getOffset();
+			// Stay inside the current segment if possible
+			if (eback() && gptr() + off >= eback() && gptr() + off <= egptr())
+			{
+				gbump((int)off);
+				return getOffset();
+			}
+			return seekpos(getOffset() + off, mode);
+		case std::ios_base::end:
+			buffer->waitForTermination();
+			if (buffer->hasFailed())
+				return -1;
+			return seekpos((streampos)buffer->getReceivedLength() + off, mode);
+		default:
+			break;
+	}
+	return -1;
+}
+
+/**
+ * \brief Called by the streambuf API
+ *
+ * Called by the streambuf API to seek to an absolute position. Waits
+ * for the writer if the position has not been received yet.
+ */
+streampos FileStreamCache::MappedReader::seekpos(streampos pos, std::ios_base::openmode mode)
+{
+	if (mode != std::ios_base::in || pos < 0)
+		return -1;
+
+	if (pos > (streampos)buffer->getReceivedLength())
+		buffer->waitForData((size_t)pos - 1);
+
+	if (!setPosition(pos))
+		return -1;
+	return pos;
+}
+#endif
+
+RingStreamCache::RingStreamCache(SystemState* _sys):StreamCache(_sys),
+	firstChunkOffset(0), readPosition(0)
+{
+}
+
+RingStreamCache::~RingStreamCache()
+{
+	for (auto it=chunks.begin(); it!=chunks.end(); ++it)
+		delete *it;
+	for (auto it=spareChunks.begin(); it!=spareChunks.end(); ++it)
+		delete *it;
+}
+
+void RingStreamCache::handleAppend(const unsigned char* data, size_t length)
+{
+	Locker locker(chunkListMutex);
+	while (length > 0)
+	{
+		if (chunks.empty() || ACQUIRE_READ(chunks.back()->used) >= chunkSize)
+		{
+			if (spareChunks.empty())
+				chunks.push_back(new MemoryChunk(chunkSize));
+			else
+			{
+				chunks.push_back(spareChunks.back());
+				spareChunks.pop_back();
+				RELEASE_WRITE(chunks.back()->used, 0);
+			}
+		}
+		MemoryChunk* chunk = chunks.back();
+		size_t used = ACQUIRE_READ(chunk->used);
+		size_t len = std::min(length, chunkSize - used);
+		memcpy(chunk->buffer + used, data, len);
+		RELEASE_WRITE(chunk->used, used + len);
+		data += len;
+		length -= len;
+	}
+}
+
+void RingStreamCache::releaseChunks(size_t pos)
+{
+	// chunkListMutex is held by the caller
+	RELEASE_WRITE(readPosition, pos);
+	while (chunks.size() > 1 && firstChunkOffset + chunkSize + keepBehind <= pos)
+	{
+		MemoryChunk* chunk = chunks.front();
+		chunks.pop_front();
+		firstChunkOffset += chunkSize;
+		if (spareChunks.size() < maxSpareChunks)
+			spareChunks.push_back(chunk);
+		else
+			delete chunk;
+	}
+}
+
+size_t RingStreamCache::getUnreadLength() const
+{
+	size_t pos = ACQUIRE_READ(readPosition);
+	size_t received = getReceivedLength();
+	return received > pos ? received - pos : 0;
+}
+
+std::streambuf *RingStreamCache::createReader()
+{
+	incRef();
+	return new RingStreamCache::Reader(_MR(this));
+}
+
+void RingStreamCache::openForWriting()
+{
+	// nothing to do, the chunks are allocated on demand
+}
+
+RingStreamCache::Reader::Reader(_R<RingStreamCache> b) :
+	buffer(b), chunkStartOffset(0)
+{
+	setg(nullptr, nullptr, nullptr);
+}
+
+streampos RingStreamCache::Reader::getOffset() const
+{
+	return chunkStartOffset + (size_t)(gptr() - eback());
+}
+
+bool RingStreamCache::Reader::setPosition(size_t pos)
+{
+	size_t received = buffer->getReceivedLength();
+	if (pos > received)
+		return false;
+
+	Locker locker(buffer->chunkListMutex);
+	if (pos < buffer->firstChunkOffset)
+	{
+		LOG(LOG_ERROR,"RingStreamCache: position "<<pos<<" has already been released");
+		return false;
+	}
+	buffer->releaseChunks(pos);
+
+	size_t index = (pos - buffer->firstChunkOffset) / chunkSize;
+	if (index >= buffer->chunks.size())
+	{
+		// pos is the end of the received data and starts a new chunk
+		chunkStartOffset = pos;
+		setg(nullptr, nullptr, nullptr);
+		return true;
+	}
+	MemoryChunk* chunk = buffer->chunks[index];
+	chunkStartOffset = buffer->firstChunkOffset + index * chunkSize;
+	size_t used = ACQUIRE_READ(chunk->used);
+	setg((char*)chunk->buffer,
+	     (char*)chunk->buffer + (pos - chunkStartOffset),
+	     (char*)chunk->buffer + used);
+	return true;
+}
+
+/**
+ * \brief Called by the streambuf API
+ *
+ * Called by the streambuf API when the data exposed by the current
+ * chunk has been consumed. Either more data has arrived in this
+ * chunk, or the reader moves to the next one.
+ */
+int RingStreamCache::Reader::underflow()
+{
+	size_t offset = getOffset();
+	if (offset >= buffer->getReceivedLength() && !buffer->hasTerminated())
+		buffer->waitForData(offset);
+
+	if (offset >= buffer->getReceivedLength())
+		return EOF;
+
+	if (!setPosition(offset) || gptr() == egptr())
+		return EOF;
+
+	return (int)(unsigned char)*gptr();
+}
+
+/**
+ * \brief Called by the streambuf API
+ *
+ * Called by the streambuf API to seek to a relative position
+ */
+streampos RingStreamCache::Reader::seekoff(streamoff off, std::ios_base::seekdir dir,
+					   std::ios_base::openmode mode)
+{
+	if (mode != std::ios_base::in)
+		return -1;
+
+	switch (dir)
+	{
+		case std::ios_base::beg:
+			return seekpos(off, mode);
+		case std::ios_base::cur:
+			if (off == 0)
+				return getOffset();
+			return seekpos(getOffset() + off, mode);
+		case std::ios_base::end:
+			buffer->waitForTermination();
+			if (buffer->hasFailed())
+				return -1;
+			return seekpos((streampos)buffer->getReceivedLength() + off, mode);
+		default:
+			break;
+	}
+	return -1;
+}
+
+/**
+ * \brief Called by the streambuf API
+ *
+ * Called by the streambuf API to seek to an absolute position. Waits
+ * for the writer if the position has not been received yet.
+ */
+streampos RingStreamCache::Reader::seekpos(streampos pos, std::ios_base::openmode mode)
+{
+	if (mode != std::ios_base::in || pos < 0)
+		return -1;
+
+	if (pos > (streampos)buffer->getReceivedLength())
+		buffer->waitForData((size_t)pos - 1);
+
+	if (!setPosition(pos))
+		return -1;
+	return pos;
+}
+
 streamsize lsfilereader::xsgetn(char *s, streamsize n)
 {
 	if (filehandler)
@@ -20,6 +20,7 @@
 #ifndef BACKENDS_STREAMCACHE_H
 #define BACKENDS_STREAMCACHE_H 1
 
+#include <deque>
 #include <list>
 #include <istream>
 #include <fstream>
@@ -51,6 +52,9 @@ protected:
 	// stateMutex must be held while receivedLength, failed or
 	// terminated are accessed
 	Mutex stateMutex;
+	// Signalled by the writer whenever data is appended or the
+	// stream is terminated
+	Cond stateCond;
 	// Amount of data already received
 	size_t receivedLength;
 	// Has the stream been completely downloaded or failed?
@@ -159,11 +163,45 @@ public:
 	void openForWriting() override;
 };
 
+/*
+ * Readers of FileStreamCache map the cache file into memory instead of
+ * issuing read syscalls. Only enabled on 64 bit POSIX systems, where
+ * address space is not a concern even for very large streams.
+ */
+#if !defined(_WIN32) && defined(LIGHTSPARK_64)
+#define LS_FILESTREAMCACHE_MMAP 1
+#endif
+
 /*
  * FileStreamCache saves the stream in a temporary file.
  */
 class DLL_PUBLIC FileStreamCache : public StreamCache {
 private:
+#ifdef LS_FILESTREAMCACHE_MMAP
+	/*
+	 * Reads directly from the memory mapped segments of the cache
+	 * file. The segments are shared by all readers, so seeking and
+	 * reading never copies data or enters the kernel once a
+	 * segment is mapped.
+	 */
+	class DLL_LOCAL MappedReader : public std::streambuf {
+	private:
+		_R<FileStreamCache> buffer;
+		// Offset of eback() in the cache file
+		size_t segmentStartOffset;
+
+		// Makes pos the current read position, returns false if
+		// pos is beyond the received data
+		bool setPosition(size_t pos);
+		int underflow() override;
+		std::streampos seekoff(std::streamoff, std::ios_base::seekdir, std::ios_base::openmode) override;
+		std::streampos seekpos(std::streampos, std::ios_base::openmode) override;
+		std::streamsize showmanyc() override;
+		std::streampos getOffset() const;
+	public:
+		MappedReader(_R<FileStreamCache> buffer);
+	};
+#endif
 	/*
 	 * Extends filebuf to wait for writer thread to supply more
 	 * data when the end of temporary file is reached.
@@ -183,6 +221,22 @@ private:
 	std::fstream cache;
 	//True if the cache file doesn't need to be deleted on destruction
 	bool keepCache:1;
+#ifdef LS_FILESTREAMCACHE_MMAP
+	// The cache file is mapped in fixed size segments. A segment is
+	// mapped when a reader first reaches it and then stays at the
+	// same address until the cache is destroyed. Segments may extend
+	// beyond the current end of file, the pages become valid as the
+	// writer appends data. mappingMutex must be held while
+	// mappedSegments or mappedFd are accessed.
+	static const size_t mappingSegmentSize = 32*1024*1024;
+	Mutex mappingMutex;
+	std::vector<unsigned char*> mappedSegments;
+	int mappedFd;
+	// Returns the start of the mapping of segment index, or nullptr
+	// if the file could not be mapped
+	unsigned char* getMappedSegment(size_t index) DLL_LOCAL;
+	void unmapSegments() DLL_LOCAL;
+#endif
 
 	void openCache() DLL_LOCAL;
 	void openExistingCache(const tiny_string& filename, bool forWriting=true) DLL_LOCAL;
@@ -203,6 +257,67 @@ public:
 	void openForWriting() override;
 };
 
+/*
+ * RingStreamCache buffers an endless stream in memory for a single reader.
+ *
+ * The stream is stored in fixed size chunks. Chunks that are more than
+ * keepBehind bytes behind the read position are released (and reused by
+ * the writer), so the memory used only depends on the amount of data
+ * that has not been read yet. Seeking back into released data fails.
+ */
+class DLL_PUBLIC RingStreamCache : public StreamCache {
+private:
+	class DLL_LOCAL Reader : public std::streambuf {
+	private:
+		_R<RingStreamCache> buffer;
+		// Offset of eback() in the stream
+		size_t chunkStartOffset;
+
+		// Makes pos the current read position, returns false if
+		// pos has been released or is beyond the received data
+		bool setPosition(size_t pos);
+		int underflow() override;
+		std::streampos seekoff(std::streamoff, std::ios_base::seekdir, std::ios_base::openmode) override;
+		std::streampos seekpos(std::streampos, std::ios_base::openmode) override;
+		std::streampos getOffset() const;
+	public:
+		Reader(_R<RingStreamCache> b);
+	};
+
+	static const size_t chunkSize = 256*1024;
+	// Data kept behind the read position, this allows the decoders to
+	// seek back to the start of the stream while probing it
+	static const size_t keepBehind = 1024*1024;
+	// Released chunks kept for reuse
+	static const size_t maxSpareChunks = 4;
+
+	// chunkListMutex must be held while chunks, spareChunks or
+	// firstChunkOffset are accessed
+	Mutex chunkListMutex;
+	std::deque<MemoryChunk *> chunks;
+	std::vector<MemoryChunk *> spareChunks;
+	// Offset of the first retained chunk in the stream
+	size_t firstChunkOffset;
+	// Read position of the reader, as of its last underflow or seek
+	ACQUIRE_RELEASE_VARIABLE(size_t, readPosition);
+
+	// Releases the chunks no longer needed by a reader at pos
+	void releaseChunks(size_t pos) DLL_LOCAL;
+
+	void handleAppend(const unsigned char* buffer, size_t length) override DLL_LOCAL;
+
+public:
+	RingStreamCache(SystemState* _sys);
+	virtual ~RingStreamCache();
+
+	// Amount of received data that has not been read yet
+	size_t getUnreadLength() const;
+
+	std::streambuf *createReader() override;
+
+	void openForWriting() override;
+};
+
 // simple wrapper to use SDL_RWops as input for istream
 // to let SDL deal with unicode filenames on windows
 class DLL_PUBLIC lsfilereader: public std::filebuf
@@ -0,0 +1,104 @@
+/**************************************************************************
+    Lightspark, a free flash player implementation
+
+    Copyright (C) 2024  Ludger Krämer <dbluelle@onlinehome.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include <cassert>
+#include <cmath>
+#include <tuple>
+#include "backends/textcache.h"
+
+using namespace std;
+using namespace lightspark;
+
+bool TextRasterCache::Key::operator<(const Key& r) const
+{
+	return std::tie(xscale,yscale,subpixelX,subpixelY,fontSize,bold,italic,smoothing,font,text)
+		< std::tie(r.xscale,r.yscale,r.subpixelX,r.subpixelY,r.fontSize,r.bold,r.italic,r.smoothing,r.font,r.text);
+}
+
+TextRasterCache::TextRasterCache(uint64_t _maxSize):maxSize(_maxSize),totalSize(0),hits(0),misses(0)
+{
+}
+
+int64_t TextRasterCache::quantizeScale(double scale)
+{
+	return llround(scale*TEXTCACHE_SCALE_STEPS);
+}
+
+uint64_t TextRasterCache::getEntrySize(const Key& key, const Line& line)
+{
+	// count the key as well, lines of short texts are much smaller than their mask
+	return line.mask.size()+key.text.numBytes()+key.font.numBytes()+sizeof(Entry);
+}
+
+void TextRasterCache::evict(uint64_t neededSize)
+{
+	while (!lru.empty() && totalSize + neededSize > maxSize)
+	{
+		auto it = entries.find(lru.back());
+		assert(it != entries.end());
+		totalSize -= getEntrySize(it->first,it->second.line);
+		entries.erase(it);
+		lru.pop_back();
+	}
+}
+
+bool TextRasterCache::lookup(const Key& key, Line& line)
+{
+	Locker l(mutex);
+	auto it = entries.find(key);
+	if (it == entries.end())
+	{
+		misses++;
+		return false;
+	}
+	hits++;
+	// move to the front of the lru list
+	lru.splice(lru.begin(),lru,it->second.lruPosition);
+	line = it->second.line;
+	return true;
+}
+
+void TextRasterCache::insert(const Key& key, const Line& line)
+{
+	uint64_t size = getEntrySize(key,line);
+	// don't let a single huge line push out everything else
+	if (size > maxSize/4)
+		return;
+	Locker l(mutex);
+	auto it = entries.find(key);
+	if (it != entries.end())
+	{
+		// rasterized concurrently by another thread
+		return;
+	}
+	evict(size);
+	lru.push_front(key);
+	Entry& e = entries[key];
+	e.line = line;
+	e.lruPosition = lru.begin();
+	totalSize += size;
+}
+
+void TextRasterCache::clear()
+{
+	Locker l(mutex);
+	entries.clear();
+	lru.clear();
+	totalSize = 0;
+}
@@ -0,0 +1,112 @@
+/**************************************************************************
+    Lightspark, a free flash player implementation
+
+    Copyright (C) 2024  Ludger Krämer <dbluelle@onlinehome.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef BACKENDS_TEXTCACHE_H
+#define BACKENDS_TEXTCACHE_H 1
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <vector>
+#include "tiny_string.h"
+#include "threading.h"
+#include "compat.h"
+
+namespace lightspark
+{
+
+// default memory limit of the rasterized text lines
+#define TEXTCACHE_MAX_SIZE (16*1024*1024)
+// scale factors are rounded to multiples of 1/TEXTCACHE_SCALE_STEPS
+#define TEXTCACHE_SCALE_STEPS 4096
+// the position of a line is rounded to multiples of 1/TEXTCACHE_SUBPIXEL_STEPS pixels
+#define TEXTCACHE_SUBPIXEL_STEPS 4
+
+/*
+ * Caches the text lines rendered by CairoPangoRenderer as 8 bit coverage
+ * masks, so TextFields only shape and rasterize lines that have changed
+ * since they were last rendered. The masks don't contain the text color, it
+ * is applied when the mask is composited.
+ *
+ * A line is identified by its text, the font attributes, the scale and the
+ * fractional part of its position in device pixels. The least recently used
+ * lines are evicted when the size of the masks exceeds the limit.
+ *
+ * All methods are thread safe.
+ */
+class TextRasterCache
+{
+public:
+	struct Key
+	{
+		tiny_string text;
+		tiny_string font;
+		uint32_t fontSize;
+		bool bold;
+		bool italic;
+		int64_t xscale;
+		int64_t yscale;
+		// fractional part of the position of the line origin, in 1/TEXTCACHE_SUBPIXEL_STEPS pixels
+		int32_t subpixelX;
+		int32_t subpixelY;
+		bool smoothing;
+		bool operator<(const Key& r) const;
+	};
+	struct Line
+	{
+		// position of the mask relative to the integer part of the line origin, in device pixels
+		int32_t x;
+		int32_t y;
+		int32_t width;
+		int32_t height;
+		int32_t stride;
+		// height*stride bytes, empty for lines without visible glyphs
+		std::vector<uint8_t> mask;
+	};
+private:
+	struct Entry
+	{
+		Line line;
+		std::list<Key>::iterator lruPosition;
+	};
+	Mutex mutex;
+	std::map<Key, Entry> entries;
+	// most recently used key first
+	std::list<Key> lru;
+	uint64_t maxSize;
+	uint64_t totalSize;
+	uint64_t hits;
+	uint64_t misses;
+	// mutex must be held by the caller
+	void evict(uint64_t neededSize);
+	static uint64_t getEntrySize(const Key& key, const Line& line);
+public:
+	TextRasterCache(uint64_t _maxSize=TEXTCACHE_MAX_SIZE);
+	static int64_t quantizeScale(double scale);
+	// copies the cached line for key to line, returns false if key is not in the cache
+	bool lookup(const Key& key, Line& line);
+	void insert(const Key& key, const Line& line);
+	void clear();
+	uint64_t getSize() const { return totalSize; }
+	uint64_t getHits() const { return hits; }
+	uint64_t getMisses() const { return misses; }
+};
+
+}
+#endif /* BACKENDS_TEXTCACHE_H */
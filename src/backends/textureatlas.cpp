@@ -0,0 +1,241 @@
+/**************************************************************************
+    Lightspark, a free flash player implementation
+
+    Copyright (C) 2024  Ludger Krämer <dbluelle@onlinehome.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include "backends/textureatlas.h"
+
+using namespace std;
+using namespace lightspark;
+
+TextureAtlas::TextureAtlas(uint32_t _size):size(_size),nextY(0),usedArea(0),itemCount(0)
+{
+}
+
+bool TextureAtlas::allocateOnShelf(Shelf& shelf, uint32_t w, uint32_t& x)
+{
+	for (auto it = shelf.freeSpans.begin(); it != shelf.freeSpans.end(); it++)
+	{
+		if (it->width < w)
+			continue;
+		x = it->x;
+		it->x += w;
+		it->width -= w;
+		if (it->width == 0)
+			shelf.freeSpans.erase(it);
+		shelf.used += w;
+		return true;
+	}
+	return false;
+}
+
+bool TextureAtlas::allocate(uint32_t w, uint32_t h, uint32_t& x, uint32_t& y)
+{
+	if (w == 0 || h == 0 || w > size || h > size)
+		return false;
+	uint32_t shelfheight = (h+ATLAS_SHELF_GRANULARITY-1)/ATLAS_SHELF_GRANULARITY*ATLAS_SHELF_GRANULARITY;
+	// find the lowest shelf the area fits in, don't waste shelves that are much higher than needed
+	Shelf* best = nullptr;
+	for (auto it = shelves.begin(); it != shelves.end(); it++)
+	{
+		if (it->height < h)
+			continue;
+		if (it->used && it->height > shelfheight*2)
+			continue;
+		if (best && best->height <= it->height)
+			continue;
+		for (auto itspan = it->freeSpans.begin(); itspan != it->freeSpans.end(); itspan++)
+		{
+			if (itspan->width >= w)
+			{
+				best = &(*it);
+				break;
+			}
+		}
+	}
+	if (best)
+	{
+		if (best->used == 0 && best->height >= shelfheight+ATLAS_SHELF_GRANULARITY)
+		{
+			// split the empty shelf, the rest stays available for other heights
+			Shelf rest;
+			rest.y = best->y+shelfheight;
+			rest.height = best->height-shelfheight;
+			rest.used = 0;
+			rest.freeSpans.push_back({0, size});
+			best->height = shelfheight;
+			uint32_t index = best-shelves.data();
+			shelves.insert(shelves.begin()+index+1, rest);
+			best = &shelves[index];
+		}
+		y = best->y;
+		allocateOnShelf(*best, w, x);
+	}
+	else
+	{
+		if (nextY+shelfheight > size)
+			return false;
+		Shelf shelf;
+		shelf.y = nextY;
+		shelf.height = shelfheight;
+		shelf.used = 0;
+		shelf.freeSpans.push_back({0, size});
+		shelves.push_back(shelf);
+		nextY += shelfheight;
+		y = shelf.y;
+		allocateOnShelf(shelves.back(), w, x);
+	}
+	usedArea += uint64_t(w)*uint64_t(h);
+	itemCount++;
+	return true;
+}
+
+void TextureAtlas::release(uint32_t x, uint32_t y, uint32_t w, uint32_t h)
+{
+	// drop the pending upload of the area, it may be reused before the uploads are flushed
+	for (auto it = pendingUploads.begin(); it != pendingUploads.end();)
+	{
+		if (it->x == x && it->y == y)
+			it = pendingUploads.erase(it);
+		else
+			it++;
+	}
+	auto it = shelves.begin();
+	while (it != shelves.end() && it->y != y)
+		it++;
+	assert(it != shelves.end() && it->used >= w);
+	if (it == shelves.end())
+		return;
+	Shelf& shelf = *it;
+	// insert the span and merge it with its neighbours
+	auto itspan = shelf.freeSpans.begin();
+	while (itspan != shelf.freeSpans.end() && itspan->x < x)
+		itspan++;
+	itspan = shelf.freeSpans.insert(itspan, {x, w});
+	auto next = itspan+1;
+	if (next != shelf.freeSpans.end() && itspan->x+itspan->width == next->x)
+	{
+		itspan->width += next->width;
+		shelf.freeSpans.erase(next);
+	}
+	if (itspan != shelf.freeSpans.begin())
+	{
+		auto prev = itspan-1;
+		if (prev->x+prev->width == itspan->x)
+		{
+			prev->width += itspan->width;
+			shelf.freeSpans.erase(itspan);
+		}
+	}
+	shelf.used -= w;
+	usedArea -= uint64_t(w)*uint64_t(h);
+	itemCount--;
+	if (shelf.used == 0)
+		mergeEmptyShelves();
+}
+
+void TextureAtlas::mergeEmptyShelves()
+{
+	for (uint32_t i = 0; i+1 < shelves.size();)
+	{
+		if (shelves[i].used == 0 && shelves[i+1].used == 0)
+		{
+			shelves[i].height += shelves[i+1].height;
+			shelves.erase(shelves.begin()+i+1);
+		}
+		else
+			i++;
+	}
+	// give empty space at the bottom back to the page
+	if (!shelves.empty() && shelves.back().used == 0)
+	{
+		nextY = shelves.back().y;
+		shelves.pop_back();
+	}
+	for (auto it = shelves.begin(); it != shelves.end(); it++)
+	{
+		if (it->used == 0)
+		{
+			it->freeSpans.clear();
+			it->freeSpans.push_back({0, size});
+		}
+	}
+}
+
+void TextureAtlas::addUpload(uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint8_t* data)
+{
+	// a newer upload to the same area replaces the old one
+	for (auto it = pendingUploads.begin(); it != pendingUploads.end();)
+	{
+		if (it->x == x && it->y == y)
+			it = pendingUploads.erase(it);
+		else
+			it++;
+	}
+	Upload u;
+	u.x = x;
+	u.y = y;
+	u.width = w;
+	u.height = h;
+	u.data.assign(data, data+w*h*4);
+	pendingUploads.push_back(std::move(u));
+}
+
+void TextureAtlas::takeUploads(std::vector<Upload>& uploads)
+{
+	sort(pendingUploads.begin(), pendingUploads.end(), [](const Upload& a, const Upload& b)
+	{
+		return a.y < b.y || (a.y == b.y && a.x < b.x);
+	});
+	auto it = pendingUploads.begin();
+	while (it != pendingUploads.end())
+	{
+		// all areas of a shelf start at the top of the shelf, so uploads next to each other can be merged
+		auto last = it+1;
+		uint32_t width = it->width;
+		uint32_t height = it->height;
+		while (last != pendingUploads.end() && last->y == it->y && (last-1)->x+(last-1)->width == last->x)
+		{
+			width += last->width;
+			height = max(height, last->height);
+			last++;
+		}
+		if (last == it+1)
+			uploads.push_back(std::move(*it));
+		else
+		{
+			// the columns of every area belong to that area for the whole shelf height, so the gaps can be filled with zeros
+			Upload merged;
+			merged.x = it->x;
+			merged.y = it->y;
+			merged.width = width;
+			merged.height = height;
+			merged.data.resize(width*height*4, 0);
+			for (auto itpart = it; itpart != last; itpart++)
+			{
+				for (uint32_t row = 0; row < itpart->height; row++)
+					memcpy(merged.data.data()+(row*width+itpart->x-merged.x)*4, itpart->data.data()+row*itpart->width*4, itpart->width*4);
+			}
+			uploads.push_back(std::move(merged));
+		}
+		it = last;
+	}
+	pendingUploads.clear();
+}
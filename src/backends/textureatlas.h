@@ -0,0 +1,109 @@
+/**************************************************************************
+    Lightspark, a free flash player implementation
+
+    Copyright (C) 2024  Ludger Krämer <dbluelle@onlinehome.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef BACKENDS_TEXTUREATLAS_H
+#define BACKENDS_TEXTUREATLAS_H 1
+
+#include <cstdint>
+#include <vector>
+#include "compat.h"
+
+namespace lightspark
+{
+
+// size of the textures used as atlas pages
+#define ATLAS_PAGE_SIZE 2048
+// textures up to this size (including the 1 pixel border) are packed into atlas pages
+#define ATLAS_MAX_ITEM_SIZE 64
+// shelf heights are rounded up to multiples of this
+#define ATLAS_SHELF_GRANULARITY 4
+
+/*
+ * Packs small textures into a shared texture page, using shelves
+ * (horizontal stripes of the page) that are filled from left to right.
+ *
+ * Released space is merged with its free neighbours, shelves that become
+ * empty are merged with adjacent empty shelves, and empty shelves at the
+ * bottom of the page are returned to the unused part of the page, so the
+ * page does not fragment over time.
+ *
+ * The pixels of the allocated areas are not uploaded directly, but queued
+ * until the render thread flushes all uploads of the page at once.
+ *
+ * Not thread safe, the RenderThread protects it with mutexLargeTexture.
+ */
+class TextureAtlas
+{
+public:
+	struct Upload
+	{
+		uint32_t x;
+		uint32_t y;
+		uint32_t width;
+		uint32_t height;
+		std::vector<uint8_t> data;
+	};
+private:
+	struct Span
+	{
+		uint32_t x;
+		uint32_t width;
+	};
+	struct Shelf
+	{
+		uint32_t y;
+		uint32_t height;
+		// sum of the widths of all allocated areas
+		uint32_t used;
+		// free parts of the shelf, sorted by x
+		std::vector<Span> freeSpans;
+	};
+	uint32_t size;
+	// sorted by y, the shelves cover the page from 0 to nextY without gaps
+	std::vector<Shelf> shelves;
+	uint32_t nextY;
+	uint64_t usedArea;
+	uint32_t itemCount;
+	std::vector<Upload> pendingUploads;
+	bool allocateOnShelf(Shelf& shelf, uint32_t w, uint32_t& x);
+	void mergeEmptyShelves();
+public:
+	TextureAtlas(uint32_t _size=ATLAS_PAGE_SIZE);
+	/*
+	 * Allocates an area of w*h pixels
+	 * @return false if the page has no space left
+	 */
+	bool allocate(uint32_t w, uint32_t h, uint32_t& x, uint32_t& y);
+	// releases an area returned by allocate()
+	void release(uint32_t x, uint32_t y, uint32_t w, uint32_t h);
+	// queues the upload of w*h BGRA pixels to x/y, data is copied
+	void addUpload(uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint8_t* data);
+	/*
+	 * Returns all queued uploads and clears the queue.
+	 * Uploads to adjacent areas of the same shelf are merged into one
+	 */
+	void takeUploads(std::vector<Upload>& uploads);
+	bool hasPendingUploads() const { return !pendingUploads.empty(); }
+	uint32_t getSize() const { return size; }
+	uint64_t getUsedArea() const { return usedArea; }
+	uint32_t getItemCount() const { return itemCount; }
+};
+
+}
+#endif /* BACKENDS_TEXTUREATLAS_H */
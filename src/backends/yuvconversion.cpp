@@ -0,0 +1,550 @@
+/**************************************************************************
+    Lightspark, a free flash player implementation
+
+    Copyright (C) 2024  Ludger Krämer <dbluelle@onlinehome.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <SDL.h>
+#include "backends/yuvconversion.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+// the AVX2 kernels are compiled with a target attribute and only used if the cpu supports them
+#define YUV_AVX2_KERNELS 1
+#include <immintrin.h>
+#endif
+#endif
+
+using namespace std;
+using namespace lightspark;
+
+namespace
+{
+/*
+ * BT.601 limited range conversion with the same coefficients as the video shader:
+ * r = 1.164383*(y-16) + 1.596027*(v-128)
+ * g = 1.164383*(y-16) - 0.391762*(u-128) - 0.812968*(v-128)
+ * b = 1.164383*(y-16) + 2.017232*(u-128)
+ * The inputs are shifted left by 7 and multiplied by the coefficients in 13 bit fixed point,
+ * keeping the upper 16 bits of the product (like _mm_mulhi_epi16), which leaves 4 fractional bits.
+ * All intermediate values fit into 16 bit
+ */
+const int32_t YUV_Y = 9539;
+const int32_t YUV_VR = 13075;
+const int32_t YUV_UG = 3209;
+const int32_t YUV_VG = 6660;
+const int32_t YUV_UB = 16525;
+
+inline int32_t mulhi(int32_t a, int32_t b)
+{
+	return (a*b)>>16;
+}
+
+inline uint32_t clampChannel(int32_t c)
+{
+	return c < 0 ? 0 : (c > 255 ? 255 : c);
+}
+
+// exact c*a/255 for c,a <= 255, as used by premultiplyPixel
+inline uint32_t premultiplyChannel(uint32_t c, uint32_t a)
+{
+	uint32_t t = c*a;
+	return (t+1+(t>>8))>>8;
+}
+
+struct YUVKernels
+{
+	const char* name;
+	// y, u, v and alpha (may be null) rows to Y, U, V, alpha bytes
+	void (*packRow)(const uint8_t* y, const uint8_t* u, const uint8_t* v, const uint8_t* a, uint8_t* out, uint32_t count);
+	// y, u, v and alpha (may be null) rows to premultiplied ARGB
+	void (*convertRow)(const uint8_t* y, const uint8_t* u, const uint8_t* v, const uint8_t* a, uint8_t* out, uint32_t count);
+	// dst[i] = src[i/2]
+	void (*upsampleRow)(const uint8_t* src, uint8_t* dst, uint32_t count);
+	// u[i] = uv[(i/2)*2], v[i] = uv[(i/2)*2+1]
+	void (*splitUpsampleRow)(const uint8_t* uv, uint8_t* u, uint8_t* v, uint32_t count);
+	// splits Y, U, V, alpha bytes into separate rows
+	void (*unpackRow)(const uint8_t* in, uint8_t* y, uint8_t* u, uint8_t* v, uint8_t* a, uint32_t count);
+};
+
+void packRowScalar(const uint8_t* y, const uint8_t* u, const uint8_t* v, const uint8_t* a, uint8_t* out, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++)
+	{
+		out[i*4  ] = y[i];
+		out[i*4+1] = u[i];
+		out[i*4+2] = v[i];
+		out[i*4+3] = a ? a[i] : 0xff;
+	}
+}
+
+void convertRowScalar(const uint8_t* y, const uint8_t* u, const uint8_t* v, const uint8_t* a, uint8_t* out, uint32_t count)
+{
+	uint32_t* dst = (uint32_t*)out;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		int32_t yy = mulhi((int32_t(y[i])-16)<<7,YUV_Y)+8;
+		int32_t uu = (int32_t(u[i])-128)<<7;
+		int32_t vv = (int32_t(v[i])-128)<<7;
+		uint32_t r = clampChannel((yy+mulhi(vv,YUV_VR))>>4);
+		uint32_t g = clampChannel((yy-mulhi(uu,YUV_UG)-mulhi(vv,YUV_VG))>>4);
+		uint32_t b = clampChannel((yy+mulhi(uu,YUV_UB))>>4);
+		uint32_t alpha = a ? a[i] : 0xff;
+		if (alpha != 0xff)
+		{
+			r = premultiplyChannel(r,alpha);
+			g = premultiplyChannel(g,alpha);
+			b = premultiplyChannel(b,alpha);
+		}
+		dst[i] = (alpha<<24)|(r<<16)|(g<<8)|b;
+	}
+}
+
+void upsampleRowScalar(const uint8_t* src, uint8_t* dst, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++)
+		dst[i] = src[i/2];
+}
+
+void splitUpsampleRowScalar(const uint8_t* uv, uint8_t* u, uint8_t* v, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++)
+	{
+		u[i] = uv[(i/2)*2];
+		v[i] = uv[(i/2)*2+1];
+	}
+}
+
+void unpackRowScalar(const uint8_t* in, uint8_t* y, uint8_t* u, uint8_t* v, uint8_t* a, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++)
+	{
+		y[i] = in[i*4  ];
+		u[i] = in[i*4+1];
+		v[i] = in[i*4+2];
+		a[i] = in[i*4+3];
+	}
+}
+
+#ifdef __SSE2__
+// interleaves 16 pixels given as 4 vectors of channel bytes and stores them
+inline void storeInterleaved(uint8_t* out, __m128i c0, __m128i c1, __m128i c2, __m128i c3)
+{
+	__m128i lo01 = _mm_unpacklo_epi8(c0,c1);
+	__m128i hi01 = _mm_unpackhi_epi8(c0,c1);
+	__m128i lo23 = _mm_unpacklo_epi8(c2,c3);
+	__m128i hi23 = _mm_unpackhi_epi8(c2,c3);
+	_mm_storeu_si128((__m128i*)(out   ),_mm_unpacklo_epi16(lo01,lo23));
+	_mm_storeu_si128((__m128i*)(out+16),_mm_unpackhi_epi16(lo01,lo23));
+	_mm_storeu_si128((__m128i*)(out+32),_mm_unpacklo_epi16(hi01,hi23));
+	_mm_storeu_si128((__m128i*)(out+48),_mm_unpackhi_epi16(hi01,hi23));
+}
+
+void packRowSSE2(const uint8_t* y, const uint8_t* u, const uint8_t* v, const uint8_t* a, uint8_t* out, uint32_t count)
+{
+	const __m128i ff = _mm_set1_epi8((char)0xff);
+	uint32_t i = 0;
+	for (; i+16 <= count; i+=16)
+	{
+		__m128i av = a ? _mm_loadu_si128((const __m128i*)(a+i)) : ff;
+		storeInterleaved(out+i*4,
+			_mm_loadu_si128((const __m128i*)(y+i)),
+			_mm_loadu_si128((const __m128i*)(u+i)),
+			_mm_loadu_si128((const __m128i*)(v+i)),
+			av);
+	}
+	packRowScalar(y+i,u+i,v+i,a ? a+i : nullptr,out+i*4,count-i);
+}
+
+// converts 8 pixels given as 16 bit lanes to clamped and premultiplied 16 bit channels
+inline void convert8(__m128i y, __m128i u, __m128i v, __m128i a, bool hasAlpha, __m128i& r, __m128i& g, __m128i& b)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i max = _mm_set1_epi16(255);
+	y = _mm_add_epi16(_mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(y,_mm_set1_epi16(16)),7),_mm_set1_epi16(YUV_Y)),_mm_set1_epi16(8));
+	u = _mm_slli_epi16(_mm_sub_epi16(u,_mm_set1_epi16(128)),7);
+	v = _mm_slli_epi16(_mm_sub_epi16(v,_mm_set1_epi16(128)),7);
+	r = _mm_add_epi16(y,_mm_mulhi_epi16(v,_mm_set1_epi16(YUV_VR)));
+	g = _mm_sub_epi16(_mm_sub_epi16(y,_mm_mulhi_epi16(u,_mm_set1_epi16(YUV_UG))),_mm_mulhi_epi16(v,_mm_set1_epi16(YUV_VG)));
+	b = _mm_add_epi16(y,_mm_mulhi_epi16(u,_mm_set1_epi16(YUV_UB)));
+	r = _mm_max_epi16(_mm_min_epi16(_mm_srai_epi16(r,4),max),zero);
+	g = _mm_max_epi16(_mm_min_epi16(_mm_srai_epi16(g,4),max),zero);
+	b = _mm_max_epi16(_mm_min_epi16(_mm_srai_epi16(b,4),max),zero);
+	if (hasAlpha)
+	{
+		const __m128i one = _mm_set1_epi16(1);
+		__m128i t = _mm_mullo_epi16(r,a);
+		r = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(t,one),_mm_srli_epi16(t,8)),8);
+		t = _mm_mullo_epi16(g,a);
+		g = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(t,one),_mm_srli_epi16(t,8)),8);
+		t = _mm_mullo_epi16(b,a);
+		b = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(t,one),_mm_srli_epi16(t,8)),8);
+	}
+}
+
+void convertRowSSE2(const uint8_t* y, const uint8_t* u, const uint8_t* v, const uint8_t* a, uint8_t* out, uint32_t count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ff = _mm_set1_epi8((char)0xff);
+	uint32_t i = 0;
+	for (; i+16 <= count; i+=16)
+	{
+		__m128i yv = _mm_loadu_si128((const __m128i*)(y+i));
+		__m128i uv = _mm_loadu_si128((const __m128i*)(u+i));
+		__m128i vv = _mm_loadu_si128((const __m128i*)(v+i));
+		__m128i av = a ? _mm_loadu_si128((const __m128i*)(a+i)) : ff;
+		__m128i rlo,glo,blo,rhi,ghi,bhi;
+		convert8(_mm_unpacklo_epi8(yv,zero),_mm_unpacklo_epi8(uv,zero),_mm_unpacklo_epi8(vv,zero),_mm_unpacklo_epi8(av,zero),a,rlo,glo,blo);
+		convert8(_mm_unpackhi_epi8(yv,zero),_mm_unpackhi_epi8(uv,zero),_mm_unpackhi_epi8(vv,zero),_mm_unpackhi_epi8(av,zero),a,rhi,ghi,bhi);
+		// native byte order of 0xAARRGGBB on x86 is b, g, r, a
+		storeInterleaved(out+i*4,_mm_packus_epi16(blo,bhi),_mm_packus_epi16(glo,ghi),_mm_packus_epi16(rlo,rhi),av);
+	}
+	convertRowScalar(y+i,u+i,v+i,a ? a+i : nullptr,out+i*4,count-i);
+}
+
+void upsampleRowSSE2(const uint8_t* src, uint8_t* dst, uint32_t count)
+{
+	uint32_t i = 0;
+	for (; i+32 <= count; i+=32)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i*)(src+i/2));
+		_mm_storeu_si128((__m128i*)(dst+i   ),_mm_unpacklo_epi8(s,s));
+		_mm_storeu_si128((__m128i*)(dst+i+16),_mm_unpackhi_epi8(s,s));
+	}
+	upsampleRowScalar(src+i/2,dst+i,count-i);
+}
+
+void splitUpsampleRowSSE2(const uint8_t* uv, uint8_t* u, uint8_t* v, uint32_t count)
+{
+	const __m128i mask = _mm_set1_epi16(0xff);
+	uint32_t i = 0;
+	for (; i+32 <= count; i+=32)
+	{
+		__m128i s0 = _mm_loadu_si128((const __m128i*)(uv+i));
+		__m128i s1 = _mm_loadu_si128((const __m128i*)(uv+i+16));
+		__m128i uu = _mm_packus_epi16(_mm_and_si128(s0,mask),_mm_and_si128(s1,mask));
+		__m128i vv = _mm_packus_epi16(_mm_srli_epi16(s0,8),_mm_srli_epi16(s1,8));
+		_mm_storeu_si128((__m128i*)(u+i   ),_mm_unpacklo_epi8(uu,uu));
+		_mm_storeu_si128((__m128i*)(u+i+16),_mm_unpackhi_epi8(uu,uu));
+		_mm_storeu_si128((__m128i*)(v+i   ),_mm_unpacklo_epi8(vv,vv));
+		_mm_storeu_si128((__m128i*)(v+i+16),_mm_unpackhi_epi8(vv,vv));
+	}
+	splitUpsampleRowScalar(uv+i,u+i,v+i,count-i);
+}
+
+// extracts the byte at shift of the 16 pixels in p0-p3
+inline __m128i extractChannel(__m128i p0, __m128i p1, __m128i p2, __m128i p3, int shift)
+{
+	const __m128i mask = _mm_set1_epi32(0xff);
+	__m128i c0 = _mm_and_si128(_mm_srl_epi32(p0,_mm_cvtsi32_si128(shift)),mask);
+	__m128i c1 = _mm_and_si128(_mm_srl_epi32(p1,_mm_cvtsi32_si128(shift)),mask);
+	__m128i c2 = _mm_and_si128(_mm_srl_epi32(p2,_mm_cvtsi32_si128(shift)),mask);
+	__m128i c3 = _mm_and_si128(_mm_srl_epi32(p3,_mm_cvtsi32_si128(shift)),mask);
+	return _mm_packus_epi16(_mm_packs_epi32(c0,c1),_mm_packs_epi32(c2,c3));
+}
+
+void unpackRowSSE2(const uint8_t* in, uint8_t* y, uint8_t* u, uint8_t* v, uint8_t* a, uint32_t count)
+{
+	uint32_t i = 0;
+	for (; i+16 <= count; i+=16)
+	{
+		__m128i p0 = _mm_loadu_si128((const __m128i*)(in+i*4   ));
+		__m128i p1 = _mm_loadu_si128((const __m128i*)(in+i*4+16));
+		__m128i p2 = _mm_loadu_si128((const __m128i*)(in+i*4+32));
+		__m128i p3 = _mm_loadu_si128((const __m128i*)(in+i*4+48));
+		_mm_storeu_si128((__m128i*)(y+i),extractChannel(p0,p1,p2,p3,0));
+		_mm_storeu_si128((__m128i*)(u+i),extractChannel(p0,p1,p2,p3,8));
+		_mm_storeu_si128((__m128i*)(v+i),extractChannel(p0,p1,p2,p3,16));
+		_mm_storeu_si128((__m128i*)(a+i),extractChannel(p0,p1,p2,p3,24));
+	}
+	unpackRowScalar(in+i*4,y+i,u+i,v+i,a+i,count-i);
+}
+#endif
+
+#ifdef YUV_AVX2_KERNELS
+// same as convert8 for 16 pixels
+__attribute__((target("avx2")))
+inline void convert16(__m256i y, __m256i u, __m256i v, __m256i a, bool hasAlpha, __m256i& r, __m256i& g, __m256i& b)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i max = _mm256_set1_epi16(255);
+	y = _mm256_add_epi16(_mm256_mulhi_epi16(_mm256_slli_epi16(_mm256_sub_epi16(y,_mm256_set1_epi16(16)),7),_mm256_set1_epi16(YUV_Y)),_mm256_set1_epi16(8));
+	u = _mm256_slli_epi16(_mm256_sub_epi16(u,_mm256_set1_epi16(128)),7);
+	v = _mm256_slli_epi16(_mm256_sub_epi16(v,_mm256_set1_epi16(128)),7);
+	r = _mm256_add_epi16(y,_mm256_mulhi_epi16(v,_mm256_set1_epi16(YUV_VR)));
+	g = _mm256_sub_epi16(_mm256_sub_epi16(y,_mm256_mulhi_epi16(u,_mm256_set1_epi16(YUV_UG))),_mm256_mulhi_epi16(v,_mm256_set1_epi16(YUV_VG)));
+	b = _mm256_add_epi16(y,_mm256_mulhi_epi16(u,_mm256_set1_epi16(YUV_UB)));
+	r = _mm256_max_epi16(_mm256_min_epi16(_mm256_srai_epi16(r,4),max),zero);
+	g = _mm256_max_epi16(_mm256_min_epi16(_mm256_srai_epi16(g,4),max),zero);
+	b = _mm256_max_epi16(_mm256_min_epi16(_mm256_srai_epi16(b,4),max),zero);
+	if (hasAlpha)
+	{
+		const __m256i one = _mm256_set1_epi16(1);
+		__m256i t = _mm256_mullo_epi16(r,a);
+		r = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(t,one),_mm256_srli_epi16(t,8)),8);
+		t = _mm256_mullo_epi16(g,a);
+		g = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(t,one),_mm256_srli_epi16(t,8)),8);
+		t = _mm256_mullo_epi16(b,a);
+		b = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(t,one),_mm256_srli_epi16(t,8)),8);
+	}
+}
+
+// packs the 16 bit lanes to bytes, keeping the order of the pixels
+__attribute__((target("avx2")))
+inline __m128i pack16(__m256i c)
+{
+	return _mm_packus_epi16(_mm256_castsi256_si128(c),_mm256_extracti128_si256(c,1));
+}
+
+__attribute__((target("avx2")))
+void convertRowAVX2(const uint8_t* y, const uint8_t* u, const uint8_t* v, const uint8_t* a, uint8_t* out, uint32_t count)
+{
+	const __m128i ff = _mm_set1_epi8((char)0xff);
+	uint32_t i = 0;
+	for (; i+16 <= count; i+=16)
+	{
+		__m128i av = a ? _mm_loadu_si128((const __m128i*)(a+i)) : ff;
+		__m256i r,g,b;
+		convert16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(y+i))),
+			_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(u+i))),
+			_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(v+i))),
+			_mm256_cvtepu8_epi16(av),a,r,g,b);
+		storeInterleaved(out+i*4,pack16(b),pack16(g),pack16(r),av);
+	}
+	convertRowScalar(y+i,u+i,v+i,a ? a+i : nullptr,out+i*4,count-i);
+}
+#endif
+
+// fills k with the requested kernels, the fastest ones supported by the cpu for YUV_KERNELS_AUTO
+bool selectKernels(YUV_KERNELS requested, YUVKernels& k)
+{
+	k.name = "scalar";
+	k.packRow = packRowScalar;
+	k.convertRow = convertRowScalar;
+	k.upsampleRow = upsampleRowScalar;
+	k.splitUpsampleRow = splitUpsampleRowScalar;
+	k.unpackRow = unpackRowScalar;
+	if (requested == YUV_KERNELS_SCALAR)
+		return true;
+#ifdef __SSE2__
+	k.name = "SSE2";
+	k.packRow = packRowSSE2;
+	k.convertRow = convertRowSSE2;
+	k.upsampleRow = upsampleRowSSE2;
+	k.splitUpsampleRow = splitUpsampleRowSSE2;
+	k.unpackRow = unpackRowSSE2;
+	if (requested == YUV_KERNELS_SSE2)
+		return true;
+#endif
+#ifdef YUV_AVX2_KERNELS
+	if (SDL_HasAVX2())
+	{
+		k.name = "AVX2";
+		k.convertRow = convertRowAVX2;
+		return true;
+	}
+#endif
+	return requested == YUV_KERNELS_AUTO;
+}
+
+YUVKernels fastestKernels()
+{
+	YUVKernels k;
+	selectKernels(YUV_KERNELS_AUTO,k);
+	return k;
+}
+
+YUVKernels& getKernels()
+{
+	static YUVKernels kernels = fastestKernels();
+	return kernels;
+}
+
+// Y, U, V and alpha of one pixel, read directly from the planes
+void readPixelReference(const YUVImage& img, uint32_t x, uint32_t row, uint8_t& y, uint8_t& u, uint8_t& v, uint8_t& a)
+{
+	if (img.format == YUV_FORMAT_PACKED_YUVA)
+	{
+		const uint8_t* p = img.planes[0]+row*img.strides[0]+x*4;
+		y = p[0];
+		u = p[1];
+		v = p[2];
+		a = p[3];
+		return;
+	}
+	y = img.planes[0][row*img.strides[0]+x];
+	a = img.planes[3] ? img.planes[3][row*img.strides[3]+x] : 0xff;
+	switch (img.format)
+	{
+		case YUV_FORMAT_420P:
+			u = img.planes[1][(row/2)*img.strides[1]+x/2];
+			v = img.planes[2][(row/2)*img.strides[2]+x/2];
+			break;
+		case YUV_FORMAT_422P:
+			u = img.planes[1][row*img.strides[1]+x/2];
+			v = img.planes[2][row*img.strides[2]+x/2];
+			break;
+		case YUV_FORMAT_NV12:
+			u = img.planes[1][(row/2)*img.strides[1]+(x/2)*2];
+			v = img.planes[1][(row/2)*img.strides[1]+(x/2)*2+1];
+			break;
+		default:
+			u = img.planes[1][row*img.strides[1]+x];
+			v = img.planes[2][row*img.strides[2]+x];
+			break;
+	}
+}
+
+/*
+ * Provides the rows of an image as full resolution y, u, v and alpha rows,
+ * subsampled and interleaved planes are expanded into temporary rows
+ */
+class RowReader
+{
+private:
+	const YUVImage& img;
+	const YUVKernels& kernels;
+	std::vector<uint8_t> tmp;
+	uint8_t* tmpY;
+	uint8_t* tmpU;
+	uint8_t* tmpV;
+	uint8_t* tmpA;
+	uint32_t lastChromaRow;
+public:
+	const uint8_t* y;
+	const uint8_t* u;
+	const uint8_t* v;
+	const uint8_t* a;
+	RowReader(const YUVImage& _img, const YUVKernels& _kernels):img(_img),kernels(_kernels),tmp(img.width*4),lastChromaRow(UINT32_MAX),y(nullptr),u(nullptr),v(nullptr),a(nullptr)
+	{
+		tmpY = tmp.data();
+		tmpU = tmpY+img.width;
+		tmpV = tmpU+img.width;
+		tmpA = tmpV+img.width;
+	}
+	void readRow(uint32_t row)
+	{
+		if (img.format == YUV_FORMAT_PACKED_YUVA)
+		{
+			kernels.unpackRow(img.planes[0]+row*img.strides[0],tmpY,tmpU,tmpV,tmpA,img.width);
+			y = tmpY;
+			u = tmpU;
+			v = tmpV;
+			a = tmpA;
+			return;
+		}
+		y = img.planes[0]+row*img.strides[0];
+		a = img.planes[3] ? img.planes[3]+row*img.strides[3] : nullptr;
+		if (img.format == YUV_FORMAT_444P)
+		{
+			u = img.planes[1]+row*img.strides[1];
+			v = img.planes[2]+row*img.strides[2];
+			return;
+		}
+		uint32_t chromaRow = (img.format == YUV_FORMAT_422P) ? row : row/2;
+		u = tmpU;
+		v = tmpV;
+		// the expanded chroma row is shared by two rows of 4:2:0 images
+		if (chromaRow == lastChromaRow)
+			return;
+		lastChromaRow = chromaRow;
+		if (img.format == YUV_FORMAT_NV12)
+			kernels.splitUpsampleRow(img.planes[1]+chromaRow*img.strides[1],tmpU,tmpV,img.width);
+		else
+		{
+			kernels.upsampleRow(img.planes[1]+chromaRow*img.strides[1],tmpU,img.width);
+			kernels.upsampleRow(img.planes[2]+chromaRow*img.strides[2],tmpV,img.width);
+		}
+	}
+};
+}
+
+void lightspark::yuvToPackedYUVA(const YUVImage& img, uint8_t* out, uint32_t outstride)
+{
+	if (img.format == YUV_FORMAT_PACKED_YUVA)
+	{
+		for (uint32_t i = 0; i < img.height; i++)
+			memcpy(out+i*outstride,img.planes[0]+i*img.strides[0],img.width*4);
+		return;
+	}
+	const YUVKernels& kernels = getKernels();
+	RowReader reader(img,kernels);
+	for (uint32_t i = 0; i < img.height; i++)
+	{
+		reader.readRow(i);
+		kernels.packRow(reader.y,reader.u,reader.v,reader.a,out+i*outstride,img.width);
+	}
+}
+
+void lightspark::yuvToPremultipliedARGB(const YUVImage& img, uint8_t* out, uint32_t outstride)
+{
+	const YUVKernels& kernels = getKernels();
+	RowReader reader(img,kernels);
+	for (uint32_t i = 0; i < img.height; i++)
+	{
+		reader.readRow(i);
+		kernels.convertRow(reader.y,reader.u,reader.v,reader.a,out+i*outstride,img.width);
+	}
+}
+
+const char* lightspark::getYUVKernelName()
+{
+	return getKernels().name;
+}
+
+bool lightspark::setYUVKernels(YUV_KERNELS kernels)
+{
+	YUVKernels k;
+	if (!selectKernels(kernels,k))
+		return false;
+	getKernels() = k;
+	return true;
+}
+
+void lightspark::yuvToPackedYUVAReference(const YUVImage& img, uint8_t* out, uint32_t outstride)
+{
+	for (uint32_t row = 0; row < img.height; row++)
+	{
+		for (uint32_t x = 0; x < img.width; x++)
+		{
+			uint8_t* p = out+row*outstride+x*4;
+			readPixelReference(img,x,row,p[0],p[1],p[2],p[3]);
+		}
+	}
+}
+
+void lightspark::yuvToPremultipliedARGBReference(const YUVImage& img, uint8_t* out, uint32_t outstride)
+{
+	for (uint32_t row = 0; row < img.height; row++)
+	{
+		uint32_t* dst = (uint32_t*)(out+row*outstride);
+		for (uint32_t x = 0; x < img.width; x++)
+		{
+			uint8_t y,u,v,a;
+			readPixelReference(img,x,row,y,u,v,a);
+			int32_t yy = mulhi((int32_t(y)-16)<<7,YUV_Y)+8;
+			int32_t uu = (int32_t(u)-128)<<7;
+			int32_t vv = (int32_t(v)-128)<<7;
+			uint32_t r = premultiplyChannel(clampChannel((yy+mulhi(vv,YUV_VR))>>4),a);
+			uint32_t g = premultiplyChannel(clampChannel((yy-mulhi(uu,YUV_UG)-mulhi(vv,YUV_VG))>>4),a);
+			uint32_t b = premultiplyChannel(clampChannel((yy+mulhi(uu,YUV_UB))>>4),a);
+			dst[x] = (uint32_t(a)<<24)|(r<<16)|(g<<8)|b;
+		}
+	}
+}
@@ -0,0 +1,97 @@
+/**************************************************************************
+    Lightspark, a free flash player implementation
+
+    Copyright (C) 2024  Ludger Krämer <dbluelle@onlinehome.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef BACKENDS_YUVCONVERSION_H
+#define BACKENDS_YUVCONVERSION_H 1
+
+#include <cstdint>
+#include "compat.h"
+
+namespace lightspark
+{
+
+/*
+ * Conversion of decoded video frames.
+ *
+ * The kernels are selected at runtime: AVX2 if the cpu supports it, SSE2 on
+ * all other x86 cpus and a scalar implementation with identical results
+ * everywhere else.
+ */
+
+enum YUV_FORMAT
+{
+	// chroma subsampled by 2 in both directions
+	YUV_FORMAT_420P=0,
+	// chroma subsampled by 2 horizontally
+	YUV_FORMAT_422P,
+	YUV_FORMAT_444P,
+	// like 420P, but U and V are interleaved in planes[1]
+	YUV_FORMAT_NV12,
+	// 4 bytes per pixel in the order Y, U, V, alpha, all in planes[0] (the layout of the video textures)
+	YUV_FORMAT_PACKED_YUVA
+};
+
+struct YUVImage
+{
+	YUV_FORMAT format;
+	// Y, U, V and alpha planes, the alpha plane is optional
+	const uint8_t* planes[4];
+	// distance between two rows of each plane in bytes
+	uint32_t strides[4];
+	uint32_t width;
+	uint32_t height;
+	YUVImage(YUV_FORMAT _format, uint32_t _width, uint32_t _height):format(_format),width(_width),height(_height)
+	{
+		for (uint32_t i = 0; i < 4; i++)
+		{
+			planes[i] = nullptr;
+			strides[i] = 0;
+		}
+	}
+};
+
+/*
+ * Packs the image into 4 bytes per pixel in the order Y, U, V, alpha,
+ * as expected by the video shader. Alpha is 0xff for images without alpha plane
+ */
+void yuvToPackedYUVA(const YUVImage& img, uint8_t* out, uint32_t outstride);
+/*
+ * Converts the image to premultiplied 32 bit ARGB (0xAARRGGBB in native byte order),
+ * using the same BT.601 conversion as the video shader
+ */
+void yuvToPremultipliedARGB(const YUVImage& img, uint8_t* out, uint32_t outstride);
+// name of the kernels selected for the cpu
+const char* getYUVKernelName();
+
+enum YUV_KERNELS { YUV_KERNELS_AUTO=0, YUV_KERNELS_SCALAR, YUV_KERNELS_SSE2, YUV_KERNELS_AVX2 };
+/*
+ * Selects the kernels used by all conversions, for tests and benchmarks.
+ * Returns false if the kernels are not supported by the build or the cpu.
+ * Must not be called while a conversion is running
+ */
+bool setYUVKernels(YUV_KERNELS kernels);
+/*
+ * Straightforward per pixel implementations of the conversions above,
+ * the kernels are checked against them in tests/kernels
+ */
+void yuvToPackedYUVAReference(const YUVImage& img, uint8_t* out, uint32_t outstride);
+void yuvToPremultipliedARGBReference(const YUVImage& img, uint8_t* out, uint32_t outstride);
+
+}
+#endif /* BACKENDS_YUVCONVERSION_H */
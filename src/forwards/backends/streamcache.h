@@ -29,6 +29,7 @@ namespace lightspark
 class StreamCache;
 class MemoryStreamCache;
 class FileStreamCache;
+class RingStreamCache;
 class lsfilereader;
 
 };
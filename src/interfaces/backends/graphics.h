@@ -56,6 +56,11 @@ public:
 	{
 		queued=false;
 	}
+	/*
+		Returns true if the upload only changes the texture of a single CachedSurface and marks that surface as damaged.
+		Otherwise the whole stage is redrawn after the upload
+	*/
+	virtual bool isSurfaceLocal() const { return false; }
 	void setQueued() {queued=true;}
 	bool getQueued() const { return queued;}
 };
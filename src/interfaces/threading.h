@@ -28,6 +28,7 @@ namespace lightspark
 class IThreadJob
 {
 friend class ThreadPool;
+friend class RasterScheduler;
 private:
 	ASWorker* fromWorker;
 public:
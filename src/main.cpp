@@ -22,6 +22,7 @@
 #include "version.h"
 #include "backends/security.h"
 #include "backends/config.h"
+#include "backends/softwarerendering.h"
 #include "backends/streamcache.h"
 #include "swf.h"
 #include "logger.h"
@@ -385,6 +386,15 @@ int main(int argc, char* argv[])
 	char* profilingFileName=nullptr;
 #endif
 	char *HTTPcookie=nullptr;
+	char* renderDir=nullptr;
+	uint32_t renderFrames=0;
+	bool renderRaw=false;
+	bool partialRedraw=true;
+	bool gpuBitmapDraw=false;
+	bool batchRendering=true;
+	uint32_t screenshotFrame=0;
+	char* screenshotFile=nullptr;
+	char* audioWAVOutput=nullptr;
 	SecurityManager::SANDBOXTYPE sandboxType=SecurityManager::LOCAL_WITH_FILE;
 	bool useInterpreter=true;
 	bool useFastInterpreter=false;
@@ -516,6 +526,65 @@ int main(int argc, char* argv[])
 		{
 			EngineData::enablerendering = false;
 		}
+		else if(strcmp(argv[i],"--render-to")==0)
+		{
+			i++;
+			if(i==argc)
+			{
+				fileName=nullptr;
+				break;
+			}
+			renderDir=argv[i];
+			// batch rendering is done on the CPU without a window
+			EngineData::enablerendering = false;
+		}
+		else if(strcmp(argv[i],"--render-frames")==0)
+		{
+			i++;
+			if(i==argc)
+			{
+				fileName=nullptr;
+				break;
+			}
+			renderFrames=max(0,atoi(argv[i]));
+		}
+		else if(strcmp(argv[i],"--render-raw")==0)
+		{
+			renderRaw=true;
+		}
+		else if(strcmp(argv[i],"--disable-partial-redraw")==0)
+		{
+			partialRedraw=false;
+		}
+		else if(strcmp(argv[i],"--gpu-bitmap-draw")==0)
+		{
+			gpuBitmapDraw=true;
+		}
+		else if(strcmp(argv[i],"--disable-batching")==0)
+		{
+			batchRendering=false;
+		}
+		else if(strcmp(argv[i],"--screenshot-frame")==0)
+		{
+			i+=2;
+			if(i>=argc)
+			{
+				fileName=nullptr;
+				break;
+			}
+			screenshotFrame=max(1,atoi(argv[i-1]));
+			screenshotFile=argv[i];
+		}
+		else if(strcmp(argv[i],"--audio-to-wav")==0)
+		{
+			i++;
+			if(i==argc)
+			{
+				fileName=nullptr;
+				break;
+			}
+			audioWAVOutput=argv[i];
+		}
 		
 		else if(strcmp(argv[i],"--HTTP-cookies")==0)
 		{
@@ -547,6 +616,8 @@ int main(int argc, char* argv[])
 #endif
 							   " [--log-level|-l 0-4] [--parameters-file|-p params-file] [--security-sandbox|-s sandbox]" <<
 							   " [--exit-on-error] [--HTTP-cookies cookie] [--air] [--avmplus] [--disable-rendering]" <<
+							   " [--render-to directory [--render-frames count] [--render-raw]] [--disable-partial-redraw] [--gpu-bitmap-draw] [--audio-to-wav file]" <<
+							   " [--disable-batching] [--screenshot-frame count file]" <<
 #ifdef PROFILING_SUPPORT
 							   " [--profiling-output|-o profiling-file]" <<
 #endif
@@ -681,6 +752,18 @@ int main(int argc, char* argv[])
 	sys->useJit=useJit;
 	sys->ignoreUnhandledExceptions=ignoreUnhandledExceptions;
 	sys->exitOnError=exitOnError;
+	sys->partialRedraw=partialRedraw;
+	sys->gpuBitmapDraw=gpuBitmapDraw;
+	sys->batchRendering=batchRendering;
+	if(screenshotFile)
+	{
+		sys->screenshotFrame=screenshotFrame;
+		sys->screenshotFile=screenshotFile;
+	}
+	if(audioWAVOutput)
+		sys->audioWAVOutput=audioWAVOutput;
+	if(renderDir)
+		sys->softwareRenderer=new SoftwareRenderer(renderDir,renderFrames,renderRaw);
 	if(paramsFileName)
 		sys->parseParametersFromFile(paramsFileName);
 #ifdef PROFILING_SUPPORT
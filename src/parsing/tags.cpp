@@ -64,6 +64,9 @@
 // see https://www.kirupa.com/developer/actionscript/depths2.htm
 #define LEGACY_DEPTH_START -16384
 
+// Decoded bitmaps of lazily decoded BitmapTags are dropped again when they exceed this size
+#define BITMAPTAG_MAX_DECODED_SIZE (256*1024*1024)
+
 using namespace std;
 using namespace lightspark;
 
@@ -90,12 +93,22 @@ Tag* TagFactory::readTag(RootMovieClip* root, DefineSpriteTag *sprite)
 				throw;
 			f.clear();
 			LOG(LOG_INFO,"Simulating EndTag at EOF @ " << f.tellg());
+			finishPendingTags(root);
 			return new EndTag(h,f);
 		}
 
 		unsigned int expectedLen=h.getLength();
 		unsigned int start=f.tellg();
 		LOG(LOG_TRACE,"Reading tag type: " << h.getTagType() << " at byte " << start << " with length " << expectedLen << " bytes");
+		if(maxPendingTags && !sprite && !datatag && deferTag(h,root))
+		{
+			firstTag=false;
+			root->loaderInfo->setBytesLoaded(f.tellg());
+			done = false;
+			continue;
+		}
+		// The tag built below may reference any of the pending tags
+		finishPendingTags(root);
 		switch(h.getTagType())
 		{
 			case 0:
@@ -334,6 +347,148 @@ Tag* TagFactory::readTag(RootMovieClip* root, DefineSpriteTag *sprite)
 	return ret;
 }
 
+TagFactory::~TagFactory()
+{
+	// Only left over if parsing was interrupted
+	for (auto it = pendingTags.begin(); it != pendingTags.end(); it++)
+	{
+		(*it)->wait();
+		delete (*it)->takeTag();
+		delete (*it);
+	}
+}
+
+bool TagFactory::deferTag(RECORDHEADER h, RootMovieClip* root)
+{
+	switch(h.getTagType())
+	{
+		case 2:
+		case 22:
+		case 32:
+		case 83:
+			// Bitmap fill styles are resolved against the dictionary while the shape is parsed
+			if (pendingBitmaps)
+				finishPendingTags(root);
+			break;
+		case 20:
+		case 36:
+		case 75:
+			break;
+		default:
+			return false;
+	}
+	DictionaryTagJob* job=new DictionaryTagJob(h,f,root);
+	if (job->isBitmap())
+		pendingBitmaps++;
+	pendingTags.push_back(job);
+	root->getSystemState()->addJob(job);
+	finishPendingTags(root,maxPendingTags);
+	return true;
+}
+
+void TagFactory::finishPendingTags(RootMovieClip* root, uint32_t remaining)
+{
+	while (pendingTags.size() > remaining)
+	{
+		DictionaryTagJob* job=pendingTags.front();
+		pendingTags.pop_front();
+		job->wait();
+		if (job->isBitmap())
+			pendingBitmaps--;
+		DictionaryTag* tag=job->takeTag();
+		tiny_string error=job->getError();
+		delete job;
+		if (!error.empty())
+			throw ParseException(error);
+		if (!tag)
+			continue;
+		root->applicationDomain->addToDictionary(tag);
+		DefineFont3Tag* font=dynamic_cast<DefineFont3Tag*>(tag);
+		if (font)
+			root->applicationDomain->registerEmbeddedFont(font->getFontname(),font);
+	}
+}
+
+DictionaryTagJob::DictionaryTagJob(RECORDHEADER h, std::istream& in, RootMovieClip* _root):
+	header(h),root(_root),parseThread(getParseThread()),tag(nullptr),finished(0)
+{
+	data.resize(h.getLength());
+	in.read(&data[0],data.size());
+}
+
+void DictionaryTagJob::execute()
+{
+	// Shapes lookup bitmaps through the ParseThread
+	setTLSParseThread(parseThread);
+	try
+	{
+		istringstream in(data);
+		switch(header.getTagType())
+		{
+			case 2:
+				tag=new DefineShapeTag(header,in,root);
+				break;
+			case 20:
+				tag=new DefineBitsLosslessTag(header,in,1,root);
+				break;
+			case 22:
+				tag=new DefineShape2Tag(header,in,root);
+				break;
+			case 32:
+				tag=new DefineShape3Tag(header,in,root);
+				break;
+			case 36:
+				tag=new DefineBitsLosslessTag(header,in,2,root);
+				break;
+			case 75:
+				tag=new DefineFont3Tag(header,in,root,false);
+				break;
+			case 83:
+				tag=new DefineShape4Tag(header,in,root);
+				break;
+			default:
+				assert(false);
+				break;
+		}
+		if(in.fail())
+			LOG(LOG_ERROR,"Error while reading tag " << header.getTagType() << ". Size exceeds expected: " << data.size());
+		else if((size_t)in.tellg()<data.size())
+			LOG(LOG_ERROR,"Error while reading tag " << header.getTagType() << ". Size=" << in.tellg() << " expected: " << data.size());
+	}
+	catch(LightsparkException& e)
+	{
+		error=e.cause;
+	}
+	catch(std::exception& e)
+	{
+		error=e.what();
+	}
+	setTLSParseThread(nullptr);
+}
+
+void DictionaryTagJob::jobFence()
+{
+	// The job is owned by the TagFactory
+	finished.signal();
+}
+
+void DictionaryTagJob::wait()
+{
+	finished.wait();
+}
+
+DictionaryTag* DictionaryTagJob::takeTag()
+{
+	DictionaryTag* ret=tag;
+	tag=nullptr;
+	return ret;
+}
+
+bool DictionaryTagJob::isBitmap() const
+{
+	return header.getTagType()==20 || header.getTagType()==36;
+}
+
 RemoveObject2Tag::RemoveObject2Tag(RECORDHEADER h, std::istream& in):DisplayListTag(h)
 {
 	in >> Depth;
@@ -673,6 +828,7 @@ DefineFontInfoTag::DefineFontInfoTag(RECORDHEADER h, std::istream& in,RootMovieC
 			fonttag->CodeTable.push_back(t);
 		}
 	}
+	fonttag->buildGlyphIndex();
 	root->applicationDomain->registerEmbeddedFont(fonttag->getFontname(),fonttag);
 }
 
@@ -682,32 +838,43 @@ FontTag::FontTag(RECORDHEADER h, int _scaling, RootMovieClip* root):DictionaryTa
 
 FontTag::~FontTag()
 {
-	for (auto it = cachedtokens.begin(); it != cachedtokens.end(); it++)
-	{
-		for (auto it2 = it->second.begin(); it2 != it->second.end(); it2++)
-			(*it2).destruct();
-	}
+	for (auto it = glyphTokens.begin(); it != glyphTokens.end(); it++)
+		(*it).destruct();
 }
 
-void FontTag::fillTokens(int glyphposition, const RGBA& color, tokensVector* tk, int scaling)
+void FontTag::fillTokens(int glyphposition, const RGBA& color, tokensVector* tk)
 {
-	auto it = cachedtokens.find(scaling);
-	if (it == cachedtokens.end())
-	{
-		it = cachedtokens.insert(make_pair(scaling,std::vector<tokensVector>())).first;
-		it->second.resize(getGlyphShapes().size());
-	}
-	if (!it->second.at(glyphposition).isFilled)
+	Locker l(glyphTokensMutex);
+	if (glyphTokens.empty())
+		glyphTokens.resize(getGlyphShapes().size());
+	tokensVector& glyph = glyphTokens.at(glyphposition);
+	if (!glyph.isFilled)
 	{
 		MATRIX m;
 		m.scale(scaling,scaling);
 		const std::vector<SHAPERECORD>& sr = getGlyphShapes().at(glyphposition).ShapeRecords;
-		TokenContainer::FromShaperecordListToShapeVector(sr,it->second.at(glyphposition),true,m);
+		TokenContainer::FromShaperecordListToShapeVector(sr,glyph,true,m);
+		glyph.setReadOnly();
 	}
 	tk->isGlyph=true;
 	tk->color=color;
-	tk->filltokens = it->second.at(glyphposition).filltokens;
-	tk->stroketokens = it->second.at(glyphposition).stroketokens;
+	tk->filltokens = glyph.filltokens;
+	tk->stroketokens = glyph.stroketokens;
+}
+
+void FontTag::buildGlyphIndex()
+{
+	glyphIndex.clear();
+	glyphIndex.reserve(CodeTable.size());
+	// the first glyph wins if a character code is used more than once
+	for (uint32_t i = 0; i < CodeTable.size(); i++)
+		glyphIndex.insert(make_pair(uint32_t(CodeTable[i]),i));
+}
+
+uint32_t FontTag::getGlyphIndex(uint32_t charcode) const
+{
+	auto it = glyphIndex.find(charcode);
+	return it != glyphIndex.end() ? it->second : UINT32_MAX;
 }
 
 ASObject* FontTag::instance(Class_base* c)
@@ -735,18 +902,9 @@ bool FontTag::hasGlyphs(const tiny_string text) const
 	}
 	for (CharIterator it = text.begin(); it != text.end(); it++)
 	{
-		bool found = false;
 		if (*it <= 0x20)
 			continue;
-		for (unsigned int i = 0; i < CodeTable.size(); i++)
-		{
-			if (CodeTable[i] == *it)
-			{
-				found = true;
-				break;
-			}
-		}
-		if (!found)
+		if (getGlyphIndex(*it) == UINT32_MAX)
 			return false;
 	}
 	return true;
@@ -778,17 +936,8 @@ void DefineFontTag::getTextBounds(const tiny_string& text, int fontpixelsize, nu
 			tmpwidth = 0;
 			height+=tokenscaling;
 		}
-		else
-		{
-			for (unsigned int i = 0; i < CodeTable.size(); i++)
-			{
-				if (CodeTable[i] == *it)
-				{
-					tmpwidth += tokenscaling;
-					break;
-				}
-			}
-		}
+		else if (getGlyphIndex(*it) != UINT32_MAX)
+			tmpwidth += tokenscaling;
 	}
 	if (width < tmpwidth)
 		width = tmpwidth;
@@ -838,30 +987,26 @@ tokensVector* DefineFontTag::fillTextTokens(tokensVector &tokens, const tiny_str
 		}
 		else
 		{
-			bool found = false;
-			for (unsigned int i = 0; i < CodeTable.size(); i++)
+			uint32_t i = getGlyphIndex(*it);
+			if (i != UINT32_MAX)
 			{
-				if (CodeTable[i] == *it)
+				if (!first && !emptytoken)
+					tk = tk->next = new tokensVector();
+				first =false;
+				fillTokens(i,textColor,tk);
+				emptytoken=tk->empty();
+				if (!emptytoken)
 				{
-					if (!first && !emptytoken)
-						tk = tokens.next = new tokensVector();
-					first =false;
-					fillTokens(i,textColor,tk,tokenscaling);
-					emptytoken=tk->empty();
-					if (!emptytoken)
-					{
-						Vector2 glyphPos = curPos*tokenscaling;
-						MATRIX glyphMatrix(1, 1, 0, 0,
-										   glyphPos.x+startposx*1024*20,
-										   glyphPos.y);
-						tk->startMatrix = glyphMatrix;
-					}
-					curPos.x += tokenscaling;
-					found = true;
-					break;
+					// the glyph outlines are shared by all sizes, so they are scaled here
+					Vector2 glyphPos = curPos*tokenscaling;
+					MATRIX glyphMatrix(fontpixelsize, fontpixelsize, 0, 0,
+									   glyphPos.x+startposx*1024*20,
+									   glyphPos.y);
+					tk->startMatrix = glyphMatrix;
 				}
+				curPos.x += tokenscaling;
 			}
-			if (!found)
+			else
 				LOG(LOG_INFO,"DefineFontTag:Character not found:"<<(int)*it<<" "<<text<<" "<<this->getFontname()<<" "<<CodeTable.size());
 		}
 	}
@@ -897,16 +1042,13 @@ void DefineFont2Tag::getTextBounds(const tiny_string& text, int fontpixelsize, n
 		}
 		else
 		{
-			for (unsigned int i = 0; i < CodeTable.size(); i++)
+			uint32_t i = getGlyphIndex(*it);
+			if (i != UINT32_MAX)
 			{
-				if (CodeTable[i] == *it)
-				{
-					if (FontFlagsHasLayout)
-						tmpwidth += number_t(FontAdvanceTable[i])/1024.0 * fontpixelsize;
-					else
-						tmpwidth += tokenscaling;
-					break;
-				}
+				if (FontFlagsHasLayout)
+					tmpwidth += number_t(FontAdvanceTable[i])/1024.0 * fontpixelsize;
+				else
+					tmpwidth += tokenscaling;
 			}
 		}
 	}
@@ -1006,6 +1148,7 @@ DefineFont2Tag::DefineFont2Tag(RECORDHEADER h, std::istream& in, RootMovieClip*
 	}
 	//TODO: implmented Kerning support
 	ignore(in,KerningCount*4);
+	buildGlyphIndex();
 	root->applicationDomain->registerEmbeddedFont(getFontname(),this);
 }
 
@@ -1028,33 +1171,28 @@ tokensVector* DefineFont2Tag::fillTextTokens(tokensVector &tokens, const tiny_st
 		}
 		else
 		{
-			bool found = false;
-			for (unsigned int i = 0; i < CodeTable.size(); i++)
+			uint32_t i = getGlyphIndex(*it);
+			if (i != UINT32_MAX)
 			{
-				if (CodeTable[i] == *it)
+				if (!first && !emptytoken)
+					tk = tk->next = new tokensVector();
+				first =false;
+				fillTokens(i,textColor,tk);
+				emptytoken=tk->empty();
+				if (!emptytoken)
 				{
-					if (!first && !emptytoken)
-						tk = tk->next = new tokensVector();
-					first =false;
-					fillTokens(i,textColor,tk,tokenscaling);
-					emptytoken=tk->empty();
-					if (!emptytoken)
-					{
-						Vector2 glyphPos = curPos*tokenscaling;
-						MATRIX glyphMatrix(1, 1, 0, 0,
-										   glyphPos.x+startposx*1024*20,
-										   glyphPos.y);
-						tk->startMatrix=glyphMatrix;
-					}
-					if (FontFlagsHasLayout)
-						curPos.x += FontAdvanceTable[i];
-					else
-						curPos.x += tokenscaling;
-					found = true;
-					break;
+					Vector2 glyphPos = curPos*tokenscaling;
+					MATRIX glyphMatrix(fontpixelsize, fontpixelsize, 0, 0,
+									   glyphPos.x+startposx*1024*20,
+									   glyphPos.y);
+					tk->startMatrix=glyphMatrix;
 				}
+				if (FontFlagsHasLayout)
+					curPos.x += FontAdvanceTable[i];
+				else
+					curPos.x += tokenscaling;
 			}
-			if (!found)
+			else
 				LOG(LOG_INFO,"DefineFont2Tag:Character not found:"<<(int)*it<<" "<<text<<" "<<this->getFontname()<<" "<<CodeTable.size());
 		}
 	}
@@ -1090,24 +1228,21 @@ void DefineFont3Tag::getTextBounds(const tiny_string& text, int fontpixelsize, n
 		}
 		else
 		{
-			for (unsigned int i = 0; i < CodeTable.size(); i++)
+			uint32_t i = getGlyphIndex(*it);
+			if (i == UINT32_MAX)
+				continue;
+			if (FontFlagsHasLayout)
+				tmpwidth += number_t(FontAdvanceTable[i])/1024.0/20.0 * tokenscaling;
+			else
 			{
-				if (CodeTable[i] == *it)
-				{
-					if (FontFlagsHasLayout)
-						tmpwidth += number_t(FontAdvanceTable[i])/1024.0/20.0 * tokenscaling;
-					else
-					{
-						tokensVector tmptokens;
-						fillTokens(i,RGBA(),&tmptokens,tokenscaling);
-						number_t xmin, xmax, ymin, ymax;
-						if (TokenContainer::boundsRectFromTokens(tmptokens,0.05,xmin,xmax,ymin,ymax))
-							tmpwidth += xmax-xmin;
-						else
-							tmpwidth += tokenscaling/2.0;
-					}
-					break;
-				}
+				tokensVector tmptokens;
+				fillTokens(i,RGBA(),&tmptokens);
+				number_t xmin, xmax, ymin, ymax;
+				// the outline is stored for font size 1
+				if (TokenContainer::boundsRectFromTokens(tmptokens,0.05,xmin,xmax,ymin,ymax))
+					tmpwidth += (xmax-xmin)*fontpixelsize;
+				else
+					tmpwidth += tokenscaling/2.0;
 			}
 		}
 	}
@@ -1115,7 +1250,7 @@ void DefineFont3Tag::getTextBounds(const tiny_string& text, int fontpixelsize, n
 		width = ceil(tmpwidth);
 }
 
-DefineFont3Tag::DefineFont3Tag(RECORDHEADER h, std::istream& in, RootMovieClip* root):FontTag(h, 1, root),CodeTableOffset(0)
+DefineFont3Tag::DefineFont3Tag(RECORDHEADER h, std::istream& in, RootMovieClip* root, bool registerFont):FontTag(h, 1, root),CodeTableOffset(0)
 {
 	LOG(LOG_TRACE,"DefineFont3");
 	in >> FontID;
@@ -1231,7 +1366,9 @@ DefineFont3Tag::DefineFont3Tag(RECORDHEADER h, std::istream& in, RootMovieClip*
 	}
 	//TODO: implment Kerning support
 	ignore(in,KerningCount* (FontFlagsWideCodes ? 6 : 4));
-	root->applicationDomain->registerEmbeddedFont(getFontname(),this);
+	buildGlyphIndex();
+	if (registerFont)
+		root->applicationDomain->registerEmbeddedFont(getFontname(),this);
 }
 
 tokensVector* DefineFont3Tag::fillTextTokens(tokensVector &tokens, const tiny_string text, int fontpixelsize,const RGBA& textColor, int32_t leading, int32_t startposx, int32_t startposy)
@@ -1252,31 +1389,26 @@ tokensVector* DefineFont3Tag::fillTextTokens(tokensVector &tokens, const tiny_st
 		}
 		else
 		{
-			bool found = false;
-			for (unsigned int i = 0; i < CodeTable.size(); i++)
+			uint32_t i = getGlyphIndex(*it);
+			if (i != UINT32_MAX)
 			{
-				if (CodeTable[i] == *it)
+				if (!first && !emptytoken)
+					tk = tk->next = new tokensVector();
+				first =false;
+				fillTokens(i,textColor,tk);
+				emptytoken = tk->empty();
+				if (!emptytoken)
 				{
-					if (!first && !emptytoken)
-						tk = tk->next = new tokensVector();
-					first =false;
-					fillTokens(i,textColor,tk,tokenscaling);
-					emptytoken = tk->empty();
-					if (!emptytoken)
-					{
-						Vector2 glyphPos = curPos*tokenscaling;
-						MATRIX glyphMatrix(1, 1, 0, 0,
-										   glyphPos.x+startposx*1024*20,
-										   glyphPos.y+startposy*1024*20);
-						tk->startMatrix=glyphMatrix;
-					}
-					if (FontFlagsHasLayout)
-						curPos.x += FontAdvanceTable[i];
-					found = true;
-					break;
+					Vector2 glyphPos = curPos*tokenscaling;
+					MATRIX glyphMatrix(fontpixelsize, fontpixelsize, 0, 0,
+									   glyphPos.x+startposx*1024*20,
+									   glyphPos.y+startposy*1024*20);
+					tk->startMatrix=glyphMatrix;
 				}
+				if (FontFlagsHasLayout)
+					curPos.x += FontAdvanceTable[i];
 			}
-			if (!found)
+			else
 				LOG(LOG_INFO,"DefineFont3Tag:Character not found:"<<(int)*it<<" "<<text<<" "<<this->getFontname()<<" "<<CodeTable.size());
 		}
 	}
@@ -1318,37 +1450,107 @@ ASObject* DefineFont4Tag::instance(Class_base* c)
 	return ret;
 }
 
-BitmapTag::BitmapTag(RECORDHEADER h,RootMovieClip* root):DictionaryTag(h,root),bitmap(_MR(new BitmapContainer(root->getSystemState()->tagsMemory)))
+std::list<const BitmapTag*> BitmapTag::decodedTags;
+uint64_t BitmapTag::decodedSize = 0;
+Mutex BitmapTag::decodedMutex;
+
+BitmapTag::BitmapTag(RECORDHEADER h,RootMovieClip* root):DictionaryTag(h,root),decodedBytes(0),isDecoded(false),bitmap(_MR(new BitmapContainer(root->getSystemState()->tagsMemory)))
 {
 }
 
 BitmapTag::~BitmapTag()
 {
+	if (!encodedData.empty())
+	{
+		Locker l(decodedMutex);
+		if (isDecoded)
+		{
+			decodedSize -= decodedBytes;
+			decodedTags.erase(decodedPos);
+		}
+	}
 	bitmap.reset();
 }
 
+void BitmapTag::setEncodedData(std::istream& in, uint32_t datasize)
+{
+	encodedData.resize(datasize);
+	in.read((char*)encodedData.data(),datasize);
+	if (!encodedData.empty())
+		bitmap.reset();
+}
+
+/*
+ * Drops the least recently used decoded bitmaps until the limit is met.
+ * decodedMutex must be held by the caller.
+ */
+void BitmapTag::evictDecodedBitmaps()
+{
+	auto it = decodedTags.begin();
+	while (decodedSize > BITMAPTAG_MAX_DECODED_SIZE && it != decodedTags.end())
+	{
+		const BitmapTag* t = *it;
+		// Bitmaps that are still used by BitmapData objects or fill styles are kept
+		if (!t->bitmap->isLastRef())
+		{
+			++it;
+			continue;
+		}
+		decodedSize -= t->decodedBytes;
+		t->bitmap.reset();
+		t->isDecoded = false;
+		it = decodedTags.erase(it);
+	}
+}
+
 _NR<BitmapContainer> BitmapTag::getBitmap() const {
+	if (encodedData.empty())
+		return bitmap;
+
+	Locker l(decodedMutex);
+	if (isDecoded)
+	{
+		// Mark as most recently used
+		decodedTags.splice(decodedTags.end(), decodedTags, decodedPos);
+		return bitmap;
+	}
+	// Decoding may take a while, don't block the other tags meanwhile
+	l.release();
+	_NR<BitmapContainer> b = _MR(new BitmapContainer(loadedFrom->getSystemState()->tagsMemory));
+	decodeBitmap(b.getPtr());
+	l.acquire();
+	if (!isDecoded)
+	{
+		bitmap = b;
+		isDecoded = true;
+		decodedBytes = b->getDataSize();
+		decodedSize += decodedBytes;
+		decodedPos = decodedTags.insert(decodedTags.end(), this);
+		evictDecodedBitmaps();
+	}
 	return bitmap;
 }
-void BitmapTag::loadBitmap(uint8_t* inData, int datasize, const uint8_t *tablesData, int tablesLen)
+void BitmapTag::loadBitmap(BitmapContainer* b, const uint8_t* inData, int datasize, const uint8_t *tablesData, int tablesLen) const
 {
+	// The decoders don't modify their input
+	uint8_t* data=const_cast<uint8_t*>(inData);
 	if (datasize < 4)
 		return;
 	else if((inData[0]&0x80) && inData[1]=='P' && inData[2]=='N' && inData[3]=='G')
-		bitmap->fromPNG(inData,datasize);
+		b->fromPNG(data,datasize);
 	else if(inData[0]==0xff && inData[1]==0xd8 && inData[2]==0xff)
-		bitmap->fromJPEG(inData,datasize,tablesData,tablesLen);
+		b->fromJPEG(data,datasize,tablesData,tablesLen);
 	else if(inData[0]=='G' && inData[1]=='I' && inData[2]=='F' && inData[3]=='8')
-		bitmap->fromGIF(inData,datasize,loadedFrom->getSystemState());
+		b->fromGIF(data,datasize,loadedFrom->getSystemState());
 	else if(inData[0]==0xff && inData[1]==0xd9)
 		// I've found swf files with broken jpegs that start with the jpeg "end of file" magic bytes and two times the "begin of file" magic bytes
 		// so we just ignore the first 4 bytes
 		// TODO check if libjpeg has a better common way to deal with invalid headers
-		loadBitmap(inData+4, datasize-4, tablesData, tablesLen);
+		loadBitmap(b, inData+4, datasize-4, tablesData, tablesLen);
 	else
 		LOG(LOG_ERROR,"unknown image format for ID "<<getId());
 }
-DefineBitsLosslessTag::DefineBitsLosslessTag(RECORDHEADER h, istream& in, int version, RootMovieClip* root):BitmapTag(h,root),BitmapColorTableSize(0)
+DefineBitsLosslessTag::DefineBitsLosslessTag(RECORDHEADER h, istream& in, int version, RootMovieClip* root):BitmapTag(h,root),BitmapColorTableSize(0),version(version)
 {
 	int dest=in.tellg();
 	dest+=h.getLength();
@@ -1356,10 +1558,13 @@ DefineBitsLosslessTag::DefineBitsLosslessTag(RECORDHEADER h, istream& in, int ve
 	if(BitmapFormat==LOSSLESS_BITMAP_PALETTE)
 		in >> BitmapColorTableSize;
 
-	string cData;
-	size_t cSize = dest-in.tellg(); //rest of this tag
-	cData.resize(cSize);
-	in.read(&cData[0], cSize);
+	//The rest of this tag is inflated when the bitmap is used
+	setEncodedData(in, dest-in.tellg());
+}
+
+void DefineBitsLosslessTag::decodeBitmap(BitmapContainer* b) const
+{
+	string cData((const char*)encodedData.data(), encodedData.size());
 	istringstream cDataStream(cData);
 	zlib_filter zf(cDataStream.rdbuf());
 	istream zfstream(&zf);
@@ -1380,7 +1585,7 @@ DefineBitsLosslessTag::DefineBitsLosslessTag(RECORDHEADER h, istream& in, int ve
 		else
 			format = BitmapContainer::ARGB32;
 
-		bitmap->fromRGB(inData, BitmapWidth, BitmapHeight, format);
+		b->fromRGB(inData, BitmapWidth, BitmapHeight, format);
 	}
 	else if (BitmapFormat == LOSSLESS_BITMAP_PALETTE)
 	{
@@ -1404,7 +1609,7 @@ DefineBitsLosslessTag::DefineBitsLosslessTag(RECORDHEADER h, istream& in, int ve
 
 		uint8_t *palette = inData;
 		uint8_t *pixelData = inData + paletteBPP*numColors;
-		bitmap->fromPalette(pixelData, BitmapWidth, BitmapHeight, stride, palette, numColors, paletteBPP);
+		b->fromPalette(pixelData, BitmapWidth, BitmapHeight, stride, palette, numColors, paletteBPP);
 		delete[] inData;
 	}
 	else
@@ -1420,33 +1625,34 @@ ASObject* BitmapTag::instance(Class_base* c)
 
 	Class_base* realClass=(c)?c:bindedTo;
 	Class_base* classRet = nullptr;
+	_NR<BitmapContainer> b = getBitmap();
 	if (loadedFrom->usesActionScript3)
 	{
 		classRet = Class<BitmapData>::getClass(loadedFrom->getSystemState());
 		if(!realClass)
-			return new (classRet->memoryAccount) BitmapData(loadedFrom->getInstanceWorker(),classRet, bitmap);
+			return new (classRet->memoryAccount) BitmapData(loadedFrom->getInstanceWorker(),classRet, b);
 		if(realClass->isSubClass(Class<Bitmap>::getClass(realClass->getSystemState())))
 		{
-			BitmapData* ret=new (classRet->memoryAccount) BitmapData(loadedFrom->getInstanceWorker(),classRet, bitmap);
+			BitmapData* ret=new (classRet->memoryAccount) BitmapData(loadedFrom->getInstanceWorker(),classRet, b);
 			Bitmap* bitmapRet= new (realClass->memoryAccount) Bitmap(loadedFrom->getInstanceWorker(),realClass,_MR(ret));
 			return bitmapRet;
 		}
 		else
-			return new (classRet->memoryAccount) BitmapData(loadedFrom->getInstanceWorker(),realClass, bitmap);
+			return new (classRet->memoryAccount) BitmapData(loadedFrom->getInstanceWorker(),realClass, b);
 	}
 	else
 	{
 		classRet = Class<AVM1BitmapData>::getClass(loadedFrom->getSystemState());
 		if(!realClass)
-			return new (classRet->memoryAccount) AVM1BitmapData(loadedFrom->getInstanceWorker(),classRet, bitmap);
+			return new (classRet->memoryAccount) AVM1BitmapData(loadedFrom->getInstanceWorker(),classRet, b);
 		if(realClass->isSubClass(Class<AVM1Bitmap>::getClass(realClass->getSystemState())))
 		{
-			AVM1BitmapData* ret=new (classRet->memoryAccount) AVM1BitmapData(loadedFrom->getInstanceWorker(),classRet, bitmap);
+			AVM1BitmapData* ret=new (classRet->memoryAccount) AVM1BitmapData(loadedFrom->getInstanceWorker(),classRet, b);
 			Bitmap* bitmapRet= new (realClass->memoryAccount) AVM1Bitmap(loadedFrom->getInstanceWorker(),realClass,_MR(ret));
 			return bitmapRet;
 		}
 		else
-			return new (classRet->memoryAccount) AVM1BitmapData(loadedFrom->getInstanceWorker(),realClass, bitmap);
+			return new (classRet->memoryAccount) AVM1BitmapData(loadedFrom->getInstanceWorker(),realClass, b);
 	}
 
 	if(realClass->isSubClass(Class<BitmapData>::getClass(realClass->getSystemState())))
@@ -1454,7 +1660,7 @@ ASObject* BitmapTag::instance(Class_base* c)
 		classRet = realClass;
 	}
 
-	return new (classRet->memoryAccount) BitmapData(loadedFrom->getInstanceWorker(),classRet, bitmap);
+	return new (classRet->memoryAccount) BitmapData(loadedFrom->getInstanceWorker(),classRet, b);
 }
 
 DefineTextTag::DefineTextTag(RECORDHEADER h, istream& in, RootMovieClip* root,int v):DictionaryTag(h,root),version(v)
@@ -1546,22 +1752,22 @@ void DefineTextTag::computeCached()
 		 * In DefineFont3Tags, shape's coordinates are 1024*20 times pixels size,
 		 * in all former DefineFont*Tags, its just 1024 times. We scale everything here
 		 * to 1024*20, so curFont->scaling=20 for DefineFont2Tags and DefineFontTags.
-		 * And, of course, scale by the TextHeight.
+		 * And, of course, scale by the TextHeight, the glyph outlines are
+		 * shared by all sizes, so that is done in the glyphMatrix.
 		 */
-		int scaling = textheight * curFont->scaling;
 		for(uint32_t j=0;j<TextRecords[i].GlyphEntries.size();++j)
 		{
 			const GLYPHENTRY& ge = TextRecords[i].GlyphEntries[j];
 			if (!first && !emptytoken)
 				tk = tk->next = new tokensVector();
 			first =false;
-			curFont->fillTokens(ge.GlyphIndex,color,tk,scaling);
+			curFont->fillTokens(ge.GlyphIndex,color,tk);
 			emptytoken = tk->empty();
 			if (!tk->empty())
 			{
 				Vector2f glyphPos = curPos*twipsScaling;
 				
-				MATRIX glyphMatrix(1, 1, 0, 0, 
+				MATRIX glyphMatrix(textheight, textheight, 0, 0, 
 								   glyphPos.x,
 								   glyphPos.y);
 				
@@ -1617,6 +1823,7 @@ ASObject *DefineShapeTag::instance(Class_base *c)
 			it->FillType.ShapeBounds = ShapeBounds;
 		}
 		TokenContainer::FromShaperecordListToShapeVector(Shapes.ShapeRecords,*tokens,false,MATRIX(),Shapes.FillStyles.FillStyles,Shapes.LineStyles.LineStyles2,ShapeBounds);
+		tokens->setReadOnly();
 	}
 	Shape* ret=nullptr;
 	if(c==nullptr)
@@ -1699,6 +1906,7 @@ void DefineMorphShapeTag::getTokensForRatio(tokensVector** tokens, uint32_t rati
 	{
 		it = tokensmap.insert(make_pair(ratio,tokensVector())).first;
 		TokenContainer::FromDefineMorphShapeTagToShapeVector(this,it->second,ratio);
+		it->second.setReadOnly();
 	}
 	*tokens = &it->second;
 }
@@ -2686,7 +2894,9 @@ std::streambuf *DefineSoundTag::createSoundStream() const
 
 SoundChannel* DefineSoundTag::createSoundChannel(const SOUNDINFO* soundinfo)
 {
-	return Class<SoundChannel>::getInstanceS(loadedFrom->getInstanceWorker(),1,SoundData, AudioFormat(getAudioCodec(), getSampleRate(), getChannels()),soundinfo);
+	SoundChannel* channel = Class<SoundChannel>::getInstanceS(loadedFrom->getInstanceWorker(),1,SoundData, AudioFormat(getAudioCodec(), getSampleRate(), getChannels()),soundinfo);
+	channel->setDuration(getDurationInMS());
+	return channel;
 }
 
 StartSoundTag::StartSoundTag(RECORDHEADER h, std::istream& in):DisplayListTag(h)
@@ -2723,6 +2933,7 @@ void StartSoundTag::execute(DisplayObjectContainer *parent, bool inskipping)
 						soundTag->getChannels()),
 			&this->SoundInfo);
 		sound->fromSoundTag = soundTag;
+		sound->setDuration(soundTag->getDurationInMS());
 		if (parent->is<Sprite>())
 			parent->as<Sprite>()->setSound(sound,false);
 	}
@@ -2886,7 +3097,7 @@ DefineBitsTag::DefineBitsTag(RECORDHEADER h, std::istream& in,RootMovieClip* roo
 	int dataSize=Header.getLength()-2;
 	uint8_t *inData=new(nothrow) uint8_t[dataSize];
 	in.read((char*)inData,dataSize);
-	loadBitmap(inData,dataSize,JPEGTablesTag::getJPEGTables(),JPEGTablesTag::getJPEGTableSize());
+	loadBitmap(bitmap.getPtr(),inData,dataSize,JPEGTablesTag::getJPEGTables(),JPEGTablesTag::getJPEGTableSize());
 	delete[] inData;
 }
 
@@ -2895,62 +3106,62 @@ DefineBitsJPEG2Tag::DefineBitsJPEG2Tag(RECORDHEADER h, std::istream& in, RootMov
 	LOG(LOG_TRACE,"DefineBitsJPEG2Tag Tag");
 	in >> CharacterId;
 	//Read image data
-	int dataSize=Header.getLength()-2;
-	uint8_t* inData=new(nothrow) uint8_t[dataSize];
-	in.read((char*)inData,dataSize);
-	loadBitmap(inData,dataSize);
-	delete[] inData;
+	setEncodedData(in, Header.getLength()-2);
+}
+
+void DefineBitsJPEG2Tag::decodeBitmap(BitmapContainer* b) const
+{
+	loadBitmap(b,encodedData.data(),encodedData.size());
 }
 
-DefineBitsJPEG3Tag::DefineBitsJPEG3Tag(RECORDHEADER h, std::istream& in, RootMovieClip* root):BitmapTag(h,root),alphaData(NULL)
+DefineBitsJPEG3Tag::DefineBitsJPEG3Tag(RECORDHEADER h, std::istream& in, RootMovieClip* root):BitmapTag(h,root)
 {
 	LOG(LOG_TRACE,"DefineBitsJPEG3Tag Tag");
 	UI32_SWF dataSize;
 	in >> CharacterId >> dataSize;
 	//Read image data
-	uint8_t* inData=new(nothrow) uint8_t[dataSize];
-	in.read((char*)inData,dataSize);
-
-	loadBitmap(inData,dataSize);
-	delete[] inData;
+	setEncodedData(in, dataSize);
 
 	//Read alpha data (if any)
 	int alphaSize=Header.getLength()-dataSize-6;
 	if(alphaSize>0) //If less that 0 the consistency check on tag size will stop later
 	{
-		//Create a zlib filter
-		string alphaData;
 		alphaData.resize(alphaSize);
-		in.read(&alphaData[0], alphaSize);
-		istringstream alphaStream(alphaData);
-		zlib_filter zf(alphaStream.rdbuf());
-		istream zfstream(&zf);
-		zfstream.exceptions ( istream::eofbit | istream::failbit | istream::badbit );
-
-		vector<char> alphaDataUncompressed;
-		alphaDataUncompressed.resize(bitmap->getHeight()*bitmap->getWidth());
-		
-		//Catch the exception if the stream ends
-		try
-		{
-			zfstream.read(alphaDataUncompressed.data(),bitmap->getHeight()*bitmap->getWidth());
-		}
-		catch(std::exception& e)
-		{
-			LOG(LOG_ERROR, "Exception while parsing Alpha data in DefineBitsJPEG3");
-		}
-		uint8_t* d = bitmap->getData();
-		//Set alpha
-		for(int32_t i=0;i<bitmap->getHeight()*bitmap->getWidth();i++)
-		{
-			d[i*4+3]=alphaDataUncompressed[i];
-		}
+		in.read((char*)alphaData.data(), alphaSize);
 	}
 }
 
-DefineBitsJPEG3Tag::~DefineBitsJPEG3Tag()
+void DefineBitsJPEG3Tag::decodeBitmap(BitmapContainer* b) const
 {
-	delete[] alphaData;
+	loadBitmap(b,encodedData.data(),encodedData.size());
+	if(alphaData.empty())
+		return;
+
+	//Create a zlib filter
+	string alphaString((const char*)alphaData.data(), alphaData.size());
+	istringstream alphaStream(alphaString);
+	zlib_filter zf(alphaStream.rdbuf());
+	istream zfstream(&zf);
+	zfstream.exceptions ( istream::eofbit | istream::failbit | istream::badbit );
+
+	vector<char> alphaDataUncompressed;
+	alphaDataUncompressed.resize(b->getHeight()*b->getWidth());
+
+	//Catch the exception if the stream ends
+	try
+	{
+		zfstream.read(alphaDataUncompressed.data(),b->getHeight()*b->getWidth());
+	}
+	catch(std::exception& e)
+	{
+		LOG(LOG_ERROR, "Exception while parsing Alpha data in DefineBitsJPEG3");
+	}
+	uint8_t* d = b->getData();
+	//Set alpha
+	for(int32_t i=0;i<b->getHeight()*b->getWidth();i++)
+	{
+		d[i*4+3]=alphaDataUncompressed[i];
+	}
 }
 
 DefineSceneAndFrameLabelDataTag::DefineSceneAndFrameLabelDataTag(RECORDHEADER h, std::istream& in):ControlTag(h)
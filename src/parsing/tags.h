@@ -22,8 +22,12 @@
 
 #include "compat.h"
 #include <vector>
+#include <deque>
+#include <list>
+#include <unordered_map>
 #include <iostream>
 #include "swftypes.h"
+#include "threading.h"
 #include "backends/geometry.h"
 #include "backends/decoder.h"
 #include "scripting/flash/display/flashdisplay.h"
@@ -37,6 +41,7 @@ class ApplicationDomain;
 class DisplayObjectContainer;
 class DefineSpriteTag;
 class AdditionalDataTag;
+class ParseThread;
 
 enum TAGTYPE {TAG=0,DISPLAY_LIST_TAG,SHOW_TAG,CONTROL_TAG,DICT_TAG,FRAMELABEL_TAG,SYMBOL_CLASS_TAG,ACTION_TAG,ABC_TAG,END_TAG,
 			  AVM1ACTION_TAG,AVM1INITACTION_TAG,BUTTONSOUND_TAG, FILEATTRIBUTES_TAG,METADATA_TAG,BACKGROUNDCOLOR_TAG,ENABLEDEBUGGER_TAG,DEFINESCALINGGRID_TAG};
@@ -472,7 +477,13 @@ protected:
 	bool FontFlagsItalic;
 	bool FontFlagsBold;
 	virtual number_t getRenderCharStartYPos() const =0;
-	std::map<int,std::vector<tokensVector>> cachedtokens;
+	// the outlines of the glyphs for font size 1, converted once and shared by all sizes and all texts using this font
+	std::vector<tokensVector> glyphTokens;
+	Mutex glyphTokensMutex;
+	// maps character codes to positions in GlyphShapeTable
+	std::unordered_map<uint32_t,uint32_t> glyphIndex;
+	// has to be called whenever CodeTable was filled
+	void buildGlyphIndex();
 public:
 	/* Multiply the coordinates of the SHAPEs by this
 	 * value to get a resolution of 1024*20th pixel
@@ -485,7 +496,13 @@ public:
 	{
 		return GlyphShapeTable;
 	}
-	void fillTokens(int glyphposition, const RGBA& color, tokensVector* tk, int scaling);
+	/*
+	 * fills tk with the outline of the glyph for font size 1,
+	 * the caller has to scale it by the font size in tk->startMatrix
+	 */
+	void fillTokens(int glyphposition, const RGBA& color, tokensVector* tk);
+	// returns the position of the glyph for charcode in GlyphShapeTable, or UINT32_MAX if the font has no such glyph
+	uint32_t getGlyphIndex(uint32_t charcode) const;
 	int getId() const override { return FontID; }
 	ASObject* instance(Class_base* c=nullptr) override;
 	const tiny_string getFontname() const { return fontname;}
@@ -570,7 +587,8 @@ private:
 protected:
 	number_t getRenderCharStartYPos() const override;
 public:
-	DefineFont3Tag(RECORDHEADER h, std::istream& in, RootMovieClip* root);
+	// registerFont is false when the tag is built outside of the parsing thread
+	DefineFont3Tag(RECORDHEADER h, std::istream& in, RootMovieClip* root, bool registerFont=true);
 	number_t getRenderCharAdvance(uint32_t index) const override;
 	void getTextBounds(const tiny_string& text, int fontpixelsize, number_t& width, number_t& height) override;
 	tokensVector* fillTextTokens(tokensVector& tokens, const tiny_string text, int fontpixelsize,const RGBA& textColor, int32_t leading, int32_t startposx, int32_t startposy) override;
@@ -650,13 +668,33 @@ class BitmapContainer;
 
 class BitmapTag: public DictionaryTag
 {
+private:
+	// Lazily decoded tags that currently hold their bitmap, least recently used first
+	static std::list<const BitmapTag*> decodedTags;
+	static uint64_t decodedSize;
+	static Mutex decodedMutex;
+	mutable std::list<const BitmapTag*>::iterator decodedPos;
+	mutable uint32_t decodedBytes;
+	mutable bool isDecoded;
+	static void evictDecodedBitmaps();
 protected:
-	_NR<BitmapContainer> bitmap;
-	void loadBitmap(uint8_t* inData, int datasize, const uint8_t *tablesData=nullptr, int tablesLen=0);
+	mutable _NR<BitmapContainer> bitmap;
+	// The undecoded image of tags that decode their bitmap on first use
+	std::vector<uint8_t> encodedData;
+	void loadBitmap(BitmapContainer* b, const uint8_t* inData, int datasize, const uint8_t *tablesData=nullptr, int tablesLen=0) const;
+	// Keeps the image read from in undecoded until the bitmap is used
+	void setEncodedData(std::istream& in, uint32_t datasize);
+	// Decodes encodedData into b
+	virtual void decodeBitmap(BitmapContainer* b) const {}
 public:
 	BitmapTag(RECORDHEADER h,RootMovieClip* root);
 	~BitmapTag();
 	ASObject* instance(Class_base* c=nullptr) override;
+	/*
+	 * Returns the bitmap, decoding it if needed. Decoded bitmaps that are
+	 * not referenced outside of their tag may be dropped again when the
+	 * decoded bitmaps of all tags exceed BITMAPTAG_MAX_DECODED_SIZE.
+	 */
 	_NR<BitmapContainer> getBitmap() const;
 };
 
@@ -680,6 +718,9 @@ private:
 	UI16_SWF BitmapHeight;
 	UI8 BitmapColorTableSize;
 	//ZlibBitmapData;
+	int version;
+protected:
+	void decodeBitmap(BitmapContainer* b) const override;
 public:
 	DefineBitsLosslessTag(RECORDHEADER h, std::istream& in, int version, RootMovieClip* root);
 	int getId() const override { return CharacterId; }
@@ -698,6 +739,8 @@ class DefineBitsJPEG2Tag: public BitmapTag
 {
 private:
 	UI16_SWF CharacterId;
+protected:
+	void decodeBitmap(BitmapContainer* b) const override;
 public:
 	DefineBitsJPEG2Tag(RECORDHEADER h, std::istream& in, RootMovieClip* root);
 	int getId() const override { return CharacterId; }
@@ -707,10 +750,12 @@ class DefineBitsJPEG3Tag: public BitmapTag
 {
 private:
 	UI16_SWF CharacterId;
-	uint8_t* alphaData;
+	// zlib compressed alpha channel
+	std::vector<uint8_t> alphaData;
+protected:
+	void decodeBitmap(BitmapContainer* b) const override;
 public:
 	DefineBitsJPEG3Tag(RECORDHEADER h, std::istream& in, RootMovieClip* root);
-	~DefineBitsJPEG3Tag();
 	int getId() const override { return CharacterId; }
 };
 
@@ -895,13 +940,55 @@ public:
 	NameCharacterTag(RECORDHEADER h, std::istream& in, RootMovieClip *root);
 };
 
+/*
+ * Builds a DictionaryTag from a copy of its record on the ThreadPool.
+ * Only used for tags that don't depend on tags that follow them in the file.
+ */
+class DictionaryTagJob: public IThreadJob
+{
+private:
+	RECORDHEADER header;
+	std::string data;
+	RootMovieClip* root;
+	ParseThread* parseThread;
+	DictionaryTag* tag;
+	tiny_string error;
+	Semaphore finished;
+public:
+	DictionaryTagJob(RECORDHEADER h, std::istream& in, RootMovieClip* _root);
+	void execute() override;
+	void threadAbort() override {}
+	void jobFence() override;
+	// Blocks until the tag has been built
+	void wait();
+	// Returns the built tag and transfers its ownership to the caller
+	DictionaryTag* takeTag();
+	const tiny_string& getError() const { return error; }
+	bool isBitmap() const;
+};
+
 class TagFactory
 {
 private:
 	std::istream& f;
 	bool firstTag;
-public:
-	TagFactory(std::istream& in):f(in),firstTag(true){}
+	// Dictionary tags being built on the thread pool, in file order
+	std::deque<DictionaryTagJob*> pendingTags;
+	// Zero if tags are built on the parsing thread
+	uint32_t maxPendingTags;
+	uint32_t pendingBitmaps;
+	bool deferTag(RECORDHEADER h, RootMovieClip* root);
+	void finishPendingTags(RootMovieClip* root, uint32_t remaining=0);
+public:
+	TagFactory(std::istream& in):f(in),firstTag(true),maxPendingTags(0),pendingBitmaps(0){}
+	~TagFactory();
+	/**
+	 * Shapes, lossless bitmaps and DefineFont3 tags are built on the
+	 * thread pool while the following tags are read, at most maxPending
+	 * at a time. They are added to the dictionary of the root by the
+	 * factory, in file order, before any other tag is returned by readTag().
+	 */
+	void enableParallelParsing(uint32_t maxPending) { maxPendingTags = maxPending; }
 	/**
 	 * The RootMovieClip that is the owner of the content.
 	 * It is needed to solve references to other tags during construction
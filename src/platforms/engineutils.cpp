@@ -1950,55 +1950,7 @@ void EngineData::exec_glStencilFunc(DEPTHSTENCIL_FUNCTION func, uint32_t ref, ui
 void audioCallback(void * userdata, uint8_t * stream, int len)
 {
 	AudioManager* manager = (AudioManager*)userdata;
-
-    SDL_memset(stream, 0, len);
-
-	{
-		Locker l(manager->streamMutex);
-		for (auto it = manager->streams.begin(); it != manager->streams.end(); it++)
-		{
-			AudioStream* s = (*it);
-			if (s->ispaused())
-				continue;
-			s->startMixing();
-			const float fmaxvolume = 1.0f / ((float)SDL_MIX_MAXVOLUME);
-			const float fvolume = (float)s->getVolume()*(float)SDL_MIX_MAXVOLUME;
-			uint32_t readcount = 0;
-			uint8_t* buf = new uint8_t[len];
-			while (readcount < ((uint32_t)len))
-			{
-				uint32_t ret = s->getDecoder()->copyFrameF32((float *)(buf+readcount), ((uint32_t)len)-readcount);
-				if (!ret)
-					break;
-				float* src32=(float *)(buf+readcount);
-				float* dst32=(float *)(stream+readcount);
-				readcount += ret;
-
-				float src1, src2;
-				double dst_sample;
-
-				const double max_audioval = 3.402823466e+38F;
-				const double min_audioval = -3.402823466e+38F;
-				int curpanning=0;
-				while (ret)
-				{
-					src1 = *src32 * fvolume * fmaxvolume * s->getPanning()[curpanning];
-					curpanning = 1-curpanning;
-					src2 = *dst32;
-					src32++;
-					dst_sample = ((double)src1) + ((double)src2);
-					if (dst_sample > max_audioval) {
-						dst_sample = max_audioval;
-					} else if (dst_sample < min_audioval) {
-						dst_sample = min_audioval;
-					}
-					*(dst32++) = (float)dst_sample;
-					ret-=4;
-				}
-			}
-			delete[] buf;
-		}
-    }
+	manager->mix(stream,len);
 }
 
 int EngineData::audio_StreamInit(AudioStream* s)
@@ -39,5 +39,35 @@ namespace lightspark
 */
 void fastYUV420ChannelsToYUV0Buffer(uint8_t* y, uint8_t* u, uint8_t* v, uint8_t* out, uint32_t width, uint32_t height);
 
+/**
+	Horizontal box blur of a 32 bit per pixel image, in place
+
+	Every channel of a pixel is set to (sum*mul)>>shift, where sum is the sum of
+	that channel over the 2*radius+1 pixels around it in the same row. The
+	pixels at the edges are repeated. Results are clamped to 255.
+
+	@param data First pixel of the first row
+	@param width Row width in pixels
+	@param rows Number of rows to blur
+	@param stride Distance between two rows in bytes
+	@param radius Blur radius in pixels
+	@param mul Multiplier approximating 1/(2*radius+1) together with shift
+	@param shift Right shift applied after the multiplication
+*/
+void fastBoxBlurRows(uint8_t* data, uint32_t width, uint32_t rows, uint32_t stride, uint32_t radius, uint32_t mul, uint32_t shift);
+
+/**
+	Vertical box blur of a 32 bit per pixel image, in place
+
+	Same as fastBoxBlurRows for the columns of the image. Additionally the
+	color channels of all pixels whose alpha (4th byte) ends up 0 are set to 0.
+
+	@param data First pixel of the first column
+	@param columns Number of columns to blur
+	@param height Column height in pixels
+	@param stride Distance between two rows in bytes
+*/
+void fastBoxBlurColumns(uint8_t* data, uint32_t columns, uint32_t height, uint32_t stride, uint32_t radius, uint32_t mul, uint32_t shift);
+
 };
 #endif /* PLATFORMS_FASTPATHS_H */
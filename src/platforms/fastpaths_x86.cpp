@@ -19,6 +19,10 @@
 
 #include "platforms/fastpaths.h"
 #include <cinttypes>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <emmintrin.h>
 
 extern "C"
 {
@@ -38,3 +42,126 @@ void lightspark::fastYUV420ChannelsToYUV0Buffer(uint8_t* y, uint8_t* u, uint8_t*
 	else
 		fastYUV420ChannelsToYUV0Buffer_SSE2Unaligned(y,u,v,out,width,height);
 }
+
+namespace
+{
+// 32 bit multiplication of all lanes, SSE2 has no _mm_mullo_epi32
+inline __m128i mullo_epi32(__m128i a, __m128i b)
+{
+	__m128i even = _mm_mul_epu32(a,b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a,32),_mm_srli_epi64(b,32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even,_MM_SHUFFLE(0,0,2,0)),_mm_shuffle_epi32(odd,_MM_SHUFFLE(0,0,2,0)));
+}
+
+// expands the 4 bytes of a pixel to 4 32 bit lanes
+inline __m128i loadPixel(const uint8_t* p)
+{
+	int32_t v;
+	memcpy(&v,p,4);
+	__m128i zero = _mm_setzero_si128();
+	return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(v),zero),zero);
+}
+
+// adds the 4 pixels at p to the sums
+inline void addPixels4(__m128i* sum, const uint8_t* p)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i v = _mm_loadu_si128((const __m128i*)p);
+	__m128i lo = _mm_unpacklo_epi8(v,zero);
+	__m128i hi = _mm_unpackhi_epi8(v,zero);
+	sum[0] = _mm_add_epi32(sum[0],_mm_unpacklo_epi16(lo,zero));
+	sum[1] = _mm_add_epi32(sum[1],_mm_unpackhi_epi16(lo,zero));
+	sum[2] = _mm_add_epi32(sum[2],_mm_unpacklo_epi16(hi,zero));
+	sum[3] = _mm_add_epi32(sum[3],_mm_unpackhi_epi16(hi,zero));
+}
+
+inline void subPixels4(__m128i* sum, const uint8_t* p)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i v = _mm_loadu_si128((const __m128i*)p);
+	__m128i lo = _mm_unpacklo_epi8(v,zero);
+	__m128i hi = _mm_unpackhi_epi8(v,zero);
+	sum[0] = _mm_sub_epi32(sum[0],_mm_unpacklo_epi16(lo,zero));
+	sum[1] = _mm_sub_epi32(sum[1],_mm_unpackhi_epi16(lo,zero));
+	sum[2] = _mm_sub_epi32(sum[2],_mm_unpacklo_epi16(hi,zero));
+	sum[3] = _mm_sub_epi32(sum[3],_mm_unpackhi_epi16(hi,zero));
+}
+}
+
+void lightspark::fastBoxBlurRows(uint8_t* data, uint32_t width, uint32_t rows, uint32_t stride, uint32_t radius, uint32_t mul, uint32_t shift)
+{
+	if (width==0)
+		return;
+	// copy of the unblurred row, so the pixels can be overwritten in place
+	std::vector<uint8_t> tmp(width*4);
+	int32_t last = width-1;
+	__m128i mulv = _mm_set1_epi32(mul);
+	__m128i shiftv = _mm_cvtsi32_si128(shift);
+	__m128i radiusv = _mm_set1_epi32(radius+1);
+	for(uint32_t i=0;i<rows;i++)
+	{
+		uint8_t* row = data+i*stride;
+		memcpy(tmp.data(),row,width*4);
+		__m128i sum = mullo_epi32(loadPixel(tmp.data()),radiusv);
+		for(int32_t k=1;k<=int32_t(radius);k++)
+			sum = _mm_add_epi32(sum,loadPixel(&tmp[std::min(k,last)*4]));
+		for(int32_t x=0;x<=last;x++)
+		{
+			__m128i v = _mm_srl_epi32(mullo_epi32(sum,mulv),shiftv);
+			// saturating packs clamp the result to 255
+			v = _mm_packus_epi16(_mm_packs_epi32(v,v),v);
+			int32_t out = _mm_cvtsi128_si32(v);
+			memcpy(row+x*4,&out,4);
+			sum = _mm_add_epi32(sum,loadPixel(&tmp[std::min(x+int32_t(radius)+1,last)*4]));
+			sum = _mm_sub_epi32(sum,loadPixel(&tmp[std::max(x-int32_t(radius),0)*4]));
+		}
+	}
+}
+
+void lightspark::fastBoxBlurColumns(uint8_t* data, uint32_t columns, uint32_t height, uint32_t stride, uint32_t radius, uint32_t mul, uint32_t shift)
+{
+	if (height==0)
+		return;
+	// columns are processed in strips of 4, so every row of a strip fits in one register
+	std::vector<uint8_t> tmp(height*16);
+	int32_t last = height-1;
+	__m128i mulv = _mm_set1_epi32(mul);
+	__m128i shiftv = _mm_cvtsi32_si128(shift);
+	__m128i radiusv = _mm_set1_epi32(radius+1);
+	__m128i alphamask = _mm_set1_epi32(0xff000000);
+	__m128i zero = _mm_setzero_si128();
+	for(uint32_t col=0;col<columns;col+=4)
+	{
+		uint32_t n = std::min(columns-col,uint32_t(4))*4;
+		uint8_t* strip = data+col*4;
+		for(uint32_t y=0;y<height;y++)
+			memcpy(&tmp[y*16],strip+y*stride,n);
+		__m128i sum[4] = { zero, zero, zero, zero };
+		addPixels4(sum,tmp.data());
+		for(uint32_t c=0;c<4;c++)
+			sum[c] = mullo_epi32(sum[c],radiusv);
+		for(int32_t k=1;k<=int32_t(radius);k++)
+			addPixels4(sum,&tmp[std::min(k,last)*16]);
+		for(int32_t y=0;y<=last;y++)
+		{
+			__m128i v0 = _mm_srl_epi32(mullo_epi32(sum[0],mulv),shiftv);
+			__m128i v1 = _mm_srl_epi32(mullo_epi32(sum[1],mulv),shiftv);
+			__m128i v2 = _mm_srl_epi32(mullo_epi32(sum[2],mulv),shiftv);
+			__m128i v3 = _mm_srl_epi32(mullo_epi32(sum[3],mulv),shiftv);
+			__m128i out = _mm_packus_epi16(_mm_packs_epi32(v0,v1),_mm_packs_epi32(v2,v3));
+			// clear the pixels with alpha 0
+			__m128i transparent = _mm_cmpeq_epi32(_mm_and_si128(out,alphamask),zero);
+			out = _mm_andnot_si128(transparent,out);
+			if (n==16)
+				_mm_storeu_si128((__m128i*)(strip+y*stride),out);
+			else
+			{
+				uint8_t buf[16];
+				_mm_storeu_si128((__m128i*)buf,out);
+				memcpy(strip+y*stride,buf,n);
+			}
+			addPixels4(sum,&tmp[std::min(y+int32_t(radius)+1,last)*16]);
+			subPixels4(sum,&tmp[std::max(y-int32_t(radius),0)*16]);
+		}
+	}
+}
@@ -19,6 +19,11 @@
 
 #include "platforms/fastpaths.h"
 #include <inttypes.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+using namespace std;
 
 void lightspark::fastYUV420ChannelsToYUV0Buffer(uint8_t* y, uint8_t* u, uint8_t* v, uint8_t* out, uint32_t width, uint32_t height)
 {
@@ -37,3 +42,76 @@ void lightspark::fastYUV420ChannelsToYUV0Buffer(uint8_t* y, uint8_t* u, uint8_t*
 	}
 }
 
+
+void lightspark::fastBoxBlurRows(uint8_t* data, uint32_t width, uint32_t rows, uint32_t stride, uint32_t radius, uint32_t mul, uint32_t shift)
+{
+	if (width==0)
+		return;
+	// copy of the unblurred row, so the pixels can be overwritten in place
+	std::vector<uint8_t> tmp(width*4);
+	int32_t last = width-1;
+	for(uint32_t i=0;i<rows;i++)
+	{
+		uint8_t* row = data+i*stride;
+		memcpy(tmp.data(),row,width*4);
+		uint32_t sum[4];
+		for(uint32_t c=0;c<4;c++)
+			sum[c] = (radius+1)*tmp[c];
+		for(int32_t k=1;k<=int32_t(radius);k++)
+		{
+			const uint8_t* p = &tmp[min(k,last)*4];
+			for(uint32_t c=0;c<4;c++)
+				sum[c] += p[c];
+		}
+		for(int32_t x=0;x<=last;x++)
+		{
+			for(uint32_t c=0;c<4;c++)
+				row[x*4+c] = min(uint32_t(255),(sum[c]*mul)>>shift);
+			const uint8_t* add = &tmp[min(x+int32_t(radius)+1,last)*4];
+			const uint8_t* sub = &tmp[max(x-int32_t(radius),0)*4];
+			for(uint32_t c=0;c<4;c++)
+				sum[c] += add[c]-sub[c];
+		}
+	}
+}
+
+void lightspark::fastBoxBlurColumns(uint8_t* data, uint32_t columns, uint32_t height, uint32_t stride, uint32_t radius, uint32_t mul, uint32_t shift)
+{
+	if (height==0)
+		return;
+	// columns are processed in strips of 4, so the inner loops work on 16 contiguous bytes
+	std::vector<uint8_t> tmp(height*16);
+	int32_t last = height-1;
+	for(uint32_t col=0;col<columns;col+=4)
+	{
+		uint32_t n = min(columns-col,uint32_t(4))*4;
+		uint8_t* strip = data+col*4;
+		for(uint32_t y=0;y<height;y++)
+			memcpy(&tmp[y*16],strip+y*stride,n);
+		uint32_t sum[16];
+		for(uint32_t c=0;c<16;c++)
+			sum[c] = (radius+1)*tmp[c];
+		for(int32_t k=1;k<=int32_t(radius);k++)
+		{
+			const uint8_t* p = &tmp[min(k,last)*16];
+			for(uint32_t c=0;c<16;c++)
+				sum[c] += p[c];
+		}
+		for(int32_t y=0;y<=last;y++)
+		{
+			uint8_t out[16];
+			for(uint32_t c=0;c<16;c++)
+				out[c] = min(uint32_t(255),(sum[c]*mul)>>shift);
+			for(uint32_t c=0;c<16;c+=4)
+			{
+				if (out[c+3]==0)
+					out[c]=out[c+1]=out[c+2]=0;
+			}
+			memcpy(strip+y*stride,out,n);
+			const uint8_t* add = &tmp[min(y+int32_t(radius)+1,last)*16];
+			const uint8_t* sub = &tmp[max(y-int32_t(radius),0)*16];
+			for(uint32_t c=0;c<16;c++)
+				sum[c] += add[c]-sub[c];
+		}
+	}
+}
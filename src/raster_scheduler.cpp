@@ -0,0 +1,352 @@
+/**************************************************************************
+    Lightspark, a free flash player implementation
+
+    Copyright (C) 2024  Ludger Krämer <dbluelle@onlinehome.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+#include <cassert>
+
+#include "interfaces/threading.h"
+#include "raster_scheduler.h"
+#include "timer.h"
+#include "exceptions.h"
+#include "compat.h"
+#include "logger.h"
+#include "swf.h"
+#include "backends/graphics.h"
+
+using namespace lightspark;
+
+DEFINE_AND_INITIALIZE_TLS(tls_raster_worker);
+
+namespace
+{
+/*
+ * Executes several small jobs in one go
+ */
+class JobBatch: public IThreadJob
+{
+private:
+	std::vector<IThreadJob*> jobs;
+public:
+	void add(IThreadJob* j) { jobs.push_back(j); }
+	void execute() override
+	{
+		for (auto it = jobs.begin(); it != jobs.end(); it++)
+		{
+			if (threadAborting)
+				break;
+			if (!(*it)->threadAborting)
+				(*it)->execute();
+		}
+	}
+	void threadAbort() override
+	{
+		for (auto it = jobs.begin(); it != jobs.end(); it++)
+		{
+			(*it)->threadAborting = true;
+			(*it)->threadAbort();
+		}
+	}
+	void jobFence() override
+	{
+		for (auto it = jobs.begin(); it != jobs.end(); it++)
+			(*it)->jobFence();
+		delete this;
+	}
+};
+
+struct ParallelForState
+{
+	std::atomic<int32_t> remaining;
+	// signaled once by every finished part
+	Semaphore done;
+	ParallelForState(int32_t count):remaining(count),done(0) {}
+};
+
+/*
+ * One part of a RasterScheduler::parallelFor() call
+ */
+class ParallelForJob: public IThreadJob
+{
+private:
+	const std::function<void(uint32_t)>& f;
+	uint32_t index;
+	ParallelForState& state;
+public:
+	ParallelForJob(const std::function<void(uint32_t)>& _f, uint32_t _index, ParallelForState& _state)
+		:f(_f),index(_index),state(_state) {}
+	void execute() override
+	{
+		if (!threadAborting)
+			f(index);
+	}
+	void jobFence() override
+	{
+		ParallelForState& s = state;
+		delete this;
+		ATOMIC_DECREMENT(s.remaining);
+		// the waiting thread may destroy the state as soon as it got all signals
+		s.done.signal();
+	}
+};
+}
+
+RasterScheduler::RasterScheduler(SystemState* s):num_jobs(0),m_sys(s),stopFlag(false),nextWorker(0)
+{
+	uint32_t count = imax(1,imin(SDL_GetCPUCount(),RASTER_MAX_THREADS));
+	workers.reserve(count);
+	for(uint32_t i=0;i<count;i++)
+	{
+		Worker* w = new Worker();
+		w->scheduler=this;
+		w->index=i;
+		w->curJob=nullptr;
+		workers.push_back(w);
+	}
+	// start the threads after all workers exist, as they may steal from each other
+	for(auto it=workers.begin();it!=workers.end();it++)
+		(*it)->thread = SDL_CreateThread(job_worker,"RasterScheduler",*it);
+	LOG(LOG_INFO,"RasterScheduler: using " << count << " threads");
+}
+
+RasterScheduler::~RasterScheduler()
+{
+	forceStop();
+	for(auto it=workers.begin();it!=workers.end();it++)
+		delete *it;
+}
+
+void RasterScheduler::forceStop()
+{
+	if(stopFlag)
+		return;
+	stopFlag=true;
+	//Signal an event for all the threads
+	for(uint32_t i=0;i<workers.size();i++)
+		num_jobs.signal();
+
+	for(auto it=workers.begin();it!=workers.end();it++)
+	{
+		Worker* w = *it;
+		Locker l(w->mutex);
+		//Abort the job that is still executing
+		if(w->curJob)
+		{
+			w->curJob->threadAborting = true;
+			w->curJob->threadAbort();
+		}
+		//Fence all the non executed jobs
+		for(auto itj=w->jobs.begin();itj!=w->jobs.end();++itj)
+			(*itj)->jobFence();
+		w->jobs.clear();
+	}
+
+	for(auto it=workers.begin();it!=workers.end();it++)
+		SDL_WaitThread((*it)->thread,nullptr);
+}
+
+RasterScheduler::Worker* RasterScheduler::getCurrentWorker() const
+{
+	Worker* w = (Worker*)tls_get(tls_raster_worker);
+	if (w && w->scheduler == this)
+		return w;
+	return nullptr;
+}
+
+void RasterScheduler::pushJob(Worker* w, IThreadJob* j)
+{
+	{
+		Locker l(w->mutex);
+		if(stopFlag)
+		{
+			l.release();
+			j->jobFence();
+			return;
+		}
+		w->jobs.push_back(j);
+	}
+	num_jobs.signal();
+}
+
+IThreadJob* RasterScheduler::getJob(Worker* w)
+{
+	{
+		Locker l(w->mutex);
+		if (!w->jobs.empty())
+		{
+			IThreadJob* j = w->jobs.back();
+			w->jobs.pop_back();
+			return j;
+		}
+	}
+	// own deque is empty, steal the oldest job of another thread
+	uint32_t count = workers.size();
+	for (uint32_t i = 1; i < count; i++)
+	{
+		Worker* victim = workers[(w->index+i)%count];
+		Locker l(victim->mutex);
+		if (!victim->jobs.empty())
+		{
+			IThreadJob* j = victim->jobs.front();
+			victim->jobs.pop_front();
+			return j;
+		}
+	}
+	return nullptr;
+}
+
+void RasterScheduler::runJob(Worker* w, IThreadJob* j)
+{
+	IThreadJob* prevJob = w->curJob;
+	{
+		Locker l(w->mutex);
+		w->curJob=j;
+	}
+	setTLSWorker(j->fromWorker);
+	try
+	{
+		// it's possible that a job was added and will be executed while forcestop() has been called
+		if(!stopFlag)
+			j->execute();
+	}
+	catch(JobTerminationException& ex)
+	{
+		LOG(LOG_NOT_IMPLEMENTED,"Job terminated");
+	}
+	catch(LightsparkException& e)
+	{
+		LOG(LOG_ERROR,"Exception in RasterScheduler " << e.what());
+		m_sys->setError(e.cause);
+	}
+	catch(std::exception& e)
+	{
+		LOG(LOG_ERROR,"std Exception in RasterScheduler:"<<j<<" "<<e.what());
+		m_sys->setError(e.what());
+	}
+	{
+		Locker l(w->mutex);
+		w->curJob=prevJob;
+	}
+	//jobFencing is allowed to happen outside the mutex
+	j->jobFence();
+}
+
+int RasterScheduler::job_worker(void *d)
+{
+	Worker* w = (Worker*)d;
+	RasterScheduler* th = w->scheduler;
+	setTLSSys(th->m_sys);
+	tls_set(tls_raster_worker,w);
+
+	ThreadProfile* profile=th->m_sys->allocateProfiler(RGB(200,100,0));
+	char buf[16];
+	snprintf(buf,16,"Raster %u",w->index);
+	profile->setTag(buf);
+
+	Chronometer chronometer;
+	while(1)
+	{
+		th->num_jobs.wait();
+		if(th->stopFlag)
+			return 0;
+		IThreadJob* j = th->getJob(w);
+		// the job may have been taken by a thread waiting in parallelFor()
+		if (!j)
+			continue;
+		chronometer.checkpoint();
+		th->runJob(w,j);
+		profile->accountTime(chronometer.checkpoint());
+	}
+	return 0;
+}
+
+void RasterScheduler::addJob(IThreadJob* j)
+{
+	assert(j);
+	j->setWorker(getWorker());
+	uint32_t index = uint32_t(ATOMIC_INCREMENT(nextWorker))%workers.size();
+	pushJob(workers[index],j);
+}
+
+void RasterScheduler::addDrawJobs(const std::vector<AsyncDrawJob*>& jobs)
+{
+	JobBatch* batch = nullptr;
+	uint64_t batcharea = 0;
+	for (auto it = jobs.begin(); it != jobs.end(); it++)
+	{
+		uint32_t w,h;
+		(*it)->sizeNeeded(w,h);
+		uint64_t area = uint64_t(w)*uint64_t(h);
+		if (area >= RASTER_BATCH_AREA)
+		{
+			addJob(*it);
+			continue;
+		}
+		(*it)->setWorker(getWorker());
+		if (!batch)
+			batch = new JobBatch();
+		batch->add(*it);
+		batcharea += area;
+		if (batcharea >= RASTER_BATCH_AREA)
+		{
+			addJob(batch);
+			batch = nullptr;
+			batcharea = 0;
+		}
+	}
+	if (batch)
+		addJob(batch);
+}
+
+void RasterScheduler::parallelFor(uint32_t count, const std::function<void(uint32_t)>& f)
+{
+	if (count < 2 || workers.size() < 2 || stopFlag)
+	{
+		for (uint32_t i = 0; i < count; i++)
+			f(i);
+		return;
+	}
+	Worker* w = getCurrentWorker();
+	ParallelForState state(count-1);
+	for (uint32_t i = 1; i < count; i++)
+	{
+		ParallelForJob* j = new ParallelForJob(f,i,state);
+		j->setWorker(getWorker());
+		if (w)
+			pushJob(w,j);
+		else
+			pushJob(workers[uint32_t(ATOMIC_INCREMENT(nextWorker))%workers.size()],j);
+	}
+	f(0);
+	if (w)
+	{
+		// help executing queued jobs until all parts are done
+		while (state.remaining > 0)
+		{
+			IThreadJob* j = getJob(w);
+			if (j)
+			{
+				// the job is no longer queued, so consume its signal if it's still available
+				num_jobs.try_wait();
+				runJob(w,j);
+			}
+			else
+				compat_msleep(0);
+		}
+	}
+	for (uint32_t i = 1; i < count; i++)
+		state.done.wait();
+}
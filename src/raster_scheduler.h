@@ -0,0 +1,103 @@
+/**************************************************************************
+    Lightspark, a free flash player implementation
+
+    Copyright (C) 2024  Ludger Krämer <dbluelle@onlinehome.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef RASTER_SCHEDULER_H
+#define RASTER_SCHEDULER_H 1
+
+#include "compat.h"
+#include <deque>
+#include <functional>
+#include <vector>
+#include "threading.h"
+
+namespace lightspark
+{
+
+// maximum number of rasterization threads
+#define RASTER_MAX_THREADS 64
+// jobs rasterizing less pixels than this are batched together
+#define RASTER_BATCH_AREA (128*128)
+// drawables with more pixels than this are rasterized in parallel bands
+#define RASTER_BAND_MIN_AREA (512*512)
+// minimum height of a band
+#define RASTER_BAND_MIN_HEIGHT 64
+
+class SystemState;
+class AsyncDrawJob;
+
+/*
+ * Thread pool used to rasterize DisplayObjects.
+ *
+ * One thread is started per CPU core. Every thread owns a deque of jobs:
+ * new jobs are distributed round robin over the deques, threads take jobs
+ * from the back of their own deque and steal from the front of the other
+ * deques when their own deque is empty. So there is no single lock all
+ * threads contend on.
+ *
+ * Work can be split with parallelFor(); when called from a job running on
+ * the scheduler the parts are pushed to the deque of the current thread,
+ * where idle threads can steal them.
+ */
+class RasterScheduler
+{
+private:
+	struct Worker
+	{
+		RasterScheduler* scheduler;
+		uint32_t index;
+		SDL_Thread* thread;
+		Mutex mutex;
+		std::deque<IThreadJob*> jobs;
+		IThreadJob* volatile curJob;
+	};
+	std::vector<Worker*> workers;
+	// number of queued jobs
+	Semaphore num_jobs;
+	SystemState* m_sys;
+	volatile bool stopFlag;
+	ATOMIC_INT32(nextWorker);
+	static int job_worker(void* d);
+	void pushJob(Worker* w, IThreadJob* j);
+	// takes a job from the back of the own deque or steals one from another deque
+	IThreadJob* getJob(Worker* w);
+	void runJob(Worker* w, IThreadJob* j);
+	Worker* getCurrentWorker() const;
+public:
+	RasterScheduler(SystemState* s);
+	~RasterScheduler();
+	uint32_t getThreadCount() const { return workers.size(); }
+	void addJob(IThreadJob* j);
+	/*
+	 * Queues the draw jobs of a frame. Jobs that rasterize only a few
+	 * pixels are batched, so that they are executed as one job
+	 */
+	void addDrawJobs(const std::vector<AsyncDrawJob*>& jobs);
+	/*
+	 * Calls f(0) ... f(count-1) in parallel and returns when all calls
+	 * are done. f(0) is executed by the calling thread. If the calling
+	 * thread belongs to the scheduler it executes queued jobs while
+	 * waiting for the other calls
+	 */
+	void parallelFor(uint32_t count, const std::function<void(uint32_t)>& f);
+	void forceStop();
+};
+
+}
+
+#endif /* RASTER_SCHEDULER_H */
@@ -80,6 +80,7 @@
 #include "exceptions.h"
 #include "scripting/abc.h"
 #include "backends/rendering.h"
+#include "backends/softwarerendering.h"
 #include "parsing/tags.h"
 #include "scripting/toplevel/Array.h"
 #include "scripting/toplevel/ASQName.h"
@@ -1194,6 +1195,11 @@ void ABCVm::handleEvent(std::pair<_NR<EventDispatcher>, _R<Event> > e)
 			case IDLE_EVENT:
 			{
 				m_sys->setFramePhase(FramePhase::IDLE);
+				// all scripts of the frame have been executed, so the display list is complete
+				if (m_sys->softwareRenderer)
+					m_sys->softwareRenderer->renderFrame(m_sys);
+				else if (m_sys->screenshotFrame && --m_sys->screenshotFrame==0 && m_sys->getRenderThread())
+					m_sys->getRenderThread()->requestScreenshotToFile();
 				m_sys->stage->cleanupRemovedDisplayObjects();
 				m_sys->worker->processGarbageCollection(false);
 				// DisplayObjects that are removed from the display list keep their Parent set until all removedFromStage events are handled
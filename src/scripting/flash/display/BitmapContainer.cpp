@@ -25,6 +25,7 @@
 #include "backends/image.h"
 #include "backends/decoder.h"
 #include "backends/streamcache.h"
+#include "backends/pixelkernels.h"
 #include "swf.h"
 
 using namespace std;
@@ -33,7 +34,7 @@ using namespace lightspark;
 extern void nanoVGDeleteImage(int image);
 BitmapContainer::BitmapContainer(MemoryAccount* m):stride(0),width(0),height(0),
 	data(reporter_allocator<uint8_t>(m)),renderevent(0),
-	nanoVGImageHandle(-1),cachedCairoPattern(nullptr),nanoVGGradientPattern(nullptr)
+	nanoVGImageHandle(-1),nanoVGGradientPattern(nullptr)
 {
 }
 
@@ -51,8 +52,6 @@ BitmapContainer::~BitmapContainer()
 		nanoVGDeleteImage(nanoVGImageHandle);
 	if (nanoVGGradientPattern)
 		delete[] nanoVGGradientPattern;
-	if (cachedCairoPattern)
-		cairo_pattern_destroy(cachedCairoPattern);
 		
 }
 
@@ -295,18 +294,7 @@ void BitmapContainer::setPixel(int32_t x, int32_t y, uint32_t color, bool setAlp
 	uint32_t *p=reinterpret_cast<uint32_t *>(&d[y*stride + 4*x]);
 	if(setAlpha)
 	{
-		if (ispremultiplied || ((color&0xff000000) == 0xff000000))
-			*p=color;
-		else
-		{
-			uint32_t res = 0;
-			uint32_t alpha = ((color >> 24)&0xff);
-			res |= ((((color >> 0) &0xff) * alpha)&0xff) << 0;
-			res |= ((((color >> 8) &0xff) * alpha)&0xff) << 8;
-			res |= ((((color >> 16) &0xff) * alpha)&0xff) << 16;
-			res |= alpha<<24;
-			*p=res;
-		}
+		*p = ispremultiplied ? color : premultiplyPixel(color);
 	}
 	else
 		*p=(*p & 0xff000000) | (color & 0x00ffffff);
@@ -319,25 +307,7 @@ uint32_t BitmapContainer::getPixel(int32_t x, int32_t y,bool premultiplied) cons
 	
 	uint8_t* d = getCurrentData();
 	const uint32_t *p=reinterpret_cast<const uint32_t *>(&d[y*stride + 4*x]);
-	if (!premultiplied)
-	{
-		uint32_t res = 0;
-		uint32_t alpha = ((*p >> 24)&0xff);
-		if (alpha && alpha != 0xff)
-		{
-			// return value with "un-multiplied" alpha: ceiling(value*255/alpha)
-			uint32_t b = ((*p) >> 0) &0xff;
-			uint32_t g = ((*p) >> 8) &0xff;
-			uint32_t r = ((*p) >> 16) &0xff;
-			//x/y + (x % y != 0);
-			res |= (((b*0xff)/alpha+((b*0xff)%alpha ? 1:0))&0xff) << 0;
-			res |= (((g*0xff)/alpha+((g*0xff)%alpha ? 1:0))&0xff) << 8;
-			res |= (((r*0xff)/alpha+((r*0xff)%alpha ? 1:0))&0xff) << 16;
-			res |= alpha<<24;
-			return res;
-		}
-	}
-	return *p;
+	return premultiplied ? *p : unpremultiplyPixel(*p);
 }
 
 void BitmapContainer::copyRectangle(_R<BitmapContainer> source,
@@ -380,21 +350,11 @@ void BitmapContainer::copyRectangle(_R<BitmapContainer> source,
 			memcpy (sourcedata,p,data.size());
 			needsdeletion = true;
 		}
-		// TODO check if there is a faster algorithm for this
 		for (int i=0; i<copyHeight; i++)
 		{
-			for (int j=0; j<copyWidth; j++)
-			{
-				uint32_t* pdst = reinterpret_cast<uint32_t *>(&p[(clippedY+i)*stride+4*(j+clippedX)]);
-				uint32_t* psrc = reinterpret_cast<uint32_t *>(&sourcedata[(sy+i)*source->stride+4*(j+sx)]);
-				uint32_t srcalpha = ((*psrc >> 24)&0xff);
-				uint32_t dstalpha = 0xff-srcalpha;
-				uint32_t b = ((((*psrc)     ) &0xff) * srcalpha + (((*pdst)     ) &0xff) * dstalpha) / 0xff;
-				uint32_t g = ((((*psrc) >> 8) &0xff) * srcalpha + (((*pdst) >> 8) &0xff) * dstalpha) / 0xff;
-				uint32_t r = ((((*psrc) >>16) &0xff) * srcalpha + (((*pdst) >>16) &0xff) * dstalpha) / 0xff;
-				uint32_t a = min (srcalpha + (((*pdst) >>24) &0xff) * dstalpha, 0xffU);
-				*pdst = (b & 0xff) | ((g&0xff)<<8) | ((r&0xff)<<16) | (a<<24);
-			}
+			blendPixels(reinterpret_cast<uint32_t *>(&sourcedata[(sy+i)*source->stride+4*sx]),
+						reinterpret_cast<uint32_t *>(&p[(clippedY+i)*stride+4*clippedX]),
+						copyWidth);
 		}
 		if (needsdeletion)
 			delete[] sourcedata;
@@ -422,12 +382,7 @@ void BitmapContainer::fillRectangle(const RECT& inputRect, uint32_t color, bool
 	
 	uint32_t realcolor = useAlpha ? color : (0xFF000000 | (color & 0xFFFFFF));
 	// fill first line
-	for(int32_t x=clippedRect.Xmin;x<clippedRect.Xmax;x++)
-	{
-		uint32_t offset=clippedRect.Ymin*stride + x*4;
-		uint32_t* ptr=(uint32_t*)(getCurrentData()+offset);
-		*ptr = realcolor;
-	}
+	fillPixels(getRowData(clippedRect.Ymin)+clippedRect.Xmin,clippedRect.Xmax-clippedRect.Xmin,realcolor);
 	// use memcpy to fill all other lines
 	for(int32_t y=clippedRect.Ymin+1;y<clippedRect.Ymax;y++)
 	{
@@ -650,10 +605,8 @@ std::vector<uint32_t> BitmapContainer::getPixelVector(const RECT& inputRect) con
 	result.reserve((rect.Xmax - rect.Xmin)*(rect.Ymax - rect.Ymin));
 	for (int32_t y=rect.Ymin; y<rect.Ymax; y++)
 	{
-		for (int32_t x=rect.Xmin; x<rect.Xmax; x++)
-		{
-			result.push_back(*getDataNoBoundsChecking(x, y));
-		}
+		const uint32_t* row = getRowData(y);
+		result.insert(result.end(),row+rect.Xmin,row+rect.Xmax);
 	}
 
 	return result;
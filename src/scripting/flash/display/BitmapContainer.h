@@ -55,7 +55,6 @@ public:
 	Semaphore renderevent;
 	TextureChunk bitmaptexture;
 	int nanoVGImageHandle;
-	cairo_pattern_t* cachedCairoPattern;
 	float* nanoVGGradientPattern;
 	BitmapContainer(MemoryAccount* m);
 	~BitmapContainer();
@@ -93,6 +92,8 @@ public:
 	void setAlpha(int32_t x, int32_t y, uint8_t alpha);
 	void setPixel(int32_t x, int32_t y, uint32_t color, bool setAlpha, bool ispremultiplied=true);
 	uint32_t getPixel(int32_t x, int32_t y, bool premultiplied=true) const;
+	// returns the premultiplied pixels of row y, no bounds checking is done
+	uint32_t* getRowData(int32_t y) const { return (uint32_t*)(getCurrentData()+y*stride); }
 	std::vector<uint32_t> getPixelVector(const RECT& rect) const;
 	void copyRectangle(_R<BitmapContainer> source, 
 			   const RECT& sourceRect,
@@ -35,6 +35,8 @@
 #include "scripting/flash/geom/Point.h"
 #include "scripting/flash/system/flashsystem.h"
 #include "backends/rendering.h"
+#include "backends/pixelkernels.h"
+#include "backends/softwarerendering.h"
 #include "3rdparty/perlinnoise/PerlinNoise.hpp"
 
 #include <cstdlib> 
@@ -212,19 +214,7 @@ ASFUNCTIONBODY_ATOM(BitmapData,_constructor)
 		*alpha=0xFF;
 	}
 	else
-	{
-		//premultiply alpha
-		uint32_t res = 0;
-		uint32_t alpha = ((fillColor >> 24)&0xff);
-		if (alpha != 0xff)
-		{
-			res |= ((((fillColor >> 0) &0xff) * alpha)&0xff) << 0;
-			res |= ((((fillColor >> 8) &0xff) * alpha)&0xff) << 8;
-			res |= ((((fillColor >> 16) &0xff) * alpha)&0xff) << 16;
-			res |= alpha<<24;
-			c= GUINT32_TO_BE(res);
-		}
-	}
+		c=GUINT32_TO_BE(premultiplyPixel(fillColor));
 	for(uint32_t i=0; i<(uint32_t)(width*height); i++)
 		pixelArray[i]=c;
 	th->pixels->fromRGB(reinterpret_cast<uint8_t *>(pixelArray), width, height, BitmapContainer::ARGB32);
@@ -240,10 +230,18 @@ ASFUNCTIONBODY_ATOM(BitmapData,dispose)
 	th->notifyUsers();
 }
 
-void BitmapData::drawDisplayObject(DisplayObject* d, const MATRIX& initialMatrix, bool smoothing, AS_BLENDMODE blendMode, ColorTransformBase* ct)
+void BitmapData::drawDisplayObject(DisplayObject* d, const MATRIX& initialMatrix, bool smoothing, AS_BLENDMODE blendMode, ColorTransformBase* ct, const RECT* clipRect)
 {
-	d->incRef();
-	getSystemState()->getRenderThread()->renderDisplayObjectToBimapContainer(_MNR(d),initialMatrix,smoothing,blendMode,ct,this->pixels);
+	SystemState* sys = getSystemState();
+	if (sys->gpuBitmapDraw && sys->getRenderThread() && !sys->softwareRenderer)
+	{
+		if (clipRect)
+			LOG(LOG_NOT_IMPLEMENTED,"BitmapData.draw does not support clipRect parameter when rendering on the GPU:"<<d->toDebugString());
+		d->incRef();
+		sys->getRenderThread()->renderDisplayObjectToBimapContainer(_MNR(d),initialMatrix,smoothing,blendMode,ct,this->pixels);
+	}
+	else
+		SoftwareRenderer::drawToBitmap(d,initialMatrix,smoothing,blendMode,ct,clipRect,this->pixels.getPtr());
 	this->notifyUsers();
 }
 
@@ -306,8 +304,6 @@ ASFUNCTIONBODY_ATOM(BitmapData,drawWithQuality)
 	}
 	else if(drawable->is<DisplayObject>())
 	{
-		if(!clipRect.isNull())
-			LOG(LOG_NOT_IMPLEMENTED,"BitmapData.draw does not support clipRect parameter:"<<drawable->toDebugString()<<" "<<clipRect->x<<"/"<<clipRect->y<<" "<<clipRect->width<<"/"<<clipRect->height);
 		DisplayObject* d=drawable->as<DisplayObject>();
 		//Compute the initial matrix, if any
 		MATRIX initialMatrix;
@@ -330,7 +326,10 @@ ASFUNCTIONBODY_ATOM(BitmapData,drawWithQuality)
 			case BUILTIN_STRINGS::STRING_SCREEN: bl = BLENDMODE_SCREEN; break;
 			case BUILTIN_STRINGS::STRING_SUBTRACT: bl = BLENDMODE_SUBTRACT; break;
 		}
-		th->drawDisplayObject(d, initialMatrix,smoothing,bl,ctransform.getPtr());
+		RECT clip;
+		if (!clipRect.isNull())
+			clip = clipRect->getRect();
+		th->drawDisplayObject(d, initialMatrix,smoothing,bl,ctransform.getPtr(),clipRect.isNull() ? nullptr : &clip);
 	}
 	else
 		LOG(LOG_NOT_IMPLEMENTED,"BitmapData.draw does not support " << drawable->toDebugString());
@@ -707,23 +706,22 @@ ASFUNCTIONBODY_ATOM(BitmapData,copyChannel)
 	if (regionWidth < 0 || regionHeight < 0)
 		return;
 
-	uint32_t constantChannelsMask = ~(0xFF << destShift);
+	// the channels are copied between the un-multiplied pixels
+	vector<uint32_t> sourceRow(regionWidth);
+	vector<uint32_t> destRow(regionWidth);
 	for (int32_t y=0; y<regionHeight; y++)
 	{
-		for (int32_t x=0; x<regionWidth; x++)
+		uint32_t* src = source->pixels->getRowData(clippedSourceRect.Ymin+y)+clippedSourceRect.Xmin;
+		uint32_t* dst = th->pixels->getRowData(clippedDestY+y)+clippedDestX;
+		unpremultiplyPixels(src,sourceRow.data(),regionWidth);
+		unpremultiplyPixels(dst,destRow.data(),regionWidth);
+		copyChannelPixels(sourceRow.data(),destRow.data(),regionWidth,sourceShift,destShift);
+		if (!th->transparent)
 		{
-			int32_t sx = clippedSourceRect.Xmin+x;
-			int32_t sy = clippedSourceRect.Ymin+y;
-			uint32_t sourcePixel = source->pixels->getPixel(sx, sy,false);
-			uint32_t channel = (sourcePixel >> sourceShift) & 0xFF;
-			int32_t dx = clippedDestX + x;
-			int32_t dy = clippedDestY + y;
-			uint32_t oldPixel = th->pixels->getPixel(dx, dy,sourceChannel == BitmapDataChannel::ALPHA);
-			uint32_t destChannelValue = channel << destShift;
-
-			uint32_t newColor = ((oldPixel & constantChannelsMask) | destChannelValue);
-			th->pixels->setPixel(dx, dy, newColor, true,sourceChannel == BitmapDataChannel::ALPHA);
+			for (int32_t i=0; i<regionWidth; i++)
+				destRow[i] |= 0xff000000;
 		}
+		premultiplyPixels(destRow.data(),dst,regionWidth);
 	}
 
 	th->notifyUsers();
@@ -798,17 +796,14 @@ ASFUNCTIONBODY_ATOM(BitmapData,histogram)
 		th->pixels->clipRect(inputRect->getRect(), rect);
 	}
 
-	unsigned int counts[4][256] = {{0}};
-	for (int32_t x=rect.Xmin; x<rect.Xmax; x++)
+	// the histogram counts the un-multiplied values
+	uint32_t counts[4][256] = {{0}};
+	uint32_t width = max(rect.Xmax-rect.Xmin,0);
+	vector<uint32_t> row(width);
+	for (int32_t y=rect.Ymin; y<rect.Ymax; y++)
 	{
-		for (int32_t y=rect.Ymin; y<rect.Ymax; y++)
-		{
-			uint32_t pixel = th->pixels->getPixel(x, y);
-			for (int i=0; i<4; i++)
-			{
-				counts[i][(pixel >> (8*i)) & 0xFF]++;
-			}
-		}
+		unpremultiplyPixels(th->pixels->getRowData(y)+rect.Xmin,row.data(),width);
+		histogramPixels(row.data(),width,counts);
 	}
 
 	asAtom v=asAtomHandler::invalidAtom;
@@ -1049,33 +1044,25 @@ ASFUNCTIONBODY_ATOM(BitmapData,colorTransform)
 	}
 	RECT rect;
 	th->pixels->clipRect(inputRect->getRect(), rect);
-	
-	unsigned int i = 0;
+	if (rect.Xmax <= rect.Xmin)
+		return;
+
+	// blue, green, red, alpha
+	const number_t multipliers[4] = { inputColorTransform->blueMultiplier, inputColorTransform->greenMultiplier, inputColorTransform->redMultiplier, inputColorTransform->alphaMultiplier };
+	const number_t offsets[4] = { inputColorTransform->blueOffset, inputColorTransform->greenOffset, inputColorTransform->redOffset, inputColorTransform->alphaOffset };
+	uint32_t width = rect.Xmax-rect.Xmin;
+	vector<uint32_t> row(width);
 	for (int32_t y=rect.Ymin; y<rect.Ymax; y++)
 	{
-		for (int32_t x=rect.Xmin; x<rect.Xmax; x++)
+		uint32_t* p = th->pixels->getRowData(y)+rect.Xmin;
+		unpremultiplyPixels(p,row.data(),width);
+		colorTransformPixels(row.data(),width,multipliers,offsets);
+		if (!th->transparent)
 		{
-			uint32_t pixel = th->pixels->getPixel(x, y);
-
-			int a, r, g, b;
-			a = ((pixel >> 24 )&0xff) * inputColorTransform->alphaMultiplier + inputColorTransform->alphaOffset;
-			if (a > 255) a = 255;
-			if (a < 0) a = 0;
-			r = ((pixel >> 16 )&0xff) * inputColorTransform->redMultiplier + inputColorTransform->redOffset;
-			if (r > 255) r = 255;
-			if (r < 0) r = 0;
-			g = ((pixel >> 8 )&0xff) * inputColorTransform->greenMultiplier + inputColorTransform->greenOffset;
-			if (g > 255) g = 255;
-			if (g < 0) g = 0;
-			b = ((pixel )&0xff) * inputColorTransform->blueMultiplier + inputColorTransform->blueOffset;
-			if (b > 255) b = 255;
-			if (b < 0) b = 0;
-			
-			pixel = (a<<24) | (r<<16) | (g<<8) | b;
-			
-			th->pixels->setPixel(x, y, pixel, th->transparent,false);
-			i++;
+			for (uint32_t i=0; i<width; i++)
+				row[i] |= 0xff000000;
 		}
+		premultiplyPixels(row.data(),p,width);
 	}
 	th->notifyUsers();
 }
@@ -1108,33 +1095,19 @@ ASFUNCTIONBODY_ATOM(BitmapData,compare)
 	rect.Ymin = 0;
 	rect.Ymax = th->getHeight();
 	
-	vector<uint32_t> pixelvec = th->pixels->getPixelVector(rect);
-	vector<uint32_t> otherpixelvec = otherBitmapData->pixels->getPixelVector(rect);
-	
 	BitmapData* res = Class<BitmapData>::getInstanceS(wrk,rect.Xmax,rect.Ymax);
-	unsigned int i = 0;
 	bool different = false;
+	// the differences are computed on the un-multiplied pixels
+	vector<uint32_t> row(rect.Xmax);
+	vector<uint32_t> otherRow(rect.Xmax);
+	vector<uint32_t> resultRow(rect.Xmax);
 	for (int32_t y=rect.Ymin; y<rect.Ymax; y++)
 	{
-		for (int32_t x=rect.Xmin; x<rect.Xmax; x++)
-		{
-
-			uint32_t pixel = pixelvec[i];
-			uint32_t otherpixel = otherpixelvec[i];
-			if (pixel == otherpixel)
-				res->pixels->setPixel(x, y, 0, true);
-			else if ((pixel & 0x00FFFFFF) == (otherpixel & 0x00FFFFFF))
-			{
-				different = true;
-				res->pixels->setPixel(x, y, ((pixel & 0xFF000000) - (otherpixel & 0xFF000000)) | 0x00FFFFFF , true);
-			}
-			else 
-			{
-				different = true;
-				res->pixels->setPixel(x, y, ((pixel & 0x00FFFFFF) - (otherpixel & 0x00FFFFFF)), true);
-			}
-			i++;
-		}
+		unpremultiplyPixels(th->pixels->getRowData(y),row.data(),rect.Xmax);
+		unpremultiplyPixels(otherBitmapData->pixels->getRowData(y),otherRow.data(),rect.Xmax);
+		if (comparePixels(row.data(),otherRow.data(),resultRow.data(),rect.Xmax))
+			different = true;
+		premultiplyPixels(resultRow.data(),res->pixels->getRowData(y),rect.Xmax);
 	}
 	if (!different)
 		asAtomHandler::setInt(ret,wrk,0);
@@ -1282,6 +1255,12 @@ ASFUNCTIONBODY_ATOM(BitmapData,perlinNoise)
 }
 ASFUNCTIONBODY_ATOM(BitmapData,threshold)
 {
+	BitmapData* th = asAtomHandler::as<BitmapData>(obj);
+	if(th->pixels.isNull())
+	{
+		createError<ArgumentError>(wrk,2015,"Disposed BitmapData");
+		return;
+	}
 	_NR<BitmapData> sourceBitmapData;
 	_NR<Rectangle> sourceRect;
 	_NR<Point> destPoint;
@@ -1292,10 +1271,86 @@ ASFUNCTIONBODY_ATOM(BitmapData,threshold)
 	bool copySource;
 	ARG_CHECK(ARG_UNPACK(sourceBitmapData)(sourceRect)(destPoint)(operation)(threshold) (color,0) (mask, 0xFFFFFFFF) (copySource, false));
 
-	LOG(LOG_NOT_IMPLEMENTED,"BitmapData.threshold not implemented");
+	if (sourceBitmapData.isNull())
+	{
+		createError<TypeError>(wrk,kNullPointerError, "sourceBitmapData");
+		return;
+	}
+	if (sourceRect.isNull())
+	{
+		createError<TypeError>(wrk,kNullPointerError, "sourceRect");
+		return;
+	}
+	if (destPoint.isNull())
+	{
+		createError<TypeError>(wrk,kNullPointerError, "destPoint");
+		return;
+	}
+	if (sourceBitmapData->pixels.isNull())
+	{
+		createError<ArgumentError>(wrk,2015,"Disposed BitmapData");
+		return;
+	}
+	THRESHOLD_OPERATION op;
+	if (operation == "<")
+		op = THRESHOLD_LESS;
+	else if (operation == "<=")
+		op = THRESHOLD_LESS_EQUAL;
+	else if (operation == ">")
+		op = THRESHOLD_GREATER;
+	else if (operation == ">=")
+		op = THRESHOLD_GREATER_EQUAL;
+	else if (operation == "==")
+		op = THRESHOLD_EQUAL;
+	else if (operation == "!=")
+		op = THRESHOLD_NOT_EQUAL;
+	else
+	{
+		createError<ArgumentError>(wrk,kInvalidEnumError, "operation");
+		return;
+	}
+
+	RECT clippedSourceRect;
+	int32_t clippedDestX;
+	int32_t clippedDestY;
+	th->pixels->clipRect(sourceBitmapData->pixels, sourceRect->getRect(),
+				 destPoint->getX(), destPoint->getY(),
+				 clippedSourceRect, clippedDestX, clippedDestY);
+	int regionWidth = clippedSourceRect.Xmax - clippedSourceRect.Xmin;
+	int regionHeight = clippedSourceRect.Ymax - clippedSourceRect.Ymin;
+	asAtomHandler::setUInt(ret,wrk,0);
+	if (regionWidth <= 0 || regionHeight <= 0)
+		return;
+
+	// the comparison is done on the un-multiplied pixels
+	uint32_t changed = 0;
+	vector<uint32_t> sourceRow(regionWidth);
+	vector<uint32_t> destRow(regionWidth);
+	for (int32_t y=0; y<regionHeight; y++)
+	{
+		uint32_t* src = sourceBitmapData->pixels->getRowData(clippedSourceRect.Ymin+y)+clippedSourceRect.Xmin;
+		uint32_t* dst = th->pixels->getRowData(clippedDestY+y)+clippedDestX;
+		unpremultiplyPixels(src,sourceRow.data(),regionWidth);
+		unpremultiplyPixels(dst,destRow.data(),regionWidth);
+		changed += thresholdPixels(sourceRow.data(),destRow.data(),regionWidth,op,threshold,color,mask,copySource);
+		if (!th->transparent)
+		{
+			for (int32_t i=0; i<regionWidth; i++)
+				destRow[i] |= 0xff000000;
+		}
+		premultiplyPixels(destRow.data(),dst,regionWidth);
+	}
+	th->notifyUsers();
+	asAtomHandler::setUInt(ret,wrk,changed);
 }
 ASFUNCTIONBODY_ATOM(BitmapData,merge)
 {
+	BitmapData* th = asAtomHandler::as<BitmapData>(obj);
+	if(th->pixels.isNull())
+	{
+		createError<ArgumentError>(wrk,2015,"Disposed BitmapData");
+		return;
+	}
 	_NR<BitmapData> sourceBitmapData;
 	_NR<Rectangle> sourceRect;
 	_NR<Point> destPoint;
@@ -1305,11 +1360,66 @@ ASFUNCTIONBODY_ATOM(BitmapData,merge)
 	uint32_t alphaMultiplier;
 	ARG_CHECK(ARG_UNPACK(sourceBitmapData)(sourceRect) (destPoint) (redMultiplier) (greenMultiplier) (blueMultiplier) (alphaMultiplier));
 
-	LOG(LOG_NOT_IMPLEMENTED,"BitmapData.merge not implemented");
+	if (sourceBitmapData.isNull())
+	{
+		createError<TypeError>(wrk,kNullPointerError, "sourceBitmapData");
+		return;
+	}
+	if (sourceRect.isNull())
+	{
+		createError<TypeError>(wrk,kNullPointerError, "sourceRect");
+		return;
+	}
+	if (destPoint.isNull())
+	{
+		createError<TypeError>(wrk,kNullPointerError, "destPoint");
+		return;
+	}
+	if (sourceBitmapData->pixels.isNull())
+	{
+		createError<ArgumentError>(wrk,2015,"Disposed BitmapData");
+		return;
+	}
+
+	RECT clippedSourceRect;
+	int32_t clippedDestX;
+	int32_t clippedDestY;
+	th->pixels->clipRect(sourceBitmapData->pixels, sourceRect->getRect(),
+				 destPoint->getX(), destPoint->getY(),
+				 clippedSourceRect, clippedDestX, clippedDestY);
+	int regionWidth = clippedSourceRect.Xmax - clippedSourceRect.Xmin;
+	int regionHeight = clippedSourceRect.Ymax - clippedSourceRect.Ymin;
+	if (regionWidth <= 0 || regionHeight <= 0)
+		return;
+
+	// blue, green, red, alpha
+	const uint32_t multipliers[4] = { min(blueMultiplier,256U), min(greenMultiplier,256U), min(redMultiplier,256U), min(alphaMultiplier,256U) };
+	vector<uint32_t> sourceRow(regionWidth);
+	vector<uint32_t> destRow(regionWidth);
+	for (int32_t y=0; y<regionHeight; y++)
+	{
+		uint32_t* src = sourceBitmapData->pixels->getRowData(clippedSourceRect.Ymin+y)+clippedSourceRect.Xmin;
+		uint32_t* dst = th->pixels->getRowData(clippedDestY+y)+clippedDestX;
+		unpremultiplyPixels(src,sourceRow.data(),regionWidth);
+		unpremultiplyPixels(dst,destRow.data(),regionWidth);
+		mergePixels(sourceRow.data(),destRow.data(),regionWidth,multipliers);
+		if (!th->transparent)
+		{
+			for (int32_t i=0; i<regionWidth; i++)
+				destRow[i] |= 0xff000000;
+		}
+		premultiplyPixels(destRow.data(),dst,regionWidth);
+	}
+	th->notifyUsers();
 }
 ASFUNCTIONBODY_ATOM(BitmapData,paletteMap)
 {
-//	BitmapData* th = asAtomHandler::as<BitmapData>(obj);
+	BitmapData* th = asAtomHandler::as<BitmapData>(obj);
+	if(th->pixels.isNull())
+	{
+		createError<ArgumentError>(wrk,2015,"Disposed BitmapData");
+		return;
+	}
 
 	_NR<BitmapData> sourceBitmapData;
 	_NR<Rectangle> sourceRect;
@@ -1320,6 +1430,76 @@ ASFUNCTIONBODY_ATOM(BitmapData,paletteMap)
 	_NR<Array> alphaArray;
 	ARG_CHECK(ARG_UNPACK(sourceBitmapData)(sourceRect) (destPoint) (redArray, NullRef) (greenArray, NullRef) (blueArray, NullRef) (alphaArray, NullRef));
 
-	LOG(LOG_NOT_IMPLEMENTED,"BitmapData.paletteMap not implemented");
-}
+	if (sourceBitmapData.isNull())
+	{
+		createError<TypeError>(wrk,kNullPointerError, "sourceBitmapData");
+		return;
+	}
+	if (sourceRect.isNull())
+	{
+		createError<TypeError>(wrk,kNullPointerError, "sourceRect");
+		return;
+	}
+	if (destPoint.isNull())
+	{
+		createError<TypeError>(wrk,kNullPointerError, "destPoint");
+		return;
+	}
+	if (sourceBitmapData->pixels.isNull())
+	{
+		createError<ArgumentError>(wrk,2015,"Disposed BitmapData");
+		return;
+	}
 
+	// blue, green, red, alpha
+	uint32_t maps[4][256];
+	Array* arrays[4] = { blueArray.getPtr(), greenArray.getPtr(), redArray.getPtr(), alphaArray.getPtr() };
+	for (uint32_t c=0; c<4; c++)
+	{
+		uint32_t size = arrays[c] ? min(arrays[c]->size(),uint64_t(256)) : 0;
+		for (uint32_t i=0; i<256; i++)
+		{
+			if (!arrays[c])
+			{
+				// no array means the channel is copied unchanged
+				maps[c][i] = i<<(8*c);
+				continue;
+			}
+			maps[c][i] = 0;
+			if (i < size)
+			{
+				asAtom v = asAtomHandler::invalidAtom;
+				arrays[c]->at_nocheck(v,i);
+				maps[c][i] = asAtomHandler::toUInt(v);
+			}
+		}
+	}
+
+	RECT clippedSourceRect;
+	int32_t clippedDestX;
+	int32_t clippedDestY;
+	th->pixels->clipRect(sourceBitmapData->pixels, sourceRect->getRect(),
+				 destPoint->getX(), destPoint->getY(),
+				 clippedSourceRect, clippedDestX, clippedDestY);
+	int regionWidth = clippedSourceRect.Xmax - clippedSourceRect.Xmin;
+	int regionHeight = clippedSourceRect.Ymax - clippedSourceRect.Ymin;
+	if (regionWidth <= 0 || regionHeight <= 0)
+		return;
+
+	vector<uint32_t> sourceRow(regionWidth);
+	vector<uint32_t> destRow(regionWidth);
+	for (int32_t y=0; y<regionHeight; y++)
+	{
+		uint32_t* src = sourceBitmapData->pixels->getRowData(clippedSourceRect.Ymin+y)+clippedSourceRect.Xmin;
+		uint32_t* dst = th->pixels->getRowData(clippedDestY+y)+clippedDestX;
+		unpremultiplyPixels(src,sourceRow.data(),regionWidth);
+		paletteMapPixels(sourceRow.data(),destRow.data(),regionWidth,maps);
+		if (!th->transparent)
+		{
+			for (int32_t i=0; i<regionWidth; i++)
+				destRow[i] |= 0xff000000;
+		}
+		premultiplyPixels(destRow.data(),dst,regionWidth);
+	}
+	th->notifyUsers();
+}
@@ -57,8 +57,10 @@ public:
 	void checkForUpload();
 	/*
 	 * Utility method to draw a DisplayObject on the surface
+	 * The DisplayObject is rasterized on the CPU, unless rendering BitmapData.draw() on the GPU is enabled.
+	 * clipRect may be nullptr
 	 */
-	void drawDisplayObject(DisplayObject* d, const MATRIX& initialMatrix, bool smoothing, AS_BLENDMODE blendMode, ColorTransformBase* ct);
+	void drawDisplayObject(DisplayObject* d, const MATRIX& initialMatrix, bool smoothing, AS_BLENDMODE blendMode, ColorTransformBase* ct, const RECT* clipRect=nullptr);
 	ASPROPERTY_GETTER(bool, transparent);
 	ASFUNCTION_ATOM(_constructor);
 	ASFUNCTION_ATOM(dispose);
@@ -33,6 +33,8 @@
 #include "scripting/flash/display/BitmapData.h"
 #include "scripting/toplevel/Array.h"
 #include "backends/rendering.h"
+#include "platforms/fastpaths.h"
+#include "raster_scheduler.h"
 
 using namespace std;
 using namespace lightspark;
@@ -88,6 +90,9 @@ int SHG_TABLE[] =
 	17, 16, 17, 17, 16, 17, 15, 16, 17, 14, 17, 16, 15, 17, 16, 17, 13, 17, 16, 17, 17, 16, 17, 14, 17, 16, 17, 16, 17, 16, 17, 9
 };
 
+// minimum number of rows or columns blurred by one thread
+#define BLUR_MIN_BAND_SIZE 32
+
 void BitmapFilter::applyBlur(uint8_t* data, uint32_t width, uint32_t height, number_t blurx, number_t blury, int quality)
 {
 	int oX;
@@ -104,202 +109,40 @@ void BitmapFilter::applyBlur(uint8_t* data, uint32_t width, uint32_t height, num
 		radiusX = sizeof(MUL_TABLE)/sizeof(int)-1;
 	if (radiusY >= int(sizeof(MUL_TABLE)/sizeof(int)))
 		radiusY = sizeof(MUL_TABLE)/sizeof(int)-1;
-	if (radiusX<=0 || radiusY <= 0)
+	if (radiusX<=0 || radiusY <= 0 || width == 0 || height == 0)
 		return;
 
-	int iterations = quality;
-
-	uint8_t* px = data;
-	int x, y, i, p, yp, yi, yw;
-	int r, g, b, a, pr, pg, pb, pa;
-
-	int divx = (radiusX + radiusX + 1);
-	int divy = (radiusY + radiusY + 1);
-	int w = width;
-	int h = height;
-
-	int w1 = w - 1;
-	int h1 = h - 1;
-	int rxp1 = radiusX + 1;
-	int ryp1 = radiusY + 1;
-
-	std::vector<RGBA> ssx;
-	ssx.resize(divx);
-	std::vector<RGBA> ssy;
-	ssy.resize(divy);
-
-	int mtx = MUL_TABLE[radiusX];
-	int stx = SHG_TABLE[radiusX];
-	int mty = MUL_TABLE[radiusY];
-	int sty = SHG_TABLE[radiusY];
-
-	while (iterations > 0)
+	// every pass of the separable box blur is split into bands of rows/columns that are blurred in parallel
+	RasterScheduler* scheduler = getSystemState()->getRasterScheduler();
+	uint32_t threads = scheduler ? scheduler->getThreadCount() : 1;
+	uint32_t rowbands = max(uint32_t(1),min(threads,height/BLUR_MIN_BAND_SIZE));
+	// column bands are multiples of 4 columns wide, as the column kernel works on strips of 4 pixels
+	uint32_t columngroups = (width+3)/4;
+	uint32_t columnbands = max(uint32_t(1),min(threads,width/BLUR_MIN_BAND_SIZE));
+	uint32_t stride = width*4;
+	std::function<void(uint32_t)> blurRows = [&](uint32_t band)
+	{
+		uint32_t y1 = band*height/rowbands;
+		uint32_t y2 = (band+1)*height/rowbands;
+		fastBoxBlurRows(data+y1*stride,width,y2-y1,stride,radiusX,MUL_TABLE[radiusX],SHG_TABLE[radiusX]);
+	};
+	std::function<void(uint32_t)> blurColumns = [&](uint32_t band)
+	{
+		uint32_t x1 = min(width,(band*columngroups/columnbands)*4);
+		uint32_t x2 = min(width,((band+1)*columngroups/columnbands)*4);
+		fastBoxBlurColumns(data+x1*4,x2-x1,height,stride,radiusY,MUL_TABLE[radiusY],SHG_TABLE[radiusY]);
+	};
+	for (int i = 0; i < quality; i++)
 	{
-		iterations--;
-		yw = yi = 0;
-		int ms = mtx;
-		int ss = stx;
-		y = h;
-		do
+		if (scheduler)
 		{
-			r = rxp1 * (pr = px[yi]);
-			g = rxp1 * (pg = px[yi + 1]);
-			b = rxp1 * (pb = px[yi + 2]);
-			a = rxp1 * (pa = px[yi + 3]);
-			auto sx = ssx.begin();
-			i = rxp1;
-			do
-			{
-				(*sx).Red = pr;
-				(*sx).Green = pg;
-				(*sx).Blue = pb;
-				(*sx).Alpha = pa;
-				sx++;
-				if (sx == ssx.end())
-					sx = ssx.begin();
-			}
-			while (--i > -1);
-			
-			for (i = 1; i < rxp1; i++)
-			{
-				p = yi + ((w1 < i ? w1 : i) << 2);
-				r += ((*sx).Red = px[p]);
-				g += ((*sx).Green = px[p + 1]);
-				b += ((*sx).Blue = px[p + 2]);
-				a += ((*sx).Alpha = px[p + 3]);
-				sx++;
-				if (sx == ssx.end())
-					sx = ssx.begin();
-			}
-			
-			auto si = ssx.begin();
-			for (x = 0; x < w; x++)
-			{
-				px[yi++] = uint32_t(r * ms) >> ss;
-				px[yi++] = uint32_t(g * ms) >> ss;
-				px[yi++] = uint32_t(b * ms) >> ss;
-				px[yi++] = uint32_t(a * ms) >> ss;
-				p = x + radiusX + 1;
-				p = (yw + (p < w1 ? p : w1)) << 2;
-				r -= (*si).Red;
-				r += ((*si).Red = px[p]);
-				g -= (*si).Green;
-				g += ((*si).Green = px[p + 1]);
-				b -= (*si).Blue;
-				b += ((*si).Blue = px[p + 2]);
-				a -= (*si).Alpha;
-				a += ((*si).Alpha = px[p + 3]);
-				si++;
-				if (si == ssx.end())
-					si = ssx.begin();
-			}
-			yw += w;
+			scheduler->parallelFor(rowbands,blurRows);
+			scheduler->parallelFor(columnbands,blurColumns);
 		}
-		while (--y > 0);
-		
-		ms = mty;
-		ss = sty;
-		for (x = 0; x < w; x++)
+		else
 		{
-			yi = x << 2;
-			r = ryp1 * (pr = px[yi]);
-			g = ryp1 * (pg = px[yi + 1]);
-			b = ryp1 * (pb = px[yi + 2]);
-			a = ryp1 * (pa = px[yi + 3]);
-			auto sy = ssy.begin();
-			for (i = 0; i< ryp1; i++)
-			{
-				(*sy).Red = pr;
-				(*sy).Green = pg;
-				(*sy).Blue = pb;
-				(*sy).Alpha = pa;
-				sy++;
-				if (sy == ssy.end())
-					sy = ssy.begin();
-			}
-			yp = w;
-			for (i = 1; i < (radiusY + 1); i++)
-			{
-				yi = (yp + x) << 2;
-				r += ((*sy).Red = px[yi]);
-				g += ((*sy).Green = px[yi + 1]);
-				b += ((*sy).Blue = px[yi + 2]);
-				a += ((*sy).Alpha = px[yi + 3]);
-				sy++;
-				if (sy == ssy.end())
-					sy = ssy.begin();
-				if (i < h1)
-				{
-					yp += w;
-				}
-			}
-			yi = x;
-			auto si = ssy.begin();
-			
-			if (iterations > 0)
-			{
-				for (y = 0; y<h; y++)
-				{
-					p = yi << 2;
-					pa = uint32_t(a * ms) >> ss;
-					px[p + 3] = pa;
-					if (pa > 0)
-					{
-						px[p] = (uint32_t(r * ms) >> ss);
-						px[p + 1] = (uint32_t(g * ms) >> ss);
-						px[p + 2] = (uint32_t(b * ms) >> ss);
-					}
-					else
-					{
-						px[p] = px[p + 1] = px[p + 2] = 0;
-					}
-					p = y + ryp1;
-					p = (x + ((p < h1 ? p : h1) * w)) << 2;
-					r -= (*si).Red;
-					r += ((*si).Red = px[p]);
-					g -= (*si).Green;
-					g += ((*si).Green = px[p + 1]);
-					b -= (*si).Blue;
-					b += ((*si).Blue = px[p + 2]);
-					a -= (*si).Alpha;
-					a += ((*si).Alpha = px[p + 3]);
-					si++;
-					if (si == ssy.end())
-						si = ssy.begin();
-					yi += w;
-				}
-			}
-			else
-			{
-				for (y = 0; y < h; y++)
-				{
-					p = yi << 2;
-					px[p + 3] = pa = uint32_t(a * ms) >> ss;
-					if (pa > 0)
-					{
-						pr = (uint32_t(r * ms) >> ss);
-						pg = (uint32_t(g * ms) >> ss);
-						pb = (uint32_t(b * ms) >> ss);
-						px[p] = pr > 255 ? 255 : pr;
-						px[p + 1] = pg > 255 ? 255 : pg;
-						px[p + 2] = pb > 255 ? 255 : pb;
-					}
-					else
-					{
-						px[p] = px[p + 1] = px[p + 2] = 0;
-					}
-					p = y + ryp1;
-					p = (x + ((p < h1 ? p : h1) * w)) << 2;
-					r -= (*si).Red - ((*si).Red = px[p]);
-					g -= (*si).Green - ((*si).Green = px[p + 1]);
-					b -= (*si).Blue - ((*si).Blue = px[p + 2]);
-					a -= (*si).Alpha - ((*si).Alpha = px[p + 3]);
-					si++;
-					if (si == ssy.end())
-						si = ssy.begin();
-					yi += w;
-				}
-			}
+			blurRows(0);
+			blurColumns(0);
 		}
 	}
 }
@@ -190,6 +190,20 @@ IDrawable *Video::invalidate(bool smoothing)
 	return res;
 }
 
+bool Video::getFramePixels(std::vector<uint8_t>& pixels, uint32_t& w, uint32_t& h)
+{
+	Locker l(mutex);
+	if (embeddedVideoDecoder)
+		return embeddedVideoDecoder->getFramePixels(pixels,w,h);
+	if (netStream && netStream->lockIfReady())
+	{
+		bool ret=netStream->getVideoFramePixels(pixels,w,h);
+		netStream->unlock();
+		return ret;
+	}
+	return false;
+}
+
 void Video::resetDecoder()
 {
 	Locker l(mutex);
@@ -620,6 +634,7 @@ ASFUNCTIONBODY_ATOM(Sound,play)
 		}
 		SoundChannel* s = Class<SoundChannel>::getInstanceS(wrk,::ceil(th->buffertime/1000.0),th->soundData, th->format);
 		s->setStartTime(startTime);
+		s->setDuration(th->length);
 		s->setLoops(loops);
 		if (th->is<AVM1Sound>())
 			th->soundChannel->setSampleProducer(th);
@@ -896,7 +911,7 @@ ASFUNCTIONBODY_GETTER_SETTER(SoundLoaderContext,checkPolicyFile)
 
 SoundChannel::SoundChannel(ASWorker* wrk, Class_base* c, uint32_t _buffertimeseconds, _NR<StreamCache> _stream, AudioFormat _format, const SOUNDINFO* _soundinfo, Sound* _sampleproducer, bool _forstreaming)
 	: EventDispatcher(wrk,c),buffertimeseconds(_buffertimeseconds),stream(_stream),sampleproducer(_sampleproducer),starting(true),stopped(true),terminated(true),stopping(false),finished(false),audioDecoder(nullptr),audioStream(nullptr),
-	format(_format),soundinfo(_soundinfo),oldVolume(-1.0),startTime(0),loopstogo(0),streamposition(0),streamdatafinished(false),restartafterabort(false),forstreaming(_forstreaming),fromSoundTag(nullptr),
+	format(_format),soundinfo(_soundinfo),oldVolume(-1.0),startTime(0),duration(0),loopstogo(0),streamposition(0),streamdatafinished(false),restartafterabort(false),forstreaming(_forstreaming),fromSoundTag(nullptr),
 	leftPeak(1),rightPeak(1),semSampleData(0)
 {
 	subtype=SUBTYPE_SOUNDCHANNEL;
@@ -1066,6 +1081,7 @@ void SoundChannel::finalize()
 	soundinfo=nullptr;
 	oldVolume=-1.0;
 	startTime=0;
+	duration=0;
 	loopstogo=0;
 	streamposition=0;
 	streamdatafinished=false;
@@ -1095,6 +1111,7 @@ bool SoundChannel::destruct()
 	soundinfo=nullptr;
 	oldVolume=-1.0;
 	startTime=0;
+	duration=0;
 	loopstogo=0;
 	streamposition=0;
 	streamdatafinished=false;
@@ -1199,6 +1216,8 @@ void SoundChannel::execute()
 void SoundChannel::playStream()
 {
 	assert(!stream.isNull());
+	if (playDecodedSound())
+		return;
 	std::streambuf *sbuf = stream->createReader();
 	istream s(sbuf);
 	s.exceptions ( istream::failbit | istream::badbit );
@@ -1326,6 +1345,87 @@ void SoundChannel::playStream()
 	delete sbuf;
 }
 
+bool SoundChannel::playDecodedSound()
+{
+	if (forstreaming || duration <= 0 || duration > AUDIO_SOUNDCACHE_MAX_DURATION || !stream->hasTerminated() || stream->hasFailed())
+		return false;
+	_NR<DecodedSound> sound = getSystemState()->audioManager->getDecodedSound(stream,format);
+	if (sound.isNull())
+		return false;
+	bool waitForFlush=true;
+	uint64_t startposition = uint64_t(startTime*sound->sampleRate/1000)*sound->frameSize;
+	DecodedSoundAudioDecoder* decoder=new DecodedSoundAudioDecoder(sound,min(startposition,uint64_t(sound->samples.size())),getSystemState()->getEngineData());
+	RELEASE_WRITE(starting,false);
+	mutex.lock();
+	if (!ACQUIRE_READ(stopped))
+	{
+		audioDecoder=decoder;
+		audioStream=getSystemState()->audioManager->createStream(decoder,false,this,this->fromSoundTag ? this->fromSoundTag->getId() : -1,startTime,soundTransform ? soundTransform->volume : 1.0);
+	}
+	mutex.unlock();
+	// the mixer reads the samples directly from the decoded sound, so only volume and envelope changes have to be applied here
+	while(!ACQUIRE_READ(stopped) && !decoder->isFinished())
+	{
+		mutex.lock();
+		if(threadAborting)
+		{
+			mutex.unlock();
+			waitForFlush=false;
+			break;
+		}
+		if(audioStream)
+		{
+			if (audioStream->getIsDone())
+			{
+				// stream was stopped by mixer
+				getSystemState()->audioManager->removeStream(audioStream);
+				audioStream=nullptr;
+				RELEASE_WRITE(stopped,true);
+				decoder->skipAll();
+				waitForFlush=false;
+				mutex.unlock();
+				break;
+			}
+			//TODO: use soundTransform->pan
+			if(soundTransform && soundTransform->volume != oldVolume)
+			{
+				audioStream->setVolume(soundTransform->volume);
+				oldVolume = soundTransform->volume;
+			}
+			checkEnvelope();
+		}
+		else
+		{
+			// no audiostream available, consume data anyway
+			decoder->skipAll();
+		}
+		mutex.unlock();
+		compat_msleep(10);
+	}
+	if(waitForFlush)
+	{
+		//Put the decoder in the flushing state and wait for the complete consumption of contents
+		if(audioStream && !audioStream->getIsDone())
+		{
+			decoder->setFlushing();
+			decoder->waitFlushed();
+		}
+		if (!ACQUIRE_READ(stopping))
+			RELEASE_WRITE(finished,true);// only add soundcomplete event if sound was played until the end
+		else
+			RELEASE_WRITE(stopping,false);
+	}
+	mutex.lock();
+	audioDecoder=nullptr;
+	if (audioStream)
+		getSystemState()->audioManager->removeStream(audioStream);
+	audioStream=nullptr;
+	mutex.unlock();
+	decoder->skipAll();
+	delete decoder;
+	return true;
+}
+
 void SoundChannel::playStreamFromSamples()
 {
 	assert(stream.isNull());
@@ -36,6 +36,7 @@ namespace lightspark
 
 class AudioStream;
 class AudioDecoder;
+class DecodedSound;
 class NetStream;
 class StreamCache;
 class SoundChannel;
@@ -126,7 +127,11 @@ private:
 	void validateSoundTransform(_NR<SoundTransform>);
 	void playStream();
 	void playStreamFromSamples();
+	// plays the sound from the decoded sound cache, returns false if the sound is not in the cache
+	bool playDecodedSound();
 	number_t startTime;
+	// duration of the complete sound in milliseconds, 0 if unknown
+	number_t duration;
 	int32_t loopstogo;
 	uint32_t streamposition;
 	bool streamdatafinished;
@@ -145,6 +150,7 @@ public:
 	void markFinished(); // indicates that all sound data is available
 	void setSampleProducer(Sound* _sampleproducer) { sampleproducer = _sampleproducer; }
 	void setStartTime(number_t starttime) { startTime = starttime; }
+	void setDuration(number_t d) { duration = d; }
 	void setLoops(int32_t loops) {loopstogo=loops;}
 	static void sinit(Class_base* c);
 	void finalize() override;
@@ -187,6 +193,8 @@ public:
 	void refreshSurfaceState() override;
 	void requestInvalidation(InvalidateQueue* q, bool forceTextureRefresh=false) override;
 	IDrawable* invalidate(bool smoothing) override;
+	// converts the current frame to premultiplied ARGB, used by BitmapData.draw()
+	bool getFramePixels(std::vector<uint8_t>& pixels, uint32_t& w, uint32_t& h);
 	void checkRatio(uint32_t ratio, bool inskipping) override;
 	void afterLegacyInsert() override;
 	void afterLegacyDelete(bool inskipping) override;
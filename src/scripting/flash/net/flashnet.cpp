@@ -33,6 +33,7 @@
 #include "compat.h"
 #include "backends/audio.h"
 #include "backends/builtindecoder.h"
+#include "backends/config.h"
 #include "backends/rendering.h"
 #include "backends/streamcache.h"
 #include "scripting/argconv.h"
@@ -1326,7 +1327,7 @@ void NetStreamAppendBytesAction::sinit(Class_base* c)
 
 NetStream::NetStream(ASWorker* wrk, Class_base* c):EventDispatcher(wrk,c),tickStarted(false),paused(false),closed(true),
 	streamTime(0),frameRate(0),connection(),downloader(nullptr),videoDecoder(nullptr),
-	audioDecoder(nullptr),audioStream(nullptr),datagenerationfile(nullptr),datagenerationthreadstarted(false),client(NullRef),
+	audioDecoder(nullptr),audioStream(nullptr),datagenerationfile(nullptr),datagenerationthreadstarted(false),datagenerationbufferfull(false),client(NullRef),
 	oldVolume(-1.0),checkPolicyFile(false),rawAccessAllowed(false),framesdecoded(0),playbackBytesPerSecond(0),maxBytesPerSecond(0),datagenerationexpecttype(DATAGENERATION_HEADER),datagenerationbuffer(Class<ByteArray>::getInstanceS(wrk)),
 	streamDecoder(nullptr),
 	backBufferLength(0),backBufferTime(30),bufferLength(0),bufferTime(0.1),bufferTimeMax(0),
@@ -1353,7 +1354,26 @@ NetStream::~NetStream()
 	delete videoDecoder;
 	delete audioDecoder;
 	if (datagenerationfile)
-		delete datagenerationfile;
+	{
+		datagenerationfile->markFinished();
+		datagenerationfile->decRef();
+	}
+}
+
+void NetStream::resetDataGeneration()
+{
+	Locker l(countermutex);
+	// a decoder thread may still be waiting for data from the old buffer
+	if (datagenerationfile)
+	{
+		datagenerationfile->markFinished();
+		datagenerationfile->decRef();
+	}
+	datagenerationfile = new RingStreamCache(getSystemState());
+	datagenerationbuffer->setLength(0);
+	datagenerationthreadstarted = false;
+	datagenerationbufferfull = false;
+	datagenerationexpecttype = DATAGENERATION_HEADER;
 }
 
 void NetStream::sinit(Class_base* c)
@@ -1393,7 +1413,17 @@ void NetStream::sinit(Class_base* c)
 
 ASFUNCTIONBODY_GETTER(NetStream, backBufferLength)
 ASFUNCTIONBODY_GETTER_SETTER(NetStream, backBufferTime)
-ASFUNCTIONBODY_GETTER(NetStream, bufferLength)
+ASFUNCTIONBODY_ATOM(NetStream,_getter_bufferLength)
+{
+	NetStream* th=asAtomHandler::as<NetStream>(obj);
+	Locker l(th->countermutex);
+	number_t len = th->bufferLength;
+	// appended data that has not been decoded yet is also buffered,
+	// its duration is estimated from the bitrate of the decoded data
+	if (th->datagenerationfile && th->playbackBytesPerSecond > 0)
+		len += th->datagenerationfile->getUnreadLength()/th->playbackBytesPerSecond;
+	asAtomHandler::setNumber(ret,wrk,len);
+}
 ASFUNCTIONBODY_GETTER_SETTER(NetStream, bufferTime)
 ASFUNCTIONBODY_GETTER_SETTER(NetStream, bufferTimeMax)
 ASFUNCTIONBODY_GETTER_SETTER(NetStream, maxPauseBufferTime)
@@ -1430,6 +1460,7 @@ ASFUNCTIONBODY_ATOM(NetStream,_getInfo)
 		res->currentBytesPerSecond = curbps;
 		res->dataBytesPerSecond = curbps;
 		res->maxBytesPerSecond = th->maxBytesPerSecond;
+		res->dataBufferLength = th->datagenerationfile->getUnreadLength();
 		
 		//TODO compute video/audio BytesPerSecond correctly
 		res->videoBytesPerSecond = curbps*3/4;
@@ -1538,8 +1569,7 @@ ASFUNCTIONBODY_ATOM(NetStream,play)
 	// Parameter Null means data is generated by calls to "appendBytes"
 	if (asAtomHandler::is<Null>(args[0]))
 	{
-		th->datagenerationfile = wrk->getSystemState()->getEngineData()->createFileStreamCache(th->getSystemState());
-		th->datagenerationfile->openForWriting();
+		th->resetDataGeneration();
 		th->streamTime=0;
 		return;
 	}
@@ -1875,7 +1905,17 @@ ASFUNCTIONBODY_ATOM(NetStream,appendBytes)
 				if (th->maxBytesPerSecond < curbps)
 					th->maxBytesPerSecond = curbps;
 				
-				th->countermutex.unlock();
+				if (!th->datagenerationbufferfull && th->datagenerationfile->getUnreadLength() > Config::getConfig()->getAppendBytesHighWatermark())
+				{
+					th->datagenerationbufferfull = true;
+					th->countermutex.unlock();
+					LOG(LOG_INFO,"NetStream.appendBytes: high watermark reached:"<<th->datagenerationfile->getUnreadLength());
+					th->incRef();
+					// not NetStream.Buffer.Full, which is only sent when bufferTime is reached
+					getVm(th->getSystemState())->addEvent(_MR(th),_MR(Class<NetStatusEvent>::getInstanceS(wrk,"warning", "NetStream.AppendBytes.BufferFull")));
+				}
+				else
+					th->countermutex.unlock();
 			}
 			if (!th->datagenerationthreadstarted && th->datagenerationfile->getReceivedLength() >= 8192)
 			{
@@ -1898,13 +1938,7 @@ ASFUNCTIONBODY_ATOM(NetStream,appendBytesAction)
 	{
 		th->threadAbort();
 		LOG(LOG_INFO,"resetBegin");
-		if (th->datagenerationfile)
-			delete th->datagenerationfile;
-		th->datagenerationfile = wrk->getSystemState()->getEngineData()->createFileStreamCache(wrk->getSystemState());
-		th->datagenerationfile->openForWriting();
-		th->datagenerationbuffer->setLength(0);
-		th->datagenerationthreadstarted = false;
-		th->datagenerationexpecttype = DATAGENERATION_HEADER;
+		th->resetDataGeneration();
 	}
 	else if (val == "resetSeek")
 	{
@@ -2100,6 +2134,11 @@ void NetStream::execute()
 			}
 			else
 			{
+				countermutex.lock();
+				// the decoders have consumed appended data, for streams with and without video
+				if (datagenerationbufferfull && datagenerationfile && datagenerationfile->getUnreadLength() < Config::getConfig()->getAppendBytesLowWatermark())
+					datagenerationbufferfull = false;
+				countermutex.unlock();
 				if (streamDecoder->videoDecoder)
 				{
 					if (streamDecoder->videoDecoder->framesdecoded != framesdecoded)
@@ -2127,6 +2166,22 @@ void NetStream::execute()
 						}
 					}
 				}
+				else if (streamDecoder->audioDecoder && streamDecoder->audioDecoder->initialTime != UINT32_MAX && streamDecoder->audioDecoder->hasDecodedFrames())
+				{
+					// audio only streams have no frame rate, the duration of the decoded data
+					// is taken from the time stamps of the audio frames
+					AudioDecoder* decoder = streamDecoder->audioDecoder;
+					uint32_t backTime = decoder->getBackTime();
+					if (backTime > decoder->initialTime)
+					{
+						number_t decodedTime = (backTime-decoder->initialTime)/1000.0;
+						countermutex.lock();
+						this->playbackBytesPerSecond = s.tellg() / decodedTime;
+						number_t playedTime = audioStream ? audioStream->getPlayedTime()/1000.0 : 0;
+						this->bufferLength = decodedTime > playedTime ? decodedTime-playedTime : 0;
+						countermutex.unlock();
+					}
+				}
 			}
 			if(videoDecoder==nullptr && streamDecoder->videoDecoder)
 			{
@@ -2187,7 +2242,10 @@ void NetStream::execute()
 		if(audioDecoder)
 			audioDecoder->setFlushing();
 		if(videoDecoder)
+		{
+			videoDecoder->drain();
 			videoDecoder->setFlushing();
+		}
 		
 		if(audioDecoder)
 			audioDecoder->waitFlushed();
@@ -2345,6 +2403,12 @@ TextureChunk& NetStream::getTexture() const
 	return videoDecoder->getTexture();
 }
 
+bool NetStream::getVideoFramePixels(std::vector<uint8_t>& pixels, uint32_t& w, uint32_t& h) const
+{
+	assert(isReady());
+	return videoDecoder->getFramePixels(pixels,w,h);
+}
+
 uint32_t NetStream::getStreamTime()
 {
 	assert(isReady());
@@ -297,8 +297,16 @@ private:
 	AudioDecoder* audioDecoder;
 	AudioStream *audioStream;
 	// only used when in DataGenerationMode
-	StreamCache* datagenerationfile;
+	RingStreamCache* datagenerationfile;
 	bool datagenerationthreadstarted;
+	/*
+	 * set when the data appended but not yet decoded exceeds the high watermark of the configuration.
+	 * appendBytes never refuses data, the application is asked to stop appending by a
+	 * NetStream.AppendBytes.BufferFull warning, which is only dispatched again after the
+	 * decoder has reduced the data below the low watermark
+	 */
+	bool datagenerationbufferfull;
+	void resetDataGeneration();
 	Mutex mutex;
 	Mutex countermutex;
 	//IThreadJob interface for long jobs
@@ -398,6 +406,13 @@ public:
 		@return a TextureChunk ready to be blitted
 	*/
 	TextureChunk& getTexture() const;
+	/**
+	  	Get the pixels of the current video frame as premultiplied ARGB
+
+		@pre lock on the object should be acquired and object should be ready
+		@return false if no frame is available
+	*/
+	bool getVideoFramePixels(std::vector<uint8_t>& pixels, uint32_t& w, uint32_t& h) const;
 	/**
 	  	Get the stream time
 
@@ -130,7 +130,7 @@ ASFUNCTIONBODY_ATOM(ASFont,hasGlyphs)
 	asAtomHandler::setBool(ret,true);
 }
 TextField::TextField(ASWorker* wrk, Class_base* c, const TextData& textData, bool _selectable, bool readOnly, const char *varname, DefineEditTextTag *_tag)
-	: InteractiveObject(wrk,c), TextData(textData), TokenContainer(this), type(ET_READ_ONLY),
+	: InteractiveObject(wrk,c), TextData(textData), TokenContainer(this), htmlTextLayoutJob(nullptr), type(ET_READ_ONLY),
 	  antiAliasType(AA_NORMAL), gridFitType(GF_PIXEL),
 	  textInteractionMode(TI_NORMAL),autosizeposition(0),tagvarname(varname,true),tagvartarget(nullptr),tag(_tag),originalXPosition(0),originalWidth(textData.width),
 	  fillstyleBackgroundColor(0xff),lineStyleBorder(0xff),lineStyleCaret(0xff),linemutex(new Mutex()),inAVM1syncVar(false),
@@ -152,6 +152,7 @@ TextField::TextField(ASWorker* wrk, Class_base* c, const TextData& textData, boo
 
 TextField::~TextField()
 {
+	discardHtmlTextLayout();
 	delete linemutex;
 	linemutex=nullptr;
 }
@@ -260,6 +261,7 @@ ASFUNCTIONBODY_GETTER_SETTER(TextField, useRichTextClipboard) // stub
 
 void TextField::finalize()
 {
+	discardHtmlTextLayout();
 	InteractiveObject::finalize();
 	restrictChars.reset();
 	styleSheet.reset();
@@ -529,6 +531,7 @@ void TextField::setSizeAndPositionFromAutoSize(bool updatewidth)
 ASFUNCTIONBODY_ATOM(TextField,_getWidth)
 {
 	TextField* th=asAtomHandler::as<TextField>(obj);
+	th->finishHtmlTextLayout();
 	asAtomHandler::setUInt(ret,wrk,th->width);
 }
 
@@ -556,6 +559,7 @@ ASFUNCTIONBODY_ATOM(TextField,_setWidth)
 ASFUNCTIONBODY_ATOM(TextField,_getHeight)
 {
 	TextField* th=asAtomHandler::as<TextField>(obj);
+	th->finishHtmlTextLayout();
 	// it seems that Adobe returns the textHeight if in autoSize mode
 	if (th->autoSize != AS_NONE)
 		asAtomHandler::setUInt(ret,wrk,th->textHeight);
@@ -598,18 +602,21 @@ ASFUNCTIONBODY_ATOM(TextField,_setTextFieldX)
 ASFUNCTIONBODY_ATOM(TextField,_getTextWidth)
 {
 	TextField* th=asAtomHandler::as<TextField>(obj);
+	th->finishHtmlTextLayout();
 	asAtomHandler::setUInt(ret,wrk,th->textWidth);
 }
 
 ASFUNCTIONBODY_ATOM(TextField,_getTextHeight)
 {
 	TextField* th=asAtomHandler::as<TextField>(obj);
+	th->finishHtmlTextLayout();
 	asAtomHandler::setUInt(ret,wrk,th->textHeight);
 }
 
 ASFUNCTIONBODY_ATOM(TextField,_getHtmlText)
 {
 	TextField* th=asAtomHandler::as<TextField>(obj);
+	th->finishHtmlTextLayout();
 	ret = asAtomHandler::fromObject(abstract_s(wrk,th->toHtmlText()));
 }
 
@@ -625,6 +632,7 @@ ASFUNCTIONBODY_ATOM(TextField,_setHtmlText)
 ASFUNCTIONBODY_ATOM(TextField,_getText)
 {
 	TextField* th=asAtomHandler::as<TextField>(obj);
+	th->finishHtmlTextLayout();
 	Locker l(*th->linemutex);
 	ret = asAtomHandler::fromObject(abstract_s(wrk,th->getText()));
 }
@@ -640,13 +648,21 @@ ASFUNCTIONBODY_ATOM(TextField,_setText)
 ASFUNCTIONBODY_ATOM(TextField, appendText)
 {
 	TextField* th=asAtomHandler::as<TextField>(obj);
+	th->finishHtmlTextLayout();
 	assert_and_throw(argslen==1);
-	th->updateText(th->getText() + asAtomHandler::toString(args[0],wrk));
+	tiny_string s = asAtomHandler::toString(args[0],wrk);
+	if (s.empty())
+		return;
+	th->linemutex->lock();
+	th->replaceTextRange(UINT32_MAX,UINT32_MAX,s);
+	th->linemutex->unlock();
+	th->textUpdated();
 }
 
 ASFUNCTIONBODY_ATOM(TextField,_getTextFormat)
 {
 	TextField* th=asAtomHandler::as<TextField>(obj);
+	th->finishHtmlTextLayout();
 	TextFormat *format=Class<TextFormat>::getInstanceS(wrk);
 
 	format->color= asAtomHandler::fromUInt(th->textColor.toUInt());
@@ -661,6 +677,7 @@ ASFUNCTIONBODY_ATOM(TextField,_getTextFormat)
 ASFUNCTIONBODY_ATOM(TextField,_setTextFormat)
 {
 	TextField* th=asAtomHandler::as<TextField>(obj);
+	th->finishHtmlTextLayout();
 	_NR<TextFormat> tf;
 	int beginIndex;
 	int endIndex;
@@ -828,6 +845,7 @@ ASFUNCTIONBODY_ATOM(TextField,_getCharIndexAtPoint)
 ASFUNCTIONBODY_ATOM(TextField,_getLineIndexAtPoint)
 {
 	TextField* th=asAtomHandler::as<TextField>(obj);
+	th->finishHtmlTextLayout();
 	number_t x;
 	number_t y;
 	ARG_CHECK(ARG_UNPACK(x) (y));
@@ -853,6 +871,7 @@ ASFUNCTIONBODY_ATOM(TextField,_getLineIndexAtPoint)
 ASFUNCTIONBODY_ATOM(TextField,_getLineIndexOfChar)
 {
 	TextField* th=asAtomHandler::as<TextField>(obj);
+	th->finishHtmlTextLayout();
 	int32_t charIndex;
 	ARG_CHECK(ARG_UNPACK(charIndex));
 
@@ -883,6 +902,7 @@ ASFUNCTIONBODY_ATOM(TextField,_getLineIndexOfChar)
 ASFUNCTIONBODY_ATOM(TextField,_getLineLength)
 {
 	TextField* th=asAtomHandler::as<TextField>(obj);
+	th->finishHtmlTextLayout();
 	int32_t lineIndex;
 	ARG_CHECK(ARG_UNPACK(lineIndex));
 
@@ -899,29 +919,31 @@ ASFUNCTIONBODY_ATOM(TextField,_getLineLength)
 ASFUNCTIONBODY_ATOM(TextField,_getLineMetrics)
 {
 	TextField* th=asAtomHandler::as<TextField>(obj);
+	th->finishHtmlTextLayout();
 	int32_t  lineIndex;
 	ARG_CHECK(ARG_UNPACK(lineIndex));
 
 	Locker l(*th->linemutex);
-	std::vector<LineData> lines = CairoPangoRenderer::getLineData(*th);
-	if ((lineIndex < 0) || (lineIndex >= (int32_t)lines.size()))
+	if ((lineIndex < 0) || (lineIndex >= (int32_t)th->textlines.size()))
 	{
 		createError<RangeError>(wrk,kParamRangeError);
 		return;
 	}
+	LineData line = CairoPangoRenderer::getLineData(*th,lineIndex);
 
 	ret = asAtomHandler::fromObject(Class<TextLineMetrics>::getInstanceS(wrk,
-		lines[lineIndex].indent,
-		lines[lineIndex].extents.Xmax - lines[lineIndex].extents.Xmin,
-		lines[lineIndex].extents.Ymax - lines[lineIndex].extents.Ymin,
-		lines[lineIndex].ascent,
-		lines[lineIndex].descent,
-		lines[lineIndex].leading));
+		line.indent,
+		line.extents.Xmax - line.extents.Xmin,
+		line.extents.Ymax - line.extents.Ymin,
+		line.ascent,
+		line.descent,
+		line.leading));
 }
 
 ASFUNCTIONBODY_ATOM(TextField,_getLineOffset)
 {
 	TextField* th=asAtomHandler::as<TextField>(obj);
+	th->finishHtmlTextLayout();
 	int32_t  lineIndex;
 	ARG_CHECK(ARG_UNPACK(lineIndex));
 
@@ -931,18 +953,13 @@ ASFUNCTIONBODY_ATOM(TextField,_getLineOffset)
 		createError<RangeError>(wrk,kParamRangeError);
 		return;
 	}
-	uint32_t firstCharOffset=0;
-	for (int32_t i=0; i < lineIndex; ++i)
-	{
-		firstCharOffset+=th->textlines[i].text.numChars()+1; // add one for the \n
-	}
-
-	asAtomHandler::setInt(ret,wrk,firstCharOffset);
+	asAtomHandler::setInt(ret,wrk,th->getLineOffset(lineIndex));
 }
 
 ASFUNCTIONBODY_ATOM(TextField,_getLineText)
 {
 	TextField* th=asAtomHandler::as<TextField>(obj);
+	th->finishHtmlTextLayout();
 	int32_t  lineIndex;
 	ARG_CHECK(ARG_UNPACK(lineIndex));
 
@@ -1010,6 +1027,7 @@ ASFUNCTIONBODY_ATOM(TextField,_setGridFitType)
 ASFUNCTIONBODY_ATOM(TextField,_getLength)
 {
 	TextField* th=asAtomHandler::as<TextField>(obj);
+	th->finishHtmlTextLayout();
 	Locker l(*th->linemutex);
 	asAtomHandler::setUInt(ret,wrk,th->getText().numChars());
 }
@@ -1017,6 +1035,7 @@ ASFUNCTIONBODY_ATOM(TextField,_getLength)
 ASFUNCTIONBODY_ATOM(TextField,_getNumLines)
 {
 	TextField* th=asAtomHandler::as<TextField>(obj);
+	th->finishHtmlTextLayout();
 	Locker l(*th->linemutex);
 	asAtomHandler::setInt(ret,wrk,(int32_t)th->getLineCount());
 }
@@ -1036,6 +1055,7 @@ ASFUNCTIONBODY_ATOM(TextField,_getMaxScrollV)
 ASFUNCTIONBODY_ATOM(TextField,_getBottomScrollV)
 {
 	TextField* th=asAtomHandler::as<TextField>(obj);
+	th->finishHtmlTextLayout();
 	
 	Locker l(*th->linemutex);
 	int32_t Ymin = 0;
@@ -1125,31 +1145,22 @@ ASFUNCTIONBODY_ATOM(TextField,_replaceText)
 
 void TextField::replaceText(unsigned int begin, unsigned int end, const tiny_string& newText)
 {
+	finishHtmlTextLayout();
 	if (!styleSheet.isNull())
 	{
 		createError<ASError>(getInstanceWorker(),0,"Can not replace text on text field with a style sheet");
 		return;
 	}
 
-	tiny_string text = getText();
-	if (begin >= text.numChars())
-	{
-		text = text + newText;
-	}
-	else if (begin > end)
+	linemutex->lock();
+	uint32_t numchars = getLineCount() ? getLineOffset(getLineCount())-1 : 0;
+	if (begin < numchars && begin > end)
 	{
+		linemutex->unlock();
 		return;
 	}
-	else if (end >= text.numChars())
-	{
-		text = text.substr(0, begin) + newText;
-	}
-	else
-	{
-		text = text.substr(0, begin) + newText + text.substr(end, text.end());
-	}
-	linemutex->lock();
-	setText(text.raw_buf());
+	// only the lines touched by the range are split and measured again
+	replaceTextRange(begin,end,newText);
 	linemutex->unlock();
 	textUpdated();
 }
@@ -1167,6 +1178,7 @@ void TextField::getTextBounds(const tiny_string& txt,number_t &xmin,number_t &xm
 ASFUNCTIONBODY_ATOM(TextField,_getCharBoundaries)
 {
 	TextField* th=asAtomHandler::as<TextField>(obj);
+	th->finishHtmlTextLayout();
 
 	int32_t charIndex;
 	ARG_CHECK(ARG_UNPACK(charIndex));
@@ -1235,6 +1247,7 @@ void TextField::validateScrollV(int32_t oldValue)
 
 int32_t TextField::getMaxScrollH()
 {
+	finishHtmlTextLayout();
 	if (wordWrap || (textWidth <= width))
 		return 0;
 	else
@@ -1243,6 +1256,7 @@ int32_t TextField::getMaxScrollH()
 
 int32_t TextField::getMaxScrollV()
 {
+	finishHtmlTextLayout();
 	Locker l(*linemutex);
 	if (getLineCount() <= 1)
 		return 1;
@@ -1279,11 +1293,26 @@ void TextField::updateSizes()
 	number_t w=0;
 	number_t h=0;
 	linemutex->lock();
+	bool remeasure = measuredAttributesChanged();
 	auto it = textlines.begin();
 	while (it != textlines.end())
 	{
+		if (!remeasure && (*it).textwidth != UINT32_MAX)
+		{
+			// line was not modified since it was measured
+			w = (*it).textwidth;
+			h = (*it).height;
+			if (w>tw)
+				tw = w;
+			it++;
+			th+=h;
+			if (it != textlines.end())
+				th+=this->leading;
+			continue;
+		}
 		getTextSizes((*it).text,w,h);
 		(*it).textwidth=w;
+		(*it).height=h;
 		bool listchanged=false;
 		if (wordWrap && width > TEXTFIELD_PADDING*2 && uint32_t(w) > width-TEXTFIELD_PADDING*2)
 		{
@@ -1298,6 +1327,7 @@ void TextField::updateSizes()
 					if(w>tw)
 						tw = w;
 					(*it).textwidth=w;
+					(*it).height=h;
 					(*it).text = text.substr(0,c);
 					textline t;
 					t.autosizeposition=0;
@@ -1370,6 +1400,20 @@ tiny_string TextField::toHtmlText()
 
 void TextField::setHtmlText(const tiny_string& html)
 {
+	// a previous assignment that is not applied yet is replaced by this one
+	discardHtmlTextLayout();
+	if (this->isConstructed() && html.numBytes() >= TEXTFIELD_HTML_ASYNC_MINSIZE)
+	{
+		// the job only needs the attributes, so the lines are not copied
+		std::vector<textline> lines;
+		linemutex->lock();
+		lines.swap(textlines);
+		htmlTextLayoutJob = new HtmlTextLayoutJob(*this,html,condenseWhite);
+		textlines.swap(lines);
+		linemutex->unlock();
+		getSystemState()->addJob(htmlTextLayoutJob);
+		return;
+	}
 	linemutex->lock();
 	vector<tiny_string> oldtext;
 	if (this->isConstructed())
@@ -1405,6 +1449,108 @@ void TextField::setHtmlText(const tiny_string& html)
 	}
 }
 
+void TextField::HtmlTextLayoutJob::execute()
+{
+	HtmlTextParser parser;
+	bool parsed;
+	if (condenseWhite)
+		parsed = parser.parseTextAndFormating(compactHTMLWhiteSpace(html), &result);
+	else
+		parsed = parser.parseTextAndFormating(html, &result);
+	// result has no lines if the html is invalid, so done stays false and the TextField keeps its content,
+	// like a synchronous assignment of invalid html does
+	if (!parsed || threadAborting)
+		return;
+	// measure the lines here, so updateSizes() only has to handle lines that need word wrapping
+	result.measureLines(result.width > TEXTFIELD_PADDING*2 ? result.width-TEXTFIELD_PADDING*2 : UINT32_MAX);
+	done=true;
+}
+
+void TextField::HtmlTextLayoutJob::jobFence()
+{
+	fenceMutex.lock();
+	if (discarded)
+	{
+		fenceMutex.unlock();
+		delete this;
+		return;
+	}
+	finished.signal();
+	fenceMutex.unlock();
+}
+
+void TextField::HtmlTextLayoutJob::discard()
+{
+	threadAborting=true;
+	fenceMutex.lock();
+	if (finished.try_wait())
+	{
+		fenceMutex.unlock();
+		delete this;
+		return;
+	}
+	discarded=true;
+	fenceMutex.unlock();
+}
+
+void TextField::finishHtmlTextLayout(bool wait)
+{
+	if (!htmlTextLayoutJob)
+		return;
+	if (wait)
+		htmlTextLayoutJob->finished.wait();
+	else if (!htmlTextLayoutJob->finished.try_wait())
+		return;
+	HtmlTextLayoutJob* job = htmlTextLayoutJob;
+	htmlTextLayoutJob=nullptr;
+	if (!job->done)
+	{
+		delete job;
+		return;
+	}
+	linemutex->lock();
+	vector<tiny_string> oldtext;
+	oldtext.reserve(textlines.size());
+	for (uint32_t i =0; i < textlines.size(); i++)
+		oldtext.push_back(textlines[i].text);
+	takeLines(job->result);
+	// the attributes changed by the parser are only taken if they were not modified in the meantime
+	if (font == job->initialData.font && fontID == job->initialData.fontID)
+	{
+		font = job->result.font;
+		fontID = job->result.fontID;
+	}
+	if (fontSize == job->initialData.fontSize)
+		fontSize = job->result.fontSize;
+	if (textColor.toUInt() == job->initialData.textColor.toUInt())
+		textColor = job->result.textColor;
+	if (align == job->initialData.align)
+		align = job->result.align;
+	if (getLineCount()>1 && this->textlines.back().text.empty())
+	{
+		//more than one line and last line is empty => remove last line
+		this->textlines.pop_back();
+	}
+	linemutex->unlock();
+	delete job;
+
+	if (!this->TextIsEqual(oldtext))
+	{
+		hasChanged=true;
+		setNeedsTextureRecalculation();
+		textUpdated();
+	}
+}
+
+void TextField::discardHtmlTextLayout()
+{
+	if (!htmlTextLayoutJob)
+		return;
+	// the VM thread doesn't wait for the job, it is deleted when it ends
+	htmlTextLayoutJob->discard();
+	htmlTextLayoutJob=nullptr;
+}
+
 std::string TextField::toDebugString() const
 {
 	std::string res = InteractiveObject::toDebugString();
@@ -1441,6 +1587,7 @@ tiny_string TextField::compactHTMLWhiteSpace(const tiny_string& html)
 
 void TextField::updateText(const tiny_string& new_text)
 {
+	finishHtmlTextLayout();
 	if (getText() == new_text)
 		return;
 	linemutex->lock();
@@ -1572,6 +1719,8 @@ void TextField::textInputChanged(const tiny_string &newtext)
 {
 	if (this->type != ET_EDITABLE)
 		return;
+	// the input is inserted into the text of a pending htmlText assignment
+	finishHtmlTextLayout();
 	linemutex->lock();
 	tiny_string tmptext = getText();
 	linemutex->unlock();
@@ -1606,6 +1755,12 @@ void TextField::tickFence()
 {
 }
 
+void TextField::enterFrame(bool implicit)
+{
+	// show the result of a large htmlText assignment as soon as it is available
+	finishHtmlTextLayout(false);
+}
+
 uint32_t TextField::getTagID() const
 {
 	return tag ? tag->getId() : UINT32_MAX;
@@ -1653,6 +1808,8 @@ void TextField::defaultEventBehavior(_R<Event> e)
 		return;
 	if (e->type == "keyDown")
 	{
+		// the keys edit the text of a pending htmlText assignment
+		finishHtmlTextLayout();
 		KeyboardEvent* ev = e->as<KeyboardEvent>();
 		uint32_t modifiers = ev->getModifiers() & (KMOD_LSHIFT | KMOD_RSHIFT |KMOD_LCTRL | KMOD_RCTRL | KMOD_LALT | KMOD_RALT);
 		if (modifiers == KMOD_NONE)
@@ -1879,12 +2036,12 @@ IDrawable* TextField::invalidate(bool smoothing)
 				smoothing ? SMOOTH_MODE::SMOOTH_SUBPIXEL : SMOOTH_MODE::SMOOTH_NONE,this->getBlendMode(),caretIndex);
 }
 
-void TextField::HtmlTextParser::parseTextAndFormating(const tiny_string& html,
+bool TextField::HtmlTextParser::parseTextAndFormating(const tiny_string& html,
 						      TextData *dest)
 {
 	textdata = dest;
 	if (!textdata)
-		return;
+		return false;
 
 	tiny_string rooted = tiny_string("<root>") + html + tiny_string("</root>");
 	uint32_t pos=0;
@@ -1898,6 +2055,7 @@ void TextField::HtmlTextParser::parseTextAndFormating(const tiny_string& html,
 		textdata->setText("");
 		doc.traverse(*this);
 		formatStack.erase(formatStack.begin(), formatStack.end());
+		return true;
 	}
 	else
 	{
@@ -1905,7 +2063,7 @@ void TextField::HtmlTextParser::parseTextAndFormating(const tiny_string& html,
 		LOG(LOG_ERROR, "Reason: " << result.description());
 		LOG(LOG_ERROR, "Offset: " << result.offset);
 		LOG(LOG_ERROR, "Text at offset: " << (rooted.raw_buf() + result.offset));
-		return;
+		return false;
 	}
 }
 
@@ -28,6 +28,8 @@
 
 // according to TextLineMetrics specs, there are always 2 pixels added to each side of a textfield
 #define TEXTFIELD_PADDING 2
+// htmlText assignments of at least this size (in bytes) are parsed in a background job
+#define TEXTFIELD_HTML_ASYNC_MINSIZE (64*1024)
 
 namespace lightspark
 {
@@ -88,9 +90,34 @@ private:
 		bool for_each(pugi::xml_node& node);
 	public:
 		HtmlTextParser() : textdata(NULL), formatStack(), prevDepth(-1) {}
-		//Stores the text and formating into a TextData object
-		void parseTextAndFormating(const tiny_string& html, TextData *dest);
+		//Stores the text and formating into a TextData object, returns false if html can't be parsed
+		bool parseTextAndFormating(const tiny_string& html, TextData *dest);
 	};
+	/*
+	 * Parses a large htmlText assignment and measures the resulting lines in a background thread.
+	 * The TextField keeps displaying its previous content until the result is applied.
+	 */
+	class HtmlTextLayoutJob : public IThreadJob
+	{
+	public:
+		// the attributes of the TextField when the job was started
+		TextData initialData;
+		TextData result;
+		tiny_string html;
+		bool condenseWhite;
+		bool done;
+		Semaphore finished;
+		// a discarded job is not waited for, it deletes itself in jobFence()
+		Mutex fenceMutex;
+		bool discarded;
+		HtmlTextLayoutJob(const TextData& data, const tiny_string& _html, bool _condenseWhite)
+			: initialData(data),result(data),html(_html),condenseWhite(_condenseWhite),done(false),finished(0),discarded(false) {}
+		void execute() override;
+		void jobFence() override;
+		// stops the job, it is deleted now if it has already finished and by jobFence() otherwise
+		void discard();
+	};
+	HtmlTextLayoutJob* htmlTextLayoutJob;
 	tokensVector tokens;
 public:
 	enum EDIT_TYPE { ET_READ_ONLY, ET_EDITABLE };
@@ -107,7 +134,14 @@ private:
 	//Computes and changes (text)width and (text)height using Pango
 	void updateSizes();
 	tiny_string toHtmlText();
-	tiny_string compactHTMLWhiteSpace(const tiny_string&);
+	static tiny_string compactHTMLWhiteSpace(const tiny_string&);
+	/*
+	 * applies the result of a pending htmlText assignment,
+	 * if wait is false it is only applied if the background job has already finished
+	 */
+	void finishHtmlTextLayout(bool wait=true);
+	// drops the result of a pending htmlText assignment
+	void discardHtmlTextLayout();
 	void validateThickness(number_t oldValue);
 	void validateSharpness(number_t oldValue);
 	void validateScrollH(int32_t oldValue);
@@ -158,6 +192,7 @@ public:
 	void textInputChanged(const tiny_string& newtext) override;
 	void tick() override;
 	void tickFence() override;
+	void enterFrame(bool implicit) override;
 	uint32_t getTagID() const override;
 	float getScaleFactor() const override { return this->scaling; }
 	bool allowAsMask() const override { return false; }
@@ -44,12 +44,16 @@
 #include "logger.h"
 #include "parsing/streams.h"
 #include "thread_pool.h"
+#include "raster_scheduler.h"
+#include "backends/shapecache.h"
+#include "backends/textcache.h"
 #include "asobject.h"
 #include "scripting/class.h"
 #include "backends/audio.h"
 #include "backends/config.h"
 #include "backends/rendering.h"
 #include "backends/cachedsurface.h"
+#include "backends/softwarerendering.h"
 #include "backends/image.h"
 #include "backends/extscriptobject.h"
 #include "backends/input.h"
@@ -64,6 +68,7 @@
 #endif
 
 #include "compat.h"
+#include <SDL.h>
 
 #ifdef ENABLE_LIBAVCODEC
 extern "C" {
@@ -74,6 +79,9 @@ extern "C" {
 using namespace std;
 using namespace lightspark;
 
+// Maximum number of dictionary tags that are built in parallel while a SWF file is parsed
+#define PARSE_MAX_PARALLEL_TAGS 8
+
 DEFINE_AND_INITIALIZE_TLS(tls_system);
 SystemState* lightspark::getSys()
 {
@@ -93,6 +101,10 @@ ParseThread* lightspark::getParseThread()
 	assert(pt);
 	return pt;
 }
+void lightspark::setTLSParseThread(ParseThread* pt)
+{
+	tls_set(parse_thread_tls,pt);
+}
 
 DEFINE_AND_INITIALIZE_TLS(tls_worker);
 void lightspark::setTLSWorker(ASWorker* worker)
@@ -205,8 +217,8 @@ SystemState::SystemState(uint32_t fileSize, FLASH_MODE mode):
 	vmVersion(VMNONE),childPid(0),
 	parameters(NullRef),
 	invalidateQueueHead(NullRef),invalidateQueueTail(NullRef),lastUsedStringId(0),lastUsedNamespaceId(0x7fffffff),framePhase(FramePhase::IDLE),
-	showProfilingData(false),allowFullscreen(false),flashMode(mode),swffilesize(fileSize),instanceCounter(0),avm1global(nullptr),
-	currentVm(nullptr),builtinClasses(nullptr),useInterpreter(true),useFastInterpreter(false),useJit(false),ignoreUnhandledExceptions(false),exitOnError(ERROR_NONE),
+	showProfilingData(false),showRedrawRegions(false),partialRedraw(true),gpuBitmapDraw(false),batchRendering(true),screenshotFrame(0),allowFullscreen(false),flashMode(mode),swffilesize(fileSize),instanceCounter(0),avm1global(nullptr),
+	currentVm(nullptr),builtinClasses(nullptr),useInterpreter(true),useFastInterpreter(false),useJit(false),ignoreUnhandledExceptions(false),exitOnError(ERROR_NONE),softwareRenderer(nullptr),
 	systemDomain(nullptr),worker(nullptr),workerDomain(nullptr),singleworker(true),
 	downloadManager(nullptr),extScriptObject(nullptr),scaleMode(SHOW_ALL),unaccountedMemory(nullptr),tagsMemory(nullptr),stringMemory(nullptr),textTokenMemory(nullptr),shapeTokenMemory(nullptr),morphShapeTokenMemory(nullptr),bitmapTokenMemory(nullptr),spriteTokenMemory(nullptr),
 	static_SoundMixer_bufferTime(0),static_Multitouch_inputMode("gesture"),isinitialized(false)
@@ -312,6 +324,9 @@ SystemState::SystemState(uint32_t fileSize, FLASH_MODE mode):
 	static_SoundMixer_soundTransform->setRefConstant();
 	threadPool=new ThreadPool(this);
 	downloadThreadPool=new ThreadPool(this);
+	rasterScheduler=new RasterScheduler(this);
+	shapeRasterCache=new ShapeRasterCache();
+	textRasterCache=new TextRasterCache();
 
 	timerThread=new TimerThread(this);
 	frameTimerThread=new TimerThread(this);
@@ -521,6 +536,8 @@ void SystemState::stopEngines()
 		downloadThreadPool->forceStop();
 	if(threadPool)
 		threadPool->forceStop();
+	if(rasterScheduler)
+		rasterScheduler->forceStop();
 	timerThread->wait();
 	frameTimerThread->wait();
 	/* first shutdown the vm, because it can use all the others */
@@ -538,6 +555,12 @@ void SystemState::stopEngines()
 	threadPool=nullptr;
 	delete downloadThreadPool;
 	downloadThreadPool=nullptr;
+	delete rasterScheduler;
+	rasterScheduler=nullptr;
+	delete shapeRasterCache;
+	shapeRasterCache=nullptr;
+	delete textRasterCache;
+	textRasterCache=nullptr;
 	//Now stop the managers
 	delete audioManager;
 	audioManager=nullptr;
@@ -708,6 +731,8 @@ void SystemState::destroy()
 		downloadThreadPool->forceStop();
 	if(threadPool)
 		threadPool->forceStop();
+	if(rasterScheduler)
+		rasterScheduler->forceStop();
 	stopEngines();
 
 	delete extScriptObject;
@@ -741,6 +766,8 @@ void SystemState::destroy()
 	delete frameTimerThread;
 	frameTimerThread= nullptr;
 	
+	delete softwareRenderer;
+	softwareRenderer=nullptr;
 	delete renderThread;
 	renderThread=nullptr;
 	delete inputThread;
@@ -896,6 +923,14 @@ void SystemState::startRenderTicks()
 	addTick(1000/renderRate,renderThread);
 }
 
+uint32_t SystemState::getFrameTickInterval(float rate) const
+{
+	// batch rendering runs the frames as fast as they can be computed
+	if (softwareRenderer)
+		return 1;
+	return 1000/rate;
+}
+
 void SystemState::EngineCreator::execute()
 {
 	getSys()->createEngines();
@@ -912,7 +947,7 @@ void SystemState::EngineCreator::threadAbort()
  */
 void SystemState::delayedCreation(SystemState* sys)
 {
-	sys->audioManager=new AudioManager(sys->engineData);
+	sys->audioManager=new AudioManager(sys->engineData,sys->audioWAVOutput);
 	sys->localstorageallowed =sys->getEngineData()->getLocalStorageAllowedMarker();
 	int32_t reqWidth=((sys->mainClip->applicationDomain->getFrameSize().Xmax-sys->mainClip->applicationDomain->getFrameSize().Xmin)/20)*sys->engineData->startscalefactor;
 	int32_t reqHeight=((sys->mainClip->applicationDomain->getFrameSize().Ymax-sys->mainClip->applicationDomain->getFrameSize().Ymin)/20)*sys->engineData->startscalefactor;
@@ -1218,7 +1253,7 @@ void SystemState::setRenderRate(float rate)
 		if (this->mainClip && this->mainClip->isConstructed())
 		{
 			removeJob(this);
-			addTick(1000/renderRate,this);
+			addTick(getFrameTickInterval(renderRate),this);
 		}
 	}
 
@@ -1312,6 +1347,7 @@ void SystemState::flushInvalidationQueue()
 		stageCoordinateMapping(renderThread->windowWidth, renderThread->windowHeight, offx, offy, scalex, scaley);
 		initialMatrix.scale(scalex,scaley);
 	}
+	std::vector<AsyncDrawJob*> drawjobs;
 	while(!cur.isNull())
 	{
 		if((cur->isOnStage() || cur->isMask()) && cur->hasChanged)
@@ -1351,7 +1387,7 @@ void SystemState::flushInvalidationQueue()
 						}
 						drawJobsNew.insert(j);
 					}
-					addJob(j);
+					drawjobs.push_back(j);
 					drawjobLock.unlock();
 				}
 				else
@@ -1365,6 +1401,8 @@ void SystemState::flushInvalidationQueue()
 		cur->invalidateQueueNext=NullRef;
 		cur=next;
 	}
+	if (!drawjobs.empty())
+		rasterScheduler->addDrawJobs(drawjobs);
 	influshing=false;
 	renderThread->signalSurfaceRefresh();
 	invalidateQueueHead=NullRef;
@@ -1725,6 +1763,9 @@ void ParseThread::parseSWF(UI8 ver)
 		}
 
 		TagFactory factory(f);
+		int cpuCount=SDL_GetCPUCount();
+		if(cpuCount>1)
+			factory.enableParallelParsing(imin(cpuCount,PARSE_MAX_PARALLEL_TAGS));
 		Tag* tag=factory.readTag(root);
 
 		if (root->applicationDomain->version >= 8)
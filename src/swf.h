@@ -58,6 +58,7 @@ class ParseThread;
 class PluginManager;
 class RenderThread;
 class SecurityManager;
+class SoftwareRenderer;
 class LocaleManager;
 class CurrencyManager;
 class DownloadManager;
@@ -74,6 +75,9 @@ class Undefined;
 class Boolean;
 class Class_base;
 class ThreadPool;
+class RasterScheduler;
+class ShapeRasterCache;
+class TextRasterCache;
 class TimerThread;
 class LocalConnectionEvent;
 class ABCVm;
@@ -128,6 +132,12 @@ private:
 	friend class SystemState::EngineCreator;
 	ThreadPool* threadPool;
 	ThreadPool* downloadThreadPool;
+	// rasterizes the AsyncDrawJobs
+	RasterScheduler* rasterScheduler;
+	// rasterized shapes shared by all instances of a DefineShapeTag
+	ShapeRasterCache* shapeRasterCache;
+	// rasterized lines of TextFields using device fonts
+	TextRasterCache* textRasterCache;
 	TimerThread* timerThread;
 	TimerThread* frameTimerThread;
 	Semaphore terminated;
@@ -252,6 +262,18 @@ public:
 
 	//Interative analysis flags
 	bool showProfilingData;
+	bool showRedrawRegions;
+	// only redraw the parts of the stage that changed since the last frame
+	bool partialRedraw;
+	// use the render thread for BitmapData.draw() instead of rasterizing on the CPU
+	bool gpuBitmapDraw;
+	// draw consecutive simple DisplayObjects in as few draw calls as possible
+	bool batchRendering;
+	// if set, the stage is written to screenshotFile after this many frames and the player shuts down
+	uint32_t screenshotFrame;
+	tiny_string screenshotFile;
+	// if set, the sound is mixed into this WAV file instead of being played
+	tiny_string audioWAVOutput;
 	bool standalone;
 	bool allowFullscreen;
 	bool allowFullscreenInteractive;
@@ -373,6 +395,9 @@ public:
 	bool useJit;
 	bool ignoreUnhandledExceptions;
 	ERROR_TYPE exitOnError;
+	// renders every frame on the CPU when running headless, frames are not throttled to the frame rate
+	SoftwareRenderer* softwareRenderer;
+	uint32_t getFrameTickInterval(float rate) const;
 
 	//Parameters/FlashVars
 	void parseParametersFromFile(const char* f) DLL_PUBLIC;
@@ -390,6 +415,9 @@ public:
 	// downloaders may be executed from inside a job from the main threadpool,
 	// so we use a second threadpool for them, to avoid deadlocks
 	void addDownloadJob(IThreadJob* j) DLL_PUBLIC;
+	RasterScheduler* getRasterScheduler() const { return rasterScheduler; }
+	ShapeRasterCache* getShapeRasterCache() const { return shapeRasterCache; }
+	TextRasterCache* getTextRasterCache() const { return textRasterCache; }
 	void addTick(uint32_t tickTime, ITickJob* job);
 	void addFrameTick(uint32_t tickTime, ITickJob* job);
 	void addWait(uint32_t waitTime, ITickJob* job);
@@ -571,6 +599,8 @@ SystemState* getSys() DLL_PUBLIC;
 void setTLSSys(SystemState* sys) DLL_PUBLIC;
 
 ParseThread* getParseThread();
+/* Set thread-specific ParseThread to be returned by getParseThread() */
+void setTLSParseThread(ParseThread* pt);
 /* Returns the thread-specific SystemState */
 ASWorker* getWorker() DLL_PUBLIC;
 void setTLSWorker(ASWorker* worker) DLL_PUBLIC;
@@ -108,10 +108,10 @@ int ThreadPool::job_worker(void *d)
 		chronometer.checkpoint();
 		try
 		{
-			// it's possible that a job was added and will be executed while forcestop() has been called
-			if(data->pool->stopFlag)
-				return 0;
-			myJob->execute();
+			// it's possible that a job was added and will be executed while forcestop() has been called,
+			// it is not executed then, but still fenced below, as its owner may be waiting for it
+			if(!data->pool->stopFlag)
+				myJob->execute();
 		}
 		catch(JobTerminationException& ex)
 		{
@@ -155,9 +155,11 @@ private:
 	uint32_t bufferHead;
 	uint32_t bufferTail;
 	uint32_t size;
+	// number of entries that may be used, the other free buffers are held back
+	uint32_t capacity;
 	ACQUIRE_RELEASE_FLAG(empty);
 public:
-	BlockingCircularQueue(uint32_t _size):freeBuffers(_size),usedBuffers(0),bufferHead(0),bufferTail(0),size(_size),empty(true)
+	BlockingCircularQueue(uint32_t _size):freeBuffers(_size),usedBuffers(0),bufferHead(0),bufferTail(0),size(_size),capacity(_size),empty(true)
 	{
 		aligned_malloc((void**)&queue,16,size*sizeof(T));
 		for(uint32_t i=0;i<size;i++)
@@ -180,6 +182,12 @@ public:
 		assert(!this->empty);
 		return queue[bufferHead];
 	}
+	// the last committed entry, must only be called by the producer
+	const T& back() const
+	{
+		assert(!this->empty);
+		return queue[(bufferTail+size-1)%size];
+	}
 	bool nonBlockingPopFront()
 	{
 		//We don't want to block if empty
@@ -204,6 +212,24 @@ public:
 		empty=false;
 		usedBuffers.signal();
 	}
+	/*
+		Limits the number of usable entries to n (at most the allocated size).
+		Must only be called by the producer, blocks until enough entries are free
+	*/
+	void setCapacity(uint32_t n)
+	{
+		n=n<1 ? 1 : (n>size ? size : n);
+		while(capacity>n)
+		{
+			freeBuffers.wait();
+			capacity--;
+		}
+		while(capacity<n)
+		{
+			freeBuffers.signal();
+			capacity++;
+		}
+	}
 	template<class GENERATOR>
 	void regen(const GENERATOR& g)
 	{
@@ -0,0 +1,507 @@
+/**************************************************************************
+    Lightspark, a free flash player implementation
+
+    Copyright (C) 2024  Ludger Krämer <dbluelle@onlinehome.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+/*
+ * Checks the box blur kernels used by BitmapFilter::applyBlur against a
+ * straightforward implementation and measures them against the stack blur
+ * applyBlur used before.
+ *
+ * Usage:
+ *   blur-benchmark                              compares the kernels with the reference, blurring
+ *                                               in one band and in the bands of several threads
+ *   blur-benchmark --benchmark [w h [threads]]  blurs images of w*h pixels (default 1024x768) with
+ *                                               the previous implementation and the kernels
+ *                                               (default threads: number of cpus)
+ */
+
+#include <SDL.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <vector>
+#include "platforms/fastpaths.h"
+
+using namespace std;
+using namespace lightspark;
+
+namespace
+{
+// same tables and band sizes as in flashfilters.cpp
+const uint32_t MUL_TABLE[] =
+{
+	1, 171, 205, 293, 57, 373, 79, 137, 241, 27, 391, 357, 41, 19, 283, 265, 497, 469, 443, 421, 25, 191, 365, 349, 335, 161, 155, 149, 9, 278, 269, 261,
+	505, 245, 475, 231, 449, 437, 213, 415, 405, 395, 193, 377, 369, 361, 353, 345, 169, 331, 325, 319, 313, 307, 301, 37, 145, 285, 281, 69, 271, 267,
+	263, 259, 509, 501, 493, 243, 479, 118, 465, 459, 113, 446, 55, 435, 429, 423, 209, 413, 51, 403, 199, 393, 97, 3, 379, 375, 371, 367, 363, 359, 355,
+	351, 347, 43, 85, 337, 333, 165, 327, 323, 5, 317, 157, 311, 77, 305, 303, 75, 297, 294, 73, 289, 287, 71, 141, 279, 277, 275, 68, 135, 67, 133, 33,
+	262, 260, 129, 511, 507, 503, 499, 495, 491, 61, 121, 481, 477, 237, 235, 467, 232, 115, 457, 227, 451, 7, 445, 221, 439, 218, 433, 215, 427, 425,
+	211, 419, 417, 207, 411, 409, 203, 202, 401, 399, 396, 197, 49, 389, 387, 385, 383, 95, 189, 47, 187, 93, 185, 23, 183, 91, 181, 45, 179, 89, 177, 11,
+	175, 87, 173, 345, 343, 341, 339, 337, 21, 167, 83, 331, 329, 327, 163, 81, 323, 321, 319, 159, 79, 315, 313, 39, 155, 309, 307, 153, 305, 303, 151,
+	75, 299, 149, 37, 295, 147, 73, 291, 145, 289, 287, 143, 285, 71, 141, 281, 35, 279, 139, 69, 275, 137, 273, 17, 271, 135, 269, 267, 133, 265, 33,
+	263, 131, 261, 130, 259, 129, 257, 1
+};
+const uint32_t SHG_TABLE[] =
+{
+	0, 9, 10, 11, 9, 12, 10, 11, 12, 9, 13, 13, 10, 9, 13, 13, 14, 14, 14, 14, 10, 13, 14, 14, 14, 13, 13, 13, 9, 14, 14, 14, 15, 14, 15, 14, 15, 15, 14,
+	15, 15, 15, 14, 15, 15, 15, 15, 15, 14, 15, 15, 15, 15, 15, 15, 12, 14, 15, 15, 13, 15, 15, 15, 15, 16, 16, 16, 15, 16, 14, 16, 16, 14, 16, 13, 16,
+	16, 16, 15, 16, 13, 16, 15, 16, 14, 9, 16, 16, 16, 16, 16, 16, 16, 16, 16, 13, 14, 16, 16, 15, 16, 16, 10, 16, 15, 16, 14, 16, 16, 14, 16, 16, 14, 16,
+	16, 14, 15, 16, 16, 16, 14, 15, 14, 15, 13, 16, 16, 15, 17, 17, 17, 17, 17, 17, 14, 15, 17, 17, 16, 16, 17, 16, 15, 17, 16, 17, 11, 17, 16, 17, 16,
+	17, 16, 17, 17, 16, 17, 17, 16, 17, 17, 16, 16, 17, 17, 17, 16, 14, 17, 17, 17, 17, 15, 16, 14, 16, 15, 16, 13, 16, 15, 16, 14, 16, 15, 16, 12, 16,
+	15, 16, 17, 17, 17, 17, 17, 13, 16, 15, 17, 17, 17, 16, 15, 17, 17, 17, 16, 15, 17, 17, 14, 16, 17, 17, 16, 17, 17, 16, 15, 17, 16, 14, 17, 16, 15,
+	17, 16, 17, 17, 16, 17, 15, 16, 17, 14, 17, 16, 15, 17, 16, 17, 13, 17, 16, 17, 17, 16, 17, 14, 17, 16, 17, 16, 17, 16, 17, 9
+};
+const uint32_t MAX_RADIUS = sizeof(MUL_TABLE)/sizeof(uint32_t)-1;
+#define BLUR_MIN_BAND_SIZE 32
+
+// a random premultiplied image, with some fully transparent areas
+vector<uint8_t> randomImage(uint32_t width, uint32_t height, mt19937& rng)
+{
+	vector<uint8_t> img(width*height*4);
+	for (uint32_t i = 0; i < width*height; i++)
+	{
+		uint8_t alpha = (rng()%4) ? rng() : 0;
+		for (uint32_t c = 0; c < 3; c++)
+			img[i*4+c] = alpha ? rng()%(alpha+1) : 0;
+		img[i*4+3] = alpha;
+	}
+	return img;
+}
+
+// one pass of the blur done by the kernels, summing every window separately
+void boxBlurReference(uint8_t* data, uint32_t width, uint32_t height, uint32_t radiusX, uint32_t radiusY)
+{
+	vector<uint8_t> tmp(data,data+width*height*4);
+	for (int32_t y = 0; y < int32_t(height); y++)
+	{
+		for (int32_t x = 0; x < int32_t(width); x++)
+		{
+			for (uint32_t c = 0; c < 4; c++)
+			{
+				uint32_t sum = 0;
+				for (int32_t k = x-int32_t(radiusX); k <= x+int32_t(radiusX); k++)
+					sum += tmp[(y*width+min(max(k,0),int32_t(width)-1))*4+c];
+				data[(y*width+x)*4+c] = min(uint32_t(255),(sum*MUL_TABLE[radiusX])>>SHG_TABLE[radiusX]);
+			}
+		}
+	}
+	tmp.assign(data,data+width*height*4);
+	for (int32_t y = 0; y < int32_t(height); y++)
+	{
+		for (int32_t x = 0; x < int32_t(width); x++)
+		{
+			uint8_t* p = data+(y*width+x)*4;
+			for (uint32_t c = 0; c < 4; c++)
+			{
+				uint32_t sum = 0;
+				for (int32_t k = y-int32_t(radiusY); k <= y+int32_t(radiusY); k++)
+					sum += tmp[(min(max(k,0),int32_t(height)-1)*width+x)*4+c];
+				p[c] = min(uint32_t(255),(sum*MUL_TABLE[radiusY])>>SHG_TABLE[radiusY]);
+			}
+			if (p[3] == 0)
+				p[0] = p[1] = p[2] = 0;
+		}
+	}
+}
+
+struct RGBA
+{
+	int Red;
+	int Green;
+	int Blue;
+	int Alpha;
+};
+
+// the stack blur BitmapFilter::applyBlur used before the box blur kernels
+void previousBlur(uint8_t* data, uint32_t width, uint32_t height, int radiusX, int radiusY, int quality)
+{
+	int iterations = quality;
+
+	uint8_t* px = data;
+	int x, y, i, p, yp, yi, yw;
+	int r, g, b, a, pr, pg, pb, pa;
+
+	int divx = (radiusX + radiusX + 1);
+	int divy = (radiusY + radiusY + 1);
+	int w = width;
+	int h = height;
+
+	int w1 = w - 1;
+	int h1 = h - 1;
+	int rxp1 = radiusX + 1;
+	int ryp1 = radiusY + 1;
+
+	std::vector<RGBA> ssx;
+	ssx.resize(divx);
+	std::vector<RGBA> ssy;
+	ssy.resize(divy);
+
+	int mtx = MUL_TABLE[radiusX];
+	int stx = SHG_TABLE[radiusX];
+	int mty = MUL_TABLE[radiusY];
+	int sty = SHG_TABLE[radiusY];
+
+	while (iterations > 0)
+	{
+		iterations--;
+		yw = yi = 0;
+		int ms = mtx;
+		int ss = stx;
+		y = h;
+		do
+		{
+			r = rxp1 * (pr = px[yi]);
+			g = rxp1 * (pg = px[yi + 1]);
+			b = rxp1 * (pb = px[yi + 2]);
+			a = rxp1 * (pa = px[yi + 3]);
+			auto sx = ssx.begin();
+			i = rxp1;
+			do
+			{
+				(*sx).Red = pr;
+				(*sx).Green = pg;
+				(*sx).Blue = pb;
+				(*sx).Alpha = pa;
+				sx++;
+				if (sx == ssx.end())
+					sx = ssx.begin();
+			}
+			while (--i > -1);
+
+			for (i = 1; i < rxp1; i++)
+			{
+				p = yi + ((w1 < i ? w1 : i) << 2);
+				r += ((*sx).Red = px[p]);
+				g += ((*sx).Green = px[p + 1]);
+				b += ((*sx).Blue = px[p + 2]);
+				a += ((*sx).Alpha = px[p + 3]);
+				sx++;
+				if (sx == ssx.end())
+					sx = ssx.begin();
+			}
+
+			auto si = ssx.begin();
+			for (x = 0; x < w; x++)
+			{
+				px[yi++] = uint32_t(r * ms) >> ss;
+				px[yi++] = uint32_t(g * ms) >> ss;
+				px[yi++] = uint32_t(b * ms) >> ss;
+				px[yi++] = uint32_t(a * ms) >> ss;
+				p = x + radiusX + 1;
+				p = (yw + (p < w1 ? p : w1)) << 2;
+				r -= (*si).Red;
+				r += ((*si).Red = px[p]);
+				g -= (*si).Green;
+				g += ((*si).Green = px[p + 1]);
+				b -= (*si).Blue;
+				b += ((*si).Blue = px[p + 2]);
+				a -= (*si).Alpha;
+				a += ((*si).Alpha = px[p + 3]);
+				si++;
+				if (si == ssx.end())
+					si = ssx.begin();
+			}
+			yw += w;
+		}
+		while (--y > 0);
+
+		ms = mty;
+		ss = sty;
+		for (x = 0; x < w; x++)
+		{
+			yi = x << 2;
+			r = ryp1 * (pr = px[yi]);
+			g = ryp1 * (pg = px[yi + 1]);
+			b = ryp1 * (pb = px[yi + 2]);
+			a = ryp1 * (pa = px[yi + 3]);
+			auto sy = ssy.begin();
+			for (i = 0; i< ryp1; i++)
+			{
+				(*sy).Red = pr;
+				(*sy).Green = pg;
+				(*sy).Blue = pb;
+				(*sy).Alpha = pa;
+				sy++;
+				if (sy == ssy.end())
+					sy = ssy.begin();
+			}
+			yp = w;
+			for (i = 1; i < (radiusY + 1); i++)
+			{
+				yi = (yp + x) << 2;
+				r += ((*sy).Red = px[yi]);
+				g += ((*sy).Green = px[yi + 1]);
+				b += ((*sy).Blue = px[yi + 2]);
+				a += ((*sy).Alpha = px[yi + 3]);
+				sy++;
+				if (sy == ssy.end())
+					sy = ssy.begin();
+				if (i < h1)
+				{
+					yp += w;
+				}
+			}
+			yi = x;
+			auto si = ssy.begin();
+
+			if (iterations > 0)
+			{
+				for (y = 0; y<h; y++)
+				{
+					p = yi << 2;
+					pa = uint32_t(a * ms) >> ss;
+					px[p + 3] = pa;
+					if (pa > 0)
+					{
+						px[p] = (uint32_t(r * ms) >> ss);
+						px[p + 1] = (uint32_t(g * ms) >> ss);
+						px[p + 2] = (uint32_t(b * ms) >> ss);
+					}
+					else
+					{
+						px[p] = px[p + 1] = px[p + 2] = 0;
+					}
+					p = y + ryp1;
+					p = (x + ((p < h1 ? p : h1) * w)) << 2;
+					r -= (*si).Red;
+					r += ((*si).Red = px[p]);
+					g -= (*si).Green;
+					g += ((*si).Green = px[p + 1]);
+					b -= (*si).Blue;
+					b += ((*si).Blue = px[p + 2]);
+					a -= (*si).Alpha;
+					a += ((*si).Alpha = px[p + 3]);
+					si++;
+					if (si == ssy.end())
+						si = ssy.begin();
+					yi += w;
+				}
+			}
+			else
+			{
+				for (y = 0; y < h; y++)
+				{
+					p = yi << 2;
+					px[p + 3] = pa = uint32_t(a * ms) >> ss;
+					if (pa > 0)
+					{
+						pr = (uint32_t(r * ms) >> ss);
+						pg = (uint32_t(g * ms) >> ss);
+						pb = (uint32_t(b * ms) >> ss);
+						px[p] = pr > 255 ? 255 : pr;
+						px[p + 1] = pg > 255 ? 255 : pg;
+						px[p + 2] = pb > 255 ? 255 : pb;
+					}
+					else
+					{
+						px[p] = px[p + 1] = px[p + 2] = 0;
+					}
+					p = y + ryp1;
+					p = (x + ((p < h1 ? p : h1) * w)) << 2;
+					r -= (*si).Red - ((*si).Red = px[p]);
+					g -= (*si).Green - ((*si).Green = px[p + 1]);
+					b -= (*si).Blue - ((*si).Blue = px[p + 2]);
+					a -= (*si).Alpha - ((*si).Alpha = px[p + 3]);
+					si++;
+					if (si == ssy.end())
+						si = ssy.begin();
+					yi += w;
+				}
+			}
+		}
+	}
+}
+
+struct BandJob
+{
+	const function<void(uint32_t)>* f;
+	uint32_t band;
+};
+
+int bandWorker(void* d)
+{
+	BandJob* job = (BandJob*)d;
+	(*job->f)(job->band);
+	return 0;
+}
+
+// runs f for all bands, the first one in the calling thread like RasterScheduler::parallelFor does
+// the threads are created for every call, so the timings include that overhead
+void parallelFor(uint32_t bands, const function<void(uint32_t)>& f)
+{
+	vector<BandJob> jobs(bands);
+	vector<SDL_Thread*> threads(bands,nullptr);
+	for (uint32_t i = 1; i < bands; i++)
+	{
+		jobs[i].f = &f;
+		jobs[i].band = i;
+		threads[i] = SDL_CreateThread(bandWorker,"BlurBand",&jobs[i]);
+	}
+	f(0);
+	for (uint32_t i = 1; i < bands; i++)
+		SDL_WaitThread(threads[i],nullptr);
+}
+
+// the blur done by BitmapFilter::applyBlur, with the bands of the given number of threads
+void boxBlur(uint8_t* data, uint32_t width, uint32_t height, uint32_t radiusX, uint32_t radiusY, int quality, uint32_t threads)
+{
+	uint32_t rowbands = max(uint32_t(1),min(threads,height/BLUR_MIN_BAND_SIZE));
+	uint32_t columngroups = (width+3)/4;
+	uint32_t columnbands = max(uint32_t(1),min(threads,width/BLUR_MIN_BAND_SIZE));
+	uint32_t stride = width*4;
+	function<void(uint32_t)> blurRows = [&](uint32_t band)
+	{
+		uint32_t y1 = band*height/rowbands;
+		uint32_t y2 = (band+1)*height/rowbands;
+		fastBoxBlurRows(data+y1*stride,width,y2-y1,stride,radiusX,MUL_TABLE[radiusX],SHG_TABLE[radiusX]);
+	};
+	function<void(uint32_t)> blurColumns = [&](uint32_t band)
+	{
+		uint32_t x1 = min(width,(band*columngroups/columnbands)*4);
+		uint32_t x2 = min(width,((band+1)*columngroups/columnbands)*4);
+		fastBoxBlurColumns(data+x1*4,x2-x1,height,stride,radiusY,MUL_TABLE[radiusY],SHG_TABLE[radiusY]);
+	};
+	for (int i = 0; i < quality; i++)
+	{
+		if (threads > 1)
+		{
+			parallelFor(rowbands,blurRows);
+			parallelFor(columnbands,blurColumns);
+		}
+		else
+		{
+			blurRows(0);
+			blurColumns(0);
+		}
+	}
+}
+
+bool check(uint32_t width, uint32_t height, uint32_t radiusX, uint32_t radiusY, int quality, uint32_t threads, mt19937& rng)
+{
+	vector<uint8_t> expected = randomImage(width,height,rng);
+	vector<uint8_t> result = expected;
+	for (int i = 0; i < quality; i++)
+		boxBlurReference(expected.data(),width,height,radiusX,radiusY);
+	boxBlur(result.data(),width,height,radiusX,radiusY,quality,threads);
+	for (uint32_t i = 0; i < result.size(); i++)
+	{
+		if (result[i] == expected[i])
+			continue;
+		printf("FAIL: %ux%u radius %u,%u quality %d, %u threads: pixel %u,%u byte %u is %02x, expected %02x\n",
+		       width,height,radiusX,radiusY,quality,threads,(i/4)%width,(i/4)/width,i%4,result[i],expected[i]);
+		return false;
+	}
+	return true;
+}
+
+int runTests()
+{
+	// sizes around the strips of 4 columns and the minimum band size, and images smaller than the radius
+	const uint32_t widths[] = { 1, 2, 3, 4, 5, 7, 31, 33, 65, 97, 130 };
+	const uint32_t heights[] = { 1, 2, 3, 17, 64, 99 };
+	const uint32_t radii[] = { 1, 2, 5, 16, 40, MAX_RADIUS };
+	const uint32_t threads[] = { 1, 3, 4 };
+	mt19937 rng(4711);
+	uint32_t failures = 0;
+	uint32_t checks = 0;
+	for (uint32_t width : widths)
+	{
+		for (uint32_t height : heights)
+		{
+			for (uint32_t radius : radii)
+			{
+				for (uint32_t t : threads)
+				{
+					// different radii in both directions, and more than one pass
+					checks += 2;
+					if (!check(width,height,radius,radii[(radius+t)%6],1,t,rng))
+						failures++;
+					if (!check(width,height,radius,radius,1+(width+t)%3,t,rng))
+						failures++;
+				}
+			}
+		}
+	}
+	printf("%u of %u blurs differ from the reference\n",failures,checks);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// milliseconds per blur, the blur is repeated for at least half a second
+double measure(const function<void(uint8_t*)>& f, const vector<uint8_t>& img)
+{
+	typedef chrono::steady_clock clock;
+	vector<uint8_t> data = img;
+	clock::duration elapsed = clock::duration::zero();
+	uint32_t blurs = 0;
+	do
+	{
+		// blurring the same buffer again would average it out to a flat color
+		data = img;
+		clock::time_point start = clock::now();
+		f(data.data());
+		elapsed += clock::now()-start;
+		blurs++;
+	}
+	while (elapsed < chrono::milliseconds(500));
+	return chrono::duration<double,milli>(elapsed).count()/blurs;
+}
+
+int runBenchmark(uint32_t width, uint32_t height, uint32_t threads)
+{
+	// blurX/blurY of 4 to 64 pixels, the radius is half of it
+	const uint32_t radii[] = { 2, 4, 8, 16, 32 };
+	mt19937 rng(4711);
+	vector<uint8_t> img = randomImage(width,height,rng);
+	printf("%ux%u, milliseconds per blur\n",width,height);
+	printf("%-7s %-8s %12s %12s %12s\n","radius","quality","previous","1 thread",threads > 1 ? "threads" : "");
+	for (uint32_t radius : radii)
+	{
+		for (int quality = 1; quality <= 3; quality++)
+		{
+			double previous = measure([&](uint8_t* data) { previousBlur(data,width,height,radius,radius,quality); },img);
+			double single = measure([&](uint8_t* data) { boxBlur(data,width,height,radius,radius,quality,1); },img);
+			if (threads > 1)
+				printf("%-7u %-8d %12.3f %12.3f %9.3f(%u)\n",radius,quality,previous,single,
+				       measure([&](uint8_t* data) { boxBlur(data,width,height,radius,radius,quality,threads); },img),threads);
+			else
+				printf("%-7u %-8d %12.3f %12.3f\n",radius,quality,previous,single);
+		}
+	}
+	return EXIT_SUCCESS;
+}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc > 1 && strcmp(argv[1],"--benchmark") == 0)
+	{
+		uint32_t width = argc > 3 ? atoi(argv[2]) : 1024;
+		uint32_t height = argc > 3 ? atoi(argv[3]) : 768;
+		uint32_t threads = argc > 4 ? atoi(argv[4]) : SDL_GetCPUCount();
+		if (width == 0 || height == 0 || threads == 0)
+		{
+			printf("invalid size or number of threads\n");
+			return EXIT_FAILURE;
+		}
+		return runBenchmark(width,height,threads);
+	}
+	return runTests();
+}
@@ -0,0 +1,226 @@
+/**************************************************************************
+    Lightspark, a free flash player implementation
+
+    Copyright (C) 2024  Ludger Krämer <dbluelle@onlinehome.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+/*
+ * Checks the YUV conversion kernels against the reference implementation
+ * and measures their speed.
+ *
+ * Usage:
+ *   yuvconversion-test                       compares all kernels supported by the cpu
+ *                                            with the reference for all formats
+ *   yuvconversion-test --benchmark [w h]     converts frames of w*h pixels (default 1920x1080)
+ *                                            with the reference and all kernels
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "backends/yuvconversion.h"
+
+using namespace std;
+using namespace lightspark;
+
+namespace
+{
+const YUV_KERNELS allKernels[] = { YUV_KERNELS_SCALAR, YUV_KERNELS_SSE2, YUV_KERNELS_AVX2 };
+const char* kernelNames[] = { "auto", "scalar", "SSE2", "AVX2" };
+const YUV_FORMAT allFormats[] = { YUV_FORMAT_420P, YUV_FORMAT_422P, YUV_FORMAT_444P, YUV_FORMAT_NV12, YUV_FORMAT_PACKED_YUVA };
+const char* formatNames[] = { "420P", "422P", "444P", "NV12", "packed YUVA" };
+// bytes written after the end of each output row, to check that no kernel writes past it
+const uint32_t GUARD_SIZE = 67;
+const uint8_t GUARD_VALUE = 0xa5;
+
+// a random image with padded rows, so the kernels can't rely on tightly packed planes
+class TestImage
+{
+private:
+	vector<uint8_t> data[4];
+public:
+	YUVImage img;
+	TestImage(YUV_FORMAT format, uint32_t width, uint32_t height, bool withAlpha, mt19937& rng):img(format,width,height)
+	{
+		uint32_t chromaWidth = (format == YUV_FORMAT_444P) ? width : (width+1)/2;
+		uint32_t chromaHeight = (format == YUV_FORMAT_420P || format == YUV_FORMAT_NV12) ? (height+1)/2 : height;
+		uint32_t rowBytes[4] = { width, chromaWidth, chromaWidth, withAlpha ? width : 0 };
+		uint32_t rows[4] = { height, chromaHeight, chromaHeight, height };
+		if (format == YUV_FORMAT_PACKED_YUVA)
+		{
+			rowBytes[0] = width*4;
+			rowBytes[1] = rowBytes[2] = rowBytes[3] = 0;
+		}
+		else if (format == YUV_FORMAT_NV12)
+		{
+			rowBytes[1] = chromaWidth*2;
+			rowBytes[2] = 0;
+		}
+		for (uint32_t i = 0; i < 4; i++)
+		{
+			if (rowBytes[i] == 0)
+				continue;
+			img.strides[i] = rowBytes[i]+(rng()%7);
+			data[i].resize(img.strides[i]*rows[i]);
+			for (uint32_t j = 0; j < data[i].size(); j++)
+				data[i][j] = rng();
+			img.planes[i] = data[i].data();
+		}
+	}
+};
+
+typedef void (*conversion)(const YUVImage&, uint8_t*, uint32_t);
+
+// converts the image into a buffer with guard bytes after every row
+vector<uint8_t> convert(conversion f, const YUVImage& img, uint32_t& outstride)
+{
+	outstride = img.width*4+GUARD_SIZE;
+	vector<uint8_t> out(outstride*img.height,GUARD_VALUE);
+	f(img,out.data(),outstride);
+	return out;
+}
+
+bool check(const char* kernel, const char* conversionName, conversion f, conversion reference, const YUVImage& img, bool withAlpha)
+{
+	uint32_t outstride;
+	vector<uint8_t> expected = convert(reference,img,outstride);
+	vector<uint8_t> result = convert(f,img,outstride);
+	for (uint32_t y = 0; y < img.height; y++)
+	{
+		for (uint32_t x = 0; x < outstride; x++)
+		{
+			uint32_t pos = y*outstride+x;
+			if (result[pos] == expected[pos])
+				continue;
+			if (x < img.width*4)
+				printf("FAIL: %s %s, %s %s%ux%u: pixel %u,%u byte %u is %02x, expected %02x\n",
+				       kernel,conversionName,formatNames[img.format],withAlpha ? "with alpha " : "",
+				       img.width,img.height,x/4,y,x%4,result[pos],expected[pos]);
+			else
+				printf("FAIL: %s %s, %s %s%ux%u: written after the end of row %u\n",
+				       kernel,conversionName,formatNames[img.format],withAlpha ? "with alpha " : "",
+				       img.width,img.height,y);
+			return false;
+		}
+	}
+	return true;
+}
+
+int runTests()
+{
+	// widths around the vector sizes (16 and 32 pixels) and odd sizes, which leave a partial chroma sample
+	const uint32_t widths[] = { 1, 2, 3, 7, 15, 16, 17, 31, 32, 33, 47, 63, 64, 65, 127, 641 };
+	const uint32_t heights[] = { 1, 2, 3, 5, 8, 17 };
+	mt19937 rng(4711);
+	uint32_t failures = 0;
+	uint32_t checks = 0;
+	for (YUV_KERNELS kernels : allKernels)
+	{
+		if (!setYUVKernels(kernels))
+		{
+			printf("%s kernels are not supported, skipped\n",kernelNames[kernels]);
+			continue;
+		}
+		for (YUV_FORMAT format : allFormats)
+		{
+			for (uint32_t withAlpha = 0; withAlpha < 2; withAlpha++)
+			{
+				// the packed format always contains alpha
+				if (withAlpha && format == YUV_FORMAT_PACKED_YUVA)
+					continue;
+				for (uint32_t width : widths)
+				{
+					for (uint32_t height : heights)
+					{
+						TestImage test(format,width,height,withAlpha,rng);
+						checks += 2;
+						if (!check(kernelNames[kernels],"packed YUVA",yuvToPackedYUVA,yuvToPackedYUVAReference,test.img,withAlpha))
+							failures++;
+						if (!check(kernelNames[kernels],"premultiplied ARGB",yuvToPremultipliedARGB,yuvToPremultipliedARGBReference,test.img,withAlpha))
+							failures++;
+					}
+				}
+			}
+		}
+		printf("%s kernels checked\n",kernelNames[kernels]);
+	}
+	setYUVKernels(YUV_KERNELS_AUTO);
+	printf("%u of %u conversions differ from the reference\n",failures,checks);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// milliseconds per frame, the conversion is repeated for at least half a second
+double measure(conversion f, const YUVImage& img, uint8_t* out, uint32_t outstride)
+{
+	typedef chrono::steady_clock clock;
+	f(img,out,outstride);
+	uint32_t frames = 0;
+	clock::time_point start = clock::now();
+	clock::duration elapsed;
+	do
+	{
+		f(img,out,outstride);
+		frames++;
+		elapsed = clock::now()-start;
+	}
+	while (elapsed < chrono::milliseconds(500));
+	return chrono::duration<double,milli>(elapsed).count()/frames;
+}
+
+int runBenchmark(uint32_t width, uint32_t height)
+{
+	mt19937 rng(4711);
+	vector<uint8_t> out(width*height*4);
+	printf("%ux%u, milliseconds per frame\n",width,height);
+	printf("%-12s %-10s %12s %12s\n","format","kernels","packed YUVA","ARGB");
+	for (YUV_FORMAT format : allFormats)
+	{
+		TestImage test(format,width,height,false,rng);
+		printf("%-12s %-10s %12.3f %12.3f\n",formatNames[format],"reference",
+		       measure(yuvToPackedYUVAReference,test.img,out.data(),width*4),
+		       measure(yuvToPremultipliedARGBReference,test.img,out.data(),width*4));
+		for (YUV_KERNELS kernels : allKernels)
+		{
+			if (!setYUVKernels(kernels))
+				continue;
+			printf("%-12s %-10s %12.3f %12.3f\n",formatNames[format],kernelNames[kernels],
+			       measure(yuvToPackedYUVA,test.img,out.data(),width*4),
+			       measure(yuvToPremultipliedARGB,test.img,out.data(),width*4));
+		}
+	}
+	setYUVKernels(YUV_KERNELS_AUTO);
+	return EXIT_SUCCESS;
+}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc > 1 && strcmp(argv[1],"--benchmark") == 0)
+	{
+		uint32_t width = argc > 3 ? atoi(argv[2]) : 1920;
+		uint32_t height = argc > 3 ? atoi(argv[3]) : 1080;
+		if (width == 0 || height == 0)
+		{
+			printf("invalid size\n");
+			return EXIT_FAILURE;
+		}
+		return runBenchmark(width,height);
+	}
+	return runTests();
+}
@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+#
+# Local HTTP server for net_URLLoader_cache_test.mxml and
+# net_URLLoader_ranges_test.mxml
+#
+# Usage:
+#   ./net_URLLoader_server.py --config /tmp/lightspark-test [port]
+#   XDG_CONFIG_HOME=/tmp/lightspark-test lightspark net_URLLoader_cache_test.swf
+#
+# --config writes a lightspark.conf to the given directory that enables the
+# persistent cache (stored below the same directory) and parallel range
+# downloads. The default port is 8000.
+#
+# Served paths:
+#   /data.bin  DATA_SIZE bytes, byte i is (i*7+3)&0xff. The response carries an
+#              ETag and a Last-Modified header and honors If-None-Match and
+#              If-Modified-Since. Single byte ranges are supported, If-Range is
+#              checked against both validators.
+#   /auth/data.bin
+#              the same data, but only sent if the request has the header
+#              "X-Lightspark-Test: secret", otherwise the response is 401.
+#              It is marked no-store, so it is always downloaded.
+#   /redirect/auth/data.bin
+#              a redirect (302) to /auth/data.bin
+#   /stats     counters of the requests for the data since the last /reset,
+#              as "full=N notmodified=N ranges=N redirects=N unauthorized=N"
+#   /reset     resets the counters
+
+import os
+import sys
+import threading
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+DATA_SIZE = 8*1024*1024
+ETAG = '"lightspark-test-1"'
+LAST_MODIFIED = "Mon, 01 Jan 2024 00:00:00 GMT"
+DATA = bytes(((i*7+3) & 0xff) for i in range(DATA_SIZE))
+
+stats_lock = threading.Lock()
+stats = {}
+
+def reset_stats():
+	with stats_lock:
+		stats.clear()
+		stats.update(full=0, notmodified=0, ranges=0, redirects=0, unauthorized=0)
+
+def count(name):
+	with stats_lock:
+		stats[name] += 1
+
+class Handler(BaseHTTPRequestHandler):
+	protocol_version = "HTTP/1.1"
+
+	def send_body(self, status, body, headers={}):
+		self.send_response(status)
+		for key, value in headers.items():
+			self.send_header(key, value)
+		self.send_header("Content-Length", str(len(body)))
+		self.end_headers()
+		if self.command != "HEAD":
+			self.wfile.write(body)
+
+	def send_text(self, text):
+		self.send_body(200, text.encode(), {"Content-Type": "text/plain", "Cache-Control": "no-store"})
+
+	def do_GET(self):
+		if self.path == "/reset":
+			reset_stats()
+			self.send_text("ok")
+		elif self.path == "/stats":
+			with stats_lock:
+				text = " ".join("%s=%d" % (key, stats[key]) for key in sorted(stats))
+			self.send_text(text)
+		elif self.path == "/data.bin":
+			self.send_data({})
+		elif self.path == "/auth/data.bin":
+			if self.headers.get("X-Lightspark-Test") != "secret":
+				count("unauthorized")
+				self.send_body(401, b"unauthorized")
+			else:
+				self.send_data({"Cache-Control": "no-store"})
+		elif self.path == "/redirect/auth/data.bin":
+			count("redirects")
+			self.send_body(302, b"moved", {"Location": "/auth/data.bin"})
+		else:
+			self.send_body(404, b"not found")
+
+	def send_data(self, extraHeaders):
+		validators = {"ETag": ETAG, "Last-Modified": LAST_MODIFIED}
+		validators.update(extraHeaders)
+		if self.headers.get("If-None-Match") == ETAG or \
+		   (self.headers.get("If-None-Match") is None and self.headers.get("If-Modified-Since") == LAST_MODIFIED):
+			count("notmodified")
+			self.send_response(304)
+			for key, value in validators.items():
+				self.send_header(key, value)
+			self.end_headers()
+			return
+		headers = {"Content-Type": "application/octet-stream", "Accept-Ranges": "bytes"}
+		headers.update(validators)
+		byterange = self.parse_range()
+		if byterange:
+			count("ranges")
+			start, end = byterange
+			headers["Content-Range"] = "bytes %d-%d/%d" % (start, end, DATA_SIZE)
+			self.send_body(206, DATA[start:end+1], headers)
+			return
+		count("full")
+		self.send_body(200, DATA, headers)
+
+	def parse_range(self):
+		value = self.headers.get("Range")
+		ifrange = self.headers.get("If-Range")
+		if not value or not value.startswith("bytes=") or "," in value:
+			return None
+		if ifrange is not None and ifrange not in (ETAG, LAST_MODIFIED):
+			return None
+		start, _, end = value[len("bytes="):].partition("-")
+		if not start:
+			return None
+		start = int(start)
+		end = min(int(end) if end else DATA_SIZE-1, DATA_SIZE-1)
+		if start > end:
+			return None
+		return (start, end)
+
+	def log_message(self, format, *args):
+		sys.stderr.write("[server] %s %s\n" % (self.headers.get("Range", ""), format % args))
+
+def write_config(directory):
+	os.makedirs(directory, exist_ok=True)
+	with open(os.path.join(directory, "lightspark.conf"), "w") as conf:
+		conf.write("[cache]\n")
+		conf.write("directory = %s\n" % os.path.join(os.path.abspath(directory), "cache"))
+		conf.write("persistent = 1\n")
+		conf.write("[network]\n")
+		conf.write("connections = 4\n")
+
+def main():
+	args = sys.argv[1:]
+	if len(args) >= 2 and args[0] == "--config":
+		write_config(args[1])
+		args = args[2:]
+	port = int(args[0]) if args else 8000
+	reset_stats()
+	ThreadingHTTPServer(("127.0.0.1", port), Handler).serve_forever()
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,107 @@
+package {
+
+	import flash.display.Bitmap;
+	import flash.display.BitmapData;
+	import flash.display.BlendMode;
+	import flash.display.Shape;
+	import flash.display.Sprite;
+	import flash.filters.BlurFilter;
+	import flash.geom.ColorTransform;
+	import flash.geom.Matrix;
+
+	/*
+	 * Reference scene for the batched drawing of simple DisplayObjects.
+	 * Runs of shapes and bitmaps that can be drawn in one batch are
+	 * interrupted by objects that end the batch (filters, masks, nested
+	 * children, blend modes), followed by a run of identical bitmaps that
+	 * must be drawn in one batch. The rendering has to be the same with and
+	 * without --disable-batching, see tools/compare-batching.sh (run it
+	 * with -b for this scene)
+	 */
+	[SWF(width="400", height="300", backgroundColor="#FFFFFF")]
+	public class rendering_Batching extends Sprite {
+
+		public function rendering_Batching() {
+			var bitmapData:BitmapData = new BitmapData(16, 16, true, 0);
+			for (var y:int = 0; y < 16; y++)
+				for (var x:int = 0; x < 16; x++)
+					bitmapData.setPixel32(x, y, ((x ^ y) & 1) ? 0xFF2040C0 : 0x80F08020);
+
+			for (var i:int = 0; i < 60; i++) {
+				var row:int = int(i / 10);
+				var col:int = i % 10;
+				if (i % 3 == 0) {
+					var bitmap:Bitmap = new Bitmap(bitmapData);
+					bitmap.x = 10 + col*38;
+					bitmap.y = 10 + row*45;
+					bitmap.scaleX = bitmap.scaleY = 1 + (i % 4)*0.5;
+					bitmap.alpha = 1 - (i % 5)*0.15;
+					addChild(bitmap);
+				} else {
+					var shape:Shape = new Shape();
+					shape.graphics.beginFill((i*0x3A5F17) & 0xFFFFFF);
+					if (i % 2)
+						shape.graphics.drawCircle(15, 15, 15);
+					else
+						shape.graphics.drawRect(0, 0, 30, 25);
+					shape.graphics.endFill();
+					shape.x = 10 + col*38;
+					shape.y = 10 + row*45;
+					shape.rotation = i*7;
+					shape.alpha = 0.4 + (i % 4)*0.2;
+					if (i % 7 == 0)
+						shape.transform.colorTransform = new ColorTransform(0.5, 1, 1, 1, 60, 0, -30, 0);
+					// objects that can't be batched end the current batch
+					if (i % 11 == 0)
+						shape.filters = [new BlurFilter(2, 2)];
+					if (i % 13 == 0)
+						shape.blendMode = BlendMode.LAYER;
+					addChild(shape);
+				}
+				if (i % 17 == 0) {
+					var nested:Sprite = new Sprite();
+					var inner:Shape = new Shape();
+					inner.graphics.beginFill(0x00A000, 0.5);
+					inner.graphics.drawRect(0, 0, 40, 10);
+					nested.addChild(inner);
+					nested.x = 15 + col*38;
+					nested.y = 30 + row*45;
+					addChild(nested);
+				}
+			}
+
+			// consecutive bitmaps in the same state, they have to end up in one batch
+			for (var k:int = 0; k < 16; k++) {
+				var tile:Bitmap = new Bitmap(bitmapData);
+				tile.x = 10 + k*16;
+				tile.y = 276;
+				addChild(tile);
+			}
+
+			// overlapping translucent shapes below a mask
+			var masked:Sprite = new Sprite();
+			for (var j:int = 0; j < 8; j++) {
+				var stripe:Shape = new Shape();
+				var m:Matrix = new Matrix();
+				m.createGradientBox(100, 20);
+				stripe.graphics.beginGradientFill("linear", [0xFF0000, 0x0000FF], [1, 0.3], [0, 255], m);
+				stripe.graphics.drawRect(0, 0, 100, 20);
+				stripe.graphics.endFill();
+				stripe.y = j*12;
+				stripe.alpha = 0.7;
+				masked.addChild(stripe);
+			}
+			var maskShape:Shape = new Shape();
+			maskShape.graphics.beginFill(0);
+			maskShape.graphics.drawCircle(50, 50, 45);
+			maskShape.graphics.endFill();
+			masked.addChild(maskShape);
+			masked.mask = maskShape;
+			masked.x = 280;
+			masked.y = 190;
+			addChild(masked);
+		}
+
+	}
+
+}
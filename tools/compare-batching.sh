@@ -0,0 +1,97 @@
+#!/bin/sh
+#**************************************************************************
+#    Lightspark, a free flash player implementation
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#**************************************************************************
+
+# Renders reference scenes with the Mesa software rasterizer (llvmpipe), once
+# with batched drawing and once with --disable-batching, and compares the
+# screenshots. The GL output of both runs has to be identical.
+#
+# Usage: compare-batching.sh [-b] [-f frames] file.swf...
+#
+# The draw calls and batches of the screenshot frame are printed for the
+# batched run. With -b the comparison also fails if the batches don't hold
+# more than one surface on average.
+#
+# tests/other/rendering_Batching.as is a scene made for this. Without a
+# display the player is started through xvfb-run, if it is installed.
+
+if test "x$LIGHTSPARK" = "x"; then
+	LIGHTSPARK="lightspark"
+fi
+
+frames=10
+checkbatches=0
+while true; do
+	if test "$1" = "-f"; then
+		frames=$2
+		shift 2
+	elif test "$1" = "-b"; then
+		checkbatches=1
+		shift 1
+	else
+		break
+	fi
+done
+
+if test $# -eq 0; then
+	echo "Usage: $0 [-b] [-f frames] file.swf..."
+	exit 2
+fi
+
+run=""
+if test "x$DISPLAY" = "x" && test "x$WAYLAND_DISPLAY" = "x"; then
+	if ! command -v xvfb-run >/dev/null; then
+		echo "no display and xvfb-run not found"
+		exit 2
+	fi
+	run="xvfb-run -a -s -screen\ 0\ 1024x768x24"
+fi
+
+LIBGL_ALWAYS_SOFTWARE=1
+GALLIUM_DRIVER=llvmpipe
+export LIBGL_ALWAYS_SOFTWARE GALLIUM_DRIVER
+
+outdir="$(mktemp -d)"
+failed=0
+for swf in "$@"; do
+	name="$(basename "$swf" .swf)"
+	eval $run '"$LIGHTSPARK"' --screenshot-frame "$frames" '"$outdir/$name-batched.bmp"' '"$swf"' > "$outdir/$name-batched.log" 2>&1
+	# "screenshot frame: draw calls: N, batches: N, batched surfaces: N"
+	stats="$(sed -n 's/.*screenshot frame: //p' "$outdir/$name-batched.log" | tail -n 1)"
+	echo "$name: $stats"
+	batches="$(echo "$stats" | sed -n 's/.*batches: \([0-9]*\).*/\1/p')"
+	surfaces="$(echo "$stats" | sed -n 's/.*batched surfaces: \([0-9]*\).*/\1/p')"
+	if test $checkbatches -eq 1 && { test -z "$batches" || test "$batches" -eq 0 || test "$surfaces" -le "$batches"; }; then
+		echo "$name: surfaces are not batched"
+		failed=1
+	fi
+	eval $run '"$LIGHTSPARK"' --disable-batching --screenshot-frame "$frames" '"$outdir/$name-unbatched.bmp"' '"$swf"' > "$outdir/$name-unbatched.log" 2>&1
+	if ! test -f "$outdir/$name-batched.bmp" || ! test -f "$outdir/$name-unbatched.bmp"; then
+		echo "$name: no screenshot"
+		failed=1
+	elif cmp -s "$outdir/$name-batched.bmp" "$outdir/$name-unbatched.bmp"; then
+		echo "$name: identical"
+	else
+		echo "$name: DIFFERENT, see $outdir"
+		failed=1
+	fi
+done
+
+if test $failed -eq 0; then
+	rm -r "$outdir"
+fi
+exit $failed